@@ -5,6 +5,7 @@ REM ***Render files***
 ECHO === Rendering File(s) ===
 ECHO.
 aqsis.exe -progress "bike.rib"
+aqsis.exe -progress "delayed.rib"
 IF ERRORLEVEL 0 GOTO end
 
 
@@ -5,3 +5,4 @@
 echo "=== Rendering File(s) ==="
 echo
 aqsis -progress "bike.rib"
+aqsis -progress "delayed.rib"
@@ -0,0 +1,7 @@
+#!/bin/bash
+
+# ***Render files***
+
+echo "=== Rendering File(s) ==="
+echo
+aqsis -progress "longshutter.rib"
@@ -23,11 +23,6 @@
 		\author Andrew Bromage (ajb@spamcop.net)
 */
 
-// This implementation is based on the MT19937 (Mersenne Twister)
-// generator by Takuji Nishimura and Makoto Matsumoto.  The original
-// copyright notice follows.
-
-//? Is random.h included already?
 #ifndef RANDOM_H_INCLUDED
 #define RANDOM_H_INCLUDED 1
 
@@ -35,68 +30,37 @@
 
 #include	<aqsis/aqsis.h>
 
+#include	<boost/cstdint.hpp>
 
 namespace Aqsis {
-/*
-   A C-program for MT19937, with initialization improved 2002/1/26.
-   Coded by Takuji Nishimura and Makoto Matsumoto.
- 
-   Before using, initialize the state by using init_genrand(seed)  
-   or init_by_array(init_key, key_length).
- 
-   Copyright (C) 1997 - 2002, Makoto Matsumoto and Takuji Nishimura,
-   All rights reserved.                          
- 
-   Redistribution and use in source and binary forms, with or without
-   modification, are permitted provided that the following conditions
-   are met:
- 
-     1. Redistributions of source code must retain the above copyright
-        notice, this list of conditions and the following disclaimer.
- 
-     2. Redistributions in binary form must reproduce the above copyright
-        notice, this list of conditions and the following disclaimer in the
-        documentation and/or other materials provided with the distribution.
- 
-     3. The names of its contributors may not be used to endorse or promote 
-        products derived from this software without specific prior written 
-        permission.
- 
-   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
-   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
-   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
-   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
-   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
-   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
-   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
-   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
-   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
-   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
-   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- 
- 
-   Any feedback is very welcome.
-   http://www.math.sci.hiroshima-u.ac.jp/~m-mat/MT/emt.html
-   email: m-mat @ math.sci.hiroshima-u.ac.jp (remove space)
-*/
 
-//----------------------------------------------------------------------
 /** \class CqRandom
  * A random number generator class.
+ *
+ * Each generator holds its own state, a permuted congruential generator
+ * (PCG32, see M. E. O'Neill, "PCG: A Family of Simple Fast Space-Efficient
+ * Statistically Good Algorithms for Random Number Generation").  A generator
+ * is selected by a seed and a stream number; generators with the same seed
+ * but different streams give independent sequences.  Code running on several
+ * threads should therefore give each bucket, grid or iterator its own
+ * generator with a deterministic seed and stream, rather than share one,
+ * which makes the results independent of how the work was scheduled.
  */
-
 class AQSIS_MATH_SHARE CqRandom
 {
 	public:
+		/// Construct a generator with the default seed and stream.
 		CqRandom();
-
-		CqRandom( TqUint Seed );
+		/** Construct a generator with the given seed and stream.
+		 * \param seed - starting point in the sequence.
+		 * \param stream - selects one of 2^32 independent sequences.
+		 */
+		CqRandom( TqUint seed, TqUint stream = 0 );
 
 		/** Get a random integer in the range (0 <= value < 2^32).
 		 */
 		TqUint RandomInt();
 
-
 		/** Get a random integer in the specified range (0 <= value < Range).
 		 * \param Range Integer max value.
 		 */
@@ -106,18 +70,26 @@ class AQSIS_MATH_SHARE CqRandom
 		 */
 		TqFloat	RandomFloat();
 
-
 		/** Get a random float in the specified range (0 <= value < Range).
 		 * \param Range The max value for the range.
 		 */
 		TqFloat	RandomFloat( TqFloat Range );
 
-		void    Reseed(TqUint Seek);
-	protected:
-		void NextState();
+		/** Fill an array with random floats (0.0 <= value < 1.0).
+		 *
+		 * This gives the same values as calling RandomFloat() count times.
+		 */
+		void	RandomFloats( TqFloat* values, TqInt count );
+
+		/** Restart the generator with the given seed and stream.
+		 */
+		void	Reseed( TqUint seed, TqUint stream = 0 );
+
+	private:
+		boost::uint64_t	m_state;		///< Current state of the generator.
+		boost::uint64_t	m_increment;	///< Odd increment, selecting the stream.
 };
 
-//-----------------------------------------------------------------------
 
 } // namespace Aqsis
 
@@ -544,6 +544,9 @@ AQSIS_RI_SHARE RtVoid RiArchiveEnd();
 
 AQSIS_RI_SHARE  RtBoolean   BasisFromName( RtBasis * b, const char * strName );
 AQSIS_RI_SHARE  RtVoid  RiProgressHandler( RtProgressFunc handler );
+AQSIS_RI_SHARE  RtVoid  RiEditLightSourceV( RtToken name, RtInt count, RtToken tokens[], RtPointer values[] );
+AQSIS_RI_SHARE  RtVoid  RiEditShaderV( RtToken shadername, RtInt count, RtToken tokens[], RtPointer values[] );
+AQSIS_RI_SHARE  RtVoid  RiReshade();
 
 #ifdef  __cplusplus
 }
@@ -0,0 +1,130 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/// \file
+///
+/// \brief Cache for RIB archives which are parsed ahead of time.
+///
+
+#ifndef AQSIS_RIBARCHIVECACHE_H_INCLUDED
+#define AQSIS_RIBARCHIVECACHE_H_INCLUDED
+
+#include <aqsis/config.h>
+
+#include <string>
+
+namespace Aqsis
+{
+
+namespace Ri { class Renderer; class RendererServices; }
+class RibDiskCache;
+class TokenDict;
+
+//------------------------------------------------------------------------------
+/// Cache of RIB archives decoded into in-memory request streams.
+///
+/// Archives which are known to be needed later (for instance, the file
+/// referenced by a DelayedReadArchive procedural) may be handed to prefetch().
+/// A pool of worker threads then tokenizes and parses the archive into a
+/// compact stream of cached requests, so that the thread which eventually
+/// calls ReadArchive only needs to replay the decoded requests.
+///
+/// Parsed archives are kept until flush() is called, so repeated reads of the
+/// same archive are also replayed from memory.
+class AQSIS_RIUTIL_SHARE RibArchiveCache
+{
+    public:
+        /// Counters describing how effective the cache has been.
+        struct Stats
+        {
+            /// Number of archives handed to a worker thread for parsing.
+            int prefetched;
+            /// Number of ReadArchive requests replayed from the cache.
+            int hits;
+            /// Number of ReadArchive requests which needed a serial parse.
+            int misses;
+            /// Number of replays which had to wait for a worker to finish.
+            int waits;
+
+            Stats() : prefetched(0), hits(0), misses(0), waits(0) {}
+        };
+
+        /// Create an archive cache.
+        ///
+        /// \param services - used by the worker parsers to look up standard
+        ///                   filters, bases and procedurals.  The lookup
+        ///                   functions must be safe to call concurrently.
+        /// \param numThreads - number of worker threads.  If this is zero,
+        ///                   prefetch() does nothing and all archives are
+        ///                   parsed serially by the caller.
+        /// \param diskCache - persistent cache which the workers read
+        ///                   archives through, or NULL to always parse the
+        ///                   archive files themselves.  Must outlive the
+        ///                   archive cache.
+        static RibArchiveCache* create(Ri::RendererServices& services,
+                                       int numThreads,
+                                       RibDiskCache* diskCache = 0);
+
+        /// Schedule the archive file at the given path for parsing.
+        ///
+        /// \param path - full path to the archive file
+        /// \param declarations - snapshot of the declared tokens which are in
+        ///                   effect; inline Declare requests in the archive
+        ///                   are added to a private copy of this.
+        virtual void prefetch(const std::string& path,
+                              const TokenDict& declarations) = 0;
+
+        /// Replay a previously prefetched archive into the given context.
+        ///
+        /// If the archive is still being parsed, wait for the worker to
+        /// finish.  If the archive was never prefetched, or the worker
+        /// encountered errors while parsing it, return false; the caller
+        /// should then parse the archive itself so that errors are reported
+        /// in the usual way.
+        virtual bool replay(const std::string& path,
+                            Ri::Renderer& context) = 0;
+
+        /// Discard all cached archives.
+        ///
+        /// Procedural requests replayed from the cache refer to data owned by
+        /// the cache, so this must only be called once any primitives created
+        /// from the replayed requests have been destroyed.
+        virtual void flush() = 0;
+
+        /// Get the cache statistics.
+        virtual Stats stats() const = 0;
+
+        virtual ~RibArchiveCache() {}
+};
+
+} // namespace Aqsis
+
+#endif // AQSIS_RIBARCHIVECACHE_H_INCLUDED
+// vi: set et:
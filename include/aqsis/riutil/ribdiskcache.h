@@ -0,0 +1,122 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/// \file
+///
+/// \brief Persistent on-disk cache of decoded RIB archives.
+///
+
+#ifndef AQSIS_RIBDISKCACHE_H_INCLUDED
+#define AQSIS_RIBDISKCACHE_H_INCLUDED
+
+#include <aqsis/config.h>
+
+#include <string>
+
+#include <boost/cstdint.hpp>
+
+namespace Aqsis
+{
+
+namespace Ri { class Renderer; class RendererServices; }
+
+//------------------------------------------------------------------------------
+/// Cache of RIB archives, stored on disk in pre-decoded form.
+///
+/// Archives which are read on every frame (or by many different renders) are
+/// normally decompressed and tokenized from scratch each time.  This cache
+/// keeps a copy of each archive re-encoded as uncompressed binary RIB, which
+/// is much cheaper to decode than ASCII or gzipped RIB and may be read back
+/// through the standard parser.  Cache entries are keyed on the archive path,
+/// and are rebuilt whenever the modification time or size of the archive
+/// changes.
+///
+/// Cached archives are self-contained: tokens which were declared outside the
+/// archive are written with inline declarations, so cache entries may be
+/// shared between renders with different global declarations.
+class AQSIS_RIUTIL_SHARE RibDiskCache
+{
+    public:
+        /// Counters describing how effective the cache has been.
+        struct Stats
+        {
+            /// Number of archives read from an existing cache entry.
+            int hits;
+            /// Number of archives which needed a new cache entry.
+            int misses;
+            /// Size of the source archives which didn't need to be decoded.
+            boost::uintmax_t bytesSaved;
+
+            Stats() : hits(0), misses(0), bytesSaved(0) {}
+        };
+
+        /// Create a disk cache storing entries in the given directory.
+        ///
+        /// The directory is created if necessary.
+        ///
+        /// \param cacheDir - directory holding the cache entries.
+        /// \param services - used to look up standard filters, bases and
+        ///                   procedurals while building cache entries.
+        static RibDiskCache* create(const std::string& cacheDir,
+                                    Ri::RendererServices& services);
+
+        /// Parse an archive via the cache.
+        ///
+        /// If the cache entry for the archive is valid, it is parsed into the
+        /// given context using parseServices.  Otherwise the archive itself
+        /// is parsed into the context, and the requests are recorded into a
+        /// new cache entry on the way through.  Errors in the archive are
+        /// reported through parseServices as usual, and an archive which
+        /// contains errors isn't cached.
+        ///
+        /// If the archive can't be read, nothing is sent to the context and
+        /// false is returned; the caller should then deal with the archive
+        /// itself so that the failure is reported in the usual way.
+        ///
+        /// This function may be called concurrently from several threads.
+        ///
+        /// \param path - full path to the archive file
+        /// \param parseServices - services used to parse the archive; these
+        ///                        supply the declarations in effect for it
+        /// \param context - renderer which the archive requests are sent to
+        virtual bool parse(const std::string& path,
+                           Ri::RendererServices& parseServices,
+                           Ri::Renderer& context) = 0;
+
+        /// Get the cache statistics.
+        virtual Stats stats() const = 0;
+
+        virtual ~RibDiskCache() {}
+};
+
+} // namespace Aqsis
+
+#endif // AQSIS_RIBDISKCACHE_H_INCLUDED
+// vi: set et:
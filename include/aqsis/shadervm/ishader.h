@@ -187,6 +187,23 @@ AQSIS_SHADERVM_SHARE boost::shared_ptr<IqShader> createShaderVM(IqRenderer* rend
  */
 AQSIS_SHADERVM_SHARE void shutdownShaderVM();
 
+/// Memory statistics for the shader programs and the shaders using them.
+struct SqShaderVMStats
+{
+	TqInt	programs;		///< Shader programs loaded.
+	TqInt	programBytes;	///< Memory used by the loaded programs.
+	TqInt	instances;		///< Shader instances created.
+	TqInt	contexts;		///< Per thread execution contexts created.
+	TqInt	sharedBytes;	///< Program memory shared between instances rather than copied.
+	TqInt	uniformEvaluated;	///< Grids for which the uniform code of a shader was run.
+	TqInt	uniformReused;	///< Grids which reused the cached results of the uniform code.
+	double	uniformTime;	///< Time spent running the uniform code, in seconds.
+};
+
+/** \brief Get the memory statistics for all shaders created so far.
+ */
+AQSIS_SHADERVM_SHARE SqShaderVMStats shaderVMStatistics();
+
 //@}
 
 } // namespace Aqsis
@@ -334,6 +334,9 @@ class CqTextureBuffer<T>::CqStochasticIterator
 		TqInt m_numSamples;
 		/// Current sample number
 		TqInt m_sampleNum;
+		/// Random offsets of the quasi random sample positions.
+		TqFloat m_offsetX;
+		TqFloat m_offsetY;
 };
 
 //==============================================================================
@@ -583,9 +586,9 @@ CqTextureBuffer<T>::CqStochasticIterator::operator++()
 {
 	++m_sampleNum;
 	m_x = m_support.sx.start
-		+ lfloor(m_support.sx.range()*detail::g_randTab.x(m_sampleNum));
+		+ lfloor(m_support.sx.range()*detail::g_randTab.x(m_sampleNum, m_offsetX));
 	m_y = m_support.sy.start
-		+ lfloor(m_support.sy.range()*detail::g_randTab.y(m_sampleNum));
+		+ lfloor(m_support.sy.range()*detail::g_randTab.y(m_sampleNum, m_offsetY));
 	return *this;
 }
 
@@ -621,7 +624,9 @@ CqTextureBuffer<T>::CqStochasticIterator::CqStochasticIterator()
 	m_x(0),
 	m_y(0),
 	m_numSamples(0),
-	m_sampleNum(0)
+	m_sampleNum(0),
+	m_offsetX(0),
+	m_offsetY(0)
 { }
 
 template<typename T>
@@ -633,10 +638,16 @@ CqTextureBuffer<T>::CqStochasticIterator::CqStochasticIterator(
 	m_x(0),
 	m_y(0),
 	m_numSamples(numSamples),
-	m_sampleNum(-1)
+	m_sampleNum(-1),
+	m_offsetX(0),
+	m_offsetY(0)
 {
-	// Randomize the table for the next point.
-	detail::g_randTab.randomize();
+	// Randomize the table offsets for this support.  The generator is seeded
+	// from the support so that results don't depend on the sampling order.
+	CqRandom random(support.sx.start ^ (support.sx.end << 16),
+			support.sy.start ^ (support.sy.end << 16));
+	m_offsetX = random.RandomFloat();
+	m_offsetY = random.RandomFloat();
 	// Call operator++ to generate valid initial sample positions.
 	++(*this);
 }
@@ -41,12 +41,18 @@
 
 #include <aqsis/aqsis.h>
 
+#include <memory>
 #include <vector>
 
 #include <boost/intrusive_ptr.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/scoped_array.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#ifdef AQSIS_SYSTEM_WIN32
+#include <windows.h>
+#endif
 
 //#include <aqsis/util/memorysentry.h>
 #include <aqsis/tex/io/itiledtexinputfile.h>
@@ -154,12 +160,29 @@ class CqTileArray : boost::noncopyable //, public CqMemoryMonitored
 		TqStochasticIterator beginStochastic(const SqFilterSupport& support,
 				TqInt numSamples) const;
 		//@}
+
+		/** \brief Load the tiles covering a region ahead of use.
+		 *
+		 * Safe to call from a thread other than the one doing the filtering;
+		 * tiles which are already loaded are left alone.
+		 *
+		 * \param support - region of pixels which will be needed.
+		 */
+		void prefetch(const SqFilterSupport& support) const;
 	private:
 		/** \brief Access to the underlying tiles
 		 *
 		 * \return The tile holding the underlying data at the given indices.
 		 */
 		boost::intrusive_ptr<TqTile> getTile(const TqInt x, const TqInt y) const;
+		/// Read a tile from file if it isn't already loaded.
+		void loadTile(const TqInt x, const TqInt y) const;
+		/** \brief Make the data of a tile loaded by another thread visible.
+		 *
+		 * Called by readers which found the tile pointer set without taking
+		 * the load lock.  Pairs with the barrier in loadTile().
+		 */
+		void acquireTile() const;
 
 		/// Underlying texture file.
 		boost::shared_ptr<IqTiledTexInputFile> m_inFile;
@@ -181,6 +204,8 @@ class CqTileArray : boost::noncopyable //, public CqMemoryMonitored
 		TqInt m_heightInTiles;
 		/// "2D" array of tiles.  Tiles may be founnd in O(1) time using this array.
 		boost::scoped_array<boost::intrusive_ptr<TqTile> > m_tiles;
+		/// Protects loading of tiles into m_tiles.
+		mutable boost::mutex m_loadMutex;
 };
 
 
@@ -301,7 +326,7 @@ class CqTileArray<T>::CqStochasticIterator
 		typedef typename TqTile::TqStochasticIterator TqBaseIter;
 
 		/// Random number stream for partitioning samples into tiles (see nextTile)
-		static CqRandom m_random;
+		CqRandom m_random;
 
 		/// Support region to iterate over.
 		SqFilterSupport m_support;
@@ -487,7 +512,8 @@ CqTileArray<T>::CqTileArray(const boost::shared_ptr<IqTiledTexInputFile>& inFile
 	m_tileHeight(inFile->tileInfo().height),
 	m_widthInTiles((m_width-1)/m_tileWidth + 1), // "ceil(m_width/m_tileWidth)"
 	m_heightInTiles((m_height-1)/m_tileHeight + 1),
-	m_tiles(new boost::intrusive_ptr<TqTile>[m_widthInTiles*m_heightInTiles])
+	m_tiles(new boost::intrusive_ptr<TqTile>[m_widthInTiles*m_heightInTiles]),
+	m_loadMutex()
 { }
 
 template<typename T>
@@ -537,14 +563,67 @@ boost::intrusive_ptr<typename CqTileArray<T>::TqTile> CqTileArray<T>::getTile(
 {
 	assert(x < m_widthInTiles);
 	assert(y < m_heightInTiles);
-	boost::intrusive_ptr<TqTile>& tilePtr = m_tiles[y*m_widthInTiles + x];
+	const boost::intrusive_ptr<TqTile>& tilePtr = m_tiles[y*m_widthInTiles + x];
 	if(!tilePtr)
+		loadTile(x, y);
+	else
+		acquireTile();
+	return tilePtr;
+}
+
+template<typename T>
+void CqTileArray<T>::loadTile(const TqInt x, const TqInt y) const
+{
+	boost::mutex::scoped_lock lock(m_loadMutex);
+	boost::intrusive_ptr<TqTile>& tilePtr = m_tiles[y*m_widthInTiles + x];
+	// Another thread may have loaded the tile while we waited.
+	if(tilePtr)
+		return;
+	std::auto_ptr<TqTile> tile(new TqTile(x*m_tileWidth, y*m_tileHeight));
+	m_inFile->readTile(tile->pixels(), x, y, m_subImageIdx);
+	// Readers don't take the lock, so the tile data must be visible before
+	// the pointer to it is.  Assigning the raw pointer means the reference
+	// count is only touched before the tile is published.  Without a known
+	// barrier, acquireTile() takes the lock instead, which orders the reader
+	// after the unlock below.
+#	if AQSIS_COMPILER_GCC
+	__sync_synchronize();
+#	elif defined(AQSIS_SYSTEM_WIN32)
+	MemoryBarrier();
+#	endif
+	tilePtr = tile.release();
+}
+
+template<typename T>
+inline void CqTileArray<T>::acquireTile() const
+{
+#	if AQSIS_COMPILER_GCC
+	__sync_synchronize();
+#	elif defined(AQSIS_SYSTEM_WIN32)
+	MemoryBarrier();
+#	else
+	boost::mutex::scoped_lock lock(m_loadMutex);
+#	endif
+}
+
+template<typename T>
+void CqTileArray<T>::prefetch(const SqFilterSupport& support) const
+{
+	SqFilterSupport s = intersect(support, SqFilterSupport(0,m_width, 0,m_height));
+	if(s.isEmpty())
+		return;
+	for(TqInt y = s.sy.start/m_tileHeight, yEnd = (s.sy.end-1)/m_tileHeight;
+			y <= yEnd; ++y)
 	{
-		tilePtr = boost::intrusive_ptr<TqTile>(
-				new TqTile(x*m_tileWidth, y*m_tileHeight));
-		m_inFile->readTile(tilePtr->pixels(), x, y, m_subImageIdx);
+		for(TqInt x = s.sx.start/m_tileWidth, xEnd = (s.sx.end-1)/m_tileWidth;
+				x <= xEnd; ++x)
+		{
+			// Check the raw pointer only, so that the reference counts of
+			// tiles in use by the filtering thread aren't touched.
+			if(!m_tiles[y*m_widthInTiles + x].get())
+				loadTile(x, y);
+		}
 	}
-	return tilePtr;
 }
 
 
@@ -630,8 +709,6 @@ CqTileArray<T>::CqIterator::CqIterator(const CqTileArray<T>& tileArray,
 
 //------------------------------------------------------------------------------
 // CqTileArray<T>::CqStochasticIterator implementation
-template<typename T>
-CqRandom CqTileArray<T>::CqStochasticIterator::m_random;
 
 template<typename T>
 inline typename CqTileArray<T>::CqStochasticIterator&
@@ -722,7 +799,8 @@ inline CqTileArray<T>::CqStochasticIterator::operator*()
 template<typename T>
 CqTileArray<T>::CqStochasticIterator::CqStochasticIterator(const CqTileArray<T>& tileArray,
 		const SqFilterSupport& support, TqInt numSamps)
-	: m_support(support),
+	: m_random(support.sx.start, support.sy.start),
+	m_support(support),
 	m_tileArray(&tileArray),
 	m_tileX0(support.sx.start/tileArray.m_tileWidth),
 	m_tileXEnd((support.sx.end-1)/tileArray.m_tileWidth + 1),
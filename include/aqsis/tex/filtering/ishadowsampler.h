@@ -82,6 +82,27 @@ class AQSIS_TEX_SHARE IqShadowSampler
 		 */
 		virtual const CqShadowSampleOptions& defaultSampleOptions() const;
 
+		/** \brief Update the sampler for a new "current" coordinate system.
+		 *
+		 * This allows a sampler and the texture data it holds to be kept from
+		 * one frame to the next when the camera moves.  The default
+		 * implementation does nothing.
+		 *
+		 * \param currToWorld - new current -> world transformation.
+		 */
+		virtual void setCurrToWorld(const CqMatrix& currToWorld);
+		/** \brief Load the texture data needed to shadow a region in advance.
+		 *
+		 * This may be called from a thread other than the one calling
+		 * sample().  The default implementation does nothing.
+		 *
+		 * \param points - corners of a region in "current" coordinates.  The
+		 *                 data covering the convex hull of the points is
+		 *                 loaded.
+		 * \param numPoints - number of points.
+		 */
+		virtual void prefetch(const CqVector3D* points, TqInt numPoints) const;
+
 		//--------------------------------------------------
 		/// \name Factory functions
 		//@{
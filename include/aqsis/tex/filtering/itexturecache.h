@@ -43,6 +43,8 @@
 #include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 
+#include <aqsis/math/vecfwd.h>
+
 namespace Aqsis {
 
 class IqTextureSampler;
@@ -91,6 +93,33 @@ struct AQSIS_TEX_SHARE IqTextureCache
 	//--------------------------------------------------
 	/// Delete all textures from the cache
 	virtual void flush() = 0;
+	/** \brief Release the textures used during a frame.
+	 *
+	 * Unlike flush(), texture, environment and shadow maps used during the
+	 * frame are kept for the next one.  They are reused there if the file
+	 * they came from has the same path, modification time and size.  Maps
+	 * which weren't used during the frame are deleted.
+	 */
+	virtual void endFrame() = 0;
+	/** \brief Start loading the shadow map data needed for a region.
+	 *
+	 * The data is loaded by a background thread, for the shadow maps used so
+	 * far in the current frame.  Returns immediately.
+	 *
+	 * \param points - corners of the region in "current" coordinates.
+	 * \param numPoints - number of points.
+	 */
+	virtual void prefetchShadows(const CqVector3D* points, TqInt numPoints) = 0;
+	/** \brief Note that the renderer has written a texture file.
+	 *
+	 * Maps kept from previous frames are reused when their file has the same
+	 * modification time and size, which can't tell a file apart from one
+	 * rewritten within the same second.  Any kept maps with the same file
+	 * name are dropped, so that the new file is read.
+	 *
+	 * \param fileName - name of the file written.
+	 */
+	virtual void fileWritten(const char* fileName) = 0;
 
 	/** \brief Return the texture file attributes for the named file.
 	 *
@@ -41,6 +41,7 @@
 #include <aqsis/aqsis.h>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
 #include <aqsis/util/file.h>
 #include <aqsis/tex/io/imagefiletype.h>
@@ -189,6 +190,10 @@ class AQSIS_TEX_SHARE IqTiledTexInputFile
 		 */
 		virtual void readTileImpl(TqUint8* buffer, TqInt tileX, TqInt tileY,
 				TqInt subImageIdx, const SqTileInfo tileSize) const = 0;
+
+	private:
+		/// Serialises tile reads, which may come from the prefetch thread.
+		mutable boost::mutex m_readMutex;
 };
 
 
@@ -210,6 +215,7 @@ void IqTiledTexInputFile::readTile(ArrayT& buffer, TqInt tileX, TqInt tileY,
 	assert(subImageIdx >= 0);
 	assert(subImageIdx < numSubImages());
 	buffer.resize(tInfo.width, tInfo.height, header().channelList());
+	boost::mutex::scoped_lock lock(m_readMutex);
 	readTileImpl(buffer.rawData(), tileX, tileY, subImageIdx, tInfo);
 }
 
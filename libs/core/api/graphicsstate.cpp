@@ -308,7 +308,8 @@ void CqMotionModeBlock::EndMotionModeBlock()
 	if( m_pDeformingSurface )
 	{
 		QGetRenderContext()->StorePrimitive( m_pDeformingSurface );
-		STATS_INC( GPR_created );
+		if( !QGetRenderContext()->fObjectBlock() )
+			STATS_INC( GPR_created );
 	}
 }
 
@@ -27,12 +27,14 @@
 #include	<aqsis/aqsis.h>
 
 #include	<fstream>
+#include	<sstream>
 #include	<stdarg.h>
 #include	<math.h>
 #include	<stdio.h>
 #include    <stdlib.h>
 
 #include	<boost/filesystem/fstream.hpp>
+#include	<boost/scoped_ptr.hpp>
 
 #include	"imagebuffer.h"
 #include	"lights.h"
@@ -53,6 +55,8 @@
 #include	<aqsis/riutil/ri2ricxx.h>
 #include	<aqsis/riutil/ricxxutil.h>
 #include	<aqsis/riutil/ricxx_filter.h>
+#include	<aqsis/riutil/ribarchivecache.h>
+#include	<aqsis/riutil/ribdiskcache.h>
 #include	<aqsis/riutil/ribparser.h>
 #include	<aqsis/riutil/risyms.h>
 #include	<aqsis/riutil/ribwriter.h>
@@ -62,7 +66,6 @@
 #include	<aqsis/util/smartptr.h>
 #include	<aqsis/tex/maketexture.h>
 #include	"stats.h"
-#include	<aqsis/math/random.h>
 #include	"../../riutil/errorhandlerimpl.h"
 
 #include	"subdivision2.h"
@@ -108,7 +111,8 @@ class RiCxxCore : public Ri::Renderer
 	public:
 		RiCxxCore(Ri::RendererServices& apiServices)
 			: m_apiServices(apiServices),
-			m_archiveCallback(0)
+			m_archiveCallback(0),
+			m_archiveCache()
 		{ }
 
         virtual RtVoid ArchiveRecord(RtConstToken type, const char* string)
@@ -316,8 +320,17 @@ class RiCxxCore : public Ri::Renderer
 			return m_apiServices.errorHandler();
 		}
 
+		/// Set up the archive caches if requested by the user.
+		void initArchiveCache();
+		/// Record archive cache statistics and discard cached archives.
+		void flushArchiveCache();
+
 		Ri::RendererServices& m_apiServices;
 		RtArchiveCallback m_archiveCallback;
+		/// Persistent cache of decoded archives.  May be NULL.
+		boost::scoped_ptr<RibDiskCache> m_diskCache;
+		/// Archives parsed ahead of time.  May be NULL (created on demand).
+		boost::scoped_ptr<RibArchiveCache> m_archiveCache;
 };
 
 //------------------------------------------------------------------------------
@@ -556,8 +569,6 @@ RtVoid RiCxxCore::FrameBegin(RtInt number)
 	QGetRenderContext() ->Stats().InitialiseFrame();
 
 	QGetRenderContext()->clippingVolume().clear();
-
-	CqRandom().Reseed('a'+'q'+'s'+'i'+'s');
 }
 
 
@@ -566,6 +577,8 @@ RtVoid RiCxxCore::FrameBegin(RtInt number)
 //
 RtVoid RiCxxCore::FrameEnd()
 {
+	// Grids kept for reshading can't outlive the frame.
+	QGetRenderContext() ->clearReshadeStore();
 	QGetRenderContext() ->EndFrameModeBlock();
 	QGetRenderContext() ->ClearDisplayRequests();
 }
@@ -657,7 +670,7 @@ RtVoid RiCxxCore::WorldBegin()
 	QGetRenderContext()->initialiseCropWindow();
 	QGetRenderContext()->pImage()->SetImage();
 
-	CqRandom().Reseed('a'+'q'+'s'+'i'+'s');
+	initArchiveCache();
 }
 
 
@@ -696,8 +709,13 @@ RtVoid RiCxxCore::WorldEnd()
 		fFailed = true;
 	}
 
-	// Remove all cached textures.
-	QGetRenderContext()->textureCache().flush();
+	// Release the textures used by this frame; maps which don't change on
+	// disk are kept for the next one.
+	QGetRenderContext()->textureCache().endFrame();
+
+	// Procedurals replayed from cached archives have all been rendered, so
+	// the archives can go.
+	flushArchiveCache();
 
 	// Clear out point cloud caches, etc.
 	clearShaderSystemCaches();
@@ -720,6 +738,9 @@ RtVoid RiCxxCore::WorldEnd()
 		QGetRenderContext() ->Stats().PrintStats( verbosity );
 	}
 
+	// Light caches not used by this frame won't be wanted again.
+	CqLightCache::endFrame();
+
 	QGetRenderContext()->SetWorldBegin(false);
 }
 
@@ -1034,6 +1055,44 @@ RtVoid RiCxxCore::Hider(RtConstToken name, const ParamList& pList)
 			GetIntegerOptionWrite("Hider", "jitter")[0] =
 				pList[jitterIdx].intData()[0];
 	}
+	int interleavedIdx = pList.find(Ri::TypeSpec(Ri::TypeSpec::Integer),
+									"interleavedtime");
+	if(interleavedIdx >= 0)
+	{
+		QGetRenderContext()->poptWriteCurrent()->
+			GetIntegerOptionWrite("Hider", "interleavedtime")[0] =
+				pList[interleavedIdx].intData()[0];
+	}
+	int adaptiveIdx = pList.find(Ri::TypeSpec(Ri::TypeSpec::Integer, 2),
+								 "adaptivesamples");
+	if(adaptiveIdx >= 0)
+	{
+		TqInt* samples = QGetRenderContext()->poptWriteCurrent()->
+			GetIntegerOptionWrite("Hider", "adaptivesamples", 2);
+		samples[0] = pList[adaptiveIdx].intData()[0];
+		samples[1] = pList[adaptiveIdx].intData()[1];
+		if(samples[0] > 0 && samples[1] > 0 && samples[0]*samples[1] < 2)
+		{
+			Aqsis::log() << warning << "Hider \"adaptivesamples\" needs at least"
+				<< " 2 base samples per pixel, all pixel samples will be used" << std::endl;
+		}
+	}
+	int thresholdIdx = pList.find(Ri::TypeSpec(Ri::TypeSpec::Float),
+								  "adaptivethreshold");
+	if(thresholdIdx >= 0)
+	{
+		QGetRenderContext()->poptWriteCurrent()->
+			GetFloatOptionWrite("Hider", "adaptivethreshold")[0] =
+				pList[thresholdIdx].floatData()[0];
+	}
+	int contrastIdx = pList.find(Ri::TypeSpec(Ri::TypeSpec::Float),
+								 "adaptivecontrast");
+	if(contrastIdx >= 0)
+	{
+		QGetRenderContext()->poptWriteCurrent()->
+			GetFloatOptionWrite("Hider", "adaptivecontrast")[0] =
+				pList[contrastIdx].floatData()[0];
+	}
 }
 
 
@@ -1260,6 +1319,87 @@ RtVoid RiCxxCore::TextureCoordinates(RtFloat s1, RtFloat t1,
 }
 
 
+//----------------------------------------------------------------------
+/** Find the cache of results for a light defined with the current attributes,
+ * if it has Attribute "light" "cache" set.
+ *
+ * Lights are matched across frames by a signature made from the shader name,
+ * the parameter values and the light to world transformation, so that any
+ * change to them gives the light a fresh cache.
+ */
+static boost::shared_ptr<CqLightCache> findLightCache(RtConstToken shadername,
+		RtConstToken name, const Ri::ParamList& pList, const IqShader& shader)
+{
+	const CqAttributes* pAttr = QGetRenderContext()->pattrCurrent().get();
+	const TqInt* pCache = pAttr->GetIntegerAttribute( "light", "cache" );
+	if( !pCache || pCache[0] == 0 )
+		return boost::shared_ptr<CqLightCache>();
+	if( !QGetRenderContext()->IsWorldBegin() )
+	{
+		// World space doesn't exist yet, so the light can't be matched up
+		// with the next frame.
+		Aqsis::log() << warning << "Light cache ignored for light \"" << shadername
+			<< "\" defined outside the world block" << std::endl;
+		return boost::shared_ptr<CqLightCache>();
+	}
+	const TqFloat* pTolerance = pAttr->GetFloatAttribute( "light", "cachetolerance" );
+	TqFloat tolerance = pTolerance ? pTolerance[0] : 0.01f;
+	bool useNormal = shader.Uses( EnvVars_N ) || shader.Uses( EnvVars_Ns );
+
+	std::ostringstream sig;
+	sig.precision(9);
+	sig << shadername << '\n' << tolerance << '\n';
+	const CqTransform* pTrans = QGetRenderContext()->ptransCurrent().get();
+	for( TqInt t = 0; t < pTrans->cTimes(); ++t )
+	{
+		const CqMatrix& mat = pTrans->matObjectToWorld( pTrans->Time( t ) );
+		for( TqInt i = 0; i < 4; ++i )
+			for( TqInt j = 0; j < 4; ++j )
+				sig << mat[i][j] << ' ';
+		sig << '\n';
+	}
+	for( size_t p = 0; p < pList.size(); ++p )
+	{
+		const Ri::Param& param = pList[p];
+		sig << param.name() << ' ' << param.spec().iclass << ' ' << param.spec().type
+			<< ' ' << param.spec().arraySize << ':';
+		switch( param.spec().storageType() )
+		{
+			case Ri::TypeSpec::Float:
+			{
+				Ri::FloatArray values = param.floatData();
+				for( size_t i = 0; i < values.size(); ++i )
+					sig << ' ' << values[i];
+				break;
+			}
+			case Ri::TypeSpec::Integer:
+			{
+				Ri::IntArray values = param.intData();
+				for( size_t i = 0; i < values.size(); ++i )
+					sig << ' ' << values[i];
+				break;
+			}
+			case Ri::TypeSpec::String:
+			{
+				Ri::StringArray values = param.stringData();
+				for( size_t i = 0; i < values.size(); ++i )
+					sig << " \"" << values[i] << '"';
+				break;
+			}
+			default:
+				// Can't tell whether anything else has changed.
+				return boost::shared_ptr<CqLightCache>();
+		}
+		sig << '\n';
+	}
+
+	std::string lightName = shadername;
+	if( name && *name )
+		lightName += std::string( " \"" ) + name + "\"";
+	return CqLightCache::find( sig.str(), lightName, tolerance, useNormal );
+}
+
+
 //----------------------------------------------------------------------
 // Create a new light source at the current transformation.
 //
@@ -1280,6 +1420,7 @@ RtVoid RiCxxCore::LightSource(RtConstToken shadername, RtConstToken name, const
 	if ( pNew )
 	{
 		setShaderArguments(pShader, pList);
+		pNew->SetCache( findLightCache( shadername, name, pList, *pShader ) );
 		QGetRenderContext() ->pattrWriteCurrent() ->AddLightsource( pNew );
 		// If this light is being defined outside the WorldBegin, then we can
 		// go ahead and initialise the parameters, as they are invariant under changes to the camera space.
@@ -2225,7 +2366,8 @@ RtVoid RiCxxCore::Points(const ParamList& pList)
 		else
 		{
 			QGetRenderContext()->StorePrimitive( pSurface );
-			STATS_INC( GPR_created );
+			if( !QGetRenderContext()->fObjectBlock() )
+				STATS_INC( GPR_created );
 		}
 	}
 }
@@ -2999,6 +3141,17 @@ RtVoid RiCxxCore::Procedural(RtPointer data, RtConstBound bound, RtProcSubdivFun
 	QGetRenderContext()->matVSpaceToSpace( "object", "world", NULL, pProc->pTransform().get(), time, matVOtoW );
 	pProc->Transform( matOtoW, matNOtoW, matVOtoW);
 	CreateGPrim( pProc );
+
+	// Start parsing the archive for delayed archives straight away, so that
+	// it's ready by the time the procedural is split.
+	if(m_archiveCache && refineproc == RiProcDelayedReadArchive)
+	{
+		boost::filesystem::path archivePath = QGetRenderContext()->poptCurrent()
+			->findRiFileNothrow(static_cast<char**>(data)[0], "archive");
+		if(!archivePath.empty())
+			m_archiveCache->prefetch(archivePath.string(),
+									 QGetRenderContext()->tokenDict());
+	}
 }
 
 
@@ -3131,16 +3284,20 @@ RtVoid RiCxxCore::SolidEnd()
 // Object retention and instancing.
 RtVoid RiCxxCore::ObjectBegin(RtConstToken name)
 {
-	errorHandler().error(EqE_Bug, "ObjectBegin should be handled by a filter");
+	if(!QGetRenderContext()->BeginObject(name))
+		errorHandler().error(EqE_Nesting,
+			"ObjectBegin \"%s\" inside another object definition", name);
 }
 RtVoid RiCxxCore::ObjectEnd()
 {
-	errorHandler().error(EqE_Bug, "ObjectEnd should be handled by a filter");
+	if(!QGetRenderContext()->EndObject())
+		errorHandler().error(EqE_Nesting,
+			"ObjectEnd outside an object definition");
 }
 RtVoid RiCxxCore::ObjectInstance(RtConstToken name)
 {
-	errorHandler().error(EqE_Bug,
-						 "ObjectInstance should be handled by a filter");
+	if(!QGetRenderContext()->InstanceObject(name))
+		errorHandler().error(EqE_BadHandle, "Bad object name \"%s\"", name);
 }
 
 
@@ -3173,6 +3330,7 @@ RtVoid RiCxxCore::MakeTexture(RtConstString imagefile, RtConstString texturefile
 		= QGetRenderContext()->poptCurrent()->findRiFile(imagefile, "texture");
 	makeTexture(inFileName, texturefile, SqFilterInfo(filterfunc, swidth, twidth),
 			wrapModes, pList);
+	QGetRenderContext()->textureCache().fileWritten(texturefile);
 }
 
 
@@ -3189,6 +3347,7 @@ RtVoid RiCxxCore::MakeLatLongEnvironment(RtConstString imagefile, RtConstString
 		->findRiFile(imagefile, "texture");
 	makeLatLongEnvironment(inFileName, reflfile, SqFilterInfo(filterfunc,
 				swidth, twidth), pList);
+	QGetRenderContext()->textureCache().fileWritten(reflfile);
 }
 
 
@@ -3214,6 +3373,7 @@ RtVoid RiCxxCore::MakeCubeFaceEnvironment(RtConstString px, RtConstString nx, Rt
 		reflfile, fov, SqFilterInfo(filterfunc, swidth, twidth),
 		pList
 	);
+	QGetRenderContext()->textureCache().fileWritten(reflfile);
 }
 
 
@@ -3229,6 +3389,7 @@ RtVoid RiCxxCore::MakeShadow(RtConstString picfile, RtConstString shadowfile, co
 	boost::filesystem::path inFileName = QGetRenderContext()->poptCurrent()
 		->findRiFile(picfile, "texture");
 	makeShadow(inFileName, shadowfile, pList);
+	QGetRenderContext()->textureCache().fileWritten(shadowfile);
 }
 
 
@@ -3247,6 +3408,7 @@ RtVoid RiCxxCore::MakeOcclusion(const StringArray& picfiles, RtConstString shado
 			->findRiFile(picfiles[i], "texture") );
 	}
 	makeOcclusion(fileNames, shadowfile, pList);
+	QGetRenderContext()->textureCache().fileWritten(shadowfile);
 }
 
 //----------------------------------------------------------------------
@@ -3424,10 +3586,21 @@ RtVoid RiCxxCore::SubdivisionMesh(RtConstToken scheme, const IntArray& nvertices
 
 RtVoid RiCxxCore::ReadArchive(RtConstToken name, RtArchiveCallback callback, const ParamList& pList)
 {
+	boost::filesystem::path archivePath =
+		QGetRenderContext()->poptCurrent()->findRiFile(name, "archive");
+	// Replay the archive from memory if it was parsed ahead of time.  Cached
+	// archives don't retain archive records, so we can't do this when the
+	// user wants to see them.
+	if(m_archiveCache && !callback &&
+	   m_archiveCache->replay(archivePath.string(), m_apiServices.firstFilter()))
+		return;
+	// Otherwise use the pre-decoded version from the disk cache if possible.
+	if(m_diskCache && !callback &&
+	   m_diskCache->parse(archivePath.string(), m_apiServices,
+						  m_apiServices.firstFilter()))
+		return;
 	// Open the archive file
-	boost::filesystem::ifstream archiveFile(
-			QGetRenderContext()->poptCurrent()->findRiFile(name, "archive"),
-			std::ios::binary);
+	boost::filesystem::ifstream archiveFile(archivePath, std::ios::binary);
 	// Parse the archive
 	RtArchiveCallback savedCallback = m_archiveCallback;
 	m_archiveCallback = callback;
@@ -3435,6 +3608,41 @@ RtVoid RiCxxCore::ReadArchive(RtConstToken name, RtArchiveCallback callback, con
 	m_archiveCallback = savedCallback;
 }
 
+void RiCxxCore::initArchiveCache()
+{
+	const CqString* cacheDir = QGetRenderContext()->poptCurrent()->
+		GetStringOption("render", "archivecache");
+	if(cacheDir && !cacheDir->empty())
+		m_diskCache.reset(RibDiskCache::create(*cacheDir, m_apiServices));
+	const TqInt* numThreads = QGetRenderContext()->poptCurrent()->
+		GetIntegerOption("limits", "archivethreads");
+	if(numThreads && numThreads[0] > 0)
+		m_archiveCache.reset(RibArchiveCache::create(m_apiServices,
+													 numThreads[0],
+													 m_diskCache.get()));
+}
+
+void RiCxxCore::flushArchiveCache()
+{
+	if(m_archiveCache)
+	{
+		RibArchiveCache::Stats stats = m_archiveCache->stats();
+		STATS_SETI( ARC_prefetched, stats.prefetched );
+		STATS_SETI( ARC_hits, stats.hits );
+		STATS_SETI( ARC_misses, stats.misses );
+		STATS_SETI( ARC_waits, stats.waits );
+		m_archiveCache.reset();
+	}
+	if(m_diskCache)
+	{
+		RibDiskCache::Stats stats = m_diskCache->stats();
+		STATS_SETI( ARC_disk_hits, stats.hits );
+		STATS_SETI( ARC_disk_misses, stats.misses );
+		STATS_SETF( ARC_disk_saved, stats.bytesSaved / (1024.0f*1024.0f) );
+		m_diskCache.reset();
+	}
+}
+
 RtVoid RiCxxCore::ArchiveBegin(RtConstToken name, const ParamList& pList)
 {
 	errorHandler().error(EqE_Bug, "ArchiveBegin should be handled by a filter");
@@ -3827,6 +4035,9 @@ RtVoid	CreateGPrim( const boost::shared_ptr<CqSurface>& pSurface )
 	else
 	{
 		QGetRenderContext()->StorePrimitive( pSurface );
+		// Object masters are only rendered through their instances.
+		if( QGetRenderContext()->fObjectBlock() )
+			return;
 		STATS_INC( GPR_created );
 
 		// Add to the raytracer database also
@@ -3851,8 +4062,9 @@ class CoreRendererServices : public Ri::RendererServices
 			m_api.reset(new RiCxxCore(*this));
 			// Add renderer utility filter.  We do this here rather than in
 			// addFilter() because this is a special filter which should only
-			// be added once.
-			Ri::Filter* utilFilter = createRenderUtilFilter(TestCondition);
+			// be added once.  Object instancing is done by the core so that
+			// instances can share their master geometry.
+			Ri::Filter* utilFilter = createRenderUtilFilter(TestCondition, false);
 			utilFilter->setNextFilter(*m_api);
 			utilFilter->setRendererServices(*this);
 			m_filterChain.push_back(boost::shared_ptr<Ri::Renderer>(utilFilter));
@@ -4214,6 +4426,93 @@ RtVoid RiProgressHandler(RtProgressFunc handler)
 }
 
 
+//----------------------------------------------------------------------
+/** Look up the types of the arguments to an edit of a shader.
+ * \return false, after reporting the error, if a token isn't declared.
+ */
+static bool editArgumentTypes(RtInt count, RtToken tokens[],
+		std::vector<std::string>& names, std::vector<EqVariableType>& types)
+{
+	for( RtInt i = 0; i < count; ++i )
+	{
+		std::string name;
+		EqVariableClass iclass;
+		EqVariableType type;
+		try
+		{
+			typeSpecToEqTypes( &iclass, &type,
+					QGetRenderContext()->tokenDict().lookup( tokens[i], &name ) );
+		}
+		catch( XqValidation& e )
+		{
+			Aqsis::log() << error << e.what() << std::endl;
+			return false;
+		}
+		names.push_back( name );
+		types.push_back( type );
+	}
+	return true;
+}
+
+
+//----------------------------------------------------------------------
+/** Change the arguments of a light source after the frame has been rendered
+ * with Option "render" "ipr", see RiReshade().
+ *	\param	name	Name of the light, as given to RiLightSource.
+ */
+RtVoid RiEditLightSourceV(RtToken name, RtInt count, RtToken tokens[], RtPointer values[])
+{
+	std::vector<std::string> names;
+	std::vector<EqVariableType> types;
+	if( !editArgumentTypes( count, tokens, names, types ) )
+		return;
+	try
+	{
+		for( RtInt i = 0; i < count; ++i )
+			QGetRenderContext()->editLightArgument( name, names[i].c_str(), types[i], values[i] );
+	}
+	catch( XqValidation& e )
+	{
+		Aqsis::log() << error << e.what() << std::endl;
+	}
+}
+
+
+//----------------------------------------------------------------------
+/** Change the arguments of the surface and atmosphere shaders with the given
+ * name after the frame has been rendered with Option "render" "ipr", see
+ * RiReshade().
+ */
+RtVoid RiEditShaderV(RtToken shadername, RtInt count, RtToken tokens[], RtPointer values[])
+{
+	std::vector<std::string> names;
+	std::vector<EqVariableType> types;
+	if( !editArgumentTypes( count, tokens, names, types ) )
+		return;
+	try
+	{
+		for( RtInt i = 0; i < count; ++i )
+			QGetRenderContext()->editShaderArgument( shadername, names[i].c_str(), types[i], values[i] );
+	}
+	catch( XqValidation& e )
+	{
+		Aqsis::log() << error << e.what() << std::endl;
+	}
+}
+
+
+//----------------------------------------------------------------------
+/** Render the frame again, only shading the grids affected by the edits
+ * since it was rendered.  Must be called between RiWorldEnd and RiFrameEnd.
+ * With Option "render" "progressive" set, the affected buckets are refined
+ * at increasing pixel sample counts like a progressive render.
+ */
+RtVoid RiReshade()
+{
+	QGetRenderContext()->reshade();
+}
+
+
 //----------------------------------------------------------------------
 // Deprecated interface features.
 
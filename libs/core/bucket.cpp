@@ -42,6 +42,7 @@
 #include	"imagebuffer.h"
 
 #include	"bucket.h"
+#include	"splitrecord.h"
 #include	"stats.h"
 
 #include	<algorithm>
@@ -62,7 +63,9 @@ CqBucket::CqBucket()
 	m_xSize(0),
 	m_ySize(0),
 	m_micropolygons(),
-	m_gPrims()
+	m_microQuadGrids(),
+	m_gPrims(),
+	m_gPrimsSize(0)
 { }
 
 //----------------------------------------------------------------------
@@ -102,6 +105,7 @@ void CqBucket::SetProcessed( bool bProc )
 		// anything else, this seems to help avoid persistent small pieces of
 		// memory which fragment the heap.
 		TqPolyStorage().swap(m_micropolygons);
+		TqGridStorage().swap(m_microQuadGrids);
 		TqSurfaceQueue().swap(m_gPrims);
 	}
 }
@@ -114,6 +118,57 @@ bool CqBucket::hasPendingSurfaces() const
 	return ! m_gPrims.empty();
 }
 
+//----------------------------------------------------------------------
+/** Evict the deferred GPrims which can be generated again by their
+ * procedural.  Proxies keep the raster bound of the GPrims they replace, so
+ * the order of the heap doesn't change.
+ */
+TqUlong CqBucket::evictGPrims(TqUlong size)
+{
+	TqUlong freed = 0;
+	for(TqSurfaceQueue::iterator i = m_gPrims.begin(); i != m_gPrims.end() && freed < size; ++i)
+	{
+		boost::shared_ptr<CqSurface>& surface = *i;
+		// GPrims in solids and ones waiting on eye splits stay as they are.
+		if(!surface->splitRecord() || surface->pCSGNode() || surface->IsUndiceable()
+			|| !surface->fCachedBound())
+			continue;
+		TqUlong surfaceSize = surface->storageSize();
+		if(surfaceSize == 0)
+			continue;
+		surface = surface->splitRecord()->evict(surface);
+		m_gPrimsSize -= surfaceSize;
+		freed += surfaceSize;
+	}
+	return freed;
+}
+
+//----------------------------------------------------------------------
+/** Get the depth range of the deferred GPrims from their cached raster bounds.
+ */
+bool CqBucket::depthRange(TqFloat& zMin, TqFloat& zMax) const
+{
+	bool found = false;
+	for(TqSurfaceQueue::const_iterator i = m_gPrims.begin(); i != m_gPrims.end(); ++i)
+	{
+		if(!(*i)->fCachedBound())
+			continue;
+		CqBound bound = (*i)->GetCachedRasterBound();
+		if(!found)
+		{
+			zMin = bound.vecMin().z();
+			zMax = bound.vecMax().z();
+			found = true;
+		}
+		else
+		{
+			zMin = min(zMin, bound.vecMin().z());
+			zMax = max(zMax, bound.vecMax().z());
+		}
+	}
+	return found;
+}
+
 
 //----------------------------------------------------------------------
 /** Add an MP to the list of deferred MPs.
@@ -124,6 +179,15 @@ void CqBucket::AddMP( boost::shared_ptr<CqMicroPolygon>& pMP )
 }
 
 
+//----------------------------------------------------------------------
+/** Add a grid of static MPs to the list of deferred grids.
+ */
+void CqBucket::AddMicroQuadGrid( const boost::shared_ptr<CqMicroQuadGrid>& pGrid )
+{
+	m_microQuadGrids.push_back( pGrid );
+}
+
+
 } // namespace Aqsis
 
 
@@ -82,6 +82,7 @@ class CqBucket
 		 */
 		void	AddGPrim( const boost::shared_ptr<CqSurface>& pGPrim )
 		{
+			m_gPrimsSize += pGPrim->storageSize();
 			m_gPrims.push_back(pGPrim);
 			std::push_heap(m_gPrims.begin(), m_gPrims.end(),
 						   closest_surface());
@@ -106,6 +107,7 @@ class CqBucket
 		{
 			if (!m_gPrims.empty())
 			{
+				m_gPrimsSize -= m_gPrims.front()->storageSize();
 				std::pop_heap(m_gPrims.begin(), m_gPrims.end(),
 							  closest_surface());
 				m_gPrims.pop_back();
@@ -118,6 +120,24 @@ class CqBucket
 			return ( m_gPrims.size() );
 		}
 		bool hasPendingSurfaces() const;
+		/** Get the estimated memory held by the deferred GPrims, in bytes.
+		 */
+		TqUlong gPrimsSize() const
+		{
+			return ( m_gPrimsSize );
+		}
+		/** Replace deferred GPrims generated by procedurals with proxies
+		 * which only hold their bound, see CqSplitRecord.
+		 *
+		 * \param size - the memory to free, in bytes.
+		 * \return The memory freed.
+		 */
+		TqUlong evictGPrims( TqUlong size );
+		/** Get the range of camera space depths covered by the deferred GPrims.
+		 *
+		 * \return false if no deferred GPrim has a cached bound.
+		 */
+		bool depthRange(TqFloat& zMin, TqFloat& zMax) const;
 		/** Get the flag that indicates if the bucket has been processed yet.
 		 */
 		bool IsProcessed() const
@@ -155,6 +175,12 @@ class CqBucket
 
 		std::vector<boost::shared_ptr<CqMicroPolygon> >& micropolygons();
 
+		/** Add a grid of static MPs to the list of deferred grids.
+		 */
+		void	AddMicroQuadGrid( const boost::shared_ptr<CqMicroQuadGrid>& pGrid );
+
+		std::vector<boost::shared_ptr<CqMicroQuadGrid> >& microQuadGrids();
+
 		const TqCache& cacheSegments() const;
 		void setCacheSegment(SqBucketCacheSegment::EqBucketCacheSide side, boost::shared_ptr<SqBucketCacheSegment>& seg);
 		void clearCache();
@@ -194,6 +220,9 @@ class CqBucket
 		/// Vector of vectors of waiting micropolygons in this bucket
 		typedef std::vector<boost::shared_ptr<CqMicroPolygon> > TqPolyStorage;
 		TqPolyStorage m_micropolygons;
+		/// References to the grids of static micropolygons in this bucket
+		typedef std::vector<boost::shared_ptr<CqMicroQuadGrid> > TqGridStorage;
+		TqGridStorage m_microQuadGrids;
 
 		/// A sorted list of primitives for this bucket
 		///
@@ -203,6 +232,8 @@ class CqBucket
 		/// completely deallocated when the bucket is done.
 		typedef std::vector<boost::shared_ptr<CqSurface> > TqSurfaceQueue;
 		TqSurfaceQueue m_gPrims;
+		/// Estimated memory held by m_gPrims.
+		TqUlong m_gPrimsSize;
 
 		TqCache m_cacheSegments;
 };
@@ -217,6 +248,11 @@ inline std::vector<boost::shared_ptr<CqMicroPolygon> >& CqBucket::micropolygons(
 	return m_micropolygons;
 }
 
+inline std::vector<boost::shared_ptr<CqMicroQuadGrid> >& CqBucket::microQuadGrids()
+{
+	return m_microQuadGrids;
+}
+
 inline void CqBucket::setCacheSegment(SqBucketCacheSegment::EqBucketCacheSide side, boost::shared_ptr<SqBucketCacheSegment>& seg)
 {
 	// Check there isn't already a cache segment for the position.
@@ -0,0 +1,216 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/**
+        \file
+        \brief Implements the orders in which the buckets of an image are rendered.
+*/
+
+#include "bucketorder.h"
+
+#include <algorithm>
+
+#include <aqsis/math/random.h>
+
+namespace Aqsis {
+
+namespace {
+
+/// Add the buckets of the region row by row, optionally alternating direction.
+void rowSequence(const CqRegion& region, bool zigzag,
+		std::vector<std::pair<TqInt, TqInt> >& sequence)
+{
+	for(TqInt row = region.yMin(); row < region.yMax(); ++row)
+	{
+		bool reverse = zigzag && (row - region.yMin()) % 2 == 1;
+		for(TqInt i = region.xMin(); i < region.xMax(); ++i)
+		{
+			TqInt col = reverse ? region.xMax() - 1 - (i - region.xMin()) : i;
+			sequence.push_back(std::make_pair(col, row));
+		}
+	}
+}
+
+/// Get the point at distance d along the Hilbert curve filling an n*n square.
+void hilbertPoint(TqInt n, TqInt d, TqInt& x, TqInt& y)
+{
+	x = 0;
+	y = 0;
+	for(TqInt s = 1, t = d; s < n; s *= 2, t /= 4)
+	{
+		TqInt rx = 1 & (t/2);
+		TqInt ry = 1 & (t ^ rx);
+		if(ry == 0)
+		{
+			if(rx == 1)
+			{
+				x = s - 1 - x;
+				y = s - 1 - y;
+			}
+			std::swap(x, y);
+		}
+		x += s*rx;
+		y += s*ry;
+	}
+}
+
+void hilbertSequence(const CqRegion& region,
+		std::vector<std::pair<TqInt, TqInt> >& sequence)
+{
+	TqInt n = 1;
+	while(n < region.width() || n < region.height())
+		n *= 2;
+	// Walk the curve over the smallest enclosing square, skipping the
+	// points outside the region.
+	for(TqInt d = 0; d < n*n; ++d)
+	{
+		TqInt x = 0;
+		TqInt y = 0;
+		hilbertPoint(n, d, x, y);
+		if(x < region.width() && y < region.height())
+			sequence.push_back(std::make_pair(region.xMin() + x, region.yMin() + y));
+	}
+}
+
+void spiralSequence(const CqRegion& region,
+		std::vector<std::pair<TqInt, TqInt> >& sequence)
+{
+	TqInt x = region.xMin() + (region.width() - 1)/2;
+	TqInt y = region.yMin() + (region.height() - 1)/2;
+	TqInt dx = 1;
+	TqInt dy = 0;
+	sequence.push_back(std::make_pair(x, y));
+	// Every bucket lies on the spiral, so stop once all are found.
+	for(TqInt length = 1; static_cast<TqInt>(sequence.size()) < region.area(); ++length)
+	{
+		for(TqInt leg = 0; leg < 2; ++leg)
+		{
+			for(TqInt i = 0; i < length; ++i)
+			{
+				x += dx;
+				y += dy;
+				if(x >= region.xMin() && x < region.xMax()
+					&& y >= region.yMin() && y < region.yMax())
+					sequence.push_back(std::make_pair(x, y));
+			}
+			// Turn clockwise.
+			TqInt t = dx;
+			dx = -dy;
+			dy = t;
+		}
+	}
+}
+
+void randomSequence(const CqRegion& region,
+		std::vector<std::pair<TqInt, TqInt> >& sequence)
+{
+	rowSequence(region, false, sequence);
+	// A fixed seed, so that repeated renders visit the buckets the same way.
+	CqRandom random;
+	for(TqInt i = sequence.size() - 1; i > 0; --i)
+		std::swap(sequence[i], sequence[random.RandomInt(i + 1)]);
+}
+
+void memorySequence(const CqRegion& region,
+		std::vector<std::pair<TqInt, TqInt> >& sequence)
+{
+	// A fixed serpentine across the short side of the region; the bucket
+	// contents are not looked at.  The boundary between finished and
+	// unfinished buckets stays as short as that side, and alternating the
+	// direction of the lines keeps consecutive buckets next to each other.
+	const bool wide = region.width() >= region.height();
+	const TqInt lineMin = wide ? region.xMin() : region.yMin();
+	const TqInt lineMax = wide ? region.xMax() : region.yMax();
+	const TqInt posMin = wide ? region.yMin() : region.xMin();
+	const TqInt posMax = wide ? region.yMax() : region.xMax();
+	for(TqInt line = lineMin; line < lineMax; ++line)
+	{
+		bool reverse = (line - lineMin) % 2 == 1;
+		for(TqInt i = posMin; i < posMax; ++i)
+		{
+			TqInt pos = reverse ? posMax - 1 - (i - posMin) : i;
+			if(wide)
+				sequence.push_back(std::make_pair(line, pos));
+			else
+				sequence.push_back(std::make_pair(pos, line));
+		}
+	}
+}
+
+} // unnamed namespace
+
+
+bool bucketOrderFromName(const std::string& name, EqBucketOrder& order)
+{
+	if(name == "horizontal")
+		order = Bucket_Horizontal;
+	else if(name == "vertical")
+		order = Bucket_Vertical;
+	else if(name == "zigzag")
+		order = Bucket_ZigZag;
+	else if(name == "spiral" || name == "circle")
+		order = Bucket_Spiral;
+	else if(name == "hilbert")
+		order = Bucket_Hilbert;
+	else if(name == "random")
+		order = Bucket_Random;
+	else if(name == "memory")
+		order = Bucket_Memory;
+	else
+		return false;
+	return true;
+}
+
+void bucketSequence(EqBucketOrder order, const CqRegion& region,
+		std::vector<std::pair<TqInt, TqInt> >& sequence)
+{
+	sequence.clear();
+	if(region.width() <= 0 || region.height() <= 0)
+		return;
+	sequence.reserve(region.area());
+	switch(order)
+	{
+		case Bucket_Vertical:
+			for(TqInt col = region.xMin(); col < region.xMax(); ++col)
+				for(TqInt row = region.yMin(); row < region.yMax(); ++row)
+					sequence.push_back(std::make_pair(col, row));
+			break;
+		case Bucket_ZigZag:
+			rowSequence(region, true, sequence);
+			break;
+		case Bucket_Spiral:
+			spiralSequence(region, sequence);
+			break;
+		case Bucket_Hilbert:
+			hilbertSequence(region, sequence);
+			break;
+		case Bucket_Random:
+			randomSequence(region, sequence);
+			break;
+		case Bucket_Memory:
+			memorySequence(region, sequence);
+			break;
+		case Bucket_Horizontal:
+		default:
+			rowSequence(region, false, sequence);
+			break;
+	}
+}
+
+} // namespace Aqsis
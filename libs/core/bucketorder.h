@@ -0,0 +1,77 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/**
+        \file
+        \brief Declares the orders in which the buckets of an image are rendered.
+*/
+
+#ifndef BUCKETORDER_H_INCLUDED
+#define BUCKETORDER_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <aqsis/math/region.h>
+
+namespace Aqsis {
+
+/// Orders in which the buckets can be rendered, see Option "render" "bucketorder".
+enum EqBucketOrder
+{
+	Bucket_Horizontal = 0,	///< Row by row, left to right.
+	Bucket_Vertical,		///< Column by column, top to bottom.
+	Bucket_ZigZag,			///< Row by row, alternating direction.
+	Bucket_Spiral,			///< Square spiral out from the centre of the image.
+	Bucket_Hilbert,			///< Along a Hilbert curve.
+	Bucket_Random,			///< Repeatable random order.
+	Bucket_Memory			///< Serpentine across the short side of the region.
+};
+
+/** Get the bucket order with the given name.
+ *
+ * "circle" is accepted as another name for "spiral".
+ *
+ * \return false if the name isn't known, in which case order is unchanged.
+ */
+bool bucketOrderFromName(const std::string& name, EqBucketOrder& order);
+
+/** Build the sequence of buckets to be rendered.
+ *
+ * The memory order is not worked out from the scene or from which buckets
+ * are finished; it is the vertical order with alternating direction for a
+ * wide region, and the zigzag order for a tall one.  Sweeping across the
+ * short side keeps the boundary between finished and unfinished buckets
+ * short, and with it the number of filter overlap cache segments and
+ * reposted primitives held waiting for unfinished buckets.
+ *
+ * \param order - order of the buckets.
+ * \param region - buckets to include, as column and row ranges.
+ * \param sequence - filled with the (column, row) of each bucket in the
+ *                   region, in the order they should be rendered.
+ */
+void bucketSequence(EqBucketOrder order, const CqRegion& region,
+		std::vector<std::pair<TqInt, TqInt> >& sequence);
+
+} // namespace Aqsis
+
+#endif // BUCKETORDER_H_INCLUDED
@@ -0,0 +1,253 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file Unit tests for the bucket orders.
+ */
+
+#include "bucketorder.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <list>
+#include <set>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+#include <aqsis/math/random.h>
+
+BOOST_AUTO_TEST_SUITE(bucketorder_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+typedef std::vector<std::pair<TqInt, TqInt> > TqSequence;
+
+const EqBucketOrder allOrders[] = {
+	Bucket_Horizontal, Bucket_Vertical, Bucket_ZigZag, Bucket_Spiral,
+	Bucket_Hilbert, Bucket_Random, Bucket_Memory
+};
+const char* const allOrderNames[] = {
+	"horizontal", "vertical", "zigzag", "spiral", "hilbert", "random", "memory"
+};
+const TqInt numOrders = sizeof(allOrders)/sizeof(allOrders[0]);
+
+bool isNeighbour(const std::pair<TqInt, TqInt>& a, const std::pair<TqInt, TqInt>& b)
+{
+	return std::abs(a.first - b.first) + std::abs(a.second - b.second) == 1;
+}
+
+/// Memory and texture cache behaviour of rendering the buckets in a sequence.
+struct SqOrderCost
+{
+	/// Peak number of filter overlap cache segments waiting for a bucket.
+	TqInt peakSegments;
+	/// Peak number of primitives covering both finished and unfinished buckets.
+	TqInt peakPrimitives;
+	/// Texture tile misses of a small LRU cache.
+	TqInt textureMisses;
+
+	SqOrderCost(const TqSequence& sequence, TqInt width, TqInt height)
+		: peakSegments(0),
+		peakPrimitives(0),
+		textureMisses(0)
+	{
+		// Primitives with random bounds a few buckets across.
+		const TqInt numPrims = 2000;
+		std::vector<TqInt> primX(numPrims), primY(numPrims), primW(numPrims), primH(numPrims);
+		CqRandom random(42);
+		for(TqInt i = 0; i < numPrims; ++i)
+		{
+			primW[i] = 1 + random.RandomInt(4);
+			primH[i] = 1 + random.RandomInt(4);
+			primX[i] = random.RandomInt(width - primW[i] + 1);
+			primY[i] = random.RandomInt(height - primH[i] + 1);
+		}
+		std::vector<TqInt> primDone(numPrims, 0);
+
+		std::vector<bool> done(width*height, false);
+		// A screen space texture with tiles of 2x2 buckets, looked up with
+		// a filter reaching half a bucket past each side.
+		const TqInt cacheSize = 16;
+		std::list<TqInt> cache;
+
+		TqInt segments = 0;
+		TqInt primitives = 0;
+		for(TqSequence::const_iterator b = sequence.begin(); b != sequence.end(); ++b)
+		{
+			TqInt x = b->first;
+			TqInt y = b->second;
+			done[y*width + x] = true;
+			for(TqInt ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1); ++ny)
+			{
+				for(TqInt nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1); ++nx)
+				{
+					if(nx == x && ny == y)
+						continue;
+					// Each finished neighbour left this bucket a segment,
+					// and this bucket leaves one to each unfinished one.
+					segments += done[ny*width + nx] ? -1 : 1;
+				}
+			}
+			peakSegments = std::max(peakSegments, segments);
+
+			for(TqInt i = 0; i < numPrims; ++i)
+			{
+				if(x >= primX[i] && x < primX[i] + primW[i]
+					&& y >= primY[i] && y < primY[i] + primH[i])
+				{
+					if(primDone[i] == 0)
+						++primitives;
+					if(++primDone[i] == primW[i]*primH[i])
+						--primitives;
+				}
+			}
+			peakPrimitives = std::max(peakPrimitives, primitives);
+
+			for(TqInt ty = (2*y - 1)/4; ty <= (2*y + 3)/4; ++ty)
+			{
+				for(TqInt tx = (2*x - 1)/4; tx <= (2*x + 3)/4; ++tx)
+				{
+					TqInt tile = ty*width + tx;
+					std::list<TqInt>::iterator i = std::find(cache.begin(), cache.end(), tile);
+					if(i == cache.end())
+					{
+						++textureMisses;
+						if(static_cast<TqInt>(cache.size()) == cacheSize)
+							cache.pop_back();
+					}
+					else
+						cache.erase(i);
+					cache.push_front(tile);
+				}
+			}
+		}
+	}
+};
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(bucketorder_names_test)
+{
+	for(TqInt i = 0; i < numOrders; ++i)
+	{
+		EqBucketOrder order = Bucket_Horizontal;
+		BOOST_CHECK(bucketOrderFromName(allOrderNames[i], order));
+		BOOST_CHECK_EQUAL(order, allOrders[i]);
+	}
+	EqBucketOrder order = Bucket_Hilbert;
+	BOOST_CHECK(bucketOrderFromName("circle", order));
+	BOOST_CHECK_EQUAL(order, Bucket_Spiral);
+	BOOST_CHECK(!bucketOrderFromName("diagonal", order));
+	BOOST_CHECK_EQUAL(order, Bucket_Spiral);
+}
+
+BOOST_AUTO_TEST_CASE(bucketorder_complete_test)
+{
+	// A cropped region which isn't square or a power of two across.
+	CqRegion region(3, 2, 14, 9);
+	for(TqInt i = 0; i < numOrders; ++i)
+	{
+		TqSequence sequence;
+		bucketSequence(allOrders[i], region, sequence);
+		BOOST_CHECK_EQUAL(static_cast<TqInt>(sequence.size()), region.area());
+		std::set<std::pair<TqInt, TqInt> > unique(sequence.begin(), sequence.end());
+		BOOST_CHECK_EQUAL(static_cast<TqInt>(unique.size()), region.area());
+		for(TqSequence::const_iterator b = sequence.begin(); b != sequence.end(); ++b)
+		{
+			BOOST_CHECK(b->first >= region.xMin() && b->first < region.xMax());
+			BOOST_CHECK(b->second >= region.yMin() && b->second < region.yMax());
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(bucketorder_locality_test)
+{
+	TqSequence sequence;
+	// Horizontal order is the order buckets were always rendered in.
+	bucketSequence(Bucket_Horizontal, CqRegion(0, 0, 3, 2), sequence);
+	BOOST_CHECK(sequence[2] == std::make_pair(2, 0));
+	BOOST_CHECK(sequence[3] == std::make_pair(0, 1));
+
+	// Consecutive buckets of the Hilbert and zigzag orders are neighbours.
+	bucketSequence(Bucket_Hilbert, CqRegion(0, 0, 16, 16), sequence);
+	for(TqInt i = 1, n = sequence.size(); i < n; ++i)
+		BOOST_CHECK(isNeighbour(sequence[i-1], sequence[i]));
+	bucketSequence(Bucket_ZigZag, CqRegion(0, 0, 7, 5), sequence);
+	for(TqInt i = 1, n = sequence.size(); i < n; ++i)
+		BOOST_CHECK(isNeighbour(sequence[i-1], sequence[i]));
+
+	// The spiral starts in the middle and stays a square while it can.
+	bucketSequence(Bucket_Spiral, CqRegion(0, 0, 9, 9), sequence);
+	BOOST_CHECK(sequence[0] == std::make_pair(4, 4));
+	for(TqInt i = 0; i < 25; ++i)
+	{
+		BOOST_CHECK(std::abs(sequence[i].first - 4) <= 2);
+		BOOST_CHECK(std::abs(sequence[i].second - 4) <= 2);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(bucketorder_cost_test)
+{
+	// Benchmark of the memory held and texture tiles missed, reported in the
+	// test log, for an image of 60x34 buckets.
+	const TqInt width = 60;
+	const TqInt height = 34;
+	std::vector<SqOrderCost> costs;
+	for(TqInt i = 0; i < numOrders; ++i)
+	{
+		TqSequence sequence;
+		bucketSequence(allOrders[i], CqRegion(0, 0, width, height), sequence);
+		costs.push_back(SqOrderCost(sequence, width, height));
+		BOOST_TEST_MESSAGE(allOrderNames[i] << " order: peak "
+				<< costs.back().peakSegments << " cache segments, peak "
+				<< costs.back().peakPrimitives << " partly rendered primitives, "
+				<< costs.back().textureMisses << " texture tile misses");
+	}
+	// The orders built for locality beat the random one.  Across this wide
+	// image the memory order is vertical with alternating direction, so it
+	// holds as little as vertical and misses fewer texture tiles.
+	const SqOrderCost& random = costs[5];
+	for(TqInt i = 0; i < numOrders; ++i)
+	{
+		if(allOrders[i] == Bucket_Random)
+			continue;
+		BOOST_CHECK(costs[i].peakSegments < random.peakSegments);
+		BOOST_CHECK(costs[i].textureMisses < random.textureMisses);
+	}
+	BOOST_CHECK(costs[6].peakSegments < costs[0].peakSegments);
+	BOOST_CHECK(costs[6].peakPrimitives < costs[0].peakPrimitives);
+	BOOST_CHECK(costs[6].peakSegments <= costs[1].peakSegments);
+	BOOST_CHECK(costs[6].textureMisses < costs[1].textureMisses);
+	BOOST_CHECK(costs[4].textureMisses < costs[0].textureMisses);
+
+	// Across a tall image the memory order is zigzag instead.
+	TqSequence memory;
+	TqSequence zigzag;
+	TqSequence vertical;
+	bucketSequence(Bucket_Memory, CqRegion(0, 0, height, width), memory);
+	bucketSequence(Bucket_ZigZag, CqRegion(0, 0, height, width), zigzag);
+	bucketSequence(Bucket_Vertical, CqRegion(0, 0, height, width), vertical);
+	BOOST_CHECK(memory == zigzag);
+	BOOST_CHECK(SqOrderCost(memory, height, width).peakSegments
+			< SqOrderCost(vertical, height, width).peakSegments);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -21,8 +21,10 @@
 #include	<valarray>
 
 #include	<aqsis/math/math.h>
+#include	<aqsis/math/random.h>
 #include	"bucket.h"
 #include	"imagebuffer.h"
+#include	"reshadestore.h"
 #include	<aqsis/util/timer.h>
 
 
@@ -46,6 +48,13 @@ CqBucketProcessor::CqBucketProcessor(CqImageBuffer& imageBuf,
 	m_SampleRegion(),
 	m_DisplayRegion(),
 	m_hasValidSamples(false),
+	m_adaptiveXStep(1),
+	m_adaptiveYStep(1),
+	m_sampleBase(false),
+	m_baseMicroPolygons(),
+	m_baseMicroQuadGrids(),
+	m_baseCulledSurfaces(),
+	m_interleavedTimes(),
 	m_channelBuffer()
 {
 	setupCacheInformation();
@@ -159,6 +168,21 @@ void CqBucketProcessor::preProcess(IqSampler* sampler)
 		}
 
 
+		// With interleaved times every pixel in the bucket gets the same
+		// stratified times, with a random offset for each bucket, so moving
+		// micropolygons only need to be interpolated once for each time.
+		m_interleavedTimes.clear();
+		if(m_optCache.interleavedTime)
+		{
+			TqInt numTimes = m_optCache.xSamps*m_optCache.ySamps;
+			CqRandom random(47, (yPos << 16) ^ xPos);
+			TqFloat offset = random.RandomFloat();
+			TqFloat shutter = m_optCache.shutterClose - m_optCache.shutterOpen;
+			m_interleavedTimes.resize(numTimes);
+			for(TqInt i = 0; i < numTimes; ++i)
+				m_interleavedTimes[i] = m_optCache.shutterOpen + shutter*(i + offset)/numTimes;
+		}
+
 		// Clear the sample points and and adjust them for the new bucket
 		// position, jittering the samples if necessary.
 		TqInt which = 0;
@@ -174,6 +198,8 @@ void CqBucketProcessor::preProcess(IqSampler* sampler)
 				CqVector2D bPos2 = CqVector2D(x, y);
 				m_aieImage[which]->clear();
 				m_aieImage[which]->setSamples(sampler, bPos2);
+				for(TqInt i = 0, n = m_interleavedTimes.size(); i < n; ++i)
+					m_aieImage[which]->SampleData(i).time = m_interleavedTimes[i];
 			}
 		}
 		InitialiseFilterValues();
@@ -203,6 +229,95 @@ void CqBucketProcessor::preProcess(IqSampler* sampler)
 		// will be used for sampling.
 		m_OcclusionTree.setupTree(*this);
 	}
+
+	// With adaptive sampling, only a stratified subset of the samples is
+	// sampled first.  The others are ignored by the occlusion culling until
+	// RefineSamples() decides which pixels need them.
+	setupAdaptiveSteps();
+	m_sampleBase = m_adaptiveXStep > 1 || m_adaptiveYStep > 1;
+	if(m_sampleBase)
+	{
+		for(TqInt y = SampleRegion().yMin(); y < SampleRegion().yMax(); ++y)
+		{
+			for(TqInt x = SampleRegion().xMin(); x < SampleRegion().xMax(); ++x)
+			{
+				CqImagePixelPtr* pie;
+				ImageElement(x, y, pie);
+				(*pie)->selectBaseSamples(m_adaptiveXStep, m_adaptiveYStep);
+				for(TqInt i = 0, nSamples = (*pie)->numSamples(); i < nSamples; ++i)
+				{
+					const SqSampleData& sample = (*pie)->SampleData(i);
+					if(!sample.isUsed)
+						m_OcclusionTree.setSampleIgnored(sample.occlusionIndex, true);
+				}
+			}
+		}
+		m_OcclusionTree.updateTree();
+	}
+
+	// Shading the bucket can't start until its surfaces are split and
+	// diced, so there's time to get the shadow maps loaded meanwhile.
+	if(m_optCache.shadowPrefetch)
+		prefetchShadows();
+}
+
+/** Work out the steps between the base samples of adaptive sampling.
+ *
+ * The steps come from the number of samples the pixels have in this render,
+ * which is less than PixelSamples at the early levels of a progressive
+ * render.  A single base sample can't vary, so adaptive sampling is left off
+ * unless there are at least two.
+ */
+void CqBucketProcessor::setupAdaptiveSteps()
+{
+	const TqInt xSamps = m_optCache.xSamps;
+	const TqInt ySamps = m_optCache.ySamps;
+	m_adaptiveXStep = 1;
+	m_adaptiveYStep = 1;
+	if(m_optCache.xAdaptiveSamps <= 0 || m_optCache.yAdaptiveSamps <= 0)
+		return;
+	TqInt xStep = max(1, xSamps/m_optCache.xAdaptiveSamps);
+	TqInt yStep = max(1, ySamps/m_optCache.yAdaptiveSamps);
+	TqInt numBase = ((xSamps + xStep - 1)/xStep)*((ySamps + yStep - 1)/yStep);
+	if(numBase < 2)
+		return;
+	m_adaptiveXStep = xStep;
+	m_adaptiveYStep = yStep;
+}
+
+void CqBucketProcessor::prefetchShadows()
+{
+	TqFloat zMin = 0;
+	TqFloat zMax = 0;
+	if(!m_bucket->depthRange(zMin, zMax))
+		return;
+	zMin = max(zMin, m_optCache.clipNear);
+	zMax = min(zMax, m_optCache.clipFar);
+	if(zMin > zMax)
+		return;
+	CqMatrix camToRaster;
+	QGetRenderContext()->matSpaceToSpace("camera", "raster", NULL, NULL,
+			QGetRenderContextI()->Time(), camToRaster);
+	CqMatrix rasterToCam = camToRaster.Inverse();
+	// Find the corners of the bucket frustum in camera space by cutting the
+	// ray through each corner of the bucket at the near and far depths.
+	// This works for both perspective and orthographic projections.
+	CqVector3D corners[8];
+	TqInt xMin = m_bucket->getXPosition();
+	TqInt yMin = m_bucket->getYPosition();
+	for(TqInt i = 0; i < 4; ++i)
+	{
+		TqFloat x = xMin + ((i & 1) ? m_bucket->getXSize() : 0);
+		TqFloat y = yMin + ((i & 2) ? m_bucket->getYSize() : 0);
+		CqVector3D p0 = rasterToCam * CqVector3D(x, y, 0);
+		CqVector3D p1 = rasterToCam * CqVector3D(x, y, 1);
+		CqVector3D dir = p1 - p0;
+		if(std::fabs(dir.z()) < 1e-6f)
+			return;
+		corners[2*i] = p0 + dir*((zMin - p0.z())/dir.z());
+		corners[2*i+1] = p0 + dir*((zMax - p0.z())/dir.z());
+	}
+	QGetRenderContext()->textureCache().prefetchShadows(corners, 8);
 }
 
 void CqBucketProcessor::process()
@@ -236,6 +351,14 @@ void CqBucketProcessor::process()
 		AQSIS_TIME_SCOPE(Render_MPGs);
 		RenderWaitingMPs();
 	}
+
+	// Once the base samples are done, add samples where they vary too much
+	// and render the surfaces culled against the base samples again.
+	if(m_sampleBase)
+	{
+		RefineSamples();
+		process();
+	}
 }
 
 void CqBucketProcessor::postProcess()
@@ -374,6 +497,77 @@ void CqBucketProcessor::CombineElements()
 	}
 }
 
+//----------------------------------------------------------------------
+/** Add samples to the pixels which need them after sampling the base samples.
+ *
+ * The base samples are combined, and any pixel where they vary by more than
+ * the adaptive threshold or contrast gets all the samples skipped so far.
+ * Only the new samples stay active, so the micropolygons kept from the base
+ * pass are sampled at those alone, and postProcess() combines only those.
+ * The surfaces culled against the base samples are put back in the bucket,
+ * since they can't be visible at the base samples but may be at the new ones.
+ */
+void CqBucketProcessor::RefineSamples()
+{
+	{
+		AQSIS_TIME_SCOPE(Combine_samples);
+		CombineElements();
+	}
+
+	TqInt numPixels = 0;
+	TqInt numRefined = 0;
+	TqInt numSamples = 0;
+	for(TqInt y = SampleRegion().yMin(); y < SampleRegion().yMax(); ++y)
+	{
+		for(TqInt x = SampleRegion().xMin(); x < SampleRegion().xMax(); ++x)
+		{
+			CqImagePixelPtr* pie;
+			ImageElement(x, y, pie);
+			CqImagePixel& pixel = **pie;
+			if(pixel.samplesVary(m_optCache.adaptiveThreshold, m_optCache.adaptiveContrast))
+			{
+				pixel.activateSkippedSamples();
+				for(TqInt i = 0, nSamples = pixel.numSamples(); i < nSamples; ++i)
+				{
+					const SqSampleData& sample = pixel.SampleData(i);
+					if(sample.isActive)
+						m_OcclusionTree.setSampleIgnored(sample.occlusionIndex, false);
+				}
+				++numRefined;
+			}
+			else
+				pixel.deactivateSamples();
+			++numPixels;
+			numSamples += pixel.numUsedSamples();
+		}
+	}
+	m_OcclusionTree.updateTree();
+	m_sampleBase = false;
+
+	if(numRefined > 0)
+	{
+		AQSIS_TIME_SCOPE(Render_MPGs);
+		for(std::vector<boost::shared_ptr<CqMicroPolygon> >::iterator i = m_baseMicroPolygons.begin();
+				i != m_baseMicroPolygons.end(); ++i)
+			RenderMicroPoly(i->get());
+		for(std::vector<boost::shared_ptr<CqMicroQuadGrid> >::iterator i = m_baseMicroQuadGrids.begin();
+				i != m_baseMicroQuadGrids.end(); ++i)
+			RenderMicroQuadGrid(**i);
+		m_OcclusionTree.updateTree();
+	}
+	std::vector<boost::shared_ptr<CqMicroPolygon> >().swap(m_baseMicroPolygons);
+	std::vector<boost::shared_ptr<CqMicroQuadGrid> >().swap(m_baseMicroQuadGrids);
+
+	for(std::vector<boost::shared_ptr<CqSurface> >::iterator i = m_baseCulledSurfaces.begin();
+			i != m_baseCulledSurfaces.end(); ++i)
+		m_bucket->AddGPrim(*i);
+	m_baseCulledSurfaces.clear();
+
+	STATS_SETI( SPL_pixels, STATS_GETI( SPL_pixels ) + numPixels );
+	STATS_SETI( SPL_pixel_samples, STATS_GETI( SPL_pixel_samples ) + numSamples );
+	STATS_SETI( SPL_refined_pixels, STATS_GETI( SPL_refined_pixels ) + numRefined );
+}
+
 //----------------------------------------------------------------------
 /** Filter the samples in this bucket according to type and filter widths.
  */
@@ -415,7 +609,10 @@ void CqBucketProcessor::FilterBucket()
 
 	TqInt	xlen = DataRegion().width();
 
-	TqInt SampleCount = 0;
+	// Hits are weighted by the number of samples per pixel over the number
+	// used in their pixel, so that coverage doesn't depend on adaptive
+	// sampling.
+	TqFloat SampleCount = 0;
 
 	TqInt x, y;
 	TqInt i = 0;
@@ -444,7 +641,7 @@ void CqBucketProcessor::FilterBucket()
 
 			TqInt size = DisplayRegion().width() * DisplayRegion().height() * m_optCache.ySamps;
 			std::valarray<TqFloat> intermediateSamples( 0.0f, size * datasize);
-			std::valarray<TqInt> sampleCounts(0, size);
+			std::valarray<TqFloat> sampleCounts(0.0f, size);
 			for ( y = DisplayRegion().yMin() - ymax; y < endy + ymax ; y++ )
 			{
 				TqFloat ycent = y + 0.5f;
@@ -477,7 +674,7 @@ void CqBucketProcessor::FilterBucket()
 								SqSampleData const& sampleData = (*pie2)->SampleData( sampleIndex );
 								CqVector2D vecS = sampleData.position;
 								vecS -= CqVector2D( xcent, ycent );
-								if ( vecS.x() >= -xfwo2 && vecS.y() >= -yfwo2 && vecS.x() <= xfwo2 && vecS.y() <= yfwo2 )
+								if ( sampleData.isUsed && vecS.x() >= -xfwo2 && vecS.y() >= -yfwo2 && vecS.x() <= xfwo2 && vecS.y() <= yfwo2 )
 								{
 									TqFloat g = m_aFilterValues[index + sampleIndex];
 									gTot += g;
@@ -487,7 +684,7 @@ void CqBucketProcessor::FilterBucket()
 										TqFloat* data = (*pie2)->sampleHitData(opv);
 										for ( TqInt k = 0; k < datasize; ++k )
 											samples[k] += data[k] * g;
-										sampleCounts[pixelIndex]++;
+										sampleCounts[pixelIndex] += TqFloat(numSubPixels) / (*pie2)->numUsedSamples();
 									}
 								}
 								sampleIndex++;
@@ -535,7 +732,7 @@ void CqBucketProcessor::FilterBucket()
 							SqSampleData const& sampleData = (*pie2)->SampleData( sampleIndex );
 							CqVector2D vecS = sampleData.position;
 							vecS -= CqVector2D( xcent, ycent );
-							if ( vecS.x() >= -xfwo2 && vecS.y() >= -yfwo2 && vecS.x() <= xfwo2 && vecS.y() <= yfwo2 )
+							if ( sampleData.isUsed && vecS.x() >= -xfwo2 && vecS.y() >= -yfwo2 && vecS.x() <= xfwo2 && vecS.y() <= yfwo2 )
 							{
 								TqFloat g = m_aFilterValues[index + sampleIndex];
 								gTot += g;
@@ -572,7 +769,7 @@ void CqBucketProcessor::FilterBucket()
 						if ( SampleCount >= numSubPixels)
 							aCoverages[ i ] = 1.0;
 						else
-							aCoverages[ i ] = ( TqFloat ) SampleCount / ( TqFloat ) (numSubPixels );
+							aCoverages[ i ] = SampleCount / ( TqFloat ) (numSubPixels );
 					}
 
 					i++;
@@ -609,7 +806,7 @@ void CqBucketProcessor::FilterBucket()
 									SqSampleData const& sampleData = (*pie2)->SampleData( sampleIndex );
 									CqVector2D vecS = sampleData.position;
 									vecS -= CqVector2D( xcent, ycent );
-									if ( vecS.x() >= -xfwo2 && vecS.y() >= -yfwo2 && vecS.x() <= xfwo2 && vecS.y() <= yfwo2 )
+									if ( sampleData.isUsed && vecS.x() >= -xfwo2 && vecS.y() >= -yfwo2 && vecS.x() <= xfwo2 && vecS.y() <= yfwo2 )
 									{
 										TqFloat g = m_aFilterValues[index+sampleIndex];
 										gTot += g;
@@ -619,7 +816,7 @@ void CqBucketProcessor::FilterBucket()
 											TqFloat* data = (*pie2)->sampleHitData(opv);
 											for ( TqInt k = 0; k < datasize; ++k )
 												samples[k] += data[k] * g;
-											SampleCount++;
+											SampleCount += TqFloat(numSubPixels) / (*pie2)->numUsedSamples();
 										}
 									}
 									sampleIndex++;
@@ -655,7 +852,7 @@ void CqBucketProcessor::FilterBucket()
 						if ( SampleCount >= numSubPixels)
 							aCoverages[ i ] = 1.0;
 						else
-							aCoverages[ i ] = ( TqFloat ) SampleCount / ( TqFloat ) (numSubPixels );
+							aCoverages[ i ] = SampleCount / ( TqFloat ) (numSubPixels );
 					}
 
 					i++;
@@ -930,8 +1127,22 @@ void CqBucketProcessor::RenderWaitingMPs()
 		CqMicroPolygon* mp = (*itMP).get();
 		RenderMicroPoly( mp );
 	}
+	if ( m_sampleBase )
+		m_baseMicroPolygons.insert( m_baseMicroPolygons.end(),
+			m_bucket->micropolygons().begin(), m_bucket->micropolygons().end() );
 	m_bucket->micropolygons().clear();
 
+	for ( std::vector<boost::shared_ptr<CqMicroQuadGrid> >::iterator itGrid = m_bucket->microQuadGrids().begin();
+			itGrid != m_bucket->microQuadGrids().end();
+			itGrid++ )
+	{
+		RenderMicroQuadGrid( **itGrid );
+	}
+	if ( m_sampleBase )
+		m_baseMicroQuadGrids.insert( m_baseMicroQuadGrids.end(),
+			m_bucket->microQuadGrids().begin(), m_bucket->microQuadGrids().end() );
+	m_bucket->microQuadGrids().clear();
+
 	m_OcclusionTree.updateTree();
 }
 
@@ -947,10 +1158,20 @@ void CqBucketProcessor::RenderSurface( boost::shared_ptr<CqSurface>& surface )
 	                                 m_optCache.depthFilter == Filter_Average) ) )
 	{
 		AQSIS_TIME_SCOPE(Occlusion_culling);
-		if ( surface->fCachedBound() &&
+		// Surfaces hidden at the samples of an early progressive level may
+		// be visible at the later ones, which only resample the kept
+		// micropolygons.
+		if ( surface->fCachedBound() && !m_imageBuf.fKeepMicroPolygons() &&
 			 ( surface->pAttributes()->GetIntegerAttributeDef( "cull", "hidden", 1 ) == 1 ) &&
 		     m_OcclusionTree.canCull(surface->GetCachedRasterBound()) )
 		{
+			// Only the base samples have been sampled so far, so the
+			// surface may still be visible at the samples added later.
+			if ( m_sampleBase )
+			{
+				m_baseCulledSurfaces.push_back( surface );
+				return;
+			}
 			m_imageBuf.RepostSurface(*m_bucket, surface);
 			STATS_INC( GPR_occlusion_culled );
 			return;
@@ -1015,6 +1236,9 @@ void CqBucketProcessor::RenderSurface( boost::shared_ptr<CqSurface>& surface )
 	// Dice & shade the surface if it's small enough...
 	if ( fDiceable )
 	{
+		if ( !surface->pCSGNode() )
+			CoalesceSurfaces( surface );
+
 		CqMicroPolyGridBase* pGrid = 0;
 		{
 			AQSIS_TIME_SCOPE(Dicing);
@@ -1024,6 +1248,15 @@ void CqBucketProcessor::RenderSurface( boost::shared_ptr<CqSurface>& surface )
 		if ( NULL != pGrid )
 		{
 			ADDREF( pGrid );
+			// Keep the grid for reshading if the render is interactive.
+			CqReshadeStore* reshadeStore = QGetRenderContext()->reshadeStore();
+			bool keepGrid = false;
+			if ( reshadeStore )
+			{
+				keepGrid = pGrid->PrepareReshade();
+				if ( !keepGrid )
+					reshadeStore->addUnsupported();
+			}
 			// Only shade in all cases since the Displacement could be called in the shadow map creation too.
 			// \note Timings for shading are broken down into component parts within this function.
 			pGrid->Shade();
@@ -1034,6 +1267,8 @@ void CqBucketProcessor::RenderSurface( boost::shared_ptr<CqSurface>& surface )
 				AQSIS_TIME_SCOPE(Bust_grids);
 				// Split any grids in this bucket waiting to be processed.
 				pGrid->Split( SampleRegion().xMin(), SampleRegion().xMax(), SampleRegion().yMin(), SampleRegion().yMax());
+				if ( keepGrid )
+					reshadeStore->addGrid( static_cast<CqMicroPolyGrid*>( pGrid ) );
 			}
 
 			RELEASEREF( pGrid );
@@ -1058,6 +1293,62 @@ void CqBucketProcessor::RenderSurface( boost::shared_ptr<CqSurface>& surface )
 	}
 }
 
+//----------------------------------------------------------------------
+/** Combine the surfaces at the top of the bucket with the given one.
+ *
+ * The shading cost of a grid has a large fixed part, which dominates for
+ * the small grids produced by heavily split primitives such as particles.
+ * Surfaces are taken in depth order, so only those which would have been
+ * rendered next are considered, and any which might be occlusion culled are
+ * left alone.
+ */
+void CqBucketProcessor::CoalesceSurfaces( boost::shared_ptr<CqSurface>& surface )
+{
+	while ( m_bucket->hasPendingSurfaces() )
+	{
+		boost::shared_ptr<CqSurface> next = m_bucket->pTopSurface();
+		if ( next->pCSGNode() || ( next->fCachedBound() &&
+		     m_OcclusionTree.canCull(next->GetCachedRasterBound()) ) )
+			break;
+		boost::shared_ptr<CqSurface> batch = surface->Coalesce( *next );
+		if ( !batch )
+			break;
+		m_bucket->popSurface();
+		surface = batch;
+		STATS_INC( GRD_coalesced );
+	}
+}
+
+//----------------------------------------------------------------------
+/** Render the micropolygons of a static grid.
+ 
+ * The quads are sampled straight from the grid storage through a single
+ * sampler micropolygon, skipping those which can't touch this bucket.
+ * \param grid The compact storage for the grid.
+ */
+void CqBucketProcessor::RenderMicroQuadGrid( CqMicroQuadGrid& grid )
+{
+	// With DoF the quads may be blurred onto the bucket from further away,
+	// leave the test to RenderMPG_MBOrDof().
+	bool UsingDof = QGetRenderContext()->UsingDepthOfField();
+	TqFloat xmin = SampleRegion().xMin();
+	TqFloat xmax = SampleRegion().xMax();
+	TqFloat ymin = SampleRegion().yMin();
+	TqFloat ymax = SampleRegion().yMax();
+
+	CqMicroQuadSampler sampler( grid );
+	for ( TqInt i = 0, cQuads = grid.cQuads(); i < cQuads; i++ )
+	{
+		// Cull on the raw vertices before doing any per-quad setup.
+		if ( !UsingDof && grid.QuadOutside( i, xmin, xmax, ymin, ymax ) )
+			continue;
+		sampler.SetQuad( i );
+		RenderMicroPoly( &sampler );
+		if ( sampler.IsHit() )
+			grid.MarkHit( i );
+	}
+}
+
 //----------------------------------------------------------------------
 /** Render a particular micropolygon.
  
@@ -1084,8 +1375,15 @@ void CqBucketProcessor::RenderMicroPoly( CqMicroPolygon* pMP )
 	// it for each sample.
 	pMP->CacheOutputInterpCoeffs(m_CurrentMpgSampleInfo);
 
-	if(IsMoving || UsingDof)
+	if(IsMoving && !UsingDof && !m_interleavedTimes.empty()
+		&& RenderMPG_Interleaved( pMP ))
+		return;
+	// The lens strata bounds are built from the cached vertices, so other
+	// shapes such as points are sampled against their whole bound.
+	if(IsMoving || (UsingDof && !pMP->IsQuad()))
 		RenderMPG_MBOrDof( pMP, IsMoving, UsingDof );
+	else if(UsingDof)
+		RenderMPG_Dof( pMP );
 	else
 		RenderMPG_Static( pMP );
 }
@@ -1166,6 +1464,8 @@ void CqBucketProcessor::RenderMPG_Static( CqMicroPolygon* pMPG)
 				for ( m = start_m; m < end_m; m++, index++ )
 				{
 					SqSampleData const& sampleData = (*pie2)->SampleData( index );
+					if ( !sampleData.isActive )
+						continue;
 					const CqVector2D& vecP = sampleData.position;
 					const TqFloat time = 0.0;
 
@@ -1217,6 +1517,175 @@ void CqBucketProcessor::RenderMPG_Static( CqMicroPolygon* pMPG)
 	}
 }
 
+// this function assumes that mb is used without dof, and that the samples
+// have interleaved times.  Each sample index has the same time in every
+// pixel, so the micropolygon is interpolated to each time once, and only
+// tested against the samples with that index under its bound at that time,
+// rather than against all samples in the bound swept out during the motion.
+bool CqBucketProcessor::RenderMPG_Interleaved( CqMicroPolygon* pMPG )
+{
+	const SqGridInfo& currentGridInfo = pMPG->pGrid()->GetCachedGridInfo();
+	const TqFloat* LodBounds = currentGridInfo.lodBounds;
+	bool UsingLevelOfDetail = LodBounds[ 0 ] >= 0.0f;
+	bool isCullable = m_CurrentMpgSampleInfo.isCullable;
+
+	CqHitTestCache hitTestCache;
+	TqInt nextx = DataRegion().width();
+	for ( TqInt index = 0, numTimes = m_interleavedTimes.size(); index < numTimes; ++index )
+	{
+		TqFloat time = m_interleavedTimes[index];
+		CqBound Bound;
+		if ( !pMPG->CacheHitTestValuesAtTime( hitTestCache, time, Bound ) )
+		{
+			assert( index == 0 );
+			return false;
+		}
+		if ( Bound.vecMin().z() > m_optCache.clipFar || Bound.vecMax().z() < m_optCache.clipNear )
+			continue;
+
+		TqInt eX = lceil( Bound.vecMax().x() );
+		TqInt eY = lceil( Bound.vecMax().y() );
+		if ( eX > SampleRegion().xMax() ) eX = SampleRegion().xMax();
+		if ( eY > SampleRegion().yMax() ) eY = SampleRegion().yMax();
+		TqInt sX = static_cast<TqInt>(std::floor( Bound.vecMin().x() ));
+		TqInt sY = static_cast<TqInt>(std::floor( Bound.vecMin().y() ));
+		if ( sY < SampleRegion().yMin() ) sY = SampleRegion().yMin();
+		if ( sX < SampleRegion().xMin() ) sX = SampleRegion().xMin();
+		if ( sX >= eX || sY >= eY )
+			continue;
+
+		CqImagePixelPtr* pie;
+		ImageElement( sX, sY, pie );
+		for ( TqInt iY = sY; iY < eY; ++iY, pie += nextx )
+		{
+			CqImagePixelPtr* pie2 = pie;
+			for ( TqInt iX = sX; iX < eX; ++iX, ++pie2 )
+			{
+				SqSampleData const& sampleData = (*pie2)->SampleData( index );
+				if ( !sampleData.isActive )
+					continue;
+
+				CqStats::IncI( CqStats::SPL_count );
+
+				const CqVector2D& vecP = sampleData.position;
+				if ( !Bound.Contains2D( vecP ) )
+					continue;
+				// Occlusion cull the micropoly bound against the current
+				// opaque sample hit.
+				if ( isCullable && Bound.vecMin().z() > sampleData.occlZ )
+					continue;
+				// Check to see if the sample is within the sample's level of detail
+				if ( UsingLevelOfDetail )
+				{
+					TqFloat LevelOfDetail = sampleData.detailLevel;
+					if ( LodBounds[ 0 ] > LevelOfDetail || LevelOfDetail >= LodBounds[ 1 ] )
+						continue;
+				}
+
+				CqStats::IncI( CqStats::SPL_bound_hits );
+
+				TqFloat D;
+				CqVector2D uv;
+				if ( pMPG->SampleAtCachedTime( hitTestCache, vecP, D, uv, time ) )
+					StoreSample( pMPG, pie2->get(), index, D, uv );
+			}
+		}
+	}
+	return true;
+}
+
+// this function assumes that dof is used on a micropolygon which isn't
+// moving.  The samples of each pixel are stratified over the lens, with one
+// sample per pixel in each lens stratum.  For each stratum the vertices of
+// the micropolygon are offset by their own CoC over the range of lens
+// positions in the stratum, which gives the exact bound of the micropolygon
+// as seen from that part of the lens.  Only the sample of that stratum in
+// each pixel under the bound is then tested.
+void CqBucketProcessor::RenderMPG_Dof( CqMicroPolygon* pMPG )
+{
+	const SqGridInfo& currentGridInfo = pMPG->pGrid()->GetCachedGridInfo();
+	const TqFloat* LodBounds = currentGridInfo.lodBounds;
+	bool UsingLevelOfDetail = LodBounds[ 0 ] >= 0.0f;
+	bool isCullable = m_CurrentMpgSampleInfo.isCullable;
+
+	CqHitTestCache hitTestCache;
+	pMPG->CacheHitTestValues( hitTestCache, true );
+	const CqVector3D* P = hitTestCache.P;
+	const CqVector2D* coc = hitTestCache.cocMult;
+
+	const CqBound& Bound = pMPG->GetBound();
+	if ( Bound.vecMin().z() > m_optCache.clipFar || Bound.vecMax().z() < m_optCache.clipNear )
+		return;
+	TqFloat bminz = Bound.vecMin().z();
+	TqFloat bmaxz = Bound.vecMax().z();
+
+	TqInt nextx = DataRegion().width();
+	for ( TqInt stratum = 0; stratum < m_NumDofBounds; ++stratum )
+	{
+		// Sample positions move by -coc*offset, and the CoC multipliers are
+		// never negative.
+		const CqBound& lens = DofSubBound( stratum );
+		TqFloat bminx = FLT_MAX, bminy = FLT_MAX;
+		TqFloat bmaxx = -FLT_MAX, bmaxy = -FLT_MAX;
+		for ( TqInt i = 0; i < 4; ++i )
+		{
+			bminx = min( bminx, P[i].x() - coc[i].x()*lens.vecMax().x() );
+			bmaxx = max( bmaxx, P[i].x() - coc[i].x()*lens.vecMin().x() );
+			bminy = min( bminy, P[i].y() - coc[i].y()*lens.vecMax().y() );
+			bmaxy = max( bmaxy, P[i].y() - coc[i].y()*lens.vecMin().y() );
+		}
+		CqBound DofBound( bminx, bminy, bminz, bmaxx, bmaxy, bmaxz );
+
+		TqInt eX = lceil( bmaxx );
+		TqInt eY = lceil( bmaxy );
+		if ( eX > SampleRegion().xMax() ) eX = SampleRegion().xMax();
+		if ( eY > SampleRegion().yMax() ) eY = SampleRegion().yMax();
+		TqInt sX = static_cast<TqInt>(std::floor( bminx ));
+		TqInt sY = static_cast<TqInt>(std::floor( bminy ));
+		if ( sY < SampleRegion().yMin() ) sY = SampleRegion().yMin();
+		if ( sX < SampleRegion().xMin() ) sX = SampleRegion().xMin();
+		if ( sX >= eX || sY >= eY )
+			continue;
+
+		CqImagePixelPtr* pie;
+		ImageElement( sX, sY, pie );
+		for ( TqInt iY = sY; iY < eY; ++iY, pie += nextx )
+		{
+			CqImagePixelPtr* pie2 = pie;
+			for ( TqInt iX = sX; iX < eX; ++iX, ++pie2 )
+			{
+				TqInt index = (*pie2)->GetDofOffsetIndex( stratum );
+				SqSampleData const& sampleData = (*pie2)->SampleData( index );
+				if ( !sampleData.isActive )
+					continue;
+
+				CqStats::IncI( CqStats::SPL_count );
+
+				if ( !DofBound.Contains2D( sampleData.position ) )
+					continue;
+				// Occlusion cull the micropoly bound against the current
+				// opaque sample hit.
+				if ( isCullable && bminz > sampleData.occlZ )
+					continue;
+				// Check to see if the sample is within the sample's level of detail
+				if ( UsingLevelOfDetail )
+				{
+					TqFloat LevelOfDetail = sampleData.detailLevel;
+					if ( LodBounds[ 0 ] > LevelOfDetail || LevelOfDetail >= LodBounds[ 1 ] )
+						continue;
+				}
+
+				CqStats::IncI( CqStats::SPL_bound_hits );
+
+				TqFloat D;
+				CqVector2D uv;
+				if ( pMPG->Sample( hitTestCache, sampleData, D, uv, 0.0f, true ) )
+					StoreSample( pMPG, pie2->get(), index, D, uv );
+			}
+		}
+	}
+}
+
 // this function assumes that either dof or mb or both are being used.
 void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving, bool UsingDof )
 {
@@ -1282,6 +1751,8 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
 			}
 		}
 
+		TqFloat minCocX = 0;
+		TqFloat minCocY = 0;
 		TqFloat maxCocX = 0;
 		TqFloat maxCocY = 0;
 
@@ -1305,6 +1776,11 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
 			const CqVector2D& maxZCoc = QGetRenderContext()->GetCircleOfConfusion( Bound.vecMax().z() );
 			maxCocX = max( minZCoc.x(), maxZCoc.x() );
 			maxCocY = max( minZCoc.y(), maxZCoc.y() );
+			if ( QGetRenderContext()->MinCoCForBound( Bound ) > 0 )
+			{
+				minCocX = min( minZCoc.x(), maxZCoc.x() );
+				minCocY = min( minZCoc.y(), maxZCoc.y() );
+			}
 			bound_maxDof = m_NumDofBounds;
 		}
 		else
@@ -1317,12 +1793,14 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
 			if(UsingDof)
 			{
 				// now shift the bounding box to cover only a given range of
-				// lens positions.
+				// lens positions.  Sample positions move by -coc*offset, so
+				// the extreme shifts come from the extremes of both the CoC
+				// and the lens offsets in the stratum.
 				const CqBound DofBound = DofSubBound( bound_numDof );
-				TqFloat leftOffset = DofBound.vecMax().x() * maxCocX;
-				TqFloat rightOffset = DofBound.vecMin().x() * maxCocX;
-				TqFloat topOffset = DofBound.vecMax().y() * maxCocY;
-				TqFloat bottomOffset = DofBound.vecMin().y() * maxCocY;
+				TqFloat leftOffset = max( DofBound.vecMax().x() * maxCocX, DofBound.vecMax().x() * minCocX );
+				TqFloat rightOffset = min( DofBound.vecMin().x() * maxCocX, DofBound.vecMin().x() * minCocX );
+				TqFloat topOffset = max( DofBound.vecMax().y() * maxCocY, DofBound.vecMax().y() * minCocY );
+				TqFloat bottomOffset = min( DofBound.vecMin().y() * maxCocY, DofBound.vecMin().y() * minCocY );
 
 				bminx = mpgbminx - leftOffset;
 				bmaxx = mpgbmaxx - rightOffset;
@@ -1382,6 +1860,9 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
 
 						index++;
 
+						if ( !sampleData.isActive )
+							continue;
+
 						CqStats::IncI( CqStats::SPL_count );
 
 						if(IsMoving && (time < time0 || time > time1))
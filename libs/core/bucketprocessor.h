@@ -105,6 +105,10 @@ class CqBucketProcessor
 		void	InitialiseFilterValues();
 		void	CalculateDofBounds();
 		void	CombineElements();
+		/** Add samples to the pixels whose base samples vary too much, and
+		 * render the kept micropolygons and culled surfaces at them.
+		 */
+		void	RefineSamples();
 		void	FilterBucket();
 		void	ExposeBucket();
 
@@ -119,6 +123,13 @@ class CqBucketProcessor
 		 */
 		void RenderWaitingMPs();
 		void RenderSurface( boost::shared_ptr<CqSurface>& surface);
+		/** Combine the following surfaces in the bucket with a diceable
+		 * surface where possible, so they are shaded as one grid.
+		 *
+		 * \param surface - the surface about to be diced, replaced by the
+		 *                  combined surface.
+		 */
+		void CoalesceSurfaces( boost::shared_ptr<CqSurface>& surface );
 		void ImageElement( TqInt iXPos, TqInt iYPos, CqImagePixel*& pie ) const;
 		/** Render a particular micropolygon.
 		 *
@@ -126,6 +137,11 @@ class CqBucketProcessor
 		 * \see CqBucket, CqImagePixel
 		 */
 		void	RenderMicroPoly( CqMicroPolygon* pMP );
+		/** Render the micropolygons of a static grid.
+		 *
+		 * \param grid The compact storage for the grid.
+		 */
+		void	RenderMicroQuadGrid( CqMicroQuadGrid& grid );
 		/** This function assumes that either dof or mb or
 		 * both are being used. */
 		void	RenderMPG_MBOrDof( CqMicroPolygon* pMP, bool IsMoving, bool UsingDof );
@@ -133,12 +149,27 @@ class CqBucketProcessor
 		 * being used. It is much simpler than the general
 		 * case dealt with above. */
 		void	RenderMPG_Static( CqMicroPolygon* pMPG);
+		/** Render a moving micropolygon when the samples of the bucket are
+		 * interleaved in time, interpolating it once for each time.
+		 *
+		 * \return false if the micropolygon can't be sampled at fixed times.
+		 */
+		bool	RenderMPG_Interleaved( CqMicroPolygon* pMPG );
+		/** Render a static micropolygon with depth of field, one lens
+		 * stratum at a time.  The micropolygon must be a quad, see
+		 * CqMicroPolygon::IsQuad().
+		 */
+		void	RenderMPG_Dof( CqMicroPolygon* pMPG );
 		void	StoreSample(CqMicroPolygon* pMPG, CqImagePixel* pie2, TqInt index,
 							TqFloat D, const CqVector2D& uv);
 		void	StoreExtraData( CqMicroPolygon* pMPG, TqFloat* hitData);
 		const CqBound& DofSubBound(TqInt index) const;
 
 		void setupCacheInformation();
+		/// Set the steps between the base samples for the current sample counts.
+		void setupAdaptiveSteps();
+		/// Ask the texture cache to load the shadow map tiles this bucket can see.
+		void prefetchShadows();
 
 
 		//--------------------------------------------------
@@ -176,6 +207,22 @@ class CqBucketProcessor
 
 		bool	m_hasValidSamples;
 
+		/// Steps between the base sample strata used by adaptive sampling.
+		TqInt	m_adaptiveXStep;
+		TqInt	m_adaptiveYStep;
+		/// Whether only the base samples are being sampled.
+		bool	m_sampleBase;
+		/// Micropolygons sampled at the base samples, to sample again when refining.
+		std::vector<boost::shared_ptr<CqMicroPolygon> >	m_baseMicroPolygons;
+		std::vector<boost::shared_ptr<CqMicroQuadGrid> >	m_baseMicroQuadGrids;
+		/// Surfaces occlusion culled against the base samples only.
+		std::vector<boost::shared_ptr<CqSurface> >	m_baseCulledSurfaces;
+
+		/** Time of each sample index, shared by all pixels of the bucket when
+		 * sample times are interleaved, otherwise empty.
+		 */
+		std::vector<TqFloat>	m_interleavedTimes;
+
 		CqChannelBuffer	m_channelBuffer;
 
 		boost::array<CqRegion, SqBucketCacheSegment::last> m_cacheRegions;
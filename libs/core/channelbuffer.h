@@ -31,6 +31,7 @@
 
 #include <aqsis/aqsis.h>
 
+#include <algorithm>
 #include <string>
 #include <map>
 #include <vector>
@@ -50,7 +51,9 @@ class CqChannelBuffer : public IqChannelBuffer
 {
 	public:
 		CqChannelBuffer();
-		virtual ~CqChannelBuffer() {}	
+		CqChannelBuffer(const CqChannelBuffer& from);
+		virtual ~CqChannelBuffer();
+		CqChannelBuffer& operator=(const CqChannelBuffer& from);
 
 		void clearChannels();
 		TqInt addChannel(const std::string& name, TqInt size);
@@ -89,11 +92,45 @@ inline void CqChannelBuffer::clearChannels()
 }
 
 inline CqChannelBuffer::CqChannelBuffer()
-: m_elementSize(0),
+: m_width(0),
+  m_height(0),
+  m_elementSize(0),
   m_data(NULL)
 {
 }
 
+inline CqChannelBuffer::CqChannelBuffer(const CqChannelBuffer& from)
+: m_width(0),
+  m_height(0),
+  m_elementSize(0),
+  m_data(NULL)
+{
+	*this = from;
+}
+
+inline CqChannelBuffer::~CqChannelBuffer()
+{
+	clearChannels();
+}
+
+inline CqChannelBuffer& CqChannelBuffer::operator=(const CqChannelBuffer& from)
+{
+	if(this == &from)
+		return *this;
+	clearChannels();
+	m_width = from.m_width;
+	m_height = from.m_height;
+	m_elementSize = from.m_elementSize;
+	m_channels = from.m_channels;
+	if(from.m_data)
+	{
+		TqInt size = m_width*m_height*m_elementSize;
+		m_data = new TqChannelValues[size];
+		std::copy(from.m_data, from.m_data + size, m_data);
+	}
+	return *this;
+}
+
 inline TqInt CqChannelBuffer::addChannel(const std::string& name, TqInt size)
 {
 	if(m_channels.find(name) != m_channels.end())
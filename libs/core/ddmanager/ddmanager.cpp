@@ -139,14 +139,17 @@ TqInt CqDDManager::CloseDisplays()
 	// Now go over any requested displays launching the clients.
 	std::vector< boost::shared_ptr<CqDisplayRequest> >::iterator i;
 	for (i = m_displayRequests.begin(); i!= m_displayRequests.end(); ++i)
+	{
 		(*i)->CloseDisplayLibrary();
+		// Shadow maps and other images written by the displays may be read
+		// as textures by later frames.
+		QGetRenderContext()->textureCache().fileWritten((*i)->name().c_str());
+	}
 	return ( 0 );
 }
 
 TqInt CqDDManager::DisplayBucket( const CqRegion& DRegion, const IqChannelBuffer* pBuffer )
 {
-	static CqRandom random( 61 );
-
 	if ( (pBuffer->width() == 0) || (pBuffer->height() == 0) )
 		return(0);
 	TqInt xmin = DRegion.xMin();
@@ -1021,7 +1024,9 @@ void CqDisplayRequest::DisplayBucket( const CqRegion& DRegion, const IqChannelBu
 
 void CqDisplayRequest::FormatBucketForDisplay( const CqRegion& DRegion, const IqChannelBuffer* pBuffer )
 {
-	static CqRandom random( 61 );
+	// Dither with a stream of its own for each bucket, so that the result
+	// doesn't depend on the order in which buckets are finished.
+	CqRandom random( 61, (DRegion.yMin() << 16) ^ DRegion.xMin() );
 
 	if (m_DataBucket == 0)
 		m_DataBucket = new unsigned char[m_elementSize * static_cast<int>(DRegion.area())];
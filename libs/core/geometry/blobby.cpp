@@ -36,6 +36,9 @@
 #include <list>
 #include <limits>
 
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
 #include <aqsis/util/file.h>
 #include "itexturemap_old.h"
 #include "marchingcubes.h"
@@ -121,32 +124,6 @@ static TqFloat repulsion(TqFloat z, TqFloat A, TqFloat B, TqFloat C, TqFloat D)
 	return (D*bump(z/C)-B/z)*(1.0f-ease(z/A));
 }
 
-/** \fn CqVector3D nearest_segment_point(const CqVector3D& Point, const CqVector3D& S1, const CqVector3D& S2)
-    \brief From a given 3D point, return a segment's closest point.
-    \param Point The point to check the distance from.
-    \param S1 The first end of the segment.
-    \param S2 The second end of the segment.
-    \return One of the points belonging to [S1;S2] segment, the nearest to Point.
- */
-static CqVector3D nearest_segment_point( const CqVector3D& Point, const CqVector3D& S1,
-        const CqVector3D& S2 )
-{
-	const CqVector3D vector = S2 - S1;
-	const CqVector3D w = Point - S1;
-
-	const TqFloat c1 = w * vector;
-	if(c1 <= 0)
-		return S1;
-
-	const TqFloat c2 = vector * vector;
-	if(c2 <= c1)
-		return S2;
-
-	const TqFloat b = c1 / c2;
-	const CqVector3D middlepoint = S1 + b * vector;
-	return middlepoint;
-}
-
 /// Blobby virtual machine assembler
 /** This class takes RiBlobby parameters as input, and returns:
     - a program that computes the associated implicit values
@@ -551,9 +528,61 @@ class blobby_vm_assembler
 //---------------------------------------------------------------------
 /** Constructor.
  */
-CqBlobby::CqBlobby(TqInt nleaf, TqInt ncode, TqInt* code, TqInt nfloats, TqFloat* floats, TqInt nstrings, char** strings) : m_nleaf(nleaf), m_ncode(ncode), m_code(code), m_nfloats(nfloats), m_floats(floats), m_nstrings(nstrings), m_strings(strings)
+CqBlobby::CqBlobby(TqInt nleaf, TqInt ncode, TqInt* code, TqInt nfloats, TqFloat* floats, TqInt nstrings, char** strings) : m_field_is_sum(false), m_nleaf(nleaf), m_ncode(ncode), m_code(code), m_nfloats(nfloats), m_floats(floats), m_nstrings(nstrings), m_strings(strings)
 {
 	blobby_vm_assembler(nleaf, ncode, code, nfloats, floats, nstrings, strings, m_instructions, m_bbox);
+	build_field();
+}
+
+//---------------------------------------------------------------------
+/** Collect the ellipsoids and segments of the program into m_field, in
+ *  program order, and find out whether the program is a plain sum.
+ */
+void CqBlobby::build_field()
+{
+	m_field_is_sum = true;
+	for(unsigned long pc = 0; pc < m_instructions.size(); )
+	{
+		switch(m_instructions[pc++].opcode)
+		{
+				case CONSTANT:
+					m_field.addConstant(m_instructions[pc++].value);
+					break;
+				case ELLIPSOID:
+					m_field.addEllipsoid(m_instructions[pc++].get_matrix());
+					break;
+				case SEGMENT:
+				{
+					const CqMatrix m = m_instructions[pc++].get_matrix();
+					const CqVector3D start = m_instructions[pc++].get_vector();
+					const CqVector3D end = m_instructions[pc++].get_vector();
+					const TqFloat radius = m_instructions[pc++].value;
+					m_field.addSegment(m, start, end, radius);
+				}
+				break;
+				case ADD:
+					pc++;
+					break;
+				case PLANE:
+					pc += 2;
+					m_field_is_sum = false;
+					break;
+				case AIR:
+					pc += 5;
+					m_field_is_sum = false;
+					break;
+				case MULTIPLY:
+				case MIN:
+				case MAX:
+					pc++;
+					m_field_is_sum = false;
+					break;
+				default:
+					m_field_is_sum = false;
+					break;
+		}
+	}
+	m_field.build();
 }
 
 //---------------------------------------------------------------------
@@ -592,9 +621,8 @@ TqFloat CqBlobby::implicit_value( const CqVector3D& Point, TqInt n, std::vector
 {
 	register TqFloat sum = 0.0f;
 	register TqFloat result;
-	std::stack<TqFloat> stack;
 	TqInt int_index = 0;
-	stack.push(0);
+	TqInt field_index = 0;
 
 	register unsigned long pc;
 
@@ -615,8 +643,8 @@ TqFloat CqBlobby::implicit_value( const CqVector3D& Point, TqInt n, std::vector
 
 				case ELLIPSOID:
 				{
-					const TqFloat r2 = (m_instructions[pc++].get_matrix() * Point).Magnitude2();
-					result = r2 <= 1 ? 1 - 3*r2 + 3*r2*r2 - r2*r2*r2 : 0;
+					pc++;
+					result = m_field.primValue(field_index++, Point);
 					sum += result;
 					splits[int_index++] = result;
 				}
@@ -743,20 +771,9 @@ TqFloat CqBlobby::implicit_value( const CqVector3D& Point, TqInt n, std::vector
 
 				case SEGMENT:
 				{
-					const CqMatrix m = m_instructions[pc++].get_matrix();
-					const CqVector3D start = m_instructions[pc++].get_vector();
-					const CqVector3D end = m_instructions[pc++].get_vector();
-					const TqFloat radius = m_instructions[pc++].value;
-
-					// Nearest segment point
-					const CqVector3D segment_point = nearest_segment_point(Point, start, end);
-					// Translation( segment_point ) * Scaling ( radius ) * m
-					const CqMatrix transformation = CqMatrix( segment_point ) * CqMatrix( radius, radius, radius ) * m;
-					// Distance
-					const TqFloat r2 = (transformation.Inverse() * Point).Magnitude2();
-					// Value
-					const TqFloat result = (r2 <= 1) ? (1 - 3*r2 + 3*r2*r2 - r2*r2*r2) : 0;
-
+					// Segment parameters are held by m_field
+					pc += 4;
+					result = m_field.primValue(field_index++, Point);
 					sum += result;
 					splits[int_index++] = result;
 				}
@@ -785,10 +802,14 @@ TqFloat CqBlobby::implicit_value( const CqVector3D& Point, TqInt n, std::vector
  */
 TqFloat CqBlobby::implicit_value( const CqVector3D& Point )
 {
+	if(m_field_is_sum)
+		return m_field.value(Point);
+
 	std::stack<TqFloat> stack;
 	stack.push(0);
 	register TqFloat result;
 	register unsigned long pc;
+	TqInt field_index = 0;
 
 	for(pc = 0; pc < m_instructions.size(); )
 	{
@@ -805,10 +826,8 @@ TqFloat CqBlobby::implicit_value( const CqVector3D& Point )
 
 				case ELLIPSOID:
 				{
-					const TqFloat r2 = (m_instructions[pc++].get_matrix() * Point).Magnitude2();
-					result = r2 <= 1 ? 1 - 3*r2 + 3*r2*r2 - r2*r2*r2 : 0;
-
-					//Aqsis::log() << info << "Ellipsoid: result " << result << std::endl;
+					pc++;
+					result = m_field.primValue(field_index++, Point);
 					stack.push(result);
 				}
 				break;
@@ -909,22 +928,9 @@ TqFloat CqBlobby::implicit_value( const CqVector3D& Point )
 
 				case SEGMENT:
 				{
-					const CqMatrix m = m_instructions[pc++].get_matrix();
-					const CqVector3D start = m_instructions[pc++].get_vector();
-					const CqVector3D end = m_instructions[pc++].get_vector();
-					const TqFloat radius = m_instructions[pc++].value;
-
-					// Nearest segment point
-					const CqVector3D segment_point = nearest_segment_point(Point, start, end);
-					// Translation( segment_point ) * Scaling ( radius ) * m
-					const CqMatrix transformation = CqMatrix( segment_point ) * CqMatrix( radius, radius, radius ) * m;
-					// Distance
-					const TqFloat r2 = (transformation.Inverse() * Point).Magnitude2();
-
-					// Value
-					result = (r2 <= 1) ? (1 - 3*r2 + 3*r2*r2 - r2*r2*r2) : 0;
-
-					//Aqsis::log() << info << "Segment: result " << result << std::endl;
+					// Segment parameters are held by m_field
+					pc += 4;
+					result = m_field.primValue(field_index++, Point);
 					stack.push(result);
 				}
 				break;
@@ -1016,6 +1022,138 @@ TqFloat CqBlobby::implicit_value( const CqVector3D& Point )
 }
 
 
+//---------------------------------------------------------------------
+/** Evaluate the implicit value over a grid of points.  Blocks of the
+ *  polygonization grid are evaluated at once, which lets m_field skip the
+ *  primitives which don't reach the block.
+ */
+void CqBlobby::implicit_values( const CqVector3D& origin, const CqVector3D& step, TqInt nx, TqInt ny, TqInt nz, TqFloat* values )
+{
+	if(m_field_is_sum)
+	{
+		m_field.evaluateGrid(origin, step, nx, ny, nz, values);
+		return;
+	}
+	for(TqInt k = 0; k < nz; ++k)
+	{
+		for(TqInt j = 0; j < ny; ++j)
+		{
+			for(TqInt i = 0; i < nx; ++i)
+			{
+				*values++ = implicit_value(origin
+						+ CqVector3D(i*step.x(), j*step.y(), k*step.z()));
+			}
+		}
+	}
+}
+
+
+namespace {
+
+/// Mesh produced by marching cubes for one block of the polygonization grid.
+struct SqBlockMesh
+{
+	std::vector<Vertex> vertices;
+	std::vector<Triangle> triangles;
+};
+
+/** Polygonizes blocks of a blobby.
+ *
+ * Several of these may run at once in different threads, each taking the
+ * next block to do from a shared counter.
+ */
+class CqBlockPolygonizer
+{
+	public:
+		CqBlockPolygonizer(CqBlobby& blobby, const CqVector3D& start,
+				const CqVector3D& voxelSize, TqInt divX, TqInt divY,
+				std::vector<SqBlockMesh>& meshes, TqInt& nextBlock,
+				boost::mutex& mutex)
+			: m_blobby(&blobby),
+			m_start(start),
+			m_voxelSize(voxelSize),
+			m_divX(divX),
+			m_divY(divY),
+			m_meshes(&meshes),
+			m_nextBlock(&nextBlock),
+			m_mutex(&mutex)
+		{ }
+
+		void operator()()
+		{
+			const TqInt n = OPTIMUM_GRID_SIZE+1;
+			std::vector<TqFloat> values(n*n*n);
+			while(true)
+			{
+				TqInt block = 0;
+				{
+					boost::mutex::scoped_lock lock(*m_mutex);
+					block = (*m_nextBlock)++;
+				}
+				if(block >= static_cast<TqInt>(m_meshes->size()))
+					return;
+				polygonize_block(block, &values[0], (*m_meshes)[block]);
+			}
+		}
+
+	private:
+		void polygonize_block(TqInt block, TqFloat* values, SqBlockMesh& mesh)
+		{
+			const TqInt n = OPTIMUM_GRID_SIZE+1;
+			const TqInt x1 = block % m_divX;
+			const TqInt y1 = (block / m_divX) % m_divY;
+			const TqInt z1 = block / (m_divX * m_divY);
+			const CqVector3D origin = m_start + OPTIMUM_GRID_SIZE * CqVector3D(
+					x1 * m_voxelSize.x(), y1 * m_voxelSize.y(), z1 * m_voxelSize.z());
+
+			m_blobby->implicit_values(origin, m_voxelSize, n, n, n, values);
+
+			// Run Marching Cubes only when the block isn't empty.
+			bool isrequired = false;
+			for(TqInt i = 0; i < n*n*n && !isrequired; ++i)
+				isrequired = (values[i] != 0.0);
+			if (!isrequired)
+				return;
+
+			MarchingCubes mc(n, n, n);
+			mc.init_all();
+			for(TqInt k = 0, which = 0; k < n; ++k)
+			{
+				for(TqInt j = 0; j < n; ++j)
+				{
+					for(TqInt i = 0; i < n; ++i, ++which)
+						mc.set_data( static_cast<TqFloat>( values[which] - 0.421875 ), i, j, k );
+				}
+			}
+			mc.run();
+
+			if ((mc.ntrigs() == 0) || mc.nverts() == 0)
+				return;
+
+			// Compute vertex positions in the blobbies world (they were returned in grid coordinates)
+			mesh.vertices.resize(mc.nverts());
+			for (TqInt i = 0; i < mc.nverts(); i++)
+			{
+				mesh.vertices[i].x = origin.x() + m_voxelSize.x() * mc.vertices()[i].x;
+				mesh.vertices[i].y = origin.y() + m_voxelSize.y() * mc.vertices()[i].y;
+				mesh.vertices[i].z = origin.z() + m_voxelSize.z() * mc.vertices()[i].z;
+			}
+			mesh.triangles.assign(mc.triangles(), mc.triangles() + mc.ntrigs());
+		}
+
+		CqBlobby* m_blobby;
+		CqVector3D m_start;
+		CqVector3D m_voxelSize;
+		TqInt m_divX;
+		TqInt m_divY;
+		std::vector<SqBlockMesh>* m_meshes;
+		TqInt* m_nextBlock;
+		boost::mutex* m_mutex;
+};
+
+} // unnamed namespace
+
+
 /** \fn TqInt polygonize( TqInt& NPoints, TqInt& NPolys, TqInt*& NVertices, TqInt*& Vertices, TqFloat*& Points, TqFloat PixelsWidth, TqFloat PixelsHeight )
     \brief Polygonizes RiBlobby and outputs RiPointsPolygons data.
     \param PixelWidth Blobby's bounding-box width in pixels.
@@ -1025,10 +1163,16 @@ TqFloat CqBlobby::implicit_value( const CqVector3D& Point )
     \param NVertices Polygon vertex counts array.
     \param Vertices Polygons array.
     \param Vertices Point Points array.
+
+    The bounding-box is divided into blocks which are polygonized
+    independently.  When the implicit value only depends on ellipsoids and
+    segments the blocks are shared out between several threads; planes and
+    dynamic blob ops go through the old texture and plugin code, which
+    isn't thread safe.
  */
 TqInt CqBlobby::polygonize( TqInt PixelsWidth, TqInt PixelsHeight, TqInt& NPoints, TqInt& NPolys, TqInt*& NVertices, TqInt*& Vertices, TqFloat*& Points )
 {
-	register TqInt i,j,k;
+	register TqInt i;
 
 	// Make sure the blobby is big enough to show
 	if(PixelsWidth <= 0 || PixelsHeight <= 0)
@@ -1059,129 +1203,65 @@ TqInt CqBlobby::polygonize( TqInt PixelsWidth, TqInt PixelsHeight, TqInt& NPoint
 	const TqInt div_z = z_resolution/OPTIMUM_GRID_SIZE + 1;
 	const TqInt div_y = y_resolution/OPTIMUM_GRID_SIZE + 1;
 	const TqInt div_x = x_resolution/OPTIMUM_GRID_SIZE + 1;
+	const TqInt nblocks = div_x * div_y * div_z;
 
-	int nverts = 0;
-	int ntrigs = 0;
-	Vertex* vertices = 0;
-	Triangle* triangles = 0;
+	Aqsis::log() << info << "We will need to call mc " << nblocks << std::endl;
 
-	Aqsis::log() << info << "We will need to call mc " << div_x  * div_y * div_z << std::endl;
-	TqInt cnt = 1;
-
-	for (TqInt k1=0; k1 < div_z; k1 ++)
+	std::vector<SqBlockMesh> meshes(nblocks);
 	{
-		for (TqInt y1=0; y1 < div_y; y1++)
+		TqInt nextBlock = 0;
+		boost::mutex mutex;
+		CqBlockPolygonizer polygonizer(*this,
+				CqVector3D(x_start, y_start, z_start),
+				CqVector3D(x_voxel_size, y_voxel_size, z_voxel_size),
+				div_x, div_y, meshes, nextBlock, mutex);
+		TqInt nthreads = 1;
+		if(m_field_is_sum)
+			nthreads = min<TqInt>(boost::thread::hardware_concurrency(), nblocks);
+		if(nthreads > 1)
 		{
-			for (TqInt x1=0; x1 < div_x; x1++)
-			{
-
-				TqFloat x,y,z;
-
-				z = z_start + (TqFloat) k1 * (TqFloat) OPTIMUM_GRID_SIZE * z_voxel_size;
-				bool isrequired = false;
-
-				// Initialize Marching Cubes algorithm
-				MarchingCubes mc(OPTIMUM_GRID_SIZE+1, OPTIMUM_GRID_SIZE+1, OPTIMUM_GRID_SIZE+1);
-
-				mc.init_all();
-
-				for( k = 0 ; k < OPTIMUM_GRID_SIZE+1; k++, z += z_voxel_size )
-				{
-					y = y_start + (TqFloat) y1 * (TqFloat)OPTIMUM_GRID_SIZE * y_voxel_size;
-					for( j = 0 ; j < OPTIMUM_GRID_SIZE+1; j++, y += y_voxel_size )
-					{
-
-						x = x_start + (TqFloat) x1 * (TqFloat)OPTIMUM_GRID_SIZE * x_voxel_size;
-						for( i = 0 ; i < OPTIMUM_GRID_SIZE+1; i++, x += x_voxel_size )
-						{
-							const TqFloat iv = implicit_value( CqVector3D( x, y, z ) );
-							isrequired |= (iv != 0.0);
-							//Aqsis::log() << info << iv << std::endl;
-							mc.set_data( static_cast<TqFloat>( iv - 0.421875 ), i, j, k );
-						}
-					}
-				}
-
-				z = z_start + (TqFloat) k1 * (TqFloat)OPTIMUM_GRID_SIZE * z_voxel_size;
-				y = y_start + (TqFloat) y1 * (TqFloat)OPTIMUM_GRID_SIZE * y_voxel_size;
-				x = x_start + (TqFloat) x1 * (TqFloat)OPTIMUM_GRID_SIZE * x_voxel_size;
-
-
-				if (!isrequired)
-				{
-					Aqsis::log() << info << "Don't need to call mc " << cnt++ << std::endl;
-					continue;
-				}
-
-				// Run Marching Cubes
-				// when we are sure it is required.
-
-
-				{
-					// Inform the status class how far we have got, and update UI.
-					float Complete = ( float ) ( cnt++ );
-					Complete /= (div_x  * div_y * div_z);
-					Complete *= 100.0f;
-					Aqsis::log() << info << "Polygonize a blobby " << Complete << "% complete" << std::endl;
-				}
-
-				mc.run() ;
-
-				if ((mc.ntrigs() == 0) || mc.nverts() == 0)
-				{
-					Aqsis::log() << info << "Don't merge the vertices they are empty " << cnt-1 << std::endl;
-					continue;
-				}
-
-				TqInt overts = nverts;
-				if (nverts == 0)
-				{
-					nverts = mc.nverts();
-					vertices = (Vertex*) malloc(nverts * sizeof(Vertex));
-
-				}
-				else
-				{
-					nverts += mc.nverts();
-					vertices = (Vertex*) realloc(vertices, nverts * sizeof(Vertex));
-
-				}
-
-				// Compute vertex positions in the blobbies world (they were returned in grid coordinates)
-				for (TqInt tmp = 0; tmp < mc.nverts(); tmp++)
-				{
-					vertices[overts+tmp].x = x + x_voxel_size * mc.vertices()[tmp].x;
-					vertices[overts+tmp].y = y + y_voxel_size * mc.vertices()[tmp].y;
-					vertices[overts+tmp].z = z + z_voxel_size * mc.vertices()[tmp].z;
-				}
-
-				TqInt otrigs = ntrigs;
-
-				if (ntrigs == 0)
-				{
-					ntrigs = mc.ntrigs();
-					triangles = (Triangle *) malloc(ntrigs * sizeof(Triangle));
-					memcpy(triangles, mc.triangles(), ntrigs * sizeof(Triangle));
-				}
-				else
-				{
-
-					ntrigs += mc.ntrigs();
-					triangles = (Triangle *) realloc(triangles,  ntrigs * sizeof(Triangle));
-					for (TqInt tmp = 0; tmp < mc.ntrigs(); tmp++)
-					{
-						triangles[otrigs+tmp].v1 = mc.triangles()[tmp].v1 + overts;
-						triangles[otrigs+tmp].v2 = mc.triangles()[tmp].v2 + overts;
-						triangles[otrigs+tmp].v3 = mc.triangles()[tmp].v3 + overts;
-					}
-				}
-
-
-
-			}
+			boost::thread_group threads;
+			for(i = 0; i < nthreads; ++i)
+				threads.create_thread(polygonizer);
+			threads.join_all();
 		}
+		else
+			polygonizer();
 	}
 
+	// Merge the blocks in order, so the result doesn't depend on the
+	// threads.
+	TqInt nverts = 0;
+	TqInt ntrigs = 0;
+	TqInt nonempty = 0;
+	for(i = 0; i < nblocks; ++i)
+	{
+		nverts += meshes[i].vertices.size();
+		ntrigs += meshes[i].triangles.size();
+		if(!meshes[i].triangles.empty())
+			++nonempty;
+	}
+	Aqsis::log() << info << "Polygonized " << nonempty << " of " << nblocks << " blocks" << std::endl;
+	std::vector<Vertex> vertices;
+	std::vector<Triangle> triangles;
+	vertices.reserve(nverts);
+	triangles.reserve(ntrigs);
+	for(i = 0; i < nblocks; ++i)
+	{
+		const TqInt overts = vertices.size();
+		vertices.insert(vertices.end(), meshes[i].vertices.begin(), meshes[i].vertices.end());
+		for(TqInt tmp = 0, end = meshes[i].triangles.size(); tmp < end; ++tmp)
+		{
+			Triangle t = meshes[i].triangles[tmp];
+			t.v1 += overts;
+			t.v2 += overts;
+			t.v3 += overts;
+			triangles.push_back(t);
+		}
+		// Free each block as we go to keep the peak memory down.
+		std::vector<Vertex>().swap(meshes[i].vertices);
+		std::vector<Triangle>().swap(meshes[i].triangles);
+	}
 
 	NPoints = nverts;
 	NPolys = ntrigs;
@@ -1209,9 +1289,6 @@ TqInt CqBlobby::polygonize( TqInt PixelsWidth, TqInt PixelsHeight, TqInt& NPoint
 		*point++ = vertices[i].z;
 	}
 
-	free(vertices);
-	free(triangles);
-
 	// Cleanup the DBO i/f
 	if (DBO_handle)
 	{
@@ -1225,7 +1302,7 @@ TqInt CqBlobby::polygonize( TqInt PixelsWidth, TqInt PixelsHeight, TqInt& NPoint
 		DBO.SimpleDLClose(DBO_handle);
 		DBO_handle = NULL;
 	}
-	return div_x * div_y * div_z;
+	return nblocks;
 }
 
 
@@ -34,6 +34,7 @@
 #include <aqsis/aqsis.h>
 #include <aqsis/math/matrix.h>
 #include "surface.h"
+#include "blobbyfield.h"
 #include <aqsis/math/vector4d.h>
 
 #include <aqsis/ri/ri.h>
@@ -92,6 +93,14 @@ class CqBlobby : public CqSurface
 
 		TqFloat implicit_value(const CqVector3D& Point);
 
+		/** Evaluate the implicit value over a grid of points.
+		 *
+		 * values[(k*ny + j)*nx + i] is set to the implicit value at
+		 * origin + (i*step.x(), j*step.y(), k*step.z()).
+		 */
+		void implicit_values(const CqVector3D& origin, const CqVector3D& step,
+				TqInt nx, TqInt ny, TqInt nz, TqFloat* values);
+
 		TqInt polygonize(TqInt PixelsWidth, TqInt PixelsHeight, TqInt& NPoints, TqInt& NPolys, TqInt*& NVertices, TqInt*& Vertices, TqFloat*& Points);
 
 		//! Enumeration of the blobby opcodes
@@ -175,9 +184,19 @@ class CqBlobby : public CqSurface
 		typedef std::vector<instruction> instructions_t;
 
 	private:
+		/// Build m_field from the ellipsoids and segments in the program.
+		void build_field();
+
 		// Program (list of instructions) that computes implicit values
 		instructions_t m_instructions;
 
+		// Accelerated evaluation of the ellipsoids and segments
+		CqBlobbyField m_field;
+		// True if the implicit value is just the sum of m_field, which is
+		// the case when the program adds up ellipsoids, segments and
+		// constants.
+		bool m_field_is_sum;
+
 		// Bounding-box
 		CqBound m_bbox;
 
@@ -0,0 +1,361 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/**
+        \file
+        \brief Implements an accelerated evaluator for the blobby primitive fields.
+*/
+
+#include "blobbyfield.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <aqsis/math/math.h>
+
+namespace Aqsis {
+
+namespace {
+
+/// Maximum number of primitives in a leaf of the hierarchy.
+const TqInt maxLeafPrims = 4;
+
+/// Falloff of the field with squared distance r2 in blob space.
+inline TqFloat falloff(TqFloat r2)
+{
+	// Same as 1 - 3*r2 + 3*r2^2 - r2^3 for r2 <= 1, and zero beyond.
+	TqFloat t = 1 - r2;
+	t = t > 0 ? t : 0;
+	return t*t*t;
+}
+
+inline bool overlaps(const CqBound& a, const CqBound& b)
+{
+	return a.vecMin().x() <= b.vecMax().x() && b.vecMin().x() <= a.vecMax().x()
+		&& a.vecMin().y() <= b.vecMax().y() && b.vecMin().y() <= a.vecMax().y()
+		&& a.vecMin().z() <= b.vecMax().z() && b.vecMin().z() <= a.vecMax().z();
+}
+
+/** Find the range [i0,i1] of grid indices origin + i*step inside [min,max].
+ * \return false if the range is empty.
+ */
+bool indexRange(TqFloat min, TqFloat max, TqFloat origin, TqFloat step,
+		TqInt n, TqInt& i0, TqInt& i1)
+{
+	if(step <= 0)
+	{
+		i0 = 0;
+		i1 = n - 1;
+		return origin >= min && origin <= max;
+	}
+	i0 = static_cast<TqInt>(std::ceil(clamp((min - origin)/step, -1.0f, TqFloat(n))));
+	i1 = static_cast<TqInt>(std::floor(clamp((max - origin)/step, -1.0f, TqFloat(n))));
+	i0 = Aqsis::max(i0, 0);
+	i1 = Aqsis::min(i1, n - 1);
+	return i0 <= i1;
+}
+
+/// Orders primitives by the centre of their bound along one axis.
+struct SqCentreLess
+{
+	const std::vector<CqVector3D>& centres;
+	TqInt axis;
+	SqCentreLess(const std::vector<CqVector3D>& centres, TqInt axis)
+		: centres(centres), axis(axis)
+	{ }
+	bool operator()(TqInt a, TqInt b) const
+	{
+		return centres[a][axis] < centres[b][axis];
+	}
+};
+
+} // unnamed namespace
+
+
+CqBlobbyField::CqBlobbyField()
+	: m_prims(),
+	m_nodes(),
+	m_order(),
+	m_constant(0)
+{ }
+
+void CqBlobbyField::addEllipsoid(const CqMatrix& invTransformation)
+{
+	SqPrim prim;
+	prim.type = Prim_Ellipsoid;
+	prim.bound = CqBound(-1, -1, -1, 1, 1, 1);
+	prim.bound.Transform(invTransformation.Inverse());
+	addPrim(prim, invTransformation);
+}
+
+void CqBlobbyField::addSegment(const CqMatrix& transformation,
+		const CqVector3D& start, const CqVector3D& end, TqFloat radius)
+{
+	SqPrim prim;
+	prim.type = Prim_Segment;
+	CqVector3D direc = end - start;
+	for(TqInt i = 0; i < 3; ++i)
+	{
+		prim.start[i] = start[i];
+		prim.direc[i] = direc[i];
+	}
+	TqFloat length2 = direc*direc;
+	prim.invLength2 = length2 > 0 ? 1/length2 : 0;
+	prim.invRadius = radius != 0 ? 1/radius : 0;
+	// The value is taken relative to the nearest point on the segment, so
+	// the region of influence is the segment swept by the transformed
+	// sphere, scaled by the radius.
+	if(radius != 0)
+	{
+		CqBound sphere(-1, -1, -1, 1, 1, 1);
+		sphere.Transform(transformation);
+		CqVector3D a = radius*sphere.vecMin();
+		CqVector3D b = radius*sphere.vecMax();
+		prim.bound = CqBound(
+			min(start.x(), end.x()) + min(a.x(), b.x()),
+			min(start.y(), end.y()) + min(a.y(), b.y()),
+			min(start.z(), end.z()) + min(a.z(), b.z()),
+			max(start.x(), end.x()) + max(a.x(), b.x()),
+			max(start.y(), end.y()) + max(a.y(), b.y()),
+			max(start.z(), end.z()) + max(a.z(), b.z()));
+	}
+	// else a segment of zero radius has no influence, and the default empty
+	// bound means it's never evaluated.
+	addPrim(prim, transformation.Inverse());
+}
+
+void CqBlobbyField::addConstant(TqFloat value)
+{
+	m_constant += value;
+}
+
+void CqBlobbyField::build()
+{
+	m_nodes.clear();
+	TqInt numPrims = m_prims.size();
+	m_order.resize(numPrims);
+	std::vector<CqVector3D> centres(numPrims);
+	for(TqInt i = 0; i < numPrims; ++i)
+	{
+		m_order[i] = i;
+		centres[i] = (m_prims[i].bound.vecMin() + m_prims[i].bound.vecMax())/2;
+	}
+	if(numPrims > 0)
+		buildNode(0, numPrims, centres);
+}
+
+TqFloat CqBlobbyField::primValue(TqInt prim, const CqVector3D& P) const
+{
+	const SqPrim& p = m_prims[prim];
+	if(!p.bound.Contains3D(P))
+		return 0;
+	TqFloat value = 0;
+	addRow(p, P.x(), 0, 1, P.y(), P.z(), &value);
+	return value;
+}
+
+TqFloat CqBlobbyField::value(const CqVector3D& P) const
+{
+	TqFloat value = m_constant;
+	if(m_nodes.empty())
+		return value;
+	TqInt stack[64];
+	TqInt top = 0;
+	stack[top++] = 0;
+	while(top > 0)
+	{
+		const SqNode& node = m_nodes[stack[--top]];
+		if(!node.bound.Contains3D(P))
+			continue;
+		if(node.count > 0)
+		{
+			for(TqInt i = node.index, end = node.index + node.count; i < end; ++i)
+			{
+				const SqPrim& p = m_prims[m_order[i]];
+				if(p.bound.Contains3D(P))
+					addRow(p, P.x(), 0, 1, P.y(), P.z(), &value);
+			}
+		}
+		else
+		{
+			stack[top++] = &node - &m_nodes[0] + 1;
+			stack[top++] = node.index;
+		}
+	}
+	return value;
+}
+
+void CqBlobbyField::evaluateGrid(const CqVector3D& origin, const CqVector3D& step,
+		TqInt nx, TqInt ny, TqInt nz, TqFloat* values) const
+{
+	std::fill(values, values + nx*ny*nz, m_constant);
+	CqBound gridBox(origin, origin);
+	gridBox.Encapsulate(origin + CqVector3D((nx-1)*step.x(), (ny-1)*step.y(),
+				(nz-1)*step.z()));
+	std::vector<TqInt> prims;
+	overlapping(gridBox, prims);
+	for(TqInt p = 0, pend = prims.size(); p < pend; ++p)
+	{
+		const SqPrim& prim = m_prims[prims[p]];
+		const CqBound& b = prim.bound;
+		TqInt i0, i1, j0, j1, k0, k1;
+		if(!indexRange(b.vecMin().x(), b.vecMax().x(), origin.x(), step.x(), nx, i0, i1)
+			|| !indexRange(b.vecMin().y(), b.vecMax().y(), origin.y(), step.y(), ny, j0, j1)
+			|| !indexRange(b.vecMin().z(), b.vecMax().z(), origin.z(), step.z(), nz, k0, k1))
+			continue;
+		TqFloat x0 = origin.x() + i0*step.x();
+		for(TqInt k = k0; k <= k1; ++k)
+		{
+			TqFloat z = origin.z() + k*step.z();
+			for(TqInt j = j0; j <= j1; ++j)
+			{
+				TqFloat y = origin.y() + j*step.y();
+				addRow(prim, x0, step.x(), i1 - i0 + 1, y, z,
+						values + (k*ny + j)*nx + i0);
+			}
+		}
+	}
+}
+
+void CqBlobbyField::overlapping(const CqBound& box, std::vector<TqInt>& prims) const
+{
+	prims.clear();
+	if(m_nodes.empty())
+		return;
+	TqInt stack[64];
+	TqInt top = 0;
+	stack[top++] = 0;
+	while(top > 0)
+	{
+		const SqNode& node = m_nodes[stack[--top]];
+		if(!overlaps(node.bound, box))
+			continue;
+		if(node.count > 0)
+		{
+			for(TqInt i = node.index, end = node.index + node.count; i < end; ++i)
+			{
+				if(overlaps(m_prims[m_order[i]].bound, box))
+					prims.push_back(m_order[i]);
+			}
+		}
+		else
+		{
+			stack[top++] = &node - &m_nodes[0] + 1;
+			stack[top++] = node.index;
+		}
+	}
+	// Sum the primitives in the order they were added, so that the result
+	// doesn't depend on the shape of the hierarchy.
+	std::sort(prims.begin(), prims.end());
+}
+
+void CqBlobbyField::addPrim(SqPrim& prim, const CqMatrix& invTrans)
+{
+	for(TqInt i = 0; i < 3; ++i)
+	{
+		for(TqInt j = 0; j < 4; ++j)
+			prim.invTrans[4*i + j] = invTrans[j][i];
+	}
+	m_prims.push_back(prim);
+}
+
+TqInt CqBlobbyField::buildNode(TqInt begin, TqInt end,
+		const std::vector<CqVector3D>& centres)
+{
+	TqInt nodeIndex = m_nodes.size();
+	m_nodes.push_back(SqNode());
+	CqBound bound;
+	CqBound centreBound;
+	for(TqInt i = begin; i < end; ++i)
+	{
+		bound.Encapsulate(&m_prims[m_order[i]].bound);
+		centreBound.Encapsulate(centres[m_order[i]]);
+	}
+	m_nodes[nodeIndex].bound = bound;
+	if(end - begin <= maxLeafPrims)
+	{
+		m_nodes[nodeIndex].index = begin;
+		m_nodes[nodeIndex].count = end - begin;
+		return nodeIndex;
+	}
+	// Split at the median centre along the longest axis.
+	CqVector3D extent = centreBound.vecCross();
+	TqInt axis = 0;
+	if(extent.y() > extent[axis])
+		axis = 1;
+	if(extent.z() > extent[axis])
+		axis = 2;
+	TqInt mid = (begin + end)/2;
+	std::nth_element(m_order.begin() + begin, m_order.begin() + mid,
+			m_order.begin() + end, SqCentreLess(centres, axis));
+	m_nodes[nodeIndex].count = 0;
+	buildNode(begin, mid, centres);
+	// Building the children reallocates m_nodes.
+	TqInt second = buildNode(mid, end, centres);
+	m_nodes[nodeIndex].index = second;
+	return nodeIndex;
+}
+
+void CqBlobbyField::addRow(const SqPrim& prim, TqFloat x0, TqFloat dx, TqInt n,
+		TqFloat y, TqFloat z, TqFloat* values) const
+{
+	const TqFloat* m = prim.invTrans;
+	if(prim.type == Prim_Ellipsoid)
+	{
+		// Transform the start of the row, then step along it.
+		TqFloat qx0 = m[0]*x0 + m[1]*y + m[2]*z + m[3];
+		TqFloat qy0 = m[4]*x0 + m[5]*y + m[6]*z + m[7];
+		TqFloat qz0 = m[8]*x0 + m[9]*y + m[10]*z + m[11];
+		TqFloat dqx = m[0]*dx;
+		TqFloat dqy = m[4]*dx;
+		TqFloat dqz = m[8]*dx;
+		for(TqInt i = 0; i < n; ++i)
+		{
+			TqFloat qx = qx0 + i*dqx;
+			TqFloat qy = qy0 + i*dqy;
+			TqFloat qz = qz0 + i*dqz;
+			values[i] += falloff(qx*qx + qy*qy + qz*qz);
+		}
+	}
+	else
+	{
+		const TqFloat* s = prim.start;
+		const TqFloat* d = prim.direc;
+		TqFloat wy = y - s[1];
+		TqFloat wz = z - s[2];
+		TqFloat c1yz = wy*d[1] + wz*d[2];
+		TqFloat invR = prim.invRadius;
+		for(TqInt i = 0; i < n; ++i)
+		{
+			TqFloat wx = x0 + i*dx - s[0];
+			// Parameter of the nearest point on the segment.
+			TqFloat t = (wx*d[0] + c1yz)*prim.invLength2;
+			t = t < 0 ? 0 : (t > 1 ? 1 : t);
+			TqFloat px = (wx - t*d[0])*invR;
+			TqFloat py = (wy - t*d[1])*invR;
+			TqFloat pz = (wz - t*d[2])*invR;
+			TqFloat qx = m[0]*px + m[1]*py + m[2]*pz + m[3];
+			TqFloat qy = m[4]*px + m[5]*py + m[6]*pz + m[7];
+			TqFloat qz = m[8]*px + m[9]*py + m[10]*pz + m[11];
+			values[i] += falloff(qx*qx + qy*qy + qz*qz);
+		}
+	}
+}
+
+} // namespace Aqsis
@@ -0,0 +1,149 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/**
+        \file
+        \brief Declares an accelerated evaluator for the blobby primitive fields.
+*/
+
+#ifndef BLOBBYFIELD_H_INCLUDED
+#define BLOBBYFIELD_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <vector>
+
+#include <aqsis/math/matrix.h>
+#include <aqsis/math/vector3d.h>
+#include "bound.h"
+
+namespace Aqsis {
+
+/** \brief Field values of the ellipsoid and segment primitives of a blobby.
+ *
+ * Each primitive only influences points inside a bounded region, so the
+ * primitives are held in a bounding volume hierarchy and only those whose
+ * region contains a point are evaluated there.  Whole grids of points can
+ * also be evaluated at once, which is what the polygonisers need: the
+ * hierarchy is then searched once for the grid, and each primitive is
+ * evaluated over the rows of the grid it overlaps with loops simple enough
+ * for the compiler to vectorise.
+ *
+ * Primitives are numbered in the order they are added.
+ */
+class CqBlobbyField
+{
+	public:
+		CqBlobbyField();
+
+		/** Add an ellipsoid primitive.
+		 * \param invTransformation - takes the ellipsoid to the unit sphere.
+		 */
+		void addEllipsoid(const CqMatrix& invTransformation);
+		/** Add a segment primitive.
+		 * \param transformation - transformation applied to the sphere swept
+		 *                         along the segment.
+		 * \param start, end - end points of the segment.
+		 * \param radius - radius of the segment.
+		 *
+		 * All transformations are assumed to be affine.
+		 */
+		void addSegment(const CqMatrix& transformation, const CqVector3D& start,
+				const CqVector3D& end, TqFloat radius);
+		/// Add a constant to the sum of all primitives.
+		void addConstant(TqFloat value);
+		/// Build the bounding volume hierarchy after all primitives are added.
+		void build();
+
+		/// Number of primitives.
+		TqInt size() const;
+		/// Region in which a primitive is nonzero.
+		const CqBound& bound(TqInt prim) const;
+		/// Value of a single primitive.
+		TqFloat primValue(TqInt prim, const CqVector3D& P) const;
+		/// Sum of all primitives and constants.
+		TqFloat value(const CqVector3D& P) const;
+		/** Evaluate the sum of all primitives and constants over a grid.
+		 *
+		 * values[(k*ny + j)*nx + i] is set to the value at
+		 * origin + (i*step.x(), j*step.y(), k*step.z()).
+		 */
+		void evaluateGrid(const CqVector3D& origin, const CqVector3D& step,
+				TqInt nx, TqInt ny, TqInt nz, TqFloat* values) const;
+		/// Get the primitives whose region overlaps the given box.
+		void overlapping(const CqBound& box, std::vector<TqInt>& prims) const;
+
+	private:
+		enum EqPrimType
+		{
+			Prim_Ellipsoid,
+			Prim_Segment
+		};
+		/// Primitive data, with the matrices reduced to the rows needed.
+		struct SqPrim
+		{
+			EqPrimType type;
+			/// Inverse transformation, as rows of a 3x4 matrix.
+			TqFloat invTrans[12];
+			/// Segment start, direction, 1/length^2 and 1/radius.
+			TqFloat start[3];
+			TqFloat direc[3];
+			TqFloat invLength2;
+			TqFloat invRadius;
+			CqBound bound;
+		};
+		/// Node of the hierarchy; leaves have count > 0.
+		struct SqNode
+		{
+			CqBound bound;
+			/// Index of the second child, or of the first primitive in m_order.
+			TqInt index;
+			TqInt count;
+		};
+
+		void addPrim(SqPrim& prim, const CqMatrix& invTrans);
+		TqInt buildNode(TqInt begin, TqInt end,
+				const std::vector<CqVector3D>& centres);
+		void addRow(const SqPrim& prim, TqFloat x0, TqFloat dx, TqInt n,
+				TqFloat y, TqFloat z, TqFloat* values) const;
+
+		std::vector<SqPrim> m_prims;
+		std::vector<SqNode> m_nodes;
+		std::vector<TqInt> m_order;
+		TqFloat m_constant;
+};
+
+
+//==============================================================================
+// Implementation details
+//==============================================================================
+
+inline TqInt CqBlobbyField::size() const
+{
+	return m_prims.size();
+}
+
+inline const CqBound& CqBlobbyField::bound(TqInt prim) const
+{
+	return m_prims[prim].bound;
+}
+
+} // namespace Aqsis
+
+#endif // BLOBBYFIELD_H_INCLUDED
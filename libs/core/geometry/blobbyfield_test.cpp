@@ -0,0 +1,202 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file Unit tests for the accelerated blobby field evaluation.
+ */
+
+#include "blobbyfield.h"
+
+#include <cmath>
+#include <ctime>
+#include <vector>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+
+BOOST_AUTO_TEST_SUITE(blobbyfield_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+// Straightforward evaluation of the primitives, as the blobby virtual
+// machine used to do it.
+TqFloat falloff(TqFloat r2)
+{
+	return r2 <= 1 ? 1 - 3*r2 + 3*r2*r2 - r2*r2*r2 : 0;
+}
+
+TqFloat ellipsoidValue(const CqMatrix& invTrans, const CqVector3D& P)
+{
+	return falloff((invTrans*P).Magnitude2());
+}
+
+TqFloat segmentValue(const CqMatrix& trans, const CqVector3D& start,
+		const CqVector3D& end, TqFloat radius, const CqVector3D& P)
+{
+	CqVector3D direc = end - start;
+	TqFloat c1 = (P - start)*direc;
+	TqFloat c2 = direc*direc;
+	CqVector3D nearest = c1 <= 0 ? start : (c2 <= c1 ? end : start + (c1/c2)*direc);
+	CqMatrix m = CqMatrix(nearest) * CqMatrix(radius, radius, radius) * trans;
+	return falloff((m.Inverse()*P).Magnitude2());
+}
+
+struct SqTestScene
+{
+	std::vector<CqMatrix> ellipsoids;
+	std::vector<CqMatrix> segTrans;
+	std::vector<CqVector3D> segStart;
+	std::vector<CqVector3D> segEnd;
+	std::vector<TqFloat> segRadius;
+	CqBlobbyField field;
+
+	// A row of ellipsoids and a spiral of segments, like the example scenes.
+	SqTestScene(TqInt n)
+	{
+		for(TqInt i = 0; i < n; ++i)
+		{
+			CqMatrix m = CqMatrix(CqVector3D(0.3f*i, 0.1f*(i%3), 0))
+				* CqMatrix(0.4f, 0.25f + 0.05f*(i%4), 0.3f);
+			ellipsoids.push_back(m.Inverse());
+			field.addEllipsoid(m.Inverse());
+
+			TqFloat a = 0.4f*i;
+			segTrans.push_back(CqMatrix(1, 0.5f, 1));
+			segStart.push_back(CqVector3D(std::cos(a), std::sin(a), 0.1f*i));
+			segEnd.push_back(CqVector3D(std::cos(a+0.4f), std::sin(a+0.4f), 0.1f*i+0.1f));
+			segRadius.push_back(0.2f);
+			field.addSegment(segTrans.back(), segStart.back(), segEnd.back(),
+					segRadius.back());
+		}
+		field.build();
+	}
+
+	TqFloat reference(const CqVector3D& P) const
+	{
+		TqFloat sum = 0;
+		for(TqInt i = 0, n = ellipsoids.size(); i < n; ++i)
+		{
+			sum += ellipsoidValue(ellipsoids[i], P);
+			sum += segmentValue(segTrans[i], segStart[i], segEnd[i], segRadius[i], P);
+		}
+		return sum;
+	}
+};
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(blobbyfield_point_test)
+{
+	SqTestScene scene(20);
+	TqInt nonzero = 0;
+	for(TqInt i = 0; i < 1000; ++i)
+	{
+		// Points along the row of ellipsoids, and around the spiral.
+		CqVector3D P = (i % 2 == 0)
+			? CqVector3D(-0.5f + 0.0065f*i, 0.1f*std::sin(0.1f*i), 0.1f*std::cos(0.07f*i))
+			: CqVector3D(1.1f*std::cos(0.01f*i), 1.1f*std::sin(0.01f*i), 0.002f*i);
+		TqFloat ref = scene.reference(P);
+		BOOST_CHECK_SMALL(scene.field.value(P) - ref, 1e-4f);
+		if(ref != 0)
+			++nonzero;
+	}
+	BOOST_CHECK(nonzero > 100);
+
+	// Individual primitive values are zero outside their bounds.
+	CqVector3D P(0.2f, 0.05f, 0);
+	BOOST_CHECK_SMALL(scene.field.primValue(0, P)
+			- ellipsoidValue(scene.ellipsoids[0], P), 1e-5f);
+	BOOST_CHECK_EQUAL(scene.field.primValue(0, CqVector3D(100, 0, 0)), 0);
+}
+
+BOOST_AUTO_TEST_CASE(blobbyfield_grid_test)
+{
+	SqTestScene scene(20);
+	scene.field.addConstant(0.5f);
+	const TqInt n = 16;
+	CqVector3D origin(-1.5f, -1.5f, -0.5f);
+	CqVector3D step(0.2f, 0.19f, 0.17f);
+	std::vector<TqFloat> values(n*n*n);
+	scene.field.evaluateGrid(origin, step, n, n, n, &values[0]);
+	for(TqInt k = 0; k < n; ++k)
+	{
+		for(TqInt j = 0; j < n; ++j)
+		{
+			for(TqInt i = 0; i < n; ++i)
+			{
+				CqVector3D P = origin + CqVector3D(i*step.x(), j*step.y(), k*step.z());
+				BOOST_CHECK_SMALL(values[(k*n + j)*n + i] - 0.5f
+						- scene.reference(P), 1e-4f);
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(blobbyfield_overlapping_test)
+{
+	SqTestScene scene(50);
+	std::vector<TqInt> prims;
+	CqBound box(-0.1f, -0.1f, -0.1f, 0.1f, 0.1f, 0.1f);
+	scene.field.overlapping(box, prims);
+	// Check against a brute force search.
+	std::vector<TqInt> expected;
+	for(TqInt i = 0; i < scene.field.size(); ++i)
+	{
+		const CqBound& b = scene.field.bound(i);
+		if(b.vecMin().x() <= 0.1f && b.vecMax().x() >= -0.1f
+			&& b.vecMin().y() <= 0.1f && b.vecMax().y() >= -0.1f
+			&& b.vecMin().z() <= 0.1f && b.vecMax().z() >= -0.1f)
+			expected.push_back(i);
+	}
+	BOOST_CHECK(!expected.empty());
+	BOOST_CHECK(prims == expected);
+}
+
+BOOST_AUTO_TEST_CASE(blobbyfield_evaluation_rate_test)
+{
+	// Micro-benchmark of the field evaluation, reported in the test log.
+	SqTestScene scene(200);
+	const TqInt n = 16;
+	CqVector3D origin(-1.5f, -1.5f, 0);
+	CqVector3D step(3.0f/n, 3.0f/n, 20.0f/n);
+	std::vector<TqFloat> values(n*n*n);
+
+	std::clock_t start = std::clock();
+	TqFloat refSum = 0;
+	for(TqInt k = 0; k < n; ++k)
+		for(TqInt j = 0; j < n; ++j)
+			for(TqInt i = 0; i < n; ++i)
+				refSum += scene.reference(origin + CqVector3D(i*step.x(), j*step.y(), k*step.z()));
+	TqFloat refTime = TqFloat(std::clock() - start)/CLOCKS_PER_SEC;
+
+	start = std::clock();
+	scene.field.evaluateGrid(origin, step, n, n, n, &values[0]);
+	TqFloat gridTime = TqFloat(std::clock() - start)/CLOCKS_PER_SEC;
+	TqFloat gridSum = 0;
+	for(TqInt i = 0; i < n*n*n; ++i)
+		gridSum += values[i];
+
+	BOOST_CHECK_CLOSE(gridSum, refSum, 0.01f);
+	BOOST_TEST_MESSAGE("blobby field, " << n*n*n << " points, 400 primitives: "
+			<< refTime << "s point by point, " << gridTime << "s as a grid");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -25,8 +25,11 @@
 */
 
 #include <aqsis/aqsis.h>
+#include <aqsis/math/math.h>
 #include <aqsis/math/vector3d.h>
 #include "curves.h"
+#include "micropolygon.h"
+#include "renderer.h"
 namespace Aqsis {
 
 
@@ -222,6 +225,12 @@ void CqCurve::PopulateWidth()
 
 bool CqCurve::Diceable(const CqMatrix& matCtoR)
 {
+	// Curves with user supplied normals have a fixed orientation, so they
+	// can't be turned to face the camera.  They, and curves crossing the eye
+	// plane, are still split into patches or subcurves as below.
+	if( m_fDiceable && N() == NULL )
+		return RibbonDiceable( matCtoR );
+
 	// OK, here the CqCubicCurveSegment line has two options:
 	//  1. split into two more lines
 	//  2. turn into a bilinear patch for rendering
@@ -297,6 +306,281 @@ bool CqCurve::GetNormal( TqInt index, CqVector3D& normal ) const
 	}
 }
 
+/**
+ * Decides whether a curve segment can be diced directly as a ribbon.
+ *
+ * The ribbon is diced along the length of the segment at the shading rate,
+ * and across it only as many times as its raster width requires, which for
+ * hair is usually once.  Segments too long for a single grid are split into
+ * subcurves, and those too wide into patches.
+ *
+ * @param matCtoR       Transformation to dicing coordinates.
+ *
+ * @return true if the segment should be diced with its current dice sizes.
+ */
+bool CqCurve::RibbonDiceable(const CqMatrix& matCtoR)
+{
+	// Length of the control hull in raster space.
+	TqInt nHull = cVertex();
+	CqVector3D hull0 = vectorCast<CqVector3D>(matCtoR * P()->pValue( 0 )[0]);
+	CqVector3D prev = hull0;
+	TqFloat vLen = 0;
+	for ( TqInt i = 1; i < nHull; i++ )
+	{
+		CqVector3D next = vectorCast<CqVector3D>(matCtoR * P()->pValue( i )[0]);
+		vLen += ( next - prev ).Magnitude();
+		prev = next;
+	}
+
+	// Raster width at the start of the curve, taking the wider end.
+	TqFloat maxWidth = max( width()->pValue( 0 )[0],
+			width()->pValue( width()->Size() - 1 )[0] );
+	CqVector3D P0 = vectorCast<CqVector3D>(P()->pValue( 0 )[0]);
+	TqFloat uLen = ( matCtoR * ( P0 + CqVector3D( maxWidth, 0, 0 ) ) - hull0 ).Magnitude();
+
+	TqFloat shadingLength = sqrt( AdjustedShadingRate() );
+	uLen /= shadingLength;
+	vLen /= shadingLength;
+
+	if ( uLen < FLT_EPSILON && vLen < FLT_EPSILON )
+	{
+		m_fDiscard = true;
+		return ( false );
+	}
+
+	m_uDiceSize = max<TqInt>( lround( uLen ), 1 );
+	m_vDiceSize = max<TqInt>( lround( vLen ), 1 );
+
+	// Ensure power of 2 to avoid cracking
+	const TqInt *binary = pAttributes() ->GetIntegerAttribute( "dice", "binary" );
+	if ( binary && *binary )
+	{
+		m_uDiceSize = ceilPow2( m_uDiceSize );
+		m_vDiceSize = ceilPow2( m_vDiceSize );
+	}
+
+	TqFloat gs = 16.0f;
+	const TqFloat* poptGridSize = QGetRenderContext() ->poptCurrent()->GetFloatOption( "System", "SqrtGridSize" );
+	if( NULL != poptGridSize )
+		gs = poptGridSize[0];
+
+	if ( m_uDiceSize > gs )
+	{
+		m_splitDecision = Split_Patch;
+		return ( false );
+	}
+	if ( m_uDiceSize * m_vDiceSize > gs * gs )
+	{
+		m_splitDecision = Split_Curve;
+		return ( false );
+	}
+
+	STATS_INC( GEO_crv_ribbon );
+	return ( true );
+}
+
+/**
+ * Evaluates the centreline of a curve segment.
+ *
+ * Linear segments have two vertices, cubic segments four vertices already
+ * converted to the bezier basis.
+ *
+ * @param v             Parameter along the segment, between 0 and 1.
+ * @param P             Returns the position.
+ * @param dPdv          Returns the tangent.
+ */
+void CqCurve::EvaluateCentreline( TqFloat v, CqVector3D& P, CqVector3D& dPdv ) const
+{
+	if ( cVertex() == 4 )
+	{
+		CqVector3D p0 = vectorCast<CqVector3D>(this->P()->pValue( 0 )[0]);
+		CqVector3D p1 = vectorCast<CqVector3D>(this->P()->pValue( 1 )[0]);
+		CqVector3D p2 = vectorCast<CqVector3D>(this->P()->pValue( 2 )[0]);
+		CqVector3D p3 = vectorCast<CqVector3D>(this->P()->pValue( 3 )[0]);
+		TqFloat w = 1 - v;
+		P = w*w*w*p0 + 3*w*w*v*p1 + 3*w*v*v*p2 + v*v*v*p3;
+		dPdv = w*w*( p1 - p0 ) + 2*w*v*( p2 - p1 ) + v*v*( p3 - p2 );
+		// Repeated control points give a zero tangent at the ends.
+		if ( dPdv.Magnitude2() < 1e-12f * ( p3 - p0 ).Magnitude2() )
+			dPdv = p3 - p0;
+	}
+	else
+	{
+		CqVector3D p0 = vectorCast<CqVector3D>(this->P()->pValue( 0 )[0]);
+		CqVector3D p1 = vectorCast<CqVector3D>(this->P()->pValue( 1 )[0]);
+		P = ( 1 - v ) * p0 + v * p1;
+		dPdv = p1 - p0;
+	}
+}
+
+/**
+ * Expands the varying parameters to the four corners of the ribbon, so that
+ * the standard bilinear dicing of varying parameters applies to them.
+ */
+void CqCurve::PreDice( TqInt uDiceSize, TqInt vDiceSize )
+{
+	std::vector<CqParameter*>::iterator iUP;
+	for ( iUP = m_aUserParams.begin(); iUP != m_aUserParams.end(); iUP++ )
+	{
+		if ( ( *iUP ) ->Class() == class_varying && ( *iUP ) ->Size() == 2 )
+		{
+			( *iUP ) ->SetSize( 4 );
+			( *iUP ) ->SetValue( ( *iUP ), 3, 1 );
+			( *iUP ) ->SetValue( ( *iUP ), 2, 1 );
+			( *iUP ) ->SetValue( ( *iUP ), 1, 0 );
+		}
+	}
+}
+
+/**
+ * Dices P, u, v, s and t for a ribbon.
+ *
+ * The width of the ribbon is oriented perpendicular to both the tangent and
+ * the direction to the camera, computed for each row of the grid rather than
+ * once for the segment as the patch conversion does.
+ */
+TqInt CqCurve::DiceAll( CqMicroPolyGrid* pGrid )
+{
+	TqInt lUses = Uses();
+	TqInt lDone = 0;
+
+	CqVector3D facing;
+	GetNormal( 0, facing );
+	// Without an RiProjection the camera is orthographic.
+	const TqInt* projection = QGetRenderContext()->GetIntegerOption( "System", "Projection" );
+	bool perspective = projection && projection[0] == ProjectionPerspective;
+
+	TqFloat w0 = width()->pValue( 0 )[0];
+	TqFloat w1 = width()->pValue( width()->Size() - 1 )[0];
+	TqFloat v0 = 0;
+	TqFloat v1 = 1;
+	if ( v() != NULL )
+	{
+		v0 = v()->pValue( 0 )[0];
+		v1 = v()->pValue( v()->Size() - 1 )[0];
+	}
+
+	IqShaderData* pu = USES( lUses, EnvVars_u ) ? pGrid->pVar(EnvVars_u) : NULL;
+	IqShaderData* pv = USES( lUses, EnvVars_v ) ? pGrid->pVar(EnvVars_v) : NULL;
+	// As for the patches, s and t default to u and v.
+	bool userst = bHasVar(EnvVars_s) || bHasVar(EnvVars_t) || FindUserParam( "st" ) != NULL;
+	IqShaderData* ps = !userst && USES( lUses, EnvVars_s ) ? pGrid->pVar(EnvVars_s) : NULL;
+	IqShaderData* pt = !userst && USES( lUses, EnvVars_t ) ? pGrid->pVar(EnvVars_t) : NULL;
+
+	CqVector3D* pointGrid = 0;
+	pGrid->pVar(EnvVars_P)->GetPointPtr( pointGrid );
+	DONE( lDone, EnvVars_P );
+
+	TqInt uSize = uDiceSize();
+	TqInt vSize = vDiceSize();
+	CqVector3D lastOffset( 1, 0, 0 );
+	for ( TqInt iv = 0; iv <= vSize; iv++ )
+	{
+		TqFloat vf = TqFloat( iv ) / vSize;
+		CqVector3D centre, tangent;
+		EvaluateCentreline( vf, centre, tangent );
+		CqVector3D toCamera = perspective ? centre * facing.z() : facing;
+		CqVector3D offset = toCamera % tangent;
+		// A curve pointing straight at the camera has no preferred
+		// direction; keep the one from the previous row.
+		if ( offset.Magnitude2() > 0 )
+			lastOffset = offset.Unit();
+		offset = lastOffset * ( ( ( 1 - vf ) * w0 + vf * w1 ) / 2 );
+		TqFloat vParam = ( 1 - vf ) * v0 + vf * v1;
+		for ( TqInt iu = 0; iu <= uSize; iu++ )
+		{
+			TqFloat uf = TqFloat( iu ) / uSize;
+			TqInt igrid = iv * ( uSize + 1 ) + iu;
+			pointGrid[igrid] = centre + offset * ( 1 - 2 * uf );
+			if ( pu )
+				pu->SetFloat( uf, igrid );
+			if ( pv )
+				pv->SetFloat( vParam, igrid );
+			if ( ps )
+				ps->SetFloat( uf, igrid );
+			if ( pt )
+				pt->SetFloat( vParam, igrid );
+		}
+	}
+	if ( pu )
+		DONE( lDone, EnvVars_u );
+	if ( pv )
+		DONE( lDone, EnvVars_v );
+	if ( ps )
+		DONE( lDone, EnvVars_s );
+	if ( pt )
+		DONE( lDone, EnvVars_t );
+
+	return ( lDone );
+}
+
+namespace {
+
+/** \brief Implementation of dicing for vertex class parameters on curves
+ *
+ * Values are evaluated along the curve, with the bezier basis for cubic
+ * segments, and are constant across the width of the ribbon.
+ */
+template <class T, class SLT>
+void curveNaturalDice( CqParameter* pParam, TqInt uDiceSize, TqInt vDiceSize,
+		IqShaderData* pData )
+{
+	CqParameterTyped<T, SLT>* pTParam = static_cast<CqParameterTyped<T, SLT>*>( pParam );
+	bool cubic = pTParam->Size() == 4;
+	for ( TqInt j = 0, arraySize = pTParam->Count(); j < arraySize; j++ )
+	{
+		SLT* dest = 0;
+		pData->ArrayEntry( j )->GetValuePtr( dest );
+		for ( TqInt iv = 0; iv <= vDiceSize; iv++ )
+		{
+			TqFloat v = TqFloat( iv ) / vDiceSize;
+			TqFloat w = 1 - v;
+			T value;
+			if ( cubic )
+				value = static_cast<T>( pTParam->pValue( 0 )[j] * ( w*w*w )
+						+ pTParam->pValue( 1 )[j] * ( 3*w*w*v )
+						+ pTParam->pValue( 2 )[j] * ( 3*w*v*v )
+						+ pTParam->pValue( 3 )[j] * ( v*v*v ) );
+			else
+				value = static_cast<T>( pTParam->pValue( 0 )[j] * w
+						+ pTParam->pValue( 1 )[j] * v );
+			for ( TqInt iu = 0; iu <= uDiceSize; iu++ )
+				*dest++ = paramToShaderType<SLT, T>( value );
+		}
+	}
+}
+
+} // unnamed namespace
+
+void CqCurve::NaturalDice( CqParameter* pParam, TqInt uDiceSize, TqInt vDiceSize,
+		IqShaderData* pData )
+{
+	switch ( pParam->Type() )
+	{
+		case type_float:
+			curveNaturalDice<TqFloat, TqFloat>( pParam, uDiceSize, vDiceSize, pData );
+			break;
+		case type_integer:
+			curveNaturalDice<TqInt, TqFloat>( pParam, uDiceSize, vDiceSize, pData );
+			break;
+		case type_point:
+		case type_vector:
+		case type_normal:
+			curveNaturalDice<CqVector3D, CqVector3D>( pParam, uDiceSize, vDiceSize, pData );
+			break;
+		case type_hpoint:
+			curveNaturalDice<CqVector4D, CqVector3D>( pParam, uDiceSize, vDiceSize, pData );
+			break;
+		case type_color:
+			curveNaturalDice<CqColor, CqColor>( pParam, uDiceSize, vDiceSize, pData );
+			break;
+		default:
+			// Strings and matrices aren't interpolated along curves, as
+			// in NaturalSubdivide().
+			break;
+	}
+}
+
 /**
  * Sets the default primitive variables.
  *
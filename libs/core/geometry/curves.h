@@ -50,6 +50,14 @@ class CqCurve : public CqSurface
 		virtual void AddPrimitiveVariable( CqParameter* pParam );
 		virtual	void Bound(CqBound* bound) const;
 		virtual void SetDefaultPrimitiveVariables( bool bUseDef_st = true );
+		/** The width is scaled by Transform(), and PreDice() expands the
+		 * varying variables in place, so neither can be shared.
+		 */
+		virtual bool fShareableParameter( const CqParameter* pParam ) const
+		{
+			return ( pParam->Class() != class_varying && pParam->strName() != "width"
+					 && CqSurface::fShareableParameter( pParam ) );
+		}
 #ifdef _DEBUG
 
 		CqString className() const
@@ -61,6 +69,8 @@ class CqCurve : public CqSurface
 	protected:
 		TqFloat GetGridLength() const;
 		void PopulateWidth();
+		bool RibbonDiceable(const CqMatrix& matCtoR);
+		void EvaluateCentreline( TqFloat v, CqVector3D& P, CqVector3D& dPdv ) const;
 		//---------------------------------------------- Inlined Public Methods
 	public:
 		/** Returns a const reference to the "constantwidth" parameter, or
@@ -84,10 +94,16 @@ class CqCurve : public CqSurface
 		}
 		/** \brief Returns whether the curve is diceable
 		 *
-		 * At the moment, no Curves are directly diceable since they're
-		 * converted to patches just prior to rendering.
+		 * Curve segments without user supplied normals are diced directly
+		 * as ribbons facing the camera: the grid runs along the length of
+		 * the segment and is usually only one micropolygon wide.  Other
+		 * curves are converted to patches just prior to rendering.
 		 */
 		virtual bool Diceable(const CqMatrix& matCtoR);
+		virtual void PreDice( TqInt uDiceSize, TqInt vDiceSize );
+		virtual TqInt DiceAll( CqMicroPolyGrid* pGrid );
+		virtual void NaturalDice( CqParameter* pParameter, TqInt uDiceSize,
+			TqInt vDiceSize, IqShaderData* pData );
 
 		/** Determine whether the passed surface is valid to be used as a
 		 *  frame in motion blur for this surface.
@@ -352,6 +368,11 @@ class CqCurvesGroup : public CqCurve
 		}
 #endif
 		void CloneData(CqCurvesGroup* clone) const;
+		/** Groups are always split into their segments before dicing. */
+		virtual bool Diceable(const CqMatrix& matCtoR)
+		{
+			return false;
+		}
 		virtual void Transform(
 		    const CqMatrix& matTx,
 		    const CqMatrix& matITTx,
@@ -0,0 +1,204 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/**
+        \file
+        \brief Implements the classes used for geometric instancing of
+                RiObjectBegin/RiObjectEnd blocks.
+*/
+
+#include "instance.h"
+
+#include "procedural.h"
+#include "renderer.h"
+#include <aqsis/util/logging.h>
+
+namespace Aqsis {
+
+//---------------------------------------------------------------------
+/** Compute the normal and vector transformations matching matTx, in the
+ * same way as CqRenderer::matNSpaceToSpace and matVSpaceToSpace.
+ */
+static void directionMatrices( const CqMatrix& matTx, CqMatrix& matITTx, CqMatrix& matRTx )
+{
+	matRTx = matTx;
+	matRTx[ 3 ][ 0 ] = matRTx[ 3 ][ 1 ] = matRTx[ 3 ][ 2 ] = matRTx[ 0 ][ 3 ] = matRTx[ 1 ][ 3 ] = matRTx[ 2 ][ 3 ] = 0.0;
+	matRTx[ 3 ][ 3 ] = 1.0;
+	matITTx = matRTx.Inverse().Transpose();
+}
+
+
+//---------------------------------------------------------------------
+CqObjectMaster::CqObjectMaster( const CqMatrix& matDefinition,
+		const CqAttributesPtr& pAttributes, bool fWorldScope )
+	: m_matDefinition( matDefinition ),
+	m_pAttributes( pAttributes ),
+	m_fWorldScope( fWorldScope ),
+	m_aSurfaces()
+{}
+
+
+void CqObjectMaster::AddSurface( const boost::shared_ptr<CqSurface>& pSurface )
+{
+	pSurface->SetInstanceMaster();
+	m_aSurfaces.push_back( pSurface );
+}
+
+
+void CqObjectMaster::Instantiate( const CqTransformPtr& pTransform,
+		const CqAttributesPtr& pAttributes,
+		std::vector<boost::shared_ptr<CqSurface> >& aInstances ) const
+{
+	TqFloat time = pTransform->Time( 0 );
+	CqMatrix matDefinitionInv = m_matDefinition.Inverse();
+	// World space at definition -> world space at this instance.
+	CqMatrix matTx = pTransform->matObjectToWorld( time ) * matDefinitionInv;
+
+	std::vector<boost::shared_ptr<CqSurface> >::const_iterator iSurface;
+	for( iSurface = m_aSurfaces.begin(); iSurface != m_aSurfaces.end(); ++iSurface )
+	{
+		const boost::shared_ptr<CqSurface>& pMaster = *iSurface;
+		// Primitives whose attributes were changed inside the object block
+		// keep them, everything else picks up the attributes in effect at
+		// RiObjectInstance.
+		CqAttributesPtr pInstanceAttributes = pAttributes;
+		if( pMaster->pAttributes().get() != m_pAttributes.get() )
+			pInstanceAttributes = boost::static_pointer_cast<CqAttributes>( pMaster->pAttributes() );
+		// Likewise any transformation made inside the object block is
+		// applied on top of the instance transformation.
+		CqTransformPtr pInstanceTransform = pTransform;
+		const CqTransform& masterTransform = static_cast<const CqTransform&>( *pMaster->pTransform() );
+		if( masterTransform.isMoving() )
+		{
+			// Motion inside the object block is combined with the instance
+			// transformation at the key times of both.
+			std::vector<TqFloat> keyTimes;
+			mergeKeyTimes( keyTimes, *pTransform, masterTransform );
+			pInstanceTransform = CqTransformPtr( new CqTransform() );
+			std::vector<TqFloat>::const_iterator iTime;
+			for( iTime = keyTimes.begin(); iTime != keyTimes.end(); ++iTime )
+			{
+				SqTransformation instanceKey;
+				instanceKey.m_matTransform = pTransform->matObjectToWorld( *iTime );
+				instanceKey.m_Handedness = pTransform->GetHandedness( *iTime );
+				SqTransformation localKey;
+				localKey.m_matTransform = matDefinitionInv * masterTransform.matObjectToWorld( *iTime );
+				localKey.m_Handedness = true;
+				pInstanceTransform->SetKeyTransform( *iTime,
+						pInstanceTransform->ConcatMotionObjects( instanceKey, localKey ) );
+			}
+		}
+		else
+		{
+			CqMatrix matLocal = matDefinitionInv * masterTransform.matObjectToWorld( time );
+			if( !matLocal.fIdentity() )
+				pInstanceTransform = CqTransformPtr( new CqTransform( pTransform, time, matLocal, CqTransform::ConcatCurrent() ) );
+		}
+
+		aInstances.push_back( boost::shared_ptr<CqSurface>(
+				new CqInstance( pMaster, matTx, pInstanceTransform, pInstanceAttributes ) ) );
+	}
+}
+
+
+//---------------------------------------------------------------------
+CqInstance::CqInstance( const boost::shared_ptr<CqSurface>& pMaster,
+		const CqMatrix& matTx, const CqTransformPtr& pTransform,
+		const CqAttributesPtr& pAttributes )
+	: CqSurface(),
+	m_pMaster( pMaster ),
+	m_matTx( matTx )
+{
+	m_pTransform = pTransform;
+	m_pAttributes = pAttributes;
+	directionMatrices( matTx, m_matITTx, m_matRTx );
+	STATS_INC( GEO_ins_created );
+}
+
+
+CqInstance::~CqInstance()
+{}
+
+
+//---------------------------------------------------------------------
+/** Bound the master in the coordinate system of this instance.
+ */
+void CqInstance::Bound( CqBound* bound ) const
+{
+	m_pMaster->Bound( bound );
+	bound->Transform( m_matTx );
+	AdjustBoundForTransformationMotion( bound );
+}
+
+
+//---------------------------------------------------------------------
+/** Accumulate the transformation; the master is left untouched.
+ */
+void CqInstance::Transform( const CqMatrix& matTx, const CqMatrix& matITTx, const CqMatrix& matRTx, TqInt iTime )
+{
+	m_matTx = matTx * m_matTx;
+	m_matITTx = matITTx * m_matITTx;
+	m_matRTx = matRTx * m_matRTx;
+}
+
+
+//---------------------------------------------------------------------
+/** Expand the instance into a clone of the master primitive, sharing the
+ * master's untransformed primitive variables.
+ */
+TqInt CqInstance::Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits )
+{
+	if( const CqProcedural* pProcedural = dynamic_cast<const CqProcedural*>( m_pMaster.get() ) )
+	{
+		// Procedurals can't be copied, so run them again in the coordinate
+		// system of the instance.  The bound is in raster space by now, see
+		// CqProcedural::Split().
+		CqBound bound = m_Bound;
+		TqFloat detail = ( bound.vecMax().x() - bound.vecMin().x() ) * ( bound.vecMax().y() - bound.vecMin().y() );
+		pProcedural->Generate( m_pAttributes, m_pTransform, detail );
+		STATS_INC( GEO_prc_split );
+		return 0;
+	}
+
+	boost::shared_ptr<CqSurface> pSurface( m_pMaster->Clone() );
+	if( !pSurface )
+	{
+		Aqsis::log() << warning << "Cannot instance primitive of type \""
+			<< m_pMaster->strName() << "\"" << std::endl;
+		return 0;
+	}
+	pSurface->SetSurfaceParameters( *this );
+	pSurface->Transform( m_matTx, m_matITTx, m_matRTx );
+	pSurface->PrepareTrimCurve();
+	aSplits.push_back( pSurface );
+	STATS_INC( GEO_ins_expanded );
+	return 1;
+}
+
+
+CqSurface* CqInstance::Clone() const
+{
+	CqInstance* clone = new CqInstance( m_pMaster, m_matTx, m_pTransform, m_pAttributes );
+	clone->m_matITTx = m_matITTx;
+	clone->m_matRTx = m_matRTx;
+	return ( clone );
+}
+
+
+} // namespace Aqsis
@@ -0,0 +1,176 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/**
+        \file
+        \brief Declares the classes used to implement geometric instancing
+                of RiObjectBegin/RiObjectEnd blocks.
+*/
+
+#ifndef INSTANCE_H_INCLUDED
+#define INSTANCE_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <aqsis/math/matrix.h>
+#include "surface.h"
+
+namespace Aqsis {
+
+
+/** \brief The master copy of the geometry in an RiObjectBegin/RiObjectEnd
+ * block.
+ *
+ * The primitives in the block are created once, in world space, and are never
+ * posted to the pipeline directly.  Each RiObjectInstance creates a
+ * lightweight CqInstance per master primitive which refers back to the data
+ * held here.
+ *
+ * Masters defined inside a world block only last until the end of it, while
+ * those defined outside are kept for later frames.
+ */
+class CqObjectMaster
+{
+	public:
+		/** Create a master.
+		 * \param matDefinition - object to world matrix at RiObjectBegin.
+		 * \param pAttributes - attributes in effect at RiObjectBegin.
+		 * \param fWorldScope - whether the master is defined in a world block.
+		 */
+		CqObjectMaster(const CqMatrix& matDefinition,
+				const CqAttributesPtr& pAttributes, bool fWorldScope);
+
+		/// Add a (world space) primitive to the master.
+		void	AddSurface( const boost::shared_ptr<CqSurface>& pSurface );
+
+		/** Create instances of all the primitives in the master.
+		 *
+		 * \param pTransform - transformation in effect at RiObjectInstance.
+		 * \param pAttributes - attributes in effect at RiObjectInstance.
+		 * \param aInstances - the new instances are appended here.
+		 */
+		void	Instantiate( const CqTransformPtr& pTransform,
+				const CqAttributesPtr& pAttributes,
+				std::vector<boost::shared_ptr<CqSurface> >& aInstances ) const;
+
+		/// Number of primitives in the master.
+		TqInt	cSurfaces() const
+		{
+			return ( m_aSurfaces.size() );
+		}
+		/// Whether the master was defined inside a world block.
+		bool	fWorldScope() const
+		{
+			return ( m_fWorldScope );
+		}
+
+	private:
+		/// Object to world matrix at the time the master was defined.
+		CqMatrix	m_matDefinition;
+		/// Attributes in effect when the master was defined.
+		CqAttributesPtr	m_pAttributes;
+		/// Whether the master was defined inside a world block.
+		bool	m_fWorldScope;
+		/// The master primitives, in world space.
+		std::vector<boost::shared_ptr<CqSurface> >	m_aSurfaces;
+};
+
+
+/** \brief A single placement of a master primitive.
+ *
+ * An instance holds only a pointer to the master primitive and the
+ * accumulated transformation to apply to it.  When the instance is first
+ * split in a bucket it is expanded into a clone of the master, which shares
+ * all the master's primitive variables except those changed by the
+ * transformation, such as "P" and "N".
+ */
+class CqInstance : public CqSurface
+{
+	public:
+		/** Create an instance of a master primitive.
+		 *
+		 * \param pMaster - master primitive, in world space at definition.
+		 * \param matTx - world to world matrix placing the instance.
+		 * \param pTransform - transformation for the instanced primitive.
+		 * \param pAttributes - attributes for the instanced primitive.
+		 */
+		CqInstance( const boost::shared_ptr<CqSurface>& pMaster,
+				const CqMatrix& matTx, const CqTransformPtr& pTransform,
+				const CqAttributesPtr& pAttributes );
+		virtual	~CqInstance();
+
+		virtual	void	Bound(CqBound* bound) const;
+		virtual	TqInt	Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits );
+		virtual void	Transform( const CqMatrix& matTx, const CqMatrix& matITTx, const CqMatrix& matRTx, TqInt iTime = 0 );
+		virtual CqSurface* Clone() const;
+
+		/* We have no geometry of our own to dice.
+		 */
+		virtual bool	Diceable(const CqMatrix& /*matCtoR*/)
+		{
+			return false;
+		}
+		virtual CqMicroPolyGridBase* Dice()
+		{
+			return NULL;
+		}
+		virtual bool	IsMotionBlurMatch( CqSurface* pSurf )
+		{
+			return( false );
+		}
+
+		/** Returns a string name of the class. */
+		virtual CqString strName() const
+		{
+			return "CqInstance";
+		}
+		virtual TqUint	cUniform() const
+		{
+			return ( 0 );
+		}
+		virtual TqUint	cVarying() const
+		{
+			return ( 0 );
+		}
+		virtual TqUint	cVertex() const
+		{
+			return ( 0 );
+		}
+		virtual TqUint	cFaceVarying() const
+		{
+			return ( 0 );
+		}
+
+	private:
+		/// The shared master primitive.
+		boost::shared_ptr<CqSurface>	m_pMaster;
+		/// Accumulated point, normal and vector transformations.
+		CqMatrix	m_matTx;
+		CqMatrix	m_matITTx;
+		CqMatrix	m_matRTx;
+};
+
+
+} // namespace Aqsis
+
+#endif // INSTANCE_H_INCLUDED
@@ -187,11 +187,16 @@ TqUint CqSurfaceNURBS::FindSpanV( TqFloat v ) const
 /** Return the basis functions for the specified parameter value.
  */
 
-void CqSurfaceNURBS::BasisFunctions( TqFloat u, TqUint i, std::vector<TqFloat>& U, TqInt k, std::vector<TqFloat>& N )
+namespace {
+
+/** Compute the k non-zero basis functions at u into N, using the caller
+ * supplied scratch arrays left and right, each of length k.
+ */
+void basisFunctions( TqFloat u, TqUint i, const TqFloat* U, TqInt k, TqFloat* N,
+		TqFloat* left, TqFloat* right )
 {
 	register TqInt j, r;
 	register TqFloat saved, temp;
-	std::vector<TqFloat> left( k ), right( k );
 
 	N[ 0 ] = 1.0f;
 	for ( j = 1; j <= k - 1; j++ )
@@ -209,6 +214,43 @@ void CqSurfaceNURBS::BasisFunctions( TqFloat u, TqUint i, std::vector<TqFloat>&
 	}
 }
 
+} // unnamed namespace
+
+void CqSurfaceNURBS::BasisFunctions( TqFloat u, TqUint i, std::vector<TqFloat>& U, TqInt k, std::vector<TqFloat>& N )
+{
+	std::vector<TqFloat> left( k ), right( k );
+	basisFunctions( u, i, &U[ 0 ], k, &N[ 0 ], &left[ 0 ], &right[ 0 ] );
+}
+
+
+//---------------------------------------------------------------------
+/** Sample the basis functions at the dice points in one direction.
+ */
+
+void CqSurfaceNURBS::BuildBasisTable( SqBasisTable& table, TqInt diceSize, bool uDirection ) const
+{
+	const std::vector<TqFloat>& aKnots = uDirection ? m_auKnots : m_avKnots;
+	TqUint order = uDirection ? m_uOrder : m_vOrder;
+	TqUint cVerts = uDirection ? m_cuVerts : m_cvVerts;
+
+	table.diceSize = diceSize;
+	table.spans.resize( diceSize + 1 );
+	table.basis.resize( ( diceSize + 1 ) * order );
+	std::vector<TqFloat> scratch( 2 * order );
+
+	TqFloat start = aKnots[ order - 1 ];
+	TqFloat range = aKnots[ cVerts ] - start;
+	TqInt i;
+	for ( i = 0; i <= diceSize; i++ )
+	{
+		TqFloat t = ( static_cast<TqFloat>( i ) / static_cast<TqFloat>( diceSize ) ) * range + start;
+		TqUint span = uDirection ? FindSpanU( t ) : FindSpanV( t );
+		table.spans[ i ] = span;
+		basisFunctions( t, span, &aKnots[ 0 ], order, &table.basis[ i * order ],
+				&scratch[ 0 ], &scratch[ order ] );
+	}
+}
+
 
 
 //---------------------------------------------------------------------
@@ -761,7 +803,9 @@ void CqSurfaceNURBS::RefineKnotU( const std::vector<TqFloat>& X )
 	TqInt k = b + p + r;
 
 	m_cuVerts = r + 1 + n + 1;
-	std::vector<TqFloat>	auHold( m_auKnots );
+	// Take over the old knots rather than copying them.
+	std::vector<TqFloat>	auHold;
+	auHold.swap( m_auKnots );
 	m_auKnots.resize( m_cuVerts + m_uOrder );
 
 	// Copy the knot values up to the first insertion point.
@@ -793,7 +837,10 @@ void CqSurfaceNURBS::RefineKnotU( const std::vector<TqFloat>& X )
 			i = b + p - 1;
 			k = b + p + r;
 
-			CqParameter* pHold = ( *iUP ) ->Clone();
+			// Refine into a new parameter, keeping the old one as the
+			// source, instead of copying the old values aside first.
+			CqParameter* pHold = *iUP;
+			*iUP = pHold->CloneType( pHold->strName().c_str(), pHold->Count() );
 			( *iUP ) ->SetSize( m_cuVerts * m_cvVerts );
 
 			// Copy the control points from the original
@@ -944,7 +991,9 @@ void CqSurfaceNURBS::RefineKnotV( const std::vector<TqFloat>& X )
 	TqInt k = b + p + r;
 
 	m_cvVerts = r + 1 + n + 1;
-	std::vector<TqFloat>	avHold( m_avKnots );
+	// Take over the old knots rather than copying them.
+	std::vector<TqFloat>	avHold;
+	avHold.swap( m_avKnots );
 	m_avKnots.resize( m_cvVerts + m_vOrder );
 
 	for ( j = 0; j <= a; j++ )
@@ -973,7 +1022,10 @@ void CqSurfaceNURBS::RefineKnotV( const std::vector<TqFloat>& X )
 			i = b + p - 1;
 			k = b + p + r;
 
-			CqParameter* pHold = ( *iUP ) ->Clone();
+			// Refine into a new parameter, keeping the old one as the
+			// source, instead of copying the old values aside first.
+			CqParameter* pHold = *iUP;
+			*iUP = pHold->CloneType( pHold->strName().c_str(), pHold->Count() );
 			( *iUP ) ->SetSize( m_cuVerts * m_cvVerts );
 
 			for ( col = 0; col < static_cast<TqInt>( m_cuVerts ); col++ )
@@ -1376,130 +1428,89 @@ void CqSurfaceNURBS::Bound(CqBound* bound) const
 
 
 //---------------------------------------------------------------------
-/** Dice the patch into a mesh of micropolygons.
+/** Dice a vertex variable onto the grid using the basis tables.
  */
 
+template <class T, class SLT>
+void CqSurfaceNURBS::DiceGrid( CqParameter* pParameter, IqShaderData* pData )
+{
+	CqParameterTyped<T, SLT>* pTParam = static_cast<CqParameterTyped<T, SLT>*>( pParameter );
+	std::vector<T> values;
+	TqInt i;
+	for( i = 0; i < pParameter->Count(); i++ )
+	{
+		EvaluateGrid( pTParam, i, values );
+		IqShaderData* arrayValue = pData->ArrayEntry( i );
+		TqInt igrid;
+		TqInt size = values.size();
+		for( igrid = 0; igrid < size; igrid++ )
+			arrayValue->SetValue( paramToShaderType<SLT, T>( values[ igrid ] ), igrid );
+	}
+}
+
+
 void CqSurfaceNURBS::NaturalDice( CqParameter* pParameter, TqInt uDiceSize, TqInt vDiceSize, IqShaderData* pData )
 {
 	assert(pParameter->Count() == pData->ArrayLength());
-	CqVector4D vec1;
-	TqInt iv;
-	for ( iv = 0; iv <= vDiceSize; iv++ )
-	{
-		TqFloat sv = ( static_cast<TqFloat>( iv ) / static_cast<TqFloat>( vDiceSize ) )
-		             * ( m_avKnots[ m_cvVerts ] - m_avKnots[ m_vOrder - 1 ] )
-		             + m_avKnots[ m_vOrder - 1 ];
-		TqInt iu;
-		for ( iu = 0; iu <= uDiceSize; iu++ )
-		{
-			TqInt igrid = ( iv * ( uDiceSize + 1 ) ) + iu;
-			TqFloat su = ( static_cast<TqFloat>( iu ) / static_cast<TqFloat>( uDiceSize ) )
-			             * ( m_auKnots[ m_cuVerts ] - m_auKnots[ m_uOrder - 1 ] )
-			             + m_auKnots[ m_uOrder - 1 ];
+	// The tables are normally built by PreDice(), but make sure they match
+	// the requested grid.
+	PreDice( uDiceSize, vDiceSize );
 
-			switch ( pParameter->Type() )
+	switch ( pParameter->Type() )
+	{
+			case type_float:
+				DiceGrid<TqFloat, TqFloat>( pParameter, pData );
+				break;
+			case type_integer:
+				DiceGrid<TqInt, TqFloat>( pParameter, pData );
+				break;
+			case type_point:
+			case type_normal:
+			case type_vector:
+				DiceGrid<CqVector3D, CqVector3D>( pParameter, pData );
+				break;
+			case type_hpoint:
+				DiceGrid<CqVector4D, CqVector3D>( pParameter, pData );
+				break;
+			case type_color:
+				DiceGrid<CqColor, CqColor>( pParameter, pData );
+				break;
+			case type_string:
+				DiceGrid<CqString, CqString>( pParameter, pData );
+				break;
+			case type_matrix:
+				DiceGrid<CqMatrix, CqMatrix>( pParameter, pData );
+				break;
+			default:
 			{
-					case type_float:
-					{
-						CqParameterTyped<TqFloat, TqFloat>* pTParam = static_cast<CqParameterTyped<TqFloat, TqFloat>*>( pParameter );
-						IqShaderData* arrayValue;
-						TqInt i;
-						for(i = 0; i<pParameter->Count(); i++)
-						{
-							arrayValue = pData->ArrayEntry(i);
-							arrayValue->SetValue( Evaluate(su, sv, pTParam, i), igrid);
-						}
-						break;
-					}
-
-					case type_integer:
-					{
-						CqParameterTyped<TqInt, TqFloat>* pTParam = static_cast<CqParameterTyped<TqInt, TqFloat>*>( pParameter );
-						IqShaderData* arrayValue;
-						TqInt i;
-						for(i = 0; i<pParameter->Count(); i++)
-						{
-							arrayValue = pData->ArrayEntry(i);
-							arrayValue->SetValue( Evaluate(su, sv, pTParam, i), igrid);
-						}
-						break;
-					}
+				// left blank to avoid compiler warnings about unhandled types
+				break;
+			}
+	}
+}
 
-					case type_point:
-					case type_normal:
-					case type_vector:
-					{
-						CqParameterTyped<CqVector3D, CqVector3D>* pTParam = static_cast<CqParameterTyped<CqVector3D, CqVector3D>*>( pParameter );
-						IqShaderData* arrayValue;
-						TqInt i;
-						for(i = 0; i<pParameter->Count(); i++)
-						{
-							arrayValue = pData->ArrayEntry(i);
-							arrayValue->SetValue( Evaluate(su, sv, pTParam, i), igrid);
-						}
-						break;
-					}
 
-					case type_hpoint:
-					{
-						CqParameterTyped<CqVector4D, CqVector3D>* pTParam = static_cast<CqParameterTyped<CqVector4D, CqVector3D>*>( pParameter );
-						IqShaderData* arrayValue;
-						TqInt i;
-						for(i = 0; i<pParameter->Count(); i++)
-						{
-							arrayValue = pData->ArrayEntry(i);
-							arrayValue->SetValue(vectorCast<CqVector3D>(Evaluate(su, sv, pTParam)), igrid);
-						}
-						break;
-					}
+//---------------------------------------------------------------------
+/** Build the basis tables shared by all the variables diced onto a grid.
+ */
 
-					case type_color:
-					{
-						CqParameterTyped<CqColor, CqColor>* pTParam = static_cast<CqParameterTyped<CqColor, CqColor>*>( pParameter );
-						IqShaderData* arrayValue;
-						TqInt i;
-						for(i = 0; i<pParameter->Count(); i++)
-						{
-							arrayValue = pData->ArrayEntry(i);
-							arrayValue->SetValue( Evaluate(su, sv, pTParam, i), igrid);
-						}
-						break;
-					}
+void CqSurfaceNURBS::PreDice( TqInt uDiceSize, TqInt vDiceSize )
+{
+	if ( m_uBasisTable.diceSize != uDiceSize )
+		BuildBasisTable( m_uBasisTable, uDiceSize, true );
+	if ( m_vBasisTable.diceSize != vDiceSize )
+		BuildBasisTable( m_vBasisTable, vDiceSize, false );
+}
 
-					case type_string:
-					{
-						CqParameterTyped<CqString, CqString>* pTParam = static_cast<CqParameterTyped<CqString, CqString>*>( pParameter );
-						IqShaderData* arrayValue;
-						TqInt i;
-						for(i = 0; i<pParameter->Count(); i++)
-						{
-							arrayValue = pData->ArrayEntry(i);
-							arrayValue->SetValue( Evaluate(su, sv, pTParam, i), igrid);
-						}
-						break;
-					}
 
-					case type_matrix:
-					{
-						CqParameterTyped<CqMatrix, CqMatrix>* pTParam = static_cast<CqParameterTyped<CqMatrix, CqMatrix>*>( pParameter );
-						IqShaderData* arrayValue;
-						TqInt i;
-						for(i = 0; i<pParameter->Count(); i++)
-						{
-							arrayValue = pData->ArrayEntry(i);
-							arrayValue->SetValue( Evaluate(su, sv, pTParam, i), igrid);
-						}
-						break;
-					}
+//---------------------------------------------------------------------
+/** Release the basis tables once the grid is complete.
+ */
 
-					default:
-					{
-						// left blank to avoid compiler warnings about unhandled types
-						break;
-					}
-			}
-		}
-	}
+void CqSurfaceNURBS::PostDice( CqMicroPolyGrid* /* pGrid */ )
+{
+	m_uBasisTable = SqBasisTable();
+	m_vBasisTable = SqBasisTable();
 }
 
 
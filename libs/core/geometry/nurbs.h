@@ -265,6 +265,59 @@ class CqSurfaceNURBS : public CqSurface
 			return ( S );
 		}
 
+		/** Evaluate a primitive variable at every point of the grid described
+		 * by the current basis tables (see PreDice()).
+		 *
+		 * The tensor product is evaluated separably: each row of control
+		 * values is first blended along u for all grid columns, then the rows
+		 * are blended along v.  This avoids repeating the u evaluation for
+		 * every grid row and keeps the inner loops running over contiguous
+		 * arrays.
+		 *
+		 * \param pParam - vertex class primitive variable to evaluate.
+		 * \param arrayIndex - array element of the variable to evaluate.
+		 * \param result - (uDiceSize+1)*(vDiceSize+1) grid values, u fastest.
+		 */
+		template <class T, class SLT>
+		void	EvaluateGrid( CqParameterTyped<T, SLT>* pParam, TqInt arrayIndex, std::vector<T>& result )
+		{
+			const TqUint nu = m_uBasisTable.diceSize + 1;
+			const TqUint nv = m_vBasisTable.diceSize + 1;
+			TqUint iu, iv, k, l, row;
+
+			// Blend along u for each row of control values.
+			std::vector<T> rows( m_cvVerts * nu );
+			for ( row = 0; row < m_cvVerts; row++ )
+			{
+				T* rowValues = &rows[ row * nu ];
+				for ( iu = 0; iu < nu; iu++ )
+				{
+					const TqFloat* Nu = &m_uBasisTable.basis[ iu * m_uOrder ];
+					TqUint uind = ( row * m_cuVerts ) + m_uBasisTable.spans[ iu ] - uDegree();
+					T temp = T();
+					for ( k = 0; k < m_uOrder; k++ )
+						temp = static_cast<T>( temp + Nu[ k ] * ( pParam->pValue( uind + k )[arrayIndex] ) );
+					rowValues[ iu ] = temp;
+				}
+			}
+
+			// Blend the rows along v.
+			result.assign( nu * nv, T() );
+			for ( iv = 0; iv < nv; iv++ )
+			{
+				const TqFloat* Nv = &m_vBasisTable.basis[ iv * m_vOrder ];
+				TqUint vind = m_vBasisTable.spans[ iv ] - vDegree();
+				T* gridValues = &result[ iv * nu ];
+				for ( l = 0; l < m_vOrder; l++ )
+				{
+					const T* rowValues = &rows[ ( vind + l ) * nu ];
+					const TqFloat w = Nv[ l ];
+					for ( iu = 0; iu < nu; iu++ )
+						gridValues[ iu ] = static_cast<T>( gridValues[ iu ] + w * rowValues[ iu ] );
+				}
+			}
+		}
+
 		CqVector4D	EvaluateWithNormal( TqFloat u, TqFloat v, CqVector4D& P );
 		void	SplitNURBS( CqSurfaceNURBS& nrbA, CqSurfaceNURBS& nrbB, bool dirflag );
 		void	SubdivideSegments( std::vector<boost::shared_ptr<CqSurfaceNURBS> >& Array );
@@ -299,6 +352,8 @@ class CqSurfaceNURBS : public CqSurface
 		virtual void uSubdivide( CqSurfaceNURBS*& pnrbA, CqSurfaceNURBS*& pnrbB );
 		virtual void vSubdivide( CqSurfaceNURBS*& pnrbA, CqSurfaceNURBS*& pnrbB );
 		virtual void NaturalDice( CqParameter* pParameter, TqInt uDiceSize, TqInt vDiceSize, IqShaderData* pData );
+		virtual void	PreDice( TqInt uDiceSize, TqInt vDiceSize );
+		virtual void	PostDice( CqMicroPolyGrid* pGrid );
 
 		virtual	void	Bound(CqBound* bound) const;
 		virtual	TqInt	Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits );
@@ -361,9 +416,35 @@ class CqSurfaceNURBS : public CqSurface
 			m_TrimLoops.Prepare( this );
 		}
 		virtual CqSurface* Clone() const;
+		/** Knot insertion when splitting rewrites the vertex variables in
+		 * place, so they can't be shared.
+		 */
+		virtual bool	fShareableParameter( const CqParameter* pParam ) const
+		{
+			return ( pParam->Class() != class_vertex && CqSurface::fShareableParameter( pParam ) );
+		}
 
 
 	protected:
+		/** \brief Basis functions sampled at the dice points along one
+		 * parametric direction.
+		 *
+		 * These are shared by all the primitive variables diced onto a grid.
+		 */
+		struct SqBasisTable
+		{
+			SqBasisTable() : diceSize( -1 ), spans(), basis()
+			{}
+			TqInt	diceSize;		///< Dice size the table was built for, -1 if empty.
+			std::vector<TqUint>	spans;	///< Knot span containing each dice point.
+			std::vector<TqFloat>	basis;	///< The order non-zero basis values at each dice point.
+		};
+		void	BuildBasisTable( SqBasisTable& table, TqInt diceSize, bool uDirection ) const;
+		template <class T, class SLT>
+		void	DiceGrid( CqParameter* pParameter, IqShaderData* pData );
+
+		SqBasisTable	m_uBasisTable;	///< Basis functions at the u dice points.
+		SqBasisTable	m_vBasisTable;	///< Basis functions at the v dice points.
 		std::vector<TqFloat>	m_auKnots;	///< Knot vector for the u direction.
 		std::vector<TqFloat>	m_avKnots;	///< Knot vector for the v direction.
 		TqUint	m_uOrder;	///< Surface order in the u direction.
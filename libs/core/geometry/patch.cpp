@@ -858,13 +858,34 @@ CqSurface* CqSurfacePatchMeshBicubic::Clone() const
 	clone->m_uPeriodic = m_uPeriodic;
 	clone->m_vPeriodic = m_vPeriodic;
 
-	clone->m_patches.insert(clone->m_patches.begin(), m_patches.begin(),
-							m_patches.end());
+	// The child patches are transformed in place, so each clone needs its
+	// own.
+	std::vector<boost::shared_ptr<CqSurfacePatchBicubic> >::const_iterator
+		iPatch, end;
+	end = m_patches.end();
+	for (iPatch = m_patches.begin(); iPatch != end; iPatch++)
+		clone->m_patches.push_back(boost::shared_ptr<CqSurfacePatchBicubic>(
+				static_cast<CqSurfacePatchBicubic*>((*iPatch)->Clone())));
 
 	return ( clone );
 }
 
 
+//---------------------------------------------------------------------
+/** Mark the child patches as instance masters along with the mesh.
+ */
+
+void CqSurfacePatchMeshBicubic::SetInstanceMaster()
+{
+	CqSurface::SetInstanceMaster();
+	std::vector<boost::shared_ptr<CqSurfacePatchBicubic> >::iterator
+		iPatch, end;
+	end = m_patches.end();
+	for (iPatch = m_patches.begin(); iPatch != end; iPatch++)
+		(*iPatch)->SetInstanceMaster();
+}
+
+
 //---------------------------------------------------------------------
 /** Get the boundary extents in camera space of the surface patch mesh
  */
@@ -262,6 +262,7 @@ class CqSurfacePatchMeshBicubic : public CqSurface
 			return ( cVarying() );
 		}
 		virtual CqSurface* Clone() const;
+		virtual void	SetInstanceMaster();
 
 		virtual CqVector3D	SurfaceParametersAtVertex( TqInt index )
 		{
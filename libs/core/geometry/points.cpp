@@ -29,6 +29,7 @@
  *
  */
 
+#include	<algorithm>
 #include	<cmath>
 #include	<cfloat>
 
@@ -39,9 +40,9 @@
 
 namespace Aqsis {
 
-CqObjectPool<CqMovingMicroPolygonKeyPoints>	CqMovingMicroPolygonKeyPoints::m_thePool;
-CqObjectPool<CqMicroPolygonPoints>	CqMicroPolygonPoints::m_thePool;
-CqObjectPool<CqMicroPolygonMotionPoints>	CqMicroPolygonMotionPoints::m_thePool;
+CqThreadLocalPool<CqMovingMicroPolygonKeyPoints>	CqMovingMicroPolygonKeyPoints::m_thePool( "point motion keys" );
+CqThreadLocalPool<CqMicroPolygonPoints>	CqMicroPolygonPoints::m_thePool( "point micropolygons" );
+CqThreadLocalPool<CqMicroPolygonMotionPoints>	CqMicroPolygonMotionPoints::m_thePool( "moving point micropolygons" );
 
 class CqPointsKDTreeData::CqPointsKDTreeDataComparator
 {
@@ -322,25 +323,62 @@ void CqPoints::NaturalDice(CqParameter* pParam, TqInt uDiceSize, TqInt vDiceSize
 	}
 }
 
-//---------------------------------------------------------------------
-/** Determine whether the quadric is suitable for dicing.
- */
-
-bool	CqPoints::Diceable(const CqMatrix& /* matCtoR */)
+/// The maximum number of points in a grid, from the "limits" "gridsize" option.
+static TqUint pointsGridSize()
 {
 	TqUint gridsize = 256;
 
 	const TqInt* poptGridSize = QGetRenderContext() ->poptCurrent()->GetIntegerOption( "limits", "gridsize" );
 	if ( poptGridSize )
 		gridsize = (TqUint) poptGridSize[ 0 ];
+	return ( gridsize );
+}
+
+//---------------------------------------------------------------------
+/** Determine whether the quadric is suitable for dicing.
+ */
 
-	if( nVertices() > gridsize )
+bool	CqPoints::Diceable(const CqMatrix& /* matCtoR */)
+{
+	if( nVertices() > pointsGridSize() )
 		return ( false );
 	else
 		return ( true );
 }
 
 
+//---------------------------------------------------------------------
+/** Combine two sets of points from the same primitive into one, so that they
+ * are shaded as a single grid.
+ *
+ * Points grids have no derivatives between the points, so the two sets can
+ * simply be concatenated.
+ */
+
+boost::shared_ptr<CqSurface> CqPoints::Coalesce( const CqSurface& other ) const
+{
+	const CqPoints* pOther = dynamic_cast<const CqPoints*>( &other );
+	// Points split from the same primitive share the primitive variables,
+	// attributes (and hence shaders and lights) and transformation.
+	if( !pOther || pOther->pPoints() != pPoints()
+		|| pOther->pAttributes() != pAttributes()
+		|| pOther->pTransform() != pTransform()
+		|| nVertices() + pOther->nVertices() > pointsGridSize() )
+		return boost::shared_ptr<CqSurface>();
+
+	boost::shared_ptr<CqPoints> pBatch( new CqPoints( m_nVertices + pOther->m_nVertices, pPoints() ) );
+	pBatch->SetSurfaceParameters( *this );
+
+	std::vector<TqInt>& leaves = pBatch->KDTree().aLeaves();
+	leaves.reserve( pBatch->m_nVertices );
+	leaves.insert( leaves.end(), m_KDTree.aLeaves().begin(), m_KDTree.aLeaves().end() );
+	leaves.insert( leaves.end(), pOther->m_KDTree.aLeaves().begin(), pOther->m_KDTree.aLeaves().end() );
+	pBatch->m_MaxWidth = std::max( m_MaxWidth, pOther->m_MaxWidth );
+
+	return ( pBatch );
+}
+
+
 //---------------------------------------------------------------------
 /** Get the geometric bound of this GPrim in 'current' space.
  */
@@ -140,6 +140,12 @@ class CqPoints : public CqSurface
 		virtual	TqInt	Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits );
 
 		virtual CqSurface* Clone() const;
+		virtual void	SetInstanceMaster()
+		{
+			CqSurface::SetInstanceMaster();
+			m_pPoints->SetInstanceMaster();
+		}
+		virtual boost::shared_ptr<CqSurface> Coalesce( const CqSurface& other ) const;
 
 		TqUint	nVertices() const
 		{
@@ -280,6 +286,10 @@ class CqMicroPolyGridPoints : public CqMicroPolyGrid
 		{}
 
 		virtual	void	Split( long xmin, long xmax, long ymin, long ymax );
+		virtual	bool	PrepareReshade()
+		{
+			return ( false );
+		}
 
 		virtual	TqUint	GridSize() const
 		{
@@ -357,6 +367,11 @@ class CqMicroPolygonPoints : public CqMicroPolygon
 			m_Bound.vecMin() = pos - CqVector3D(m_radius, m_radius, 0);
 			m_Bound.vecMax() = pos + CqVector3D(m_radius, m_radius, 0);
 		}
+		/// Only the centre of the point is cached, the radius is in the bound.
+		virtual bool IsQuad() const
+		{
+			return false;
+		}
 		virtual	bool	Sample( CqHitTestCache& hitTestCache, SqSampleData const& sample, TqFloat& D, CqVector2D& uv, TqFloat time, bool UsingDof = false ) const;
 		virtual void CacheHitTestValues(CqHitTestCache& cache, bool usingDof) const;
 
@@ -367,7 +382,7 @@ class CqMicroPolygonPoints : public CqMicroPolygon
 	private:
 		TqFloat	m_radius;
 
-		static	CqObjectPool<CqMicroPolygonPoints>	m_thePool;
+		static	CqThreadLocalPool<CqMicroPolygonPoints>	m_thePool;
 }
 ;
 
@@ -423,7 +438,7 @@ class CqMovingMicroPolygonKeyPoints
 		CqVector3D	m_Point0;
 		TqFloat		m_radius;
 
-		static	CqObjectPool<CqMovingMicroPolygonKeyPoints>	m_thePool;
+		static	CqThreadLocalPool<CqMovingMicroPolygonKeyPoints>	m_thePool;
 }
 ;
 
@@ -499,7 +514,7 @@ class CqMicroPolygonMotionPoints : public CqMicroPolygon
 		std::vector<TqFloat> m_Times;
 		std::vector<CqMovingMicroPolygonKeyPoints*>	m_Keys;
 
-		static	CqObjectPool<CqMicroPolygonMotionPoints>	m_thePool;
+		static	CqThreadLocalPool<CqMicroPolygonMotionPoints>	m_thePool;
 
 };
 
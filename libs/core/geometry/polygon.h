@@ -625,6 +625,11 @@ class CqSurfacePointsPolygons : public CqSurface
 			return ( m_pPoints->cFaceVarying() );
 		}
 		virtual CqSurface* Clone() const;
+		virtual void	SetInstanceMaster()
+		{
+			CqSurface::SetInstanceMaster();
+			m_pPoints->SetInstanceMaster();
+		}
 
 	private:
 		TqInt	m_NumPolys;
@@ -37,6 +37,7 @@
 #include <boost/tokenizer.hpp>
 
 #include "renderer.h"
+#include "splitrecord.h"
 #include <aqsis/util/file.h>
 #include <aqsis/util/plugins.h>
 #include <aqsis/core/corecontext.h>
@@ -72,13 +73,6 @@ CqProcedural::CqProcedural(RtPointer data, CqBound &B, RtProcSubdivFunc subfunc,
 
 TqInt CqProcedural::Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits )
 {
-	// Store current context, set current context to the stored one
-	boost::shared_ptr<CqModeBlock> pconSave = QGetRenderContext()->pconCurrent( m_pconStored );
-
-	m_pconStored->m_pattrCurrent = m_pAttributes;
-
-	m_pconStored->m_ptransCurrent = m_pTransform;
-
 	/// \note: The bound is in "raster" coordinates by now, as during posting to the imagebuffer
 	/// the the Culling routines do the job for us, see CqSurface::CacheRasterBound.
 	CqBound bound = m_Bound;
@@ -86,6 +80,34 @@ TqInt CqProcedural::Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits )
 	float detail = ( bound.vecMax().x() - bound.vecMin().x() ) * ( bound.vecMax().y() - bound.vecMin().y() );
 	//std::cout << "detail: " << detail << std::endl;
 
+	// Note the primitives generated, so that they can be evicted and
+	// generated again when the deferred geometry is over its memory limit.
+	boost::shared_ptr<CqSplitRecord> record;
+	const TqInt* geometryMemory = QGetRenderContext()->poptCurrent()->GetIntegerOption( "limits", "geometrymemory" );
+	if( geometryMemory && geometryMemory[0] > 0 )
+		record.reset( new CqSplitRecord( boost::static_pointer_cast<CqProcedural>( shared_from_this() ),
+					m_pAttributes, m_pTransform, detail ) );
+	boost::shared_ptr<CqSplitRecord> recordSave = QGetRenderContext()->setSplitRecord( record );
+
+	Generate( m_pAttributes, m_pTransform, detail );
+
+	QGetRenderContext()->setSplitRecord( recordSave );
+
+	STATS_INC( GEO_prc_split );
+
+	return 0;
+}
+
+
+void CqProcedural::Generate( const CqAttributesPtr& pAttributes, const CqTransformPtr& pTransform, TqFloat detail ) const
+{
+	// Store current context, set current context to the stored one
+	boost::shared_ptr<CqModeBlock> pconSave = QGetRenderContext()->pconCurrent( m_pconStored );
+
+	m_pconStored->m_pattrCurrent = pAttributes;
+
+	m_pconStored->m_ptransCurrent = pTransform;
+
 	// Call the procedural secific Split()
 	RiAttributeBegin();
 
@@ -96,10 +118,6 @@ TqInt CqProcedural::Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits )
 
 	// restore saved context
 	QGetRenderContext()->pconCurrent( pconSave );
-
-	STATS_INC( GEO_prc_split );
-
-	return 0;
 }
 
 
@@ -54,6 +54,12 @@ class CqProcedural : public CqSurface
 		 * \return Integer count of new GPrims created.
 		 */
 		virtual	TqInt	Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits );
+		/** Call the procedural to generate its geometry.
+		 * \param pAttributes - attributes to generate the geometry with.
+		 * \param pTransform - transformation to generate the geometry with.
+		 * \param detail - raster space area of the procedural bound.
+		 */
+		void	Generate( const CqAttributesPtr& pAttributes, const CqTransformPtr& pTransform, TqFloat detail ) const;
 		virtual ~CqProcedural();
 
 		//---------------------------------------------- Inlined Public Methods
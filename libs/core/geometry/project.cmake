@@ -1,8 +1,10 @@
 set(geometry_srcs
 	blobby.cpp
+	blobbyfield.cpp
 	bunny.cpp
 	cubiccurves.cpp
 	curves.cpp
+	instance.cpp
 	jules_bloomenthal.cpp
 	lath.cpp
 	linearcurves.cpp
@@ -13,6 +15,7 @@ set(geometry_srcs
 	polygon.cpp
 	procedural.cpp
 	quadrics.cpp
+	splitrecord.cpp
 	subdivision2.cpp
 	surface.cpp
 	teapot.cpp
@@ -22,8 +25,10 @@ make_absolute(geometry_srcs ${geometry_SOURCE_DIR})
 
 set(geometry_hdrs
 	blobby.h
+	blobbyfield.h
 	bunny.h
 	curves.h
+	instance.h
 	jules_bloomenthal.h
 	kdtree.h
 	lath.h
@@ -35,6 +40,7 @@ set(geometry_hdrs
 	polygon.h
 	procedural.h
 	quadrics.h
+	splitrecord.h
 	subdivision2.h
 	surface.h
 	teapot.h
@@ -42,5 +48,10 @@ set(geometry_hdrs
 )
 make_absolute(geometry_hdrs ${geometry_SOURCE_DIR})
 
+set(geometry_test_srcs
+	blobbyfield_test.cpp
+)
+make_absolute(geometry_test_srcs ${geometry_SOURCE_DIR})
+
 include_directories(${geometry_SOURCE_DIR})
 
@@ -0,0 +1,132 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/**
+        \file
+        \brief Implements the classes used to evict the primitives generated
+                by procedurals and generate them again later.
+*/
+
+#include "splitrecord.h"
+
+#include <algorithm>
+
+#include "procedural.h"
+#include "renderer.h"
+
+namespace Aqsis {
+
+//------------------------------------------------------------------------------
+// CqSplitRecord
+CqSplitRecord::CqSplitRecord( const boost::shared_ptr<CqProcedural>& procedural,
+		const CqAttributesPtr& pAttributes, const CqTransformPtr& pTransform,
+		TqFloat detail )
+	: m_procedural(procedural),
+	m_pAttributes(pAttributes),
+	m_pTransform(pTransform),
+	m_detail(detail),
+	m_evicted(),
+	m_regenerated(0),
+	m_next(0)
+{ }
+
+bool CqSplitRecord::addSurface( const boost::shared_ptr<CqSurface>& surface )
+{
+	if( !m_regenerated )
+	{
+		surface->setSplitRecord( shared_from_this(), m_evicted.size() );
+		m_evicted.push_back( false );
+		return true;
+	}
+
+	// Only keep the primitives which are waiting as proxies, the others are
+	// still in the buckets or have already been rendered.
+	TqInt index = m_next++;
+	if( index < static_cast<TqInt>( m_evicted.size() ) && m_evicted[ index ] )
+	{
+		surface->setSplitRecord( shared_from_this(), index );
+		m_evicted[ index ] = false;
+		m_regenerated->push_back( surface );
+		STATS_INC( GPR_regenerated );
+	}
+	return false;
+}
+
+boost::shared_ptr<CqSurface> CqSplitRecord::evict( const boost::shared_ptr<CqSurface>& surface )
+{
+	TqInt index = surface->splitIndex();
+	assert( index < static_cast<TqInt>( m_evicted.size() ) );
+	m_evicted[ index ] = true;
+	STATS_INC( GPR_evicted );
+	return boost::shared_ptr<CqSurface>(
+			new CqEvictedSurface( shared_from_this(), index, surface ) );
+}
+
+bool CqSplitRecord::isEvicted( TqInt index ) const
+{
+	return m_evicted[ index ];
+}
+
+void CqSplitRecord::regenerate( std::vector<boost::shared_ptr<CqSurface> >& surfaces )
+{
+	boost::shared_ptr<CqSplitRecord> recordSave
+		= QGetRenderContext()->setSplitRecord( shared_from_this() );
+	m_regenerated = &surfaces;
+	m_next = 0;
+
+	m_procedural->Generate( m_pAttributes, m_pTransform, m_detail );
+
+	m_regenerated = 0;
+	QGetRenderContext()->setSplitRecord( recordSave );
+
+	// Anything the procedural didn't generate this time is lost.
+	if( std::find( m_evicted.begin(), m_evicted.end(), true ) != m_evicted.end() )
+	{
+		Aqsis::log() << warning << "Procedural didn't generate the same primitives again,"
+			<< " some evicted primitives are missing" << std::endl;
+		std::fill( m_evicted.begin(), m_evicted.end(), false );
+	}
+}
+
+
+//------------------------------------------------------------------------------
+// CqEvictedSurface
+CqEvictedSurface::CqEvictedSurface( const boost::shared_ptr<CqSplitRecord>& record,
+		TqInt index, const boost::shared_ptr<CqSurface>& surface )
+	: CqSurface(),
+	m_record(record),
+	m_index(index),
+	m_cameraBound()
+{
+	SetSurfaceParameters( *surface );
+	surface->Bound( &m_cameraBound );
+	CqBound rasterBound = surface->GetCachedRasterBound();
+	CacheRasterBound( rasterBound );
+}
+
+TqInt CqEvictedSurface::Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits )
+{
+	// The primitive may already have come back with another one from the
+	// same procedural.
+	if( m_record->isEvicted( m_index ) )
+		m_record->regenerate( aSplits );
+	return ( aSplits.size() );
+}
+
+} // namespace Aqsis
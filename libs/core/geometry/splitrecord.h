@@ -0,0 +1,165 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/**
+        \file
+        \brief Declares the classes used to evict the primitives generated
+                by procedurals and generate them again later.
+*/
+
+#ifndef SPLITRECORD_H_INCLUDED
+#define SPLITRECORD_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <vector>
+
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+
+#include "surface.h"
+
+namespace Aqsis {
+
+class CqProcedural;
+
+//------------------------------------------------------------------------------
+/** \brief Record of the primitives generated by a procedural, so that they can
+ * be evicted from the buckets and generated again when they are needed.
+ *
+ * With Option "limits" "geometrymemory" set, each procedural which is split
+ * makes a record, and every primitive it stores is tagged with the record and
+ * its position in the output of the procedural.  The record is much smaller
+ * than the primitives, since it only holds on to the procedural itself.
+ *
+ * A deferred primitive can then be replaced by a CqEvictedSurface, which
+ * only keeps its bound.  When the proxy reaches the top of its bucket, the
+ * procedural is run again, and the primitives which were evicted are picked
+ * out of its output and posted again; the others are dropped.  This relies on
+ * the procedural generating the same primitives in the same order each time.
+ */
+class CqSplitRecord : private boost::noncopyable,
+	public boost::enable_shared_from_this<CqSplitRecord>
+{
+	public:
+		/** Make a record for the primitives of a procedural.
+		 *
+		 * \param procedural - the procedural being split.
+		 * \param pAttributes, pTransform, detail - arguments to generate the
+		 *                     primitives with.
+		 */
+		CqSplitRecord( const boost::shared_ptr<CqProcedural>& procedural,
+				const CqAttributesPtr& pAttributes,
+				const CqTransformPtr& pTransform, TqFloat detail );
+
+		/** Note a primitive stored while the procedural is running.
+		 *
+		 * \return false if the primitive was taken by regenerate(), in which
+		 * case it mustn't be posted.
+		 */
+		bool	addSurface( const boost::shared_ptr<CqSurface>& surface );
+		/** Make a proxy holding the bound of a deferred primitive of the
+		 * procedural, to replace it in its bucket.
+		 */
+		boost::shared_ptr<CqSurface>	evict( const boost::shared_ptr<CqSurface>& surface );
+		/// Whether a primitive of the procedural is waiting as a proxy.
+		bool	isEvicted( TqInt index ) const;
+		/** Run the procedural again to get back the evicted primitives.
+		 *
+		 * \param surfaces - the primitives are added to this.
+		 */
+		void	regenerate( std::vector<boost::shared_ptr<CqSurface> >& surfaces );
+
+	private:
+		boost::shared_ptr<CqProcedural>	m_procedural;
+		CqAttributesPtr	m_pAttributes;
+		CqTransformPtr	m_pTransform;
+		TqFloat	m_detail;
+		/// Flags for the primitives generated, set when they are evicted.
+		std::vector<bool>	m_evicted;
+		/// Primitives are being collected by regenerate() into this.
+		std::vector<boost::shared_ptr<CqSurface> >*	m_regenerated;
+		/// Position of the next primitive while regenerating.
+		TqInt	m_next;
+};
+
+
+//------------------------------------------------------------------------------
+/** \brief Bound-only stand in for a primitive evicted from its bucket.
+ *
+ * The proxy has the raster bound of the primitive, so it is sorted and
+ * occlusion culled in its place.  Splitting the proxy gets the primitive back
+ * from its split record.
+ */
+class CqEvictedSurface : public CqSurface
+{
+	public:
+		CqEvictedSurface( const boost::shared_ptr<CqSplitRecord>& record,
+				TqInt index, const boost::shared_ptr<CqSurface>& surface );
+
+		virtual	TqInt	Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits );
+
+		virtual	void	Bound( CqBound* bound ) const
+		{
+			*bound = m_cameraBound;
+		}
+		virtual bool	Diceable( const CqMatrix& /*diceCoords*/ )
+		{
+			return ( false );
+		}
+		virtual CqMicroPolyGridBase* Dice()
+		{
+			return ( NULL );
+		}
+		virtual bool	IsMotionBlurMatch( CqSurface* /*pSurf*/ )
+		{
+			return ( false );
+		}
+		virtual TqUint	cUniform() const
+		{
+			return ( 0 );
+		}
+		virtual TqUint	cVarying() const
+		{
+			return ( 0 );
+		}
+		virtual TqUint	cVertex() const
+		{
+			return ( 0 );
+		}
+		virtual TqUint	cFaceVarying() const
+		{
+			return ( 0 );
+		}
+		virtual CqSurface* Clone() const
+		{
+			return ( NULL );
+		}
+
+	private:
+		boost::shared_ptr<CqSplitRecord>	m_record;
+		TqInt	m_index;
+		/// Camera space bound of the evicted primitive.
+		CqBound	m_cameraBound;
+};
+
+} // namespace Aqsis
+
+#endif // SPLITRECORD_H_INCLUDED
@@ -102,6 +102,57 @@ TqInt CqSurface::Uses() const
 }
 
 
+//---------------------------------------------------------------------
+/** Estimate the memory held by the primitive variables, from their sizes and
+ * types.
+ */
+
+TqUlong CqSurface::storageSize() const
+{
+	TqUlong size = 0;
+	std::vector<CqParameter*>::const_iterator iUP;
+	for ( iUP = m_aUserParams.begin(); iUP != m_aUserParams.end(); iUP++ )
+	{
+		// Shared data is accounted for by the master.
+		if ( fSharedParameter( *iUP ) )
+			continue;
+		TqUlong valueSize = 0;
+		switch ( ( *iUP ) ->Type() )
+		{
+			case type_float:
+				valueSize = sizeof( TqFloat );
+				break;
+			case type_integer:
+			case type_bool:
+				valueSize = sizeof( TqInt );
+				break;
+			case type_string:
+				valueSize = sizeof( CqString );
+				break;
+			case type_color:
+			case type_normal:
+			case type_vector:
+			case type_triple:
+				valueSize = sizeof( CqVector3D );
+				break;
+			case type_point:
+			case type_hpoint:
+				// Points are stored homogeneous.
+				valueSize = sizeof( CqVector4D );
+				break;
+			case type_matrix:
+			case type_sixteentuple:
+				valueSize = sizeof( CqMatrix );
+				break;
+			default:
+				break;
+		}
+		size += valueSize * ( *iUP ) ->Size() * ( *iUP ) ->Count();
+	}
+	return ( size );
+}
+
+
 //---------------------------------------------------------------------
 /** Adjust the bound of the quadric taking into account transformation motion blur.
  */
@@ -159,7 +210,11 @@ CqSurface::CqSurface()
 	m_SplitDir(SplitDir_U),
 	m_CachedBound(false),
 	m_Bound(),
-	m_pCSGNode()
+	m_pCSGNode(),
+	m_fInstanceMaster(false),
+	m_pParamMaster(),
+	m_splitRecord(),
+	m_splitIndex(0)
 {
 	// Set a refernce with the current attributes.
 	m_pAttributes = QGetRenderContext() ->pattrCurrent();
@@ -227,7 +282,17 @@ void CqSurface::ClonePrimitiveVariables( const CqSurface& From )
 	std::vector<CqParameter*>::const_iterator iUP;
 	std::vector<CqParameter*>::const_iterator end = From.m_aUserParams.end() ;
 	for ( iUP = From.m_aUserParams.begin(); iUP != end; iUP++ )
-		AddPrimitiveVariable( ( *iUP ) ->Clone() );
+	{
+		if ( From.m_fInstanceMaster && From.fShareableParameter( *iUP ) )
+		{
+			// Refer to the master's copy, keeping the master alive for as
+			// long as we use it.
+			m_pParamMaster = From.shared_from_this();
+			AddPrimitiveVariable( *iUP );
+		}
+		else
+			AddPrimitiveVariable( ( *iUP ) ->Clone() );
+	}
 
 	// Copy the standard primitive variables index table.
 	TqInt i;
@@ -235,6 +300,25 @@ void CqSurface::ClonePrimitiveVariables( const CqSurface& From )
 		m_aiStdPrimitiveVars[ i ] = From.m_aiStdPrimitiveVars[ i ];
 }
 
+//---------------------------------------------------------------------
+/** Transform() changes points, normals and vectors in place, everything else
+ * is only read once the GPrim has been created.
+ */
+
+bool CqSurface::fShareableParameter( const CqParameter* pParam ) const
+{
+	switch ( pParam->Type() )
+	{
+		case type_point:
+		case type_hpoint:
+		case type_normal:
+		case type_vector:
+			return ( false );
+		default:
+			return ( true );
+	}
+}
+
 //---------------------------------------------------------------------
 /** Set the default values (where available) from the attribute state for all standard
  * primitive variables.
@@ -505,6 +589,21 @@ CqMicroPolyGridBase* CqSurface::Dice()
 		pGrid->SetbGeometricNormals( true );
 
 	// Now we need to dice the user specified parameters as appropriate.
+	DiceUserParams( pGrid );
+
+	PostDice( pGrid );
+
+	return ( pGrid );
+}
+
+
+//---------------------------------------------------------------------
+/** Pass the user specified parameters to the shaders of a grid diced from
+ * this surface.
+ */
+
+void CqSurface::DiceUserParams( CqMicroPolyGridBase* pGrid )
+{
 	std::vector<CqParameter*>::iterator iUP;
 	std::vector<CqParameter*>::iterator end = m_aUserParams.end();
 	for ( iUP = m_aUserParams.begin(); iUP != end ; iUP++ )
@@ -519,10 +618,6 @@ CqMicroPolyGridBase* CqSurface::Dice()
 		if ( pShader=pGrid->pAttributes() ->pshadAtmosphere(QGetRenderContext()->Time()) )
 			pShader->SetArgument( ( *iUP ), this );
 	}
-
-	PostDice( pGrid );
-
-	return ( pGrid );
 }
 
 
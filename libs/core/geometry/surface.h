@@ -29,6 +29,7 @@
 #define SURFACE_H_INCLUDED 1
 
 #include	<aqsis/aqsis.h>
+#include	<algorithm>
 #include	<boost/enable_shared_from_this.hpp>
 #include	<boost/utility.hpp>
 
@@ -48,6 +49,7 @@
 
 namespace Aqsis {
 
+class CqSplitRecord;
 
 //----------------------------------------------------------------------
 /** \class CqSurface
@@ -63,7 +65,7 @@ class CqSurface : public IqSurface, private boost::noncopyable, public boost::en
 		{
 			std::vector<CqParameter*>::iterator iUP;
 			for ( iUP = m_aUserParams.begin(); iUP != m_aUserParams.end(); iUP++ )
-				if ( NULL != ( *iUP ) )
+				if ( NULL != ( *iUP ) && !fSharedParameter( *iUP ) )
 					delete( *iUP );
 			STATS_DEC( GPR_current );
 		}
@@ -224,12 +226,80 @@ class CqSurface : public IqSurface, private boost::noncopyable, public boost::en
 			return ( m_pCSGNode );
 		}
  		virtual CqSurface* Clone() const = 0;
+		/** Combine this diceable GPrim with another so both can be diced and
+		 * shaded as a single grid.
+		 *
+		 * Small grids spend most of their time in the fixed per grid costs of
+		 * shading, so the bucket processor offers the next surfaces in the
+		 * bucket to the one about to be diced.  Only primitives whose grids
+		 * carry no derivative information between points can safely be
+		 * concatenated, so the default is not to combine at all.
+		 *
+		 * \param other - the surface to combine with this one.
+		 * \return A diceable surface covering both, or a null pointer if the
+		 * two can't be shaded together.
+		 */
+		virtual boost::shared_ptr<CqSurface> Coalesce( const CqSurface& /* other */ ) const
+		{
+			return boost::shared_ptr<CqSurface>();
+		}
+		/** Estimate the memory held by the primitive variables of this GPrim.
+		 *
+		 * The image buffer adds this up over the deferred GPrims to keep
+		 * them within Option "limits" "geometrymemory".
+		 *
+		 * \return The size in bytes.
+		 */
+		virtual TqUlong storageSize() const;
+		/** Get the record of the procedural which generated this GPrim, from
+		 * which it can be generated again if it is evicted.
+		 *
+		 * \return The record, or NULL if the GPrim can't be evicted.
+		 */
+		const boost::shared_ptr<CqSplitRecord>& splitRecord() const
+		{
+			return ( m_splitRecord );
+		}
+		/// Get the position of this GPrim in the output of its procedural.
+		TqInt	splitIndex() const
+		{
+			return ( m_splitIndex );
+		}
+		/// Set the record of the procedural which generated this GPrim.
+		void	setSplitRecord( const boost::shared_ptr<CqSplitRecord>& record, TqInt index )
+		{
+			m_splitRecord = record;
+			m_splitIndex = index;
+		}
 
 
 		virtual	void	SetDefaultPrimitiveVariables( bool bUseDef_st = true );
 
 		void ClonePrimitiveVariables( const CqSurface& From );
 
+		/** Mark this GPrim as the master copy of an instanced object.
+		 *
+		 * Clones of a master share its primitive variables which are left
+		 * alone by Transform(), rather than copying them.  The GPrim must be
+		 * held by a shared pointer.
+		 */
+		virtual void	SetInstanceMaster()
+		{
+			m_fInstanceMaster = true;
+		}
+		/** Determine whether a primitive variable of this GPrim can be shared
+		 * by its clones, because the clones never change it in place.
+		 */
+		virtual bool	fShareableParameter( const CqParameter* pParam ) const;
+		/** Determine whether a primitive variable is shared with the master
+		 * this GPrim was cloned from, rather than owned by this GPrim.
+		 */
+		bool	fSharedParameter( const CqParameter* pParam ) const
+		{
+			return ( m_pParamMaster && std::find( m_pParamMaster->m_aUserParams.begin(),
+					m_pParamMaster->m_aUserParams.end(), pParam ) != m_pParamMaster->m_aUserParams.end() );
+		}
+
 		/** Get a reference the to P default parameter.
 		 */
 		virtual CqParameterTyped<CqVector4D, CqVector3D>* P()
@@ -547,6 +617,10 @@ class CqSurface : public IqSurface, private boost::noncopyable, public boost::en
 		{}
 
 		virtual	CqMicroPolyGridBase* Dice();
+		/** Pass the user parameters to the shaders of a grid diced from this
+		 * surface, so that they are bound for shading it.
+		 */
+		void	DiceUserParams( CqMicroPolyGridBase* pGrid );
 		virtual	TqInt	Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits );
 
 		virtual bool isMoving() const
@@ -608,6 +682,10 @@ class CqSurface : public IqSurface, private boost::noncopyable, public boost::en
 		bool	m_CachedBound;		///< Whether or not the bound has been cached
 		CqBound	m_Bound;			///< The cached object bound
 		boost::shared_ptr<CqCSGTreeNode>	m_pCSGNode;		///< Pointer to the 'primitive' CSG node this surface belongs to, NULL if not part of a solid.
+		bool	m_fInstanceMaster;	///< Whether clones of this GPrim share its primitive variables.
+		boost::shared_ptr<const CqSurface>	m_pParamMaster;	///< Master holding the primitive variables shared with it, NULL if none are.
+		boost::shared_ptr<CqSplitRecord>	m_splitRecord;	///< Record of the procedural which generated this GPrim, NULL if it can't be evicted.
+		TqInt	m_splitIndex;		///< Position of this GPrim in the output of its procedural.
 }
 ;
 
@@ -692,6 +770,15 @@ class CqDeformingSurface : public CqSurface, public CqMotionSpec<boost::shared_p
 			}
 			return ( cSplits );
 		}
+		/** Get the storage of all the time slots.
+		 */
+		virtual TqUlong storageSize() const
+		{
+			TqUlong size = 0;
+			for ( TqInt i = 0; i < cTimes(); i++ )
+				size += GetMotionObject( Time( i ) )->storageSize();
+			return ( size );
+		}
 		/** Determine if the prmary time slot is diceable, this is the one that is shaded, so
 		 * determines the dicing rate, which is then copied to the other times.
 		 * \return Boolean indicating GPrim is diceable.
@@ -706,13 +793,34 @@ class CqDeformingSurface : public CqSurface, public CqMotionSpec<boost::shared_p
 			return ( f );
 		}
 
+		/** Clone all the time slots.
+		 * \return The clone, or NULL if any of the time slots can't be cloned.
+		 */
 		virtual CqSurface* Clone() const
 		{
-/* 			CqDeformingSurface* clone = new CqDeformingSurface(GetDefaultObject());
- * 			clone->CqMotionSpec<boost::shared_ptr<CqSurface> >::operator=(*this);
- * 			return(clone);
- */
-			return(NULL);
+			CqDeformingSurface* clone = new CqDeformingSurface( boost::shared_ptr<CqSurface>() );
+			CqSurface::CloneData( clone );
+			TqInt i;
+			for ( i = 0; i < cTimes(); i++ )
+			{
+				CqSurface* pTimeClone = GetMotionObject( Time( i ) ) ->Clone();
+				if ( !pTimeClone )
+				{
+					delete( clone );
+					return ( NULL );
+				}
+				clone->AddTimeSlot( Time( i ), boost::shared_ptr<CqSurface>( pTimeClone ) );
+			}
+			return ( clone );
+		}
+		/** Mark the GPrims at all times as instance masters.
+		 */
+		virtual void	SetInstanceMaster()
+		{
+			CqSurface::SetInstanceMaster();
+			TqInt i;
+			for ( i = 0; i < cTimes(); i++ )
+				GetMotionObject( Time( i ) ) ->SetInstanceMaster();
 		}
 
 
@@ -40,6 +40,7 @@
 #include	"threadscheduler.h"
 #include	"multijitter.h"
 #include	"grid.h"
+#include	"reshadestore.h"
 
 
 namespace Aqsis {
@@ -223,8 +224,27 @@ void	CqImageBuffer::SetImage()
 		rowPos += m_optCache.yBucketSize;
 	}
 
+	// Work out the order of the buckets now, since surfaces are posted to
+	// the first bucket they touch in that order.
+	EqBucketOrder order = Bucket_Horizontal;
+	if ( const CqString* pstrBucketOrder = opts.GetStringOption( "render", "bucketorder" ) )
+	{
+		if ( !bucketOrderFromName( pstrBucketOrder[ 0 ], order ) )
+			Aqsis::log() << warning << "Not supported \"" << pstrBucketOrder[ 0 ] << "\" bucket order, using \"horizontal\"" << std::endl;
+	}
+	bucketSequence( order, m_bucketRegion, m_bucketSequence );
+	m_bucketRanks.assign( m_cYBuckets, std::vector<TqInt>( m_cXBuckets, 0 ) );
+	for ( TqInt rank = 0, numBuckets = m_bucketSequence.size(); rank < numBuckets; ++rank )
+		m_bucketRanks[ m_bucketSequence[ rank ].second ][ m_bucketSequence[ rank ].first ] = rank;
+
+	m_bucketIndex = 0;
 	m_CurrentBucketCol = m_bucketRegion.xMin();
 	m_CurrentBucketRow = m_bucketRegion.yMin();
+	if ( !m_bucketSequence.empty() )
+	{
+		m_CurrentBucketCol = m_bucketSequence[ 0 ].first;
+		m_CurrentBucketRow = m_bucketSequence[ 0 ].second;
+	}
 }
 
 
@@ -399,10 +419,10 @@ void CqImageBuffer::PostSurface( const boost::shared_ptr<CqSurface>& pSurface )
 	// If the primitive has been marked as undiceable by the eyeplane check, then we cannot get a valid
 	// bucket index from it as the projection of the bound would cross the camera plane and therefore give a false
 	// result, so just put it back in the current bucket for further splitting.
-	TqInt XMinb = 0;
-	TqInt YMinb = 0;
-	TqInt XMaxb = 0;
-	TqInt YMaxb = 0;
+	TqInt XMinb = m_CurrentBucketCol;
+	TqInt YMinb = m_CurrentBucketRow;
+	TqInt XMaxb = m_CurrentBucketCol;
+	TqInt YMaxb = m_CurrentBucketRow;
 	if (! pSurface->IsUndiceable() )
 	{
 		XMinb = static_cast<TqInt>( Bound.vecMin().x() ) / m_optCache.xBucketSize;
@@ -410,39 +430,11 @@ void CqImageBuffer::PostSurface( const boost::shared_ptr<CqSurface>& pSurface )
 		XMaxb = static_cast<TqInt>( Bound.vecMax().x() ) / m_optCache.xBucketSize;
 		YMaxb = static_cast<TqInt>( Bound.vecMax().y() ) / m_optCache.yBucketSize;
 	}
-	XMinb = clamp( XMinb, m_bucketRegion.xMin(), m_bucketRegion.xMax()-1 );
-	YMinb = clamp( YMinb, m_bucketRegion.yMin(), m_bucketRegion.yMax()-1 );
-	XMaxb = clamp( XMaxb, m_bucketRegion.xMin(), m_bucketRegion.xMax()-1 );
-	YMaxb = clamp( YMaxb, m_bucketRegion.yMin(), m_bucketRegion.yMax()-1 );
 
-	// Sanity check we are not putting into a bucket that has already been processed.
-	CqBucket* bucket = &Bucket( XMinb, YMinb );
-	if ( bucket->IsProcessed() )
-	{
-		// Scan over the buckets that the bound touches, looking for the first one that isn't processed.
-		TqInt yb = YMinb;
-		TqInt xb = XMinb + 1;
-		bool done = false;
-		while(!done && yb <= YMaxb)
-		{
-			while(!done && xb <= XMaxb)
-			{
-				CqBucket& availBucket = Bucket(xb, yb);
-				if(!availBucket.IsProcessed())
-				{
-					availBucket.AddGPrim(pSurface);
-					done = true;
-				}
-				++xb;
-			}
-			xb = XMinb;
-			++yb;
-		}
-	}
-	else
-	{
+	// Put the surface into the first bucket it touches which isn't processed,
+	// in the order the buckets are processed.
+	if ( CqBucket* bucket = FirstBucketInRange( XMinb, YMinb, XMaxb, YMaxb, m_bucketIndex ) )
 		bucket->AddGPrim( pSurface );
-	}
 }
 
 
@@ -451,36 +443,16 @@ void CqImageBuffer::RepostSurface(const CqBucket& oldBucket,
 {
 	const CqBound rasterBound = surface->GetCachedRasterBound();
 
-	bool wasPosted = false;
 	// Surface is behind everying in this bucket but it may be visible in other
-	// buckets it overlaps.
-	//
-	// First look in bucket to the right
-	TqInt nextBucketX = oldBucket.getCol() + 1;
-	TqInt nextBucketY = oldBucket.getRow();
-	TqInt xpos = oldBucket.getXPosition() + oldBucket.getXSize();
-	if ( nextBucketX < m_bucketRegion.xMax() && rasterBound.vecMax().x() >= xpos )
-	{
-		Bucket( nextBucketX, nextBucketY ).AddGPrim( surface );
-		wasPosted = true;
-	}
-	else
-	{
-		// next row
-		++nextBucketY;
-		// find bucket containing left side of bound
-		nextBucketX = max<TqInt>(m_bucketRegion.xMin(),
-				lfloor(rasterBound.vecMin().x())/m_optCache.xBucketSize);
-		TqInt ypos = oldBucket.getYPosition() + oldBucket.getYSize();
-
-		if ( ( nextBucketX < m_bucketRegion.xMax() ) &&
-			( nextBucketY  < m_bucketRegion.yMax() ) &&
-			( rasterBound.vecMax().y() >= ypos ) )
-		{
-			Bucket( nextBucketX, nextBucketY ).AddGPrim( surface );
-			wasPosted = true;
-		}
-	}
+	// buckets it overlaps, so move it to the next of those in the bucket order.
+	CqBucket* nextBucket = FirstBucketInRange(
+			lfloor(rasterBound.vecMin().x())/m_optCache.xBucketSize,
+			lfloor(rasterBound.vecMin().y())/m_optCache.yBucketSize,
+			lfloor(rasterBound.vecMax().x())/m_optCache.xBucketSize,
+			lfloor(rasterBound.vecMax().y())/m_optCache.yBucketSize,
+			m_bucketRanks[oldBucket.getRow()][oldBucket.getCol()] + 1 );
+	if ( nextBucket )
+		nextBucket->AddGPrim( surface );
 
 #ifdef DEBUG
 	// Print info about reposting.  This is protected by DEBUG so that scenes
@@ -490,13 +462,13 @@ void CqImageBuffer::RepostSurface(const CqBucket& oldBucket,
 	if(const CqString* name = surface->pAttributes()
 			->GetStringAttribute("identifier", "name"))
 		objName = name[0];
-	if(wasPosted)
+	if(nextBucket)
 	{
 		Aqsis::log() << info << "GPrim: \"" << objName
 			<< "\" occluded in bucket: "
 			<< oldBucket.getCol() << ", " << oldBucket.getRow()
 			<< " shifted into bucket: "
-			<< nextBucketX << ", " << nextBucketY << "\n";
+			<< nextBucket->getCol() << ", " << nextBucket->getRow() << "\n";
 	}
 	else
 	{
@@ -506,15 +478,59 @@ void CqImageBuffer::RepostSurface(const CqBucket& oldBucket,
 #endif
 }
 
+
 //----------------------------------------------------------------------
-/** Add a new micro polygon to the list of waiting ones.
- * \param pmpgNew Pointer to a CqMicroPolygon derived class.
+/** Find the first unprocessed bucket of a range in the bucket order.
+ *
+ * \param xMin, yMin, xMax, yMax - inclusive range of bucket columns and
+ *                                 rows, clamped to the rendered buckets.
+ * \param minRank - buckets before this position in the order are skipped.
+ * \return the bucket, or NULL if all buckets in the range are processed.
  */
 
-void CqImageBuffer::AddMPG( boost::shared_ptr<CqMicroPolygon>& pmpgNew )
+CqBucket* CqImageBuffer::FirstBucketInRange( TqInt xMin, TqInt yMin, TqInt xMax, TqInt yMax,
+                                             TqInt minRank )
+{
+	xMin = clamp( xMin, m_bucketRegion.xMin(), m_bucketRegion.xMax()-1 );
+	yMin = clamp( yMin, m_bucketRegion.yMin(), m_bucketRegion.yMax()-1 );
+	xMax = clamp( xMax, m_bucketRegion.xMin(), m_bucketRegion.xMax()-1 );
+	yMax = clamp( yMax, m_bucketRegion.yMin(), m_bucketRegion.yMax()-1 );
+
+	CqBucket* first = 0;
+	TqInt firstRank = 0;
+	for ( TqInt row = yMin; row <= yMax; ++row )
+	{
+		for ( TqInt col = xMin; col <= xMax; ++col )
+		{
+			TqInt rank = m_bucketRanks[ row ][ col ];
+			if ( rank < minRank || ( first && rank >= firstRank ) )
+				continue;
+			CqBucket& bucket = Bucket( col, row );
+			if ( bucket.IsProcessed() )
+				continue;
+			first = &bucket;
+			firstRank = rank;
+			// Nothing can come earlier than this.
+			if ( rank == minRank )
+				return first;
+		}
+	}
+	return first;
+}
+
+//----------------------------------------------------------------------
+/** Find the range of buckets touched by a micropolygon bound.
+ * \param B Tight raster space bound, not including DoF.
+ * \param iXBa Integer minimum bucket column.
+ * \param iYBa Integer minimum bucket row.
+ * \param iXBb Integer maximum bucket column (inclusive).
+ * \param iYBb Integer maximum bucket row (inclusive).
+ * \return false if no unprocessed part of the image is touched.
+ */
+
+bool CqImageBuffer::BucketRange( CqBound B, TqInt& iXBa, TqInt& iYBa, TqInt& iXBb, TqInt& iYBb ) const
 {
 	CqRenderer* renderContext = QGetRenderContext();
-	CqBound B = pmpgNew->GetBound();
 
 	// Expand the micropolygon bound for DoF if necessary.
 	if(renderContext->UsingDepthOfField())
@@ -535,17 +551,9 @@ void CqImageBuffer::AddMPG( boost::shared_ptr<CqMicroPolygon>& pmpgNew )
 	     B.vecMin().x() > renderContext->cropWindowXMax() + m_optCache.xFiltSize / 2.0f ||
 	     B.vecMin().y() > renderContext->cropWindowYMax() + m_optCache.yFiltSize / 2.0f )
 	{
-		return;
+		return false;
 	}
 
-	////////// Dump the micro polygon into a dump file //////////
-#if ENABLE_MPDUMP
-	if(m_mpdump.IsOpen())
-		m_mpdump.dump(*pmpgNew);
-#endif
-	/////////////////////////////////////////////////////////////
-
-
 	// Find out the minimum bucket touched by the micropoly bound.
 
 	B.vecMin().x( B.vecMin().x() - (lfloor(m_optCache.xFiltSize / 2.0f)) );
@@ -553,15 +561,15 @@ void CqImageBuffer::AddMPG( boost::shared_ptr<CqMicroPolygon>& pmpgNew )
 	B.vecMax().x( B.vecMax().x() + (lfloor(m_optCache.xFiltSize / 2.0f)) );
 	B.vecMax().y( B.vecMax().y() + (lfloor(m_optCache.yFiltSize / 2.0f)) );
 
-	TqInt iXBa = static_cast<TqInt>( B.vecMin().x() / m_optCache.xBucketSize );
-	TqInt iYBa = static_cast<TqInt>( B.vecMin().y() / m_optCache.yBucketSize );
-	TqInt iXBb = static_cast<TqInt>( B.vecMax().x() / m_optCache.xBucketSize );
-	TqInt iYBb = static_cast<TqInt>( B.vecMax().y() / m_optCache.yBucketSize );
+	iXBa = static_cast<TqInt>( B.vecMin().x() / m_optCache.xBucketSize );
+	iYBa = static_cast<TqInt>( B.vecMin().y() / m_optCache.yBucketSize );
+	iXBb = static_cast<TqInt>( B.vecMax().x() / m_optCache.xBucketSize );
+	iYBb = static_cast<TqInt>( B.vecMax().y() / m_optCache.yBucketSize );
 
 	if ( ( iXBb < m_bucketRegion.xMin() ) || ( iYBb < m_bucketRegion.yMin() ) ||
 	        ( iXBa >= m_bucketRegion.xMax() ) || ( iYBa >= m_bucketRegion.yMax() ) )
 	{
-		return ;
+		return false;
 	}
 
 	// Use sane values -- otherwise sometimes crashes, probably
@@ -571,6 +579,30 @@ void CqImageBuffer::AddMPG( boost::shared_ptr<CqMicroPolygon>& pmpgNew )
 	if ( iXBb >= m_bucketRegion.xMax() )  iXBb = m_bucketRegion.xMax() - 1;
 	if ( iYBb >= m_bucketRegion.yMax() )  iYBb = m_bucketRegion.yMax() - 1;
 
+	return true;
+}
+
+
+//----------------------------------------------------------------------
+/** Add a new micro polygon to the list of waiting ones.
+ * \param pmpgNew Pointer to a CqMicroPolygon derived class.
+ */
+
+void CqImageBuffer::AddMPG( boost::shared_ptr<CqMicroPolygon>& pmpgNew )
+{
+	TqInt iXBa, iYBa, iXBb, iYBb;
+	if ( !BucketRange( pmpgNew->GetBound(), iXBa, iYBa, iXBb, iYBb ) )
+		return;
+	if ( m_keepMicroPolygons )
+		m_keptMicroPolygons.push_back( pmpgNew );
+
+	////////// Dump the micro polygon into a dump file //////////
+#if ENABLE_MPDUMP
+	if(m_mpdump.IsOpen())
+		m_mpdump.dump(*pmpgNew);
+#endif
+	/////////////////////////////////////////////////////////////
+
 	// Add the MP to all the Buckets that it touches
 	for ( TqInt i = iXBa; i <= iXBb; i++ )
 	{
@@ -591,6 +623,52 @@ void CqImageBuffer::AddMPG( boost::shared_ptr<CqMicroPolygon>& pmpgNew )
 }
 
 
+//----------------------------------------------------------------------
+/** Add the micropolygons of a static grid to the list of waiting ones.
+ *
+ * A single reference to the grid is held by each bucket touched by the
+ * bound of its micropolygons, see CqMicroQuadGrid.
+ *
+ * \param pGrid Compact micropolygon storage for a shaded grid.
+ */
+
+void CqImageBuffer::AddMicroQuadGrid( const boost::shared_ptr<CqMicroQuadGrid>& pGrid )
+{
+	TqInt iXBa, iYBa, iXBb, iYBb;
+	if ( !BucketRange( pGrid->GetBound(), iXBa, iYBa, iXBb, iYBb ) )
+		return;
+	if ( m_keepMicroPolygons )
+		m_keptMicroQuadGrids.push_back( pGrid );
+
+	////////// Dump the micro polygons into a dump file //////////
+#if ENABLE_MPDUMP
+	if(m_mpdump.IsOpen())
+	{
+		CqMicroQuadSampler sampler( *pGrid );
+		for ( TqInt i = 0, cQuads = pGrid->cQuads(); i < cQuads; i++ )
+		{
+			sampler.SetQuad( i );
+			m_mpdump.dump( sampler );
+		}
+	}
+#endif
+	/////////////////////////////////////////////////////////////
+
+	for ( TqInt i = iXBa; i <= iXBb; i++ )
+	{
+		for ( TqInt j = iYBa; j <= iYBb; j++ )
+		{
+			CqBucket* bucket = &Bucket( i, j );
+			// Only add the grid if the bucket isn't processed, see AddMPG().
+			if ( !bucket->IsProcessed() )
+			{
+				bucket->AddMicroQuadGrid( pGrid );
+			}
+		}
+	}
+}
+
+
 //----------------------------------------------------------------------
 /** Render any waiting Surfaces
  
@@ -635,26 +713,94 @@ void CqImageBuffer::RenderImage()
 	RtProgressFunc pProgressHandler = NULL;
 	pProgressHandler = QGetRenderContext()->pProgressHandler();
 
-	const CqString* pstrBucketOrder = QGetRenderContext() ->poptCurrent()->GetStringOption( "render", "bucketorder" );
-	enum EqBucketOrder order = Bucket_Horizontal;
-	if ( NULL != pstrBucketOrder )
-	{
-	if( !pstrBucketOrder[ 0 ].compare( "vertical" ) )
-		order = Bucket_Vertical;
-	else if ( !pstrBucketOrder[ 0 ].compare( "horizontal" ) )
-		order = Bucket_Horizontal;
-	else {
-		Aqsis::log() << warning << "Not supported \"" << pstrBucketOrder[ 0 ] << "\" " << std::endl;
-	}
-#ifdef NOTREADY
-	else if ( !pstrBucketOrder[ 0 ].compare( "zigzag" ) )
-		order = Bucket_ZigZag;
-	else if ( !pstrBucketOrder[ 0 ].compare( "circle" ) )
-		order = Bucket_Circle;
-	else if ( !pstrBucketOrder[ 0 ].compare( "random" ) )
-		order = Bucket_Random;
-#endif
+	// A progressive render samples the whole image at increasing numbers of
+	// pixel samples, up to the full number.  The micropolygons are kept
+	// from one level to the next, so only the first level dices and shades.
+	const TqInt xSamps = m_optCache.xSamps;
+	const TqInt ySamps = m_optCache.ySamps;
+	std::vector<std::pair<TqInt, TqInt> > levels;
+	ProgressiveLevels( levels );
+
+	// Buckets which are done before the render starts, see ReshadeGrids().
+	std::vector<std::vector<bool> > doneBuckets( m_cYBuckets, std::vector<bool>( m_cXBuckets ) );
+	for ( TqInt row = 0; row < m_cYBuckets; ++row )
+		for ( TqInt col = 0; col < m_cXBuckets; ++col )
+			doneBuckets[ row ][ col ] = Bucket( col, row ).IsProcessed();
+
+	for ( TqInt level = 0, numLevels = levels.size(); level < numLevels && !m_fQuit; ++level )
+	{
+		std::vector<boost::shared_ptr<CqMicroPolygon> > micropolygons;
+		std::vector<boost::shared_ptr<CqMicroQuadGrid> > microQuadGrids;
+		if ( level > 0 )
+		{
+			micropolygons.swap( m_keptMicroPolygons );
+			microQuadGrids.swap( m_keptMicroQuadGrids );
+			ResetBuckets( doneBuckets );
+		}
+		m_optCache.xSamps = levels[ level ].first;
+		m_optCache.ySamps = levels[ level ].second;
+		m_keepMicroPolygons = level + 1 < numLevels;
+		for ( std::vector<boost::shared_ptr<CqMicroPolygon> >::iterator i = micropolygons.begin();
+				i != micropolygons.end(); ++i )
+			AddMPG( *i );
+		for ( std::vector<boost::shared_ptr<CqMicroQuadGrid> >::iterator i = microQuadGrids.begin();
+				i != microQuadGrids.end(); ++i )
+			AddMicroQuadGrid( *i );
+		if ( numLevels > 1 )
+			Aqsis::log() << info << "Progressive level " << level + 1 << " of " << numLevels << ", "
+				<< m_optCache.xSamps << "x" << m_optCache.ySamps << " pixel samples" << std::endl;
+
+		RenderBuckets( level, numLevels );
 	}
+	m_optCache.xSamps = xSamps;
+	m_optCache.ySamps = ySamps;
+	m_keepMicroPolygons = false;
+	m_keptMicroPolygons.clear();
+	m_keptMicroQuadGrids.clear();
+
+	// Pass >100 through to progress to allow it to indicate completion.
+	if ( pProgressHandler )
+	{
+		( *pProgressHandler ) ( 100.0f, QGetRenderContext() ->CurrentFrame() );
+	}
+}
+
+
+//----------------------------------------------------------------------
+/** Find the pixel sample counts for each level of the render.
+ *
+ * Without Option "render" "progressive" there is a single level at the full
+ * PixelSamples.  Otherwise the counts double at each level, starting from
+ * 1x1.
+ *
+ * \param levels - the x and y sample counts are added to this, in order.
+ */
+
+void CqImageBuffer::ProgressiveLevels( std::vector<std::pair<TqInt, TqInt> >& levels ) const
+{
+	const TqInt xSamps = m_optCache.xSamps;
+	const TqInt ySamps = m_optCache.ySamps;
+	const TqInt* poptProgressive = QGetRenderContext() ->poptCurrent()->GetIntegerOption( "render", "progressive" );
+	if ( poptProgressive && poptProgressive[ 0 ] )
+	{
+		for ( TqInt x = 1, y = 1; x < xSamps || y < ySamps;
+				x = min( 2*x, xSamps ), y = min( 2*y, ySamps ) )
+			levels.push_back( std::make_pair( x, y ) );
+	}
+	levels.push_back( std::make_pair( xSamps, ySamps ) );
+}
+
+
+//----------------------------------------------------------------------
+/** Render all buckets which aren't done yet, at the current number of
+ * pixel samples.
+ *
+ * \param level, numLevels - level of a progressive render, for reporting progress.
+ */
+
+void CqImageBuffer::RenderBuckets( TqInt level, TqInt numLevels )
+{
+	RtProgressFunc pProgressHandler = QGetRenderContext()->pProgressHandler();
 
 	// A counter for the number of processed buckets (used for progress reporting)
 	TqInt iBucket = 0;
@@ -672,7 +818,7 @@ void CqImageBuffer::RenderImage()
 	{
 		bucketLists[index % MULTIPROCESSING_NBUCKETS].push_back( &(CurrentBucket()) );
 		++index;
-	} while ( NextBucket(order) );
+	} while ( NextBucket() );
 	boost::thread_group threadGroup;
 	for (int i = 0; i < MULTIPROCESSING_NBUCKETS; ++i)
 	{
@@ -712,6 +858,15 @@ void CqImageBuffer::RenderImage()
 
 		for (int i = 0; pendingBuckets && i < numConcurrentBuckets; ++i)
 		{
+			// Skip buckets which are already done, see ReshadeGrids().
+			while ( pendingBuckets && CurrentBucket().IsProcessed() )
+			{
+				iBucket += 1;
+				pendingBuckets = NextBucket();
+			}
+			if ( !pendingBuckets )
+				break;
+
 			bucketProcessors[i]->setBucket(&CurrentBucket());
 
 			// Prepare the bucket processor
@@ -729,7 +884,7 @@ void CqImageBuffer::RenderImage()
 
 			// Advance to next bucket, quit if nothing left
 			iBucket += 1;
-			pendingBuckets = NextBucket(order);
+			pendingBuckets = NextBucket();
 		}
 
 		// Wait for all current buckets to complete before allocating more to the available threads.
@@ -745,6 +900,8 @@ void CqImageBuffer::RenderImage()
 				if (bucket)
 				{
 					QGetRenderContext() ->pDDmanager() ->DisplayBucket( bucketProcessors[i]->DisplayRegion(), &(bucketProcessors[i]->getChannelBuffer()) );
+					if ( CqReshadeStore* reshadeStore = QGetRenderContext()->reshadeStore() )
+						reshadeStore->addBucket( bucket->getCol(), bucket->getRow(), bucketProcessors[i]->getChannelBuffer() );
 				}
 			}
 			bucketProcessors[i]->reset();
@@ -752,7 +909,8 @@ void CqImageBuffer::RenderImage()
 			if ( pProgressHandler )
 			{
 				// Inform the status class how far we have got, and update UI.
-				float Complete = (100.0f * iBucket) / static_cast<float> ( m_bucketRegion.area() );
+				float Complete = (100.0f * ( level * m_bucketRegion.area() + iBucket ))
+					/ static_cast<float> ( numLevels * m_bucketRegion.area() );
 				QGetRenderContext() ->Stats().SetComplete( Complete );
 				( *pProgressHandler ) ( Complete, QGetRenderContext() ->CurrentFrame() );
 			}
@@ -762,201 +920,194 @@ void CqImageBuffer::RenderImage()
 				SetProcessWorkingSetSize( GetCurrentProcess(), 0xffffffff, 0xffffffff );
 #endif
 		}
-	}
 
-	// Pass >100 through to progress to allow it to indicate completion.
-	if ( pProgressHandler )
-	{
-		( *pProgressHandler ) ( 100.0f, QGetRenderContext() ->CurrentFrame() );
+		// No bucket is being processed here, so the deferred GPrims can be
+		// swapped for proxies safely.
+		if ( m_optCache.geometryMemory > 0 && !m_fQuit )
+			LimitGeometryMemory( numConcurrentBuckets );
 	}
 }
 
 
 //----------------------------------------------------------------------
-/** Stop rendering.
+/** Evict the deferred GPrims of the buckets processed last first, since they
+ * would otherwise stay in memory the longest.
+ *
+ * Once over the limit, GPrims are evicted until they are down to three
+ * quarters of it.  A proxy brings back every evicted GPrim of its procedural
+ * when it is reached, so evicting only just enough would soon push the total
+ * over the limit again, and the same procedural would be run again and
+ * again.  For the same reason the buckets of the next batch are left alone,
+ * since their proxies would be regenerated straight away.
+ *
+ * \param numNextBuckets - number of buckets rendered in the next batch.
  */
 
-void CqImageBuffer::Quit()
+void CqImageBuffer::LimitGeometryMemory( TqInt numNextBuckets )
 {
-	m_fQuit = true;
-}
-
-//----------------------------------------------------------------------
-/** Move to the next bucket to process.
-
-  Computes the next bucket based on the "render" "bucketorder" given.
-
-  \return True if there is still an unprocessed bucket left, otherwise False.
- */
-bool CqImageBuffer::NextBucket(EqBucketOrder order)
-{
-	// only deal with horizontal bucket orders for now.
-	m_CurrentBucketCol++;
+	TqUlong limit = static_cast<TqUlong>( m_optCache.geometryMemory ) * 1024;
+	TqUlong total = 0;
+	std::vector<std::pair<TqInt, TqInt> >::const_iterator i;
+	for ( i = m_bucketSequence.begin(); i != m_bucketSequence.end(); ++i )
+		total += Bucket( i->first, i->second ).gPrimsSize();
+	if ( total <= limit )
+		return;
+	TqUlong target = limit - limit/4;
 
-	if( m_CurrentBucketCol >= m_bucketRegion.xMax() )
+	// Find the end of the next batch of unprocessed buckets.
+	TqInt nextEnd = m_bucketIndex;
+	for ( TqInt numNext = 0, numBuckets = m_bucketSequence.size();
+			nextEnd < numBuckets && numNext < numNextBuckets; ++nextEnd )
 	{
-		m_CurrentBucketCol = m_bucketRegion.xMin();
-		m_CurrentBucketRow++;
-		if( m_CurrentBucketRow >= m_bucketRegion.yMax() )
-			return false;
+		if ( !Bucket( m_bucketSequence[ nextEnd ].first, m_bucketSequence[ nextEnd ].second ).IsProcessed() )
+			++numNext;
 	}
 
-	// General bucket orders are not ready for prime time.
-	// WARNING: The code below needs to be adjusted to deal with m_bucketRegion
-#if 0
-	TqInt cnt = 0;
-	TqInt total = m_bucketRegion.area();
-
-	for (TqInt i =0; i < m_cYBuckets - 1 ; i++)
-		for (TqInt j = 0; j < m_cXBuckets - 1; j++)
-			if (Bucket(j, i).IsProcessed() )
-				cnt ++;
-         
-	if ((order != Bucket_Vertical) &&
-	        (order != Bucket_Horizontal) &&
-	        (cnt == total))
-		return false;
-
-	switch (order)
+	for ( TqInt index = m_bucketSequence.size() - 1; index >= nextEnd && total > target; --index )
 	{
+		CqBucket& bucket = Bucket( m_bucketSequence[ index ].first, m_bucketSequence[ index ].second );
+		if ( !bucket.IsProcessed() )
+			total -= bucket.evictGPrims( total - target );
+	}
+}
 
-		case Bucket_Random :
-		{
-			CqRandom rg;
-			do
-			{
-				m_CurrentBucketCol = (TqInt) rg.RandomFloat(m_cXBuckets);
-				m_CurrentBucketRow = (TqInt) rg.RandomFloat(m_cYBuckets);
-				m_CurrentBucketCol = clamp(m_CurrentBucketCol, 0, m_cXBuckets - 1);
-				m_CurrentBucketRow = clamp(m_CurrentBucketRow, 0, m_cYBuckets - 1);
-			}
-			while ( Bucket(m_CurrentBucketCol, m_CurrentBucketRow).IsProcessed() );
 
-		}
-		break;
+//----------------------------------------------------------------------
+/** Mark the buckets as not processed, for the next level of a progressive
+ * render.
+ *
+ * \param doneBuckets - buckets which were done before the render started,
+ *                      and so stay processed.
+ */
 
-		case Bucket_Circle :
+void CqImageBuffer::ResetBuckets( const std::vector<std::vector<bool> >& doneBuckets )
+{
+	for ( TqInt row = m_bucketRegion.yMin(); row < m_bucketRegion.yMax(); ++row )
+	{
+		for ( TqInt col = m_bucketRegion.xMin(); col < m_bucketRegion.xMax(); ++col )
 		{
-			static TqInt radius = 0;
-			static float theta = 0.0f;
-
-			if ((m_CurrentBucketCol == m_CurrentBucketRow) &&
-				(m_CurrentBucketRow == 0))
-			{
-				radius = 0;
-				theta = 0.0f;
-			}
-			TqFloat r = (TqFloat) sqrt(static_cast<double>((m_cXBuckets * m_cXBuckets) + (m_cYBuckets * m_cYBuckets))) + 2;
-			TqInt midx = m_cXBuckets/2;
-			TqInt midy = m_cYBuckets/2;
-
-
-			TqFloat delta = 0.01f;
-
-			do
-			{
-				if (radius > r)
-					break;
-				m_CurrentBucketCol = midx + (TqInt) (radius * cos(theta));
-				m_CurrentBucketRow = midy + (TqInt) (radius * sin(theta));
-
-				theta += delta;
-				if (theta > 6.28f)
-				{
-					theta = 0.0f;
-					radius ++;
-				}
-				if (radius > r)
-					break;
+			if ( !doneBuckets[ row ][ col ] )
+				Bucket( col, row ).SetProcessed( false );
+		}
+	}
+	m_bucketIndex = 0;
+	if ( !m_bucketSequence.empty() )
+	{
+		m_CurrentBucketCol = m_bucketSequence[ 0 ].first;
+		m_CurrentBucketRow = m_bucketSequence[ 0 ].second;
+	}
+}
 
-				m_CurrentBucketCol = clamp(m_CurrentBucketCol, 0, m_cXBuckets - 1);
-				m_CurrentBucketRow = clamp(m_CurrentBucketRow, 0, m_cYBuckets - 1);
-			}
-			while (Bucket(m_CurrentBucketCol, m_CurrentBucketRow).IsProcessed());
 
-			if (radius > r)
-			{
-				// Maybe a bucket was not done
-				for (TqInt i =0; i < m_cYBuckets - 1 ; i++)
-					for (TqInt j = 0; j < m_cXBuckets - 1; j++)
-						if (!Bucket(j, i).IsProcessed() )
-						{
-							m_CurrentBucketCol = j;
-							m_CurrentBucketRow = i;
-
-						}
-			}
+//----------------------------------------------------------------------
+/** Set up the buckets for reshading the grids kept from the last render.
+ */
 
+void CqImageBuffer::ReshadeGrids( CqReshadeStore& store )
+{
+	std::vector<CqReshadeStore::SqGrid>& grids = store.grids();
 
+	// Find the buckets covered by the dirty grids.
+	std::vector<std::vector<bool> > dirtyBuckets( m_cYBuckets, std::vector<bool>( m_cXBuckets, false ) );
+	std::vector<CqReshadeStore::SqGrid>::iterator grid;
+	for ( grid = grids.begin(); grid != grids.end(); ++grid )
+	{
+		TqInt iXBa, iYBa, iXBb, iYBb;
+		if ( grid->dirty && BucketRange( grid->bound, iXBa, iYBa, iXBb, iYBb ) )
+		{
+			for ( TqInt row = iYBa; row <= iYBb; ++row )
+				for ( TqInt col = iXBa; col <= iXBb; ++col )
+					dirtyBuckets[ row ][ col ] = true;
 		}
-		break;
+	}
 
-		case Bucket_ZigZag :
+	// Show the stored results for the other buckets.
+	TqInt cleanBuckets = 0;
+	for ( TqInt row = m_bucketRegion.yMin(); row < m_bucketRegion.yMax(); ++row )
+	{
+		for ( TqInt col = m_bucketRegion.xMin(); col < m_bucketRegion.xMax(); ++col )
 		{
-
-			if (bucketdirection == 1)
-				m_CurrentBucketCol++;
-			else
-				m_CurrentBucketCol--;
-
-			if((bucketdirection == 1) && ( m_CurrentBucketCol >= m_cXBuckets ))
+			const CqChannelBuffer* buffer = store.bucket( col, row );
+			if ( dirtyBuckets[ row ][ col ] || !buffer )
 			{
-
-				m_CurrentBucketCol = m_cXBuckets-1;
-				m_CurrentBucketRow++;
-				bucketdirection = -1;
-				if( m_CurrentBucketRow >= m_cYBuckets )
-					return( false );
-
+				dirtyBuckets[ row ][ col ] = true;
+				continue;
 			}
-			else if((bucketdirection == -1) && ( m_CurrentBucketCol < 0 ))
-			{
-
-				m_CurrentBucketCol = 0;
-				m_CurrentBucketRow++;
-				bucketdirection = 1;
-
-				if( m_CurrentBucketRow >= m_cYBuckets )
-					return( false );
+			CqBucket& bucket = Bucket( col, row );
+			CqRegion region( bucket.getXPosition(), bucket.getYPosition(),
+					bucket.getXPosition() + bucket.getXSize(),
+					bucket.getYPosition() + bucket.getYSize() );
+			QGetRenderContext() ->pDDmanager() ->DisplayBucket( region, buffer );
+			bucket.SetProcessed();
+			++cleanBuckets;
+		}
+	}
 
-			}
+	// Reshade the dirty grids, and put the micropolygons of all grids
+	// touching the buckets to be sampled back into them.  A progressive
+	// render needs them again for its later levels, see RenderImage().
+	std::vector<std::pair<TqInt, TqInt> > levels;
+	ProgressiveLevels( levels );
+	m_keepMicroPolygons = levels.size() > 1;
+	TqInt reshaded = 0;
+	TqInt resplit = 0;
+	for ( grid = grids.begin(); grid != grids.end(); ++grid )
+	{
+		TqInt iXBa, iYBa, iXBb, iYBb;
+		if ( !BucketRange( grid->bound, iXBa, iYBa, iXBb, iYBb ) )
+			continue;
+		bool touchesDirty = false;
+		for ( TqInt row = iYBa; row <= iYBb && !touchesDirty; ++row )
+			for ( TqInt col = iXBa; col <= iXBb && !touchesDirty; ++col )
+				touchesDirty = dirtyBuckets[ row ][ col ];
+		if ( !touchesDirty )
+			continue;
+		if ( grid->dirty )
+		{
+			grid->grid->Reshade();
+			++reshaded;
 		}
-		break;
-		case Bucket_Vertical :
+		else
 		{
+			grid->grid->RestorePositions();
+			++resplit;
+		}
+		grid->grid->Split( m_bucketRegion.xMin(), m_bucketRegion.xMax(),
+				m_bucketRegion.yMin(), m_bucketRegion.yMax() );
+	}
+	for ( grid = grids.begin(); grid != grids.end(); ++grid )
+		grid->dirty = false;
 
-			m_CurrentBucketRow++;
+	Aqsis::log() << info << "Reshading " << reshaded << " grids, resampling "
+		<< reshaded + resplit << " grids in " << m_bucketRegion.area() - cleanBuckets
+		<< " of " << m_bucketRegion.area() << " buckets" << std::endl;
+}
 
-			if( m_CurrentBucketRow >= m_cYBuckets )
-			{
 
-				m_CurrentBucketRow = 0;
-				m_CurrentBucketCol++;
+//----------------------------------------------------------------------
+/** Stop rendering.
+ */
 
-				if( m_CurrentBucketCol >= m_cXBuckets )
-					return( false );
+void CqImageBuffer::Quit()
+{
+	m_fQuit = true;
+}
 
-			}
-		}
-		break;
-		default:
-		case Bucket_Horizontal :
-		{
+//----------------------------------------------------------------------
+/** Move to the next bucket to process.
 
-			m_CurrentBucketCol++;
+  Follows the sequence of buckets built from "render" "bucketorder" by SetImage().
 
-			if( m_CurrentBucketCol >= m_bucketRegion.xMax() )
-			{
-				m_CurrentBucketCol = m_bucketRegion.xMin();
-				m_CurrentBucketRow++;
-				if( m_CurrentBucketRow >= m_bucketRegion.yMax() )
-					return( false );
-			}
-		}
-		break;
-	}
-#endif
-	return( true );
+  \return True if there is still an unprocessed bucket left, otherwise False.
+ */
+bool CqImageBuffer::NextBucket()
+{
+	++m_bucketIndex;
+	if ( m_bucketIndex >= static_cast<TqInt>( m_bucketSequence.size() ) )
+		return false;
+	m_CurrentBucketCol = m_bucketSequence[ m_bucketIndex ].first;
+	m_CurrentBucketRow = m_bucketSequence[ m_bucketIndex ].second;
+	return true;
 }
 
 //---------------------------------------------------------------------
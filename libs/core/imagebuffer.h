@@ -35,6 +35,7 @@
 #include	"surface.h"
 #include	<aqsis/math/vector2d.h>
 #include   	"bucket.h"
+#include	"bucketorder.h"
 #include	"mpdump.h"
 #include	"optioncache.h"
 
@@ -42,16 +43,8 @@ namespace Aqsis {
 
 
 class CqMicroPolygon;
-
-
-// Enumeration of the type of rendering order of the buckets (experimental)
-enum EqBucketOrder {
-        Bucket_Horizontal = 0,
-        Bucket_Vertical,
-        Bucket_ZigZag,
-        Bucket_Circle,
-        Bucket_Random
-};
+class CqMicroQuadGrid;
+class CqReshadeStore;
 
 
 //-----------------------------------------------------------------------
@@ -84,11 +77,18 @@ class CqImageBuffer
 				m_cXBuckets( 0 ),
 				m_cYBuckets( 0 ),
 				m_CurrentBucketCol( 0 ),
-				m_CurrentBucketRow( 0 )
+				m_CurrentBucketRow( 0 ),
+				m_bucketSequence(),
+				m_bucketRanks(),
+				m_bucketIndex( 0 ),
+				m_keepMicroPolygons( false ),
+				m_keptMicroPolygons(),
+				m_keptMicroQuadGrids()
 		{}
 		~CqImageBuffer();
 
 		void AddMPG( boost::shared_ptr<CqMicroPolygon>& pmpgNew );
+		void AddMicroQuadGrid( const boost::shared_ptr<CqMicroQuadGrid>& pGrid );
 		void PostSurface( const boost::shared_ptr<CqSurface>& pSurface );
 		/** \brief Repost a previously posted surface into the next unfinished bucket.
 		 *
@@ -103,6 +103,15 @@ class CqImageBuffer
 		void RepostSurface( const CqBucket& oldBucket,
 		                    const boost::shared_ptr<CqSurface>& surface );
 		void RenderImage();
+		/** \brief Set up the buckets for reshading the grids kept from the last render.
+		 *
+		 * Dirty grids are shaded again, and split along with the other grids
+		 * touching the buckets they cover.  The remaining buckets are sent to
+		 * the displays from the store and marked as processed, so that
+		 * RenderImage() only samples the affected buckets.  Must be called
+		 * between SetImage() and RenderImage(), with the displays open.
+		 */
+		void ReshadeGrids( CqReshadeStore& store );
 
 		void SetImage();
 		void Quit();
@@ -121,6 +130,15 @@ class CqImageBuffer
 		 *  \param neighbours - A reference to the array to be filled.
 		 */
 		void	axialNeighbours(CqBucket const& bucket, std::vector<CqBucket*>& neighbours);
+		/** Whether the micropolygons being bucketed are kept for a later
+		 * level of a progressive render.  Surfaces mustn't be occlusion
+		 * culled then, since the samples of the current level are only a
+		 * subset of those of the later levels.
+		 */
+		bool	fKeepMicroPolygons() const
+		{
+			return m_keepMicroPolygons;
+		}
 
 	private:
 		/// Get a pointer to the bucket at position x,y in the grid.
@@ -143,17 +161,47 @@ class CqImageBuffer
 		std::vector<std::vector<CqBucket> >	m_Buckets; ///< Array of bucket storage classes (row/col)
 		TqInt	m_CurrentBucketCol;	///< Column index of the bucket currently being processed.
 		TqInt	m_CurrentBucketRow;	///< Row index of the bucket currently being processed.
+		/// Columns and rows of the buckets, in the order they are processed.
+		std::vector<std::pair<TqInt, TqInt> >	m_bucketSequence;
+		/// Position of each bucket in m_bucketSequence, by row and column.
+		std::vector<std::vector<TqInt> >	m_bucketRanks;
+		TqInt	m_bucketIndex;		///< Position of the current bucket in m_bucketSequence.
+
+		/** Whether micropolygons are kept for the next level of a progressive
+		 * render.  All micropolygons of the frame are then held until the
+		 * last level starts, rather than only until their buckets are done.
+		 */
+		bool	m_keepMicroPolygons;
+		std::vector<boost::shared_ptr<CqMicroPolygon> >	m_keptMicroPolygons;
+		std::vector<boost::shared_ptr<CqMicroQuadGrid> >	m_keptMicroQuadGrids;
 
 #if ENABLE_MPDUMP
 		CqMPDump	m_mpdump;
 #endif
 
 		bool	CullSurface( CqBound& Bound, const boost::shared_ptr<CqSurface>& pSurface );
+		bool	BucketRange( CqBound B, TqInt& iXBa, TqInt& iYBa, TqInt& iXBb, TqInt& iYBb ) const;
 		void	DeleteImage();
 
+		/// Find the pixel sample counts of the levels of a progressive render.
+		void	ProgressiveLevels( std::vector<std::pair<TqInt, TqInt> >& levels ) const;
+		/// Process all unfinished buckets, as one level of a progressive render.
+		void	RenderBuckets( TqInt level, TqInt numLevels );
+		/// Mark the buckets which weren't done before the render as unprocessed.
+		void	ResetBuckets( const std::vector<std::vector<bool> >& doneBuckets );
+		/** Evict deferred GPrims, starting from the last bucket in the order,
+		 * once they are over Option "limits" "geometrymemory".
+		 */
+		void	LimitGeometryMemory( TqInt numNextBuckets );
+
 		/** Move to the next bucket to process.
 		 */
-		bool NextBucket(EqBucketOrder order);
+		bool NextBucket();
+		/** Find the first unprocessed bucket of a range in the bucket order,
+		 * skipping those before the given position in the order.
+		 */
+		CqBucket* FirstBucketInRange( TqInt xMin, TqInt yMin, TqInt xMax, TqInt yMax,
+		                              TqInt minRank );
 
 		/** Get a pointer to the current bucket
 		 */
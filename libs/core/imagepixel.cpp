@@ -51,7 +51,8 @@ CqImagePixel::CqImagePixel(TqInt xSamples, TqInt ySamples)
 		m_hitSamples(),
 		m_DofOffsetIndices(new TqInt[xSamples*ySamples]),
 		m_refCount(0),
-		m_hasValidSamples(false)
+		m_hasValidSamples(false),
+		m_numUsedSamples(xSamples*ySamples)
 {
 	assert(xSamples > 0);
 	assert(ySamples > 0);
@@ -73,6 +74,7 @@ void CqImagePixel::swap(CqImagePixel& other)
 	m_samples.swap(other.m_samples);
 	m_DofOffsetIndices.swap(other.m_DofOffsetIndices);
 	m_hasValidSamples = other.m_hasValidSamples;
+	std::swap(m_numUsedSamples, other.m_numUsedSamples);
 }
 
 void CqImagePixel::setupGridPattern(CqVector2D& offset, TqFloat opentime,
@@ -118,7 +120,89 @@ void CqImagePixel::clear()
 		m_samples[i].occludingHit.index = i*sampSize;
 		// Reset the occluding depth to the maximum.
 		m_samples[i].occlZ = FLT_MAX;
+		m_samples[i].isActive = true;
+		m_samples[i].isUsed = true;
 	}
+	m_numUsedSamples = nSamples;
+}
+
+void CqImagePixel::selectBaseSamples(TqInt xStep, TqInt yStep)
+{
+	m_numUsedSamples = 0;
+	for(TqInt j = 0; j < m_YSamples; ++j)
+	{
+		for(TqInt i = 0; i < m_XSamples; ++i)
+		{
+			SqSampleData& sample = m_samples[j*m_XSamples + i];
+			sample.isUsed = i % xStep == 0 && j % yStep == 0;
+			sample.isActive = sample.isUsed;
+			if(sample.isUsed)
+				++m_numUsedSamples;
+		}
+	}
+}
+
+void CqImagePixel::deactivateSamples()
+{
+	for(TqInt i = 0, nSamples = numSamples(); i < nSamples; ++i)
+		m_samples[i].isActive = false;
+}
+
+void CqImagePixel::activateSkippedSamples()
+{
+	TqInt nSamples = numSamples();
+	for(TqInt i = 0; i < nSamples; ++i)
+	{
+		m_samples[i].isActive = !m_samples[i].isUsed;
+		m_samples[i].isUsed = true;
+	}
+	m_numUsedSamples = nSamples;
+}
+
+bool CqImagePixel::samplesVary(TqFloat threshold, TqFloat contrast) const
+{
+	const TqInt numChannels = 4;
+	TqFloat sum[numChannels] = {0, 0, 0, 0};
+	TqFloat sum2[numChannels] = {0, 0, 0, 0};
+	TqFloat minVal[numChannels] = {FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX};
+	TqFloat maxVal[numChannels] = {0, 0, 0, 0};
+	TqInt count = 0;
+	for(TqInt i = 0, nSamples = numSamples(); i < nSamples; ++i)
+	{
+		if(!m_samples[i].isUsed)
+			continue;
+		TqFloat val[numChannels] = {0, 0, 0, 0};
+		const SqImageSample& hit = m_samples[i].occludingHit;
+		if(hit.flags & SqImageSample::Flag_Valid)
+		{
+			const TqFloat* data = sampleHitData(hit);
+			val[0] = data[Sample_Red];
+			val[1] = data[Sample_Green];
+			val[2] = data[Sample_Blue];
+			val[3] = (data[Sample_ORed] + data[Sample_OGreen] + data[Sample_OBlue])/3;
+		}
+		for(TqInt c = 0; c < numChannels; ++c)
+		{
+			sum[c] += val[c];
+			sum2[c] += val[c]*val[c];
+			minVal[c] = min(minVal[c], val[c]);
+			maxVal[c] = max(maxVal[c], val[c]);
+		}
+		++count;
+	}
+	if(count < 2)
+		return false;
+	for(TqInt c = 0; c < numChannels; ++c)
+	{
+		TqFloat mean = sum[c]/count;
+		TqFloat variance = sum2[c]/count - mean*mean;
+		if(variance > threshold*threshold)
+			return true;
+		TqFloat range = maxVal[c] + minVal[c];
+		if(range > 0 && (maxVal[c] - minVal[c]) > contrast*range)
+			return true;
+	}
+	return false;
 }
 
 
@@ -149,6 +233,8 @@ void CqImagePixel::Combine( enum EqDepthFilter depthfilter, CqColor zThreshold )
 	for(TqInt sampIdx = 0; sampIdx < nSamples; ++sampIdx)
 	{
 		SqSampleData& sampleData = m_samples[sampIdx];
+		if(!sampleData.isActive)
+			continue;
 
 		SqImageSample& occlHit = sampleData.occludingHit;
 		sampleIndex++;
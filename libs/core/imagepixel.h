@@ -145,6 +145,10 @@ struct SqSampleData : private boost::noncopyable
 	 * or other more exotic depth filters)
 	 */
 	TqFloat occlZ;
+	/// Whether micropolygons are sampled at this point in the current pass.
+	bool isActive;
+	/// Whether the sample contributes to the pixel; adaptive sampling skips some.
+	bool isUsed;
 
 	/// Default construct members & set numeric members to 0 except occlZ=FLT_MAX.
 	SqSampleData();
@@ -212,10 +216,37 @@ class CqImagePixel : private boost::noncopyable
 		/** \brief Clear all sample information from this pixel.
 		 *
 		 * Removes all the semitransparent sample hits and resets the occluding
-		 * sample hits to invalid.
+		 * sample hits to invalid.  All samples are made active and used again.
 		 */
 		void clear();
 
+		/** \brief Use only a subset of the samples, for adaptive sampling.
+		 *
+		 * The samples in every xStep'th column and yStep'th row of the
+		 * sample strata are kept active, the others are skipped.
+		 */
+		void selectBaseSamples(TqInt xStep, TqInt yStep);
+		/** \brief Stop sampling at all samples, after they have been combined.
+		 */
+		void deactivateSamples();
+		/** \brief Activate and use the samples skipped by selectBaseSamples().
+		 */
+		void activateSkippedSamples();
+		/// Get the number of samples which contribute to the pixel.
+		TqInt numUsedSamples() const;
+		/** \brief Whether the combined used samples vary too much for
+		 * adaptive sampling.
+		 *
+		 * The standard deviation and the contrast (max-min)/(max+min) of the
+		 * colour and the opacity of the used samples are compared against
+		 * the thresholds.  Samples which didn't hit anything count as black
+		 * and transparent.  Fewer than two used samples never vary.
+		 *
+		 * \param threshold - standard deviation above which samples vary.
+		 * \param contrast - contrast above which samples vary.
+		 */
+		bool samplesVary(TqFloat threshold, TqFloat contrast) const;
+
 		/** \brief Get a reference to the array of values for the specified sample.
 		 * \param index the index of the sample point within the pixel
 		 */
@@ -244,7 +275,9 @@ class CqImagePixel : private boost::noncopyable
 		 *  
 		 *  The successful sample hits recorded at each sample point are
 		 *  combined using alpha blending to produce a final visible color
-		 *  at the top of the sample.
+		 *  at the top of the sample.  Only active samples are combined, so
+		 *  that samples added by adaptive sampling can be combined without
+		 *  combining the others twice.
 		 *
 		 *  \param eDepthFilter - The filter to use to combine depth values.
 		 *  \param zThreshold - The color value at which to consider a sample opaque
@@ -324,6 +357,8 @@ class CqImagePixel : private boost::noncopyable
 		int m_refCount;
 		/// A flag to indicate successful sample hits in this pixel.
 		bool m_hasValidSamples;
+		/// The number of samples contributing to the pixel.
+		TqInt m_numUsedSamples;
 }; 
 
 /// Intrusive reference counted pointer to a pixel class.
@@ -400,7 +435,9 @@ inline SqSampleData::SqSampleData()
 	detailLevel(0),
 	data(),
 	occludingHit(),
-	occlZ(FLT_MAX)
+	occlZ(FLT_MAX),
+	isActive(true),
+	isUsed(true)
 { }
 
 
@@ -421,6 +458,11 @@ inline TqInt CqImagePixel::numSamples() const
 	return m_XSamples*m_YSamples;
 }
 
+inline TqInt CqImagePixel::numUsedSamples() const
+{
+	return m_numUsedSamples;
+}
+
 inline TqInt CqImagePixel::GetDofOffsetIndex(TqInt i) const
 {
 	return m_DofOffsetIndices[i];
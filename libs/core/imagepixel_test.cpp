@@ -0,0 +1,116 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for the adaptive sampling parts of CqImagePixel.
+ */
+
+#include "imagepixel.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(imagepixel_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+/// Give a sample of the pixel an opaque grey hit.
+void setHit(CqImagePixel& pixel, TqInt index, TqFloat grey)
+{
+	SqImageSample& hit = pixel.occludingHit(index);
+	hit.flags |= SqImageSample::Flag_Valid;
+	TqFloat* data = pixel.sampleHitData(hit);
+	data[Sample_Red] = data[Sample_Green] = data[Sample_Blue] = grey;
+	data[Sample_ORed] = data[Sample_OGreen] = data[Sample_OBlue] = 1;
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(imagepixel_base_samples_test)
+{
+	CqImagePixel pixel(4, 4);
+	BOOST_CHECK_EQUAL(pixel.numUsedSamples(), 16);
+
+	pixel.selectBaseSamples(2, 2);
+	BOOST_CHECK_EQUAL(pixel.numUsedSamples(), 4);
+	for(TqInt j = 0; j < 4; ++j)
+	{
+		for(TqInt i = 0; i < 4; ++i)
+		{
+			const SqSampleData& sample = pixel.SampleData(j*4 + i);
+			bool base = i % 2 == 0 && j % 2 == 0;
+			BOOST_CHECK_EQUAL(sample.isUsed, base);
+			BOOST_CHECK_EQUAL(sample.isActive, base);
+		}
+	}
+
+	// Only the skipped samples are sampled next, but all are used.
+	pixel.activateSkippedSamples();
+	BOOST_CHECK_EQUAL(pixel.numUsedSamples(), 16);
+	for(TqInt j = 0; j < 4; ++j)
+	{
+		for(TqInt i = 0; i < 4; ++i)
+		{
+			const SqSampleData& sample = pixel.SampleData(j*4 + i);
+			BOOST_CHECK(sample.isUsed);
+			BOOST_CHECK_EQUAL(sample.isActive, i % 2 != 0 || j % 2 != 0);
+		}
+	}
+
+	pixel.clear();
+	BOOST_CHECK_EQUAL(pixel.numUsedSamples(), 16);
+	BOOST_CHECK(pixel.SampleData(5).isActive);
+}
+
+BOOST_AUTO_TEST_CASE(imagepixel_samples_vary_test)
+{
+	CqImagePixel pixel(2, 2);
+	pixel.selectBaseSamples(1, 2);
+	// Samples 0 and 1 are used.
+	setHit(pixel, 0, 0.5f);
+	setHit(pixel, 1, 0.5f);
+	BOOST_CHECK(!pixel.samplesVary(0.02f, 0.3f));
+
+	// The skipped samples don't count.
+	setHit(pixel, 2, 1.0f);
+	BOOST_CHECK(!pixel.samplesVary(0.02f, 0.3f));
+
+	// A small change shows in the deviation, or in a low contrast.
+	setHit(pixel, 1, 0.6f);
+	BOOST_CHECK(pixel.samplesVary(0.02f, 0.3f));
+	BOOST_CHECK(!pixel.samplesVary(0.1f, 0.3f));
+	BOOST_CHECK(pixel.samplesVary(0.1f, 0.05f));
+
+	// Samples without a hit are black and transparent.
+	pixel.clear();
+	pixel.selectBaseSamples(1, 2);
+	setHit(pixel, 0, 0.5f);
+	BOOST_CHECK(pixel.samplesVary(1.0f, 0.3f));
+
+	// A single sample can't vary.
+	pixel.selectBaseSamples(2, 2);
+	setHit(pixel, 0, 0.5f);
+	BOOST_CHECK_EQUAL(pixel.numUsedSamples(), 1);
+	BOOST_CHECK(!pixel.samplesVary(0.0f, 0.0f));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
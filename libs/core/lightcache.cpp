@@ -0,0 +1,213 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/**
+        \file
+        \brief Implements a cache of light shader results for static lights.
+*/
+
+#include "lightcache.h"
+
+#include <cmath>
+
+#include <aqsis/math/math.h>
+
+namespace Aqsis {
+
+namespace {
+
+/// Number of cells along each axis of the normal grid, over [-1,1].
+const TqFloat normalCells = 32.0f;
+
+/// Cell index of a coordinate, clamped so that it can't overflow.
+inline TqInt cellIndex(TqFloat x)
+{
+	const TqFloat limit = 1e9f;
+	return static_cast<TqInt>(std::floor(clamp(x, -limit, limit)));
+}
+
+struct SqRegistryEntry
+{
+	boost::shared_ptr<CqLightCache> cache;
+	TqInt frame;
+};
+typedef std::map<std::string, SqRegistryEntry> TqRegistry;
+
+boost::mutex g_registryMutex;
+TqRegistry g_registry;
+TqInt g_frame = 0;
+
+} // unnamed namespace
+
+
+//------------------------------------------------------------------------------
+bool CqLightCache::SqKey::operator<(const SqKey& rhs) const
+{
+	for(TqInt i = 0; i < 6; ++i)
+	{
+		if(k[i] != rhs.k[i])
+			return k[i] < rhs.k[i];
+	}
+	return false;
+}
+
+
+CqLightCache::CqLightCache(const std::string& name, TqFloat tolerance, bool useNormal)
+	: m_name(name),
+	m_invTolerance(tolerance > 0 ? 1/tolerance : 1e6f),
+	m_useNormal(useNormal),
+	m_mutex(),
+	m_samples(),
+	m_hits(0),
+	m_misses(0)
+{ }
+
+TqInt CqLightCache::lookup(const std::vector<CqVector3D>& P,
+		const std::vector<CqVector3D>& N, std::vector<SqSample>& samples,
+		std::vector<bool>& missed)
+{
+	TqInt count = P.size();
+	samples.resize(count);
+	missed.assign(count, true);
+	std::vector<SqKey> keys(count);
+	for(TqInt i = 0; i < count; ++i)
+		keys[i] = key(P[i], N[i]);
+	TqInt numMissed = 0;
+	boost::mutex::scoped_lock lock(m_mutex);
+	for(TqInt i = 0; i < count; ++i)
+	{
+		TqSampleMap::const_iterator s = m_samples.find(keys[i]);
+		if(s != m_samples.end())
+		{
+			samples[i] = s->second;
+			missed[i] = false;
+		}
+		else
+			++numMissed;
+	}
+	m_hits += count - numMissed;
+	m_misses += numMissed;
+	return numMissed;
+}
+
+void CqLightCache::insert(const std::vector<CqVector3D>& P,
+		const std::vector<CqVector3D>& N, const std::vector<SqSample>& samples,
+		const std::vector<bool>& missed)
+{
+	TqInt count = P.size();
+	std::vector<SqKey> keys;
+	keys.reserve(count);
+	for(TqInt i = 0; i < count; ++i)
+	{
+		if(missed[i])
+			keys.push_back(key(P[i], N[i]));
+	}
+	boost::mutex::scoped_lock lock(m_mutex);
+	for(TqInt i = 0, j = 0; i < count; ++i)
+	{
+		if(!missed[i])
+			continue;
+		if(static_cast<TqInt>(m_samples.size()) >= maxEntries())
+			break;
+		// Several points of a grid may fall in the same cell, the first
+		// one wins.
+		m_samples.insert(TqSampleMap::value_type(keys[j++], samples[i]));
+	}
+}
+
+TqInt CqLightCache::size() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_samples.size();
+}
+
+TqInt CqLightCache::hits() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_hits;
+}
+
+TqInt CqLightCache::misses() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_misses;
+}
+
+boost::shared_ptr<CqLightCache> CqLightCache::find(const std::string& signature,
+		const std::string& name, TqFloat tolerance, bool useNormal)
+{
+	boost::mutex::scoped_lock lock(g_registryMutex);
+	SqRegistryEntry& entry = g_registry[signature];
+	if(!entry.cache)
+		entry.cache.reset(new CqLightCache(name, tolerance, useNormal));
+	entry.frame = g_frame;
+	return entry.cache;
+}
+
+void CqLightCache::caches(std::vector<boost::shared_ptr<CqLightCache> >& result)
+{
+	boost::mutex::scoped_lock lock(g_registryMutex);
+	result.clear();
+	for(TqRegistry::const_iterator i = g_registry.begin(); i != g_registry.end(); ++i)
+	{
+		if(i->second.frame == g_frame)
+			result.push_back(i->second.cache);
+	}
+}
+
+void CqLightCache::endFrame()
+{
+	boost::mutex::scoped_lock lock(g_registryMutex);
+	for(TqRegistry::iterator i = g_registry.begin(); i != g_registry.end(); )
+	{
+		if(i->second.frame != g_frame)
+			g_registry.erase(i++);
+		else
+		{
+			boost::mutex::scoped_lock cacheLock(i->second.cache->m_mutex);
+			i->second.cache->m_hits = 0;
+			i->second.cache->m_misses = 0;
+			++i;
+		}
+	}
+	++g_frame;
+}
+
+CqLightCache::SqKey CqLightCache::key(const CqVector3D& P, const CqVector3D& N) const
+{
+	SqKey k;
+	k.k[0] = cellIndex(P.x()*m_invTolerance);
+	k.k[1] = cellIndex(P.y()*m_invTolerance);
+	k.k[2] = cellIndex(P.z()*m_invTolerance);
+	if(m_useNormal)
+	{
+		CqVector3D n = N;
+		TqFloat len = n.Magnitude();
+		if(len > 0)
+			n /= len;
+		k.k[3] = cellIndex(n.x()*normalCells);
+		k.k[4] = cellIndex(n.y()*normalCells);
+		k.k[5] = cellIndex(n.z()*normalCells);
+	}
+	else
+		k.k[3] = k.k[4] = k.k[5] = 0;
+	return k;
+}
+
+} // namespace Aqsis
@@ -0,0 +1,143 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/**
+        \file
+        \brief Declares a cache of light shader results for static lights.
+*/
+
+#ifndef LIGHTCACHE_H_INCLUDED
+#define LIGHTCACHE_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+
+#include <aqsis/math/color.h>
+#include <aqsis/math/vector3d.h>
+
+namespace Aqsis {
+
+/** \brief Cache of the Cl and L computed by a light shader.
+ *
+ * Results are stored in a sparse grid over world space.  Points which fall in
+ * the same cell of size tolerance, and whose normals lie within the same
+ * angular cell, share the result computed for the first of them.  This is
+ * only valid for lights whose output depends on nothing but the position and
+ * normal of the point being lit, so caching has to be enabled explicitly for
+ * each light with Attribute "light" "cache".
+ *
+ * Caches are kept in a registry keyed on a signature of the light shader, its
+ * parameters and its transformation, so that a light which is unchanged in
+ * the next frame picks up the results of the previous one.  Caches which were
+ * not used during a frame are discarded at the end of it.
+ */
+class CqLightCache : boost::noncopyable
+{
+	public:
+		/// Result of the light shader for one point, in world space.
+		struct SqSample
+		{
+			CqColor	Cl;
+			CqVector3D	L;
+		};
+
+		/** Create an empty cache.
+		 * \param name - name of the light, used in the statistics output.
+		 * \param tolerance - size of the grid cells in world space.
+		 * \param useNormal - whether results depend on the surface normal.
+		 */
+		CqLightCache(const std::string& name, TqFloat tolerance, bool useNormal);
+
+		/** Look up the results for a set of points.
+		 *
+		 * \param P - world space positions.
+		 * \param N - world space normals, one for each point.
+		 * \param samples - filled with the results for cached points.
+		 * \param missed - set to true for each point which isn't cached.
+		 * \return the number of points which aren't cached.
+		 */
+		TqInt	lookup(const std::vector<CqVector3D>& P, const std::vector<CqVector3D>& N,
+				std::vector<SqSample>& samples, std::vector<bool>& missed);
+		/** Store the results for the points flagged in missed.
+		 *
+		 * Once the cache holds maxEntries() results, further results are
+		 * dropped.
+		 */
+		void	insert(const std::vector<CqVector3D>& P, const std::vector<CqVector3D>& N,
+				const std::vector<SqSample>& samples, const std::vector<bool>& missed);
+
+		/// Name of the light.
+		const std::string&	name() const
+		{
+			return m_name;
+		}
+		/// Number of results stored.
+		TqInt	size() const;
+		/// Points found in the cache since the start of the frame.
+		TqInt	hits() const;
+		/// Points not found in the cache since the start of the frame.
+		TqInt	misses() const;
+		/// Maximum number of results held by a cache.
+		static TqInt	maxEntries()
+		{
+			return 1 << 19;
+		}
+
+		/** Find the cache for a light, creating it if it doesn't exist.
+		 *
+		 * \param signature - string uniquely identifying the light shader,
+		 * its parameters and its transformation.
+		 */
+		static boost::shared_ptr<CqLightCache>	find(const std::string& signature,
+				const std::string& name, TqFloat tolerance, bool useNormal);
+		/// Get all caches used during the current frame.
+		static void	caches(std::vector<boost::shared_ptr<CqLightCache> >& result);
+		/// Discard the caches which weren't used in the frame just finished.
+		static void	endFrame();
+
+	private:
+		struct SqKey
+		{
+			TqInt	k[6];
+			bool operator<(const SqKey& rhs) const;
+		};
+		typedef std::map<SqKey, SqSample> TqSampleMap;
+
+		SqKey	key(const CqVector3D& P, const CqVector3D& N) const;
+
+		std::string	m_name;
+		TqFloat	m_invTolerance;
+		bool	m_useNormal;
+		/// Protects everything below.
+		mutable boost::mutex	m_mutex;
+		TqSampleMap	m_samples;
+		TqInt	m_hits;
+		TqInt	m_misses;
+};
+
+} // namespace Aqsis
+
+#endif // LIGHTCACHE_H_INCLUDED
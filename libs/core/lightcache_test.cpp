@@ -0,0 +1,114 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file Unit tests for the light shader result cache.
+ */
+
+#include "lightcache.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(lightcache_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+CqLightCache::SqSample sample(TqFloat value)
+{
+	CqLightCache::SqSample s;
+	s.Cl = CqColor(value, value, value);
+	s.L = CqVector3D(0, 0, value);
+	return s;
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(lightcache_tolerance_test)
+{
+	CqLightCache cache("test", 0.1f, true);
+	std::vector<CqVector3D> P(2);
+	std::vector<CqVector3D> N(2, CqVector3D(0, 0, 1));
+	P[0] = CqVector3D(0.01f, 0.01f, 0.01f);
+	P[1] = CqVector3D(1.05f, 0.01f, 0.01f);
+
+	std::vector<CqLightCache::SqSample> samples;
+	std::vector<bool> missed;
+	BOOST_CHECK_EQUAL(cache.lookup(P, N, samples, missed), 2);
+	samples[0] = sample(1);
+	samples[1] = sample(2);
+	cache.insert(P, N, samples, missed);
+	BOOST_CHECK_EQUAL(cache.size(), 2);
+
+	// Points within the same cell reuse the stored results.
+	P[0] = CqVector3D(0.09f, 0.02f, 0.05f);
+	P[1] = CqVector3D(1.2f, 0.01f, 0.01f);
+	BOOST_CHECK_EQUAL(cache.lookup(P, N, samples, missed), 1);
+	BOOST_CHECK(!missed[0]);
+	BOOST_CHECK(missed[1]);
+	BOOST_CHECK_EQUAL(samples[0].Cl, CqColor(1, 1, 1));
+	BOOST_CHECK_EQUAL(samples[0].L, CqVector3D(0, 0, 1));
+
+	// A different normal misses.
+	N[0] = CqVector3D(0, 1, 0);
+	BOOST_CHECK_EQUAL(cache.lookup(P, N, samples, missed), 2);
+
+	BOOST_CHECK_EQUAL(cache.hits(), 1);
+	BOOST_CHECK_EQUAL(cache.misses(), 5);
+}
+
+BOOST_AUTO_TEST_CASE(lightcache_ignore_normal_test)
+{
+	CqLightCache cache("test", 0.1f, false);
+	std::vector<CqVector3D> P(1, CqVector3D(0.5f, 0.5f, 0.5f));
+	std::vector<CqVector3D> N(1, CqVector3D(0, 0, 1));
+	std::vector<CqLightCache::SqSample> samples;
+	std::vector<bool> missed;
+	cache.lookup(P, N, samples, missed);
+	samples[0] = sample(3);
+	cache.insert(P, N, samples, missed);
+
+	N[0] = CqVector3D(1, 0, 0);
+	BOOST_CHECK_EQUAL(cache.lookup(P, N, samples, missed), 0);
+	BOOST_CHECK_EQUAL(samples[0].Cl, CqColor(3, 3, 3));
+}
+
+BOOST_AUTO_TEST_CASE(lightcache_registry_test)
+{
+	boost::shared_ptr<CqLightCache> a = CqLightCache::find("a", "a", 0.1f, true);
+	BOOST_CHECK_EQUAL(CqLightCache::find("a", "a", 0.1f, true), a);
+	boost::shared_ptr<CqLightCache> b = CqLightCache::find("b", "b", 0.1f, true);
+	BOOST_CHECK(a != b);
+
+	// Caches used in a frame survive into the next one...
+	CqLightCache::endFrame();
+	BOOST_CHECK_EQUAL(CqLightCache::find("a", "a", 0.1f, true), a);
+	std::vector<boost::shared_ptr<CqLightCache> > caches;
+	CqLightCache::caches(caches);
+	BOOST_CHECK_EQUAL(caches.size(), 1U);
+
+	// ...but those which aren't are dropped.
+	CqLightCache::endFrame();
+	BOOST_CHECK(CqLightCache::find("b", "b", 0.1f, true) != b);
+	CqLightCache::endFrame();
+	CqLightCache::endFrame();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
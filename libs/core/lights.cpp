@@ -57,6 +57,85 @@ CqLightsource::~CqLightsource()
 }
 
 
+//---------------------------------------------------------------------
+/** Evaluate the shader.
+ * \param pPs the points being lit.
+ * \param pNs the normals at the points being lit.
+ */
+void CqLightsource::Evaluate( IqShaderData* pPs, IqShaderData* pNs, IqSurface* pSurface )
+{
+	Ps() ->SetValueFromVariable( pPs );
+	Ns() ->SetValueFromVariable( pNs );
+	m_pShaderExecEnv->SetCurrentSurface(pSurface);
+	if ( m_pCache && pPs->Class() == class_varying && pNs->Class() == class_varying &&
+	        L()->Class() == class_varying && Cl()->Class() == class_varying )
+		EvaluateCached( pPs, pNs );
+	else
+		m_pShader->Evaluate( m_pShaderExecEnv.get() );
+}
+
+
+//---------------------------------------------------------------------
+/** Fill in Cl and L from the cache, running the shader only for the points
+ * which aren't in it.  The cache holds world space values, since current
+ * space changes from frame to frame.
+ */
+void CqLightsource::EvaluateCached( IqShaderData* pPs, IqShaderData* pNs )
+{
+	TqFloat time = QGetRenderContextI()->Time();
+	CqMatrix matToWorld, matNToWorld, matVToWorld, matVFromWorld;
+	QGetRenderContext() ->matSpaceToSpace( "current", "world", NULL, NULL, time, matToWorld );
+	QGetRenderContext() ->matNSpaceToSpace( "current", "world", NULL, NULL, time, matNToWorld );
+	QGetRenderContext() ->matVSpaceToSpace( "current", "world", NULL, NULL, time, matVToWorld );
+	QGetRenderContext() ->matVSpaceToSpace( "world", "current", NULL, NULL, time, matVFromWorld );
+
+	TqInt count = shadingPointCount();
+	std::vector<CqVector3D> P( count );
+	std::vector<CqVector3D> N( count );
+	for ( TqInt i = 0; i < count; ++i )
+	{
+		CqVector3D p, n;
+		pPs->GetPoint( p, i );
+		pNs->GetNormal( n, i );
+		P[ i ] = matToWorld * p;
+		N[ i ] = matNToWorld * n;
+	}
+
+	std::vector<CqLightCache::SqSample> samples;
+	std::vector<bool> missed;
+	if ( m_pCache->lookup( P, N, samples, missed ) > 0 )
+	{
+		// Run the shader for the points which weren't found only.
+		CqBitVector& state = m_pShaderExecEnv->CurrentState();
+		for ( TqInt i = 0; i < count; ++i )
+			state.SetValue( i, missed[ i ] );
+		m_pShaderExecEnv->GetCurrentState();
+		m_pShader->Evaluate( m_pShaderExecEnv.get() );
+		m_pShaderExecEnv->CurrentState().SetAll( true );
+		m_pShaderExecEnv->GetCurrentState();
+
+		for ( TqInt i = 0; i < count; ++i )
+		{
+			if ( !missed[ i ] )
+				continue;
+			CqVector3D l;
+			L() ->GetVector( l, i );
+			Cl() ->GetColor( samples[ i ].Cl, i );
+			samples[ i ].L = matVToWorld * l;
+		}
+		m_pCache->insert( P, N, samples, missed );
+	}
+
+	for ( TqInt i = 0; i < count; ++i )
+	{
+		if ( missed[ i ] )
+			continue;
+		L() ->SetVector( matVFromWorld * samples[ i ].L, i );
+		Cl() ->SetColor( samples[ i ].Cl, i );
+	}
+}
+
+
 //---------------------------------------------------------------------
 /** Initialise the environment for the specified grid size.
  * \param iGridRes Integer grid resolution.
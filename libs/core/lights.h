@@ -44,6 +44,7 @@
 #include <aqsis/version.h>
 #include <aqsis/core/ilightsource.h>
 #include "attributes.h"
+#include "lightcache.h"
 #include "transform.h"
 
 namespace Aqsis {
@@ -86,12 +87,13 @@ class CqLightsource : public IqLightsource, public boost::enable_shared_from_thi
 		/** Evaluate the shader.
 		 * \param pPs the point being lit.
 		 */
-		virtual void	Evaluate( IqShaderData* pPs, IqShaderData* pNs, IqSurface* pSurface )
+		virtual void	Evaluate( IqShaderData* pPs, IqShaderData* pNs, IqSurface* pSurface );
+		/** Reuse the results of the shader held in a cache where possible.
+		 * \param pCache the cache, or a null pointer to always run the shader.
+		 */
+		void	SetCache( const boost::shared_ptr<CqLightCache>& pCache )
 		{
-			Ps() ->SetValueFromVariable( pPs );
-			Ns() ->SetValueFromVariable( pNs );
-			m_pShaderExecEnv->SetCurrentSurface(pSurface);
-			m_pShader->Evaluate( m_pShaderExecEnv.get() );
+			m_pCache = pCache;
 		}
 		/** Get a pointer to the attributes state associated with this GPrim.
 		 * \return A pointer to a CqAttributes class.
@@ -265,6 +267,9 @@ class CqLightsource : public IqLightsource, public boost::enable_shared_from_thi
 		CqAttributesPtr	m_pAttributes;			///< Pointer to the associated attributes.
 		CqTransformPtr m_pTransform;		///< Pointer to the transformation state associated with this GPrim.
 		boost::shared_ptr<IqShaderExecEnv>	m_pShaderExecEnv;	///< Pointer to the shader execution environment.
+		boost::shared_ptr<CqLightCache>	m_pCache;	///< Cached results of the shader, if enabled.
+
+		void	EvaluateCached( IqShaderData* pPs, IqShaderData* pNs );
 }
 ;
 
@@ -40,8 +40,8 @@
 namespace Aqsis {
 
 
-CqObjectPool<CqMicroPolygon> CqMicroPolygon::m_thePool;
-CqObjectPool<CqMovingMicroPolygonKey>	CqMovingMicroPolygonKey::m_thePool;
+CqThreadLocalPool<CqMicroPolygon> CqMicroPolygon::m_thePool( "micropolygons" );
+CqThreadLocalPool<CqMovingMicroPolygonKey>	CqMovingMicroPolygonKey::m_thePool( "micropolygon motion keys" );
 
 void CqMicroPolyGridBase::CacheGridInfo(const boost::shared_ptr<const CqSurface>& surface)
 {
@@ -73,6 +73,7 @@ void CqMicroPolyGridBase::CacheGridInfo(const boost::shared_ptr<const CqSurface>
 CqMicroPolyGrid::CqMicroPolyGrid() : CqMicroPolyGridBase(),
 		m_bShadingNormals( false ),
 		m_bGeometricNormals( false ), 
+		m_fReshadeable( false ),
 		m_pShaderExecEnv(IqShaderExecEnv::create(QGetRenderContextI()))
 {
 	STATS_INC( GRD_allocated );
@@ -95,12 +96,12 @@ CqMicroPolyGrid::~CqMicroPolyGrid()
 	STATS_INC( GRD_deallocated );
 	STATS_DEC( GRD_current );
 
-	// Delete any cloned shader output variables.
-	std::vector<IqShaderData*>::iterator outputVar;
-	for( outputVar = m_apShaderOutputVariables.begin(); outputVar != m_apShaderOutputVariables.end(); outputVar++ )
-		if( (*outputVar) )
-			delete( (*outputVar) );
-	m_apShaderOutputVariables.clear();
+	DeleteOutputVariables();
+
+	// Delete the variables saved for reshading.
+	std::vector<IqShaderData*>::iterator savedVar;
+	for( savedVar = m_apSavedVariables.begin(); savedVar != m_apSavedVariables.end(); savedVar++ )
+		delete( *savedVar );
 }
 
 
@@ -473,6 +474,32 @@ void CqMicroPolyGrid::Shade( bool canCullGrid )
 		}
 	}
 
+	// Keep the state of the grid before surface shading if it's to be reshaded.
+	if ( m_fReshadeable )
+	{
+		m_apSavedVariables.resize( EnvVars_Last, 0 );
+		for ( TqInt varID = 0; varID < EnvVars_Last; varID++ )
+		{
+			if ( pVar(varID) )
+				m_apSavedVariables[ varID ] = pVar(varID)->Clone();
+		}
+		m_SavedCulledPolys = m_CulledPolys;
+	}
+
+	ShadeSurface( canCullGrid );
+}
+
+//---------------------------------------------------------------------
+/** Run the surface and atmosphere shaders, and cull any transparent
+ * micropolygons.
+ */
+
+void CqMicroPolyGrid::ShadeSurface( bool canCullGrid )
+{
+	TqInt lUses = pSurface() ->Uses();
+	TqInt gs = m_pShaderExecEnv->shadingPointCount();
+	TqInt gsmin1 = gs - 1;
+
 	// Now shade the grid.
 	boost::shared_ptr<IqShader> pshadSurface = pSurface() ->pAttributes() ->pshadSurface(QGetRenderContext()->Time());
 	if ( pshadSurface )
@@ -520,12 +547,90 @@ void CqMicroPolyGrid::Shade( bool canCullGrid )
 			return ;
 		}
 	}
-	DeleteVariables( false );
+	// Grids kept for reshading need all their variables.
+	if ( !m_fReshadeable )
+		DeleteVariables( false );
 
 	STATS_INC( GRD_shd_size_4 + clamp<TqInt>( CqStats::stats_log2(
 					m_pShaderExecEnv->shadingPointCount() ) - 2, 0, 7 ) );
 }
 
+//---------------------------------------------------------------------
+/** Mark the grid to be kept for reshading.
+ *
+ * Shade() then saves the variables before running the surface shader, and
+ * keeps all variables afterwards.
+ */
+
+bool CqMicroPolyGrid::PrepareReshade()
+{
+	// Micropolygons blurred by a moving transformation aren't covered by
+	// the bound of the grid kept for reshading.
+	if ( pSurface()->pTransform()->cTimes() > 1
+		|| QGetRenderContext()->GetCameraTransform()->cTimes() > 1 )
+		return ( false );
+	m_fReshadeable = true;
+	return ( true );
+}
+
+//---------------------------------------------------------------------
+/** Shade the grid again, from the state saved before surface shading.
+ */
+
+void CqMicroPolyGrid::Reshade()
+{
+	assert( m_fReshadeable );
+
+	for ( TqInt varID = 0; varID < EnvVars_Last; varID++ )
+	{
+		if ( m_apSavedVariables[ varID ] && pVar(varID) )
+			pVar(varID)->SetValueFromVariable( m_apSavedVariables[ varID ] );
+	}
+	m_CulledPolys = m_SavedCulledPolys;
+
+	// The shaders hold the primitive variables of the last grid they shaded,
+	// so they have to be set up for this grid again.
+	TqInt cu = uGridRes();
+	TqInt cv = vGridRes();
+	boost::shared_ptr<IqShader> pshadSurface = pAttributes() ->pshadSurface(QGetRenderContext()->Time());
+	boost::shared_ptr<IqShader> pshadAtmosphere = pAttributes() ->pshadAtmosphere(QGetRenderContext()->Time());
+	if ( pshadSurface )
+		pshadSurface->Initialise( cu, cv, numShadingPoints(cu, cv), m_pShaderExecEnv.get() );
+	if ( pshadAtmosphere )
+		pshadAtmosphere->Initialise( cu, cv, numShadingPoints(cu, cv), m_pShaderExecEnv.get() );
+	m_pSurface->DiceUserParams( this );
+
+	// Don't cull the whole grid, since a later edit might make it visible.
+	ShadeSurface( false );
+
+	DeleteOutputVariables();
+	TransferOutputVariables();
+}
+
+//---------------------------------------------------------------------
+/** Put back the camera space positions saved before surface shading.
+ */
+
+void CqMicroPolyGrid::RestorePositions()
+{
+	assert( m_fReshadeable );
+	if ( m_apSavedVariables[ EnvVars_P ] && pVar(EnvVars_P) )
+		pVar(EnvVars_P)->SetValueFromVariable( m_apSavedVariables[ EnvVars_P ] );
+}
+
+//---------------------------------------------------------------------
+/** Delete the copies of the shader output variables.
+ */
+
+void CqMicroPolyGrid::DeleteOutputVariables()
+{
+	std::vector<IqShaderData*>::iterator outputVar;
+	for( outputVar = m_apShaderOutputVariables.begin(); outputVar != m_apShaderOutputVariables.end(); outputVar++ )
+		if( (*outputVar) )
+			delete( (*outputVar) );
+	m_apShaderOutputVariables.clear();
+}
+
 //---------------------------------------------------------------------
 /** Transfer any shader variables marked as "otuput" as they may be needed by the display devices.
  */
@@ -763,6 +868,7 @@ void CqMicroPolyGrid::Split( long xmin, long xmax, long ymin, long ymax )
 
 	ADDREF( this );
 
+	boost::shared_ptr<CqMicroQuadGrid> pQuads;
 	TqInt iv;
 //	bool tooSmall_ = false;
 //	TqFloat smallArea = 1.0;
@@ -848,11 +954,10 @@ void CqMicroPolyGrid::Split( long xmin, long xmax, long ymin, long ymax )
 			}
 			else
 			{
-				boost::shared_ptr<CqMicroPolygon> pNew(new CqMicroPolygon(this, iIndex));
-				if ( fTrimmed )
-					pNew->MarkTrimmed();
-				pNew->Initialise();
-				QGetRenderContext()->pImage()->AddMPG( pNew );
+				// Static micropolygons are sampled directly from the grid.
+				if ( !pQuads )
+					pQuads = boost::shared_ptr<CqMicroQuadGrid>( new CqMicroQuadGrid( this ) );
+				pQuads->AddQuad( iIndex, fTrimmed );
 			}
 
 			// Calculate MPG area
@@ -878,6 +983,8 @@ void CqMicroPolyGrid::Split( long xmin, long xmax, long ymin, long ymax )
 		//	}
 		}
 	}
+	if ( pQuads )
+		QGetRenderContext()->pImage()->AddMicroQuadGrid( pQuads );
 	AQSIS_TIMER_STOP(Bust_grids);
 //	if(tooSmall_)
 //	{
@@ -1171,6 +1278,16 @@ CqMicroPolygon::CqMicroPolygon(CqMicroPolyGridBase* pGrid, TqInt Index ) : m_pGr
 }
 
 
+//---------------------------------------------------------------------
+/** Constructor for grid samplers, see CqMicroQuadSampler.
+ */
+
+CqMicroPolygon::CqMicroPolygon(CqMicroPolyGridBase* pGrid ) : m_pGrid( pGrid ), m_Index(0), m_Flags( MicroPolyFlags_GridSampler )
+{
+	ADDREF(pGrid);
+}
+
+
 //---------------------------------------------------------------------
 /** Destructor
  */
@@ -1179,6 +1296,8 @@ CqMicroPolygon::~CqMicroPolygon()
 {
 	if ( m_pGrid )
 		RELEASEREF( m_pGrid );
+	if ( m_Flags & MicroPolyFlags_GridSampler )
+		return;
 	STATS_INC( MPG_deallocated );
 	STATS_DEC( MPG_current );
 	if ( !IsHit() )
@@ -1186,6 +1305,65 @@ CqMicroPolygon::~CqMicroPolygon()
 }
 
 
+//---------------------------------------------------------------------
+void CqMicroPolygon::SetIndex( TqInt Index )
+{
+	m_Index = Index;
+	m_Flags = MicroPolyFlags_GridSampler;
+}
+
+
+//---------------------------------------------------------------------
+/** Constructor
+ */
+
+CqMicroQuadGrid::CqMicroQuadGrid( CqMicroPolyGridBase* pGrid ) : m_pGrid( pGrid ), m_pP( 0 ), m_cu( pGrid->uGridRes() ), m_Quads(), m_Flags(), m_Bound()
+{
+	m_pGrid->pVar(EnvVars_P) ->GetPointPtr( m_pP );
+	STATS_INC( MPG_grids );
+	ADDREF(pGrid);
+}
+
+
+//---------------------------------------------------------------------
+/** Destructor
+ */
+
+CqMicroQuadGrid::~CqMicroQuadGrid()
+{
+	RELEASEREF( m_pGrid );
+	TqInt cQuads = m_Quads.size();
+	TqInt cMissed = 0;
+	for ( TqInt i = 0; i < cQuads; ++i )
+	{
+		if ( ( m_Flags[ i ] & QuadFlags_Hit ) == 0 )
+			++cMissed;
+	}
+	STATS_SETI( MPG_deallocated, STATS_GETI( MPG_deallocated ) + cQuads );
+	STATS_SETI( MPG_current, STATS_GETI( MPG_current ) - cQuads );
+	STATS_SETI( MPG_missed, STATS_GETI( MPG_missed ) + cMissed );
+}
+
+
+//---------------------------------------------------------------------
+void CqMicroQuadGrid::AddQuad( TqInt Index, bool fTrimmed )
+{
+	m_Quads.push_back( Index );
+	m_Flags.push_back( fTrimmed ? QuadFlags_Trimmed : 0 );
+
+	m_Bound.Encapsulate( m_pP[ Index ] );
+	m_Bound.Encapsulate( m_pP[ Index + 1 ] );
+	m_Bound.Encapsulate( m_pP[ Index + m_cu + 1 ] );
+	m_Bound.Encapsulate( m_pP[ Index + m_cu + 2 ] );
+
+	STATS_INC( MPG_allocated );
+	STATS_INC( MPG_current );
+	TqInt cMPG = STATS_GETI( MPG_current );
+	TqInt cPeak = STATS_GETI( MPG_peak );
+	STATS_SETI( MPG_peak, cMPG > cPeak ? cMPG : cPeak );
+}
+
+
 //---------------------------------------------------------------------
 void CqMicroPolygon::Initialise()
 {
@@ -1431,6 +1609,29 @@ void CqMicroPolygon::CacheHitTestValues(CqHitTestCache& cache, bool usingDof) co
 	}
 }
 
+bool CqMicroPolygon::CacheHitTestValuesAtTime(CqHitTestCache& cache,
+		TqFloat time, CqBound& bound) const
+{
+	return false;
+}
+
+bool CqMicroPolygon::SampleAtCachedTime( CqHitTestCache& hitTestCache,
+		const CqVector2D& vecSample, TqFloat& D, CqVector2D& uv, TqFloat time ) const
+{
+	if ( !fContains( hitTestCache, vecSample, D, uv, time ) )
+		return false;
+	if ( pGrid() ->fTriangular() )
+	{
+		CqVector3D vA, vB;
+		pGrid()->TriangleSplitPoints( vA, vB, time );
+		TqFloat v = ( vA.y() - vB.y() )*vecSample.x() + ( vB.x() - vA.x() )*vecSample.y()
+			+ ( vA.x()*vB.y() - vB.x()*vA.y() );
+		if ( v <= 0 )
+			return false;
+	}
+	return true;
+}
+
 void CqMicroPolygon::CacheOutputInterpCoeffs(SqMpgSampleInfo& cache) const
 {
 	if(cache.smoothInterpolation)
@@ -1771,24 +1972,9 @@ bool CqMicroPolygonMotion::Sample( CqHitTestCache& hitTestCache, SqSampleData co
 	CqVector3D points[4];
 
 	// Calculate the position in time of the MP.
-	TqInt iIndex = 0;
 	TqFloat Fraction = 0.0f;
-	bool Exact = true;
-
-	if ( time > m_Times.front() )
-	{
-		if ( time >= m_Times.back() )
-			iIndex = m_Times.size() - 1;
-		else
-		{
-			// Find the appropriate time span.
-			iIndex = 0;
-			while ( time >= m_Times[ iIndex + 1 ] )
-				iIndex += 1;
-			Fraction = ( time - m_Times[ iIndex ] ) / ( m_Times[ iIndex + 1 ] - m_Times[ iIndex ] );
-			Exact = ( m_Times[ iIndex ] == time );
-		}
-	}
+	TqInt iIndex = KeyAtTime( time, Fraction );
+	bool Exact = Fraction == 0.0f;
 
 	// Interpolate the bounding box along the motion segment to get the
 	// bounding box at the appropriate sample time.
@@ -1836,24 +2022,7 @@ bool CqMicroPolygonMotion::Sample( CqHitTestCache& hitTestCache, SqSampleData co
 	// micropolygon vertices at the sample time.
 
 	// Interpolate the polygon vertices along the motion segment.
-	if ( Exact )
-	{
-		CqMovingMicroPolygonKey * pMP1 = m_Keys[ iIndex ];
-		points[0] = pMP1->m_Point0;
-		points[1] = pMP1->m_Point1;
-		points[2] = pMP1->m_Point2;
-		points[3] = pMP1->m_Point3;
-	}
-	else
-	{
-		TqFloat F1 = 1.0f - Fraction;
-		CqMovingMicroPolygonKey* pMP1 = m_Keys[ iIndex ];
-		CqMovingMicroPolygonKey* pMP2 = m_Keys[ iIndex + 1 ];
-		points[0] = ( F1 * pMP1->m_Point0 ) + ( Fraction * pMP2->m_Point0 );
-		points[1] = ( F1 * pMP1->m_Point1 ) + ( Fraction * pMP2->m_Point1 );
-		points[2] = ( F1 * pMP1->m_Point2 ) + ( Fraction * pMP2->m_Point2 );
-		points[3] = ( F1 * pMP1->m_Point3 ) + ( Fraction * pMP2->m_Point3 );
-	}
+	PointsAtTime( iIndex, Fraction, points );
 
 	if(UsingDof)
 	{
@@ -1949,6 +2118,56 @@ void CqMicroPolygonMotion::CacheHitTestValues(CqHitTestCache& cache,
  * \param time Float shutter time that this MPG represents.
  */
 
+bool CqMicroPolygonMotion::CacheHitTestValuesAtTime(CqHitTestCache& cache,
+		TqFloat time, CqBound& bound) const
+{
+	TqFloat fraction = 0.0f;
+	TqInt key = KeyAtTime( time, fraction );
+	CqVector3D points[4];
+	PointsAtTime( key, fraction, points );
+	bound = CqBound( points[0], points[0] );
+	for ( TqInt i = 1; i < 4; ++i )
+		bound.Encapsulate( points[i] );
+	cachePointInPolyTest( cache, points );
+	return true;
+}
+
+TqInt CqMicroPolygonMotion::KeyAtTime( TqFloat time, TqFloat& fraction ) const
+{
+	fraction = 0.0f;
+	if ( time <= m_Times.front() )
+		return 0;
+	if ( time >= m_Times.back() )
+		return m_Times.size() - 1;
+	// Find the appropriate time span.
+	TqInt key = 0;
+	while ( time >= m_Times[ key + 1 ] )
+		key += 1;
+	fraction = ( time - m_Times[ key ] ) / ( m_Times[ key + 1 ] - m_Times[ key ] );
+	return key;
+}
+
+void CqMicroPolygonMotion::PointsAtTime( TqInt key, TqFloat fraction, CqVector3D points[4] ) const
+{
+	CqMovingMicroPolygonKey* pMP1 = m_Keys[ key ];
+	if ( fraction == 0.0f )
+	{
+		points[0] = pMP1->m_Point0;
+		points[1] = pMP1->m_Point1;
+		points[2] = pMP1->m_Point2;
+		points[3] = pMP1->m_Point3;
+	}
+	else
+	{
+		TqFloat F1 = 1.0f - fraction;
+		CqMovingMicroPolygonKey* pMP2 = m_Keys[ key + 1 ];
+		points[0] = ( F1 * pMP1->m_Point0 ) + ( fraction * pMP2->m_Point0 );
+		points[1] = ( F1 * pMP1->m_Point1 ) + ( fraction * pMP2->m_Point1 );
+		points[2] = ( F1 * pMP1->m_Point2 ) + ( fraction * pMP2->m_Point2 );
+		points[3] = ( F1 * pMP1->m_Point3 ) + ( fraction * pMP2->m_Point3 );
+	}
+}
+
 void CqMicroPolygonMotion::AppendKey( const CqVector3D& vA, const CqVector3D& vB, const CqVector3D& vC, const CqVector3D& vD, TqFloat time )
 {
 	//	assert( time >= m_Times.back() );
@@ -32,7 +32,7 @@
 #include	<boost/utility.hpp>
 
 #include	"bilinear.h"
-#include	<aqsis/util/pool.h>
+#include	"threadlocalpool.h"
 #include	<aqsis/math/color.h>
 #include	<aqsis/util/list.h>
 #include	"bound.h"
@@ -117,6 +117,14 @@ class CqMicroPolyGridBase : public CqRefCount
 		 */
 		virtual	void	Shade(bool canCullGrid = true ) = 0;
 		virtual	void	TransferOutputVariables() = 0;
+		/** Prepare the grid to be kept for reshading, see CqReshadeStore.
+		 * Must be called before the grid is shaded.
+		 * \return false if this type of grid can't be reshaded.
+		 */
+		virtual	bool	PrepareReshade()
+		{
+			return ( false );
+		}
 		/*
 		 * Delete all the variables per grid 
 		 */
@@ -291,6 +299,19 @@ class CqMicroPolyGrid : public CqMicroPolyGridBase
 		virtual	void	Split( long xmin, long xmax, long ymin, long ymax );
 		virtual	void	Shade( bool canCullGrid = true );
 		virtual	void	TransferOutputVariables();
+		virtual	bool	PrepareReshade();
+
+		/** Run the surface and atmosphere shaders again.
+		 *
+		 * The variables are first put back as they were before the surface
+		 * was shaded by Shade(), so the shaders see the same displaced grid.
+		 * The grid must have been prepared with PrepareReshade().
+		 */
+		void	Reshade();
+		/** Put back the camera space positions of the grid, so that it may
+		 * be split again without being reshaded.
+		 */
+		void	RestorePositions();
 
 		/** Get a pointer to the surface which this grid belongs.
 		 * \return Surface pointer, only valid during shading.
@@ -386,6 +407,12 @@ class CqMicroPolyGrid : public CqMicroPolyGridBase
 		boost::shared_ptr<CqCSGTreeNode> m_pCSGNode;	///< Pointer to the CSG tree node this grid belongs to, NULL if not part of a solid.
 		CqBitVector	m_CulledPolys;		///< Bitvector indicating whether the individual micro polygons are culled.
 		std::vector<IqShaderData*>	m_apShaderOutputVariables;	///< Vector of pointers to shader output variables.
+		bool	m_fReshadeable;		///< Flag indicating the grid is kept for reshading.
+		std::vector<IqShaderData*>	m_apSavedVariables;	///< Copies of the standard variables before surface shading, for reshading.
+		CqBitVector	m_SavedCulledPolys;	///< Culled status of the micro polygons before surface shading.
+
+		void	ShadeSurface( bool canCullGrid );
+		void	DeleteOutputVariables();
 	protected:
 		boost::shared_ptr<IqShaderExecEnv> m_pShaderExecEnv;	///< Pointer to the shader execution environment for this grid.
 
@@ -568,6 +595,19 @@ class CqMicroPolygon : boost::noncopyable
 		 */
 		CqMicroPolygon( CqMicroPolyGridBase* pGrid, TqInt Index );
 		virtual	~CqMicroPolygon();
+	protected:
+		/** Constructor for micropolygons which are pointed at each quad of a
+		 * CqMicroQuadGrid in turn.  These are not counted in the
+		 * micropolygon statistics, the grid accounts for its quads instead.
+		 *
+		 * \param pGrid CqMicroPolyGrid pointer.
+		 */
+		explicit CqMicroPolygon( CqMicroPolyGridBase* pGrid );
+		/** Point the micropolygon at another quad of the donor grid,
+		 * clearing all flags.  Initialise() must be called afterwards.
+		 */
+		void	SetIndex( TqInt Index );
+	public:
 
 		/** Overridden operator new to allocate micropolys from a pool.
 		 * \todo Review: Unused parameter size
@@ -597,6 +637,7 @@ class CqMicroPolygon : boost::noncopyable
 			MicroPolyFlags_Trimmed		= 0x0001,
 			MicroPolyFlags_Hit		= 0x0002,
 			MicroPolyFlags_PushedForward	= 0x0004,
+			MicroPolyFlags_GridSampler	= 0x0008,
 		};
 
 	public:
@@ -695,6 +736,14 @@ class CqMicroPolygon : boost::noncopyable
 		{
 			return false;
 		}
+		/** Whether CacheHitTestValues() fills in all four vertices and
+		 * circle of confusion multipliers of the hit test cache, which the
+		 * depth of field bounds of the lens strata are built from.
+		 */
+		virtual bool IsQuad() const
+		{
+			return true;
+		}
 
 		/** Check if the sample point is within the micropoly.
 		 * \param vecSample 2D sample point.
@@ -715,6 +764,26 @@ class CqMicroPolygon : boost::noncopyable
 		 * \param usingDof - true if depth of field is turned on.
 		 */
 		virtual void CacheHitTestValues(CqHitTestCache& cache, bool usingDof) const;
+		/** \brief Cache the point-in-poly test for the micropolygon at a fixed time.
+		 *
+		 * Moving micropolygons which support this are interpolated to the
+		 * given time once, after which every sample at exactly that time can
+		 * be tested with SampleAtCachedTime().
+		 *
+		 * \param cache - storage for relevant hit test data.
+		 * \param time - the time to interpolate the micropolygon to.
+		 * \param bound - set to the bound of the micropolygon at that time.
+		 * \return false if the micropolygon can't be sampled this way.
+		 */
+		virtual bool CacheHitTestValuesAtTime(CqHitTestCache& cache, TqFloat time,
+				CqBound& bound) const;
+		/** \brief Check if a sample point is within the micropolygon at the
+		 * time cached by CacheHitTestValuesAtTime().
+		 *
+		 * \param time - the time passed to CacheHitTestValuesAtTime().
+		 */
+		bool SampleAtCachedTime( CqHitTestCache& hitTestCache, const CqVector2D& vecSample,
+				TqFloat& D, CqVector2D& uv, TqFloat time ) const;
 
 		/** \brief Cache information needed to interpolate colour and opacity
 		 * across the micropolygon.
@@ -812,11 +881,140 @@ class CqMicroPolygon : boost::noncopyable
 		void cachePointInPolyTest(CqHitTestCache& cache, CqVector3D* points) const;
 
 	private:
-		static	CqObjectPool<CqMicroPolygon> m_thePool;
+		static	CqThreadLocalPool<CqMicroPolygon> m_thePool;
 }
 ;
 
 
+//----------------------------------------------------------------------
+/** \class CqMicroQuadGrid
+ * Compact storage for the micropolygons of a shaded, static grid.
+ *
+ * Rather than busting a grid into individually allocated micropolygons, the
+ * grid is referenced from each bucket it touches and its quads are sampled
+ * straight from the raster space vertex array held by the grid, using a
+ * CqMicroQuadSampler.  Only the grid index and a few flags are kept for each
+ * quad which survived culling and trimming.
+ */
+
+class CqMicroQuadGrid : boost::noncopyable
+{
+	public:
+		/** Constructor
+		 * \param pGrid The shaded grid, P must already be in raster space.
+		 */
+		explicit CqMicroQuadGrid( CqMicroPolyGridBase* pGrid );
+		~CqMicroQuadGrid();
+
+		/** Add the quad with top left vertex at Index to the storage.
+		 * \param Index Integer grid index.
+		 * \param fTrimmed Flag indicating that the quad spans a trim curve.
+		 */
+		void	AddQuad( TqInt Index, bool fTrimmed );
+
+		/** Get the pointer to the donor grid.
+		 */
+		CqMicroPolyGridBase* pGrid() const
+		{
+			return ( m_pGrid );
+		}
+		/** Get the number of quads stored.
+		 */
+		TqInt	cQuads() const
+		{
+			return ( m_Quads.size() );
+		}
+		/** Get the grid index of the i'th quad.
+		 */
+		TqInt	QuadIndex( TqInt i ) const
+		{
+			return ( m_Quads[ i ] );
+		}
+		/** Query if the i'th quad spans a trim curve.
+		 */
+		bool	IsTrimmed( TqInt i ) const
+		{
+			return ( ( m_Flags[ i ] & QuadFlags_Trimmed ) != 0 );
+		}
+		/** Query if the i'th quad lies entirely outside a raster space
+		 * rectangle, looking only at its four vertices.
+		 */
+		bool	QuadOutside( TqInt i, TqFloat xmin, TqFloat xmax, TqFloat ymin, TqFloat ymax ) const
+		{
+			TqInt index = m_Quads[ i ];
+			const CqVector3D& A = m_pP[ index ];
+			const CqVector3D& B = m_pP[ index + 1 ];
+			const CqVector3D& C = m_pP[ index + m_cu + 1 ];
+			const CqVector3D& D = m_pP[ index + m_cu + 2 ];
+			return ( ( A.x() < xmin && B.x() < xmin && C.x() < xmin && D.x() < xmin ) ||
+			         ( A.x() > xmax && B.x() > xmax && C.x() > xmax && D.x() > xmax ) ||
+			         ( A.y() < ymin && B.y() < ymin && C.y() < ymin && D.y() < ymin ) ||
+			         ( A.y() > ymax && B.y() > ymax && C.y() > ymax && D.y() > ymax ) );
+		}
+		/** Record that the i'th quad has been hit by a pixel sample.
+		 */
+		void	MarkHit( TqInt i )
+		{
+			m_Flags[ i ] |= QuadFlags_Hit;
+		}
+		/** \brief Get the bound of all stored quads (not including DoF).
+		 */
+		const CqBound& GetBound() const
+		{
+			return ( m_Bound );
+		}
+
+	private:
+		enum EqQuadFlags
+		{
+			QuadFlags_Trimmed	= 0x01,
+			QuadFlags_Hit		= 0x02,
+		};
+
+		CqMicroPolyGridBase*	m_pGrid;	///< Pointer to the donor grid.
+		const CqVector3D*	m_pP;		///< Raster space vertices of the donor grid.
+		TqInt	m_cu;			///< Number of quads across the donor grid.
+		std::vector<TqInt>	m_Quads;	///< Grid indices of the stored quads.
+		std::vector<TqUchar>	m_Flags;	///< EqQuadFlags for each stored quad.
+		CqBound	m_Bound;		///< Bound of all stored quads.
+};
+
+
+//----------------------------------------------------------------------
+/** \class CqMicroQuadSampler
+ * A micropolygon which walks the quads of a CqMicroQuadGrid.
+ *
+ * The sampler is constructed on the stack by the bucket processor and pointed
+ * at each quad in turn, so it can be passed through the usual micropolygon
+ * sampling code without allocating anything per quad.
+ */
+
+class CqMicroQuadSampler : public CqMicroPolygon
+{
+	public:
+		explicit CqMicroQuadSampler( CqMicroQuadGrid& grid )
+			: CqMicroPolygon( grid.pGrid() ),
+			m_grid( grid )
+		{}
+
+		/** Point the sampler at the i'th quad of the grid.
+		 *
+		 * This sets up the vertex order and bound, so quads which can be
+		 * culled with CqMicroQuadGrid::QuadOutside() should be skipped first.
+		 */
+		void	SetQuad( TqInt i )
+		{
+			SetIndex( m_grid.QuadIndex( i ) );
+			if ( m_grid.IsTrimmed( i ) )
+				MarkTrimmed();
+			Initialise();
+		}
+
+	private:
+		CqMicroQuadGrid&	m_grid;
+};
+
+
 
 //----------------------------------------------------------------------
 /** \class CqMovingMicroPolygonKey
@@ -863,7 +1061,7 @@ class CqMovingMicroPolygonKey
 		CqBound m_Bound;
 		bool	m_BoundReady;
 
-		static	CqObjectPool<CqMovingMicroPolygonKey>	m_thePool;
+		static	CqThreadLocalPool<CqMovingMicroPolygonKey>	m_thePool;
 }
 ;
 
@@ -930,6 +1128,8 @@ class CqMicroPolygonMotion : public CqMicroPolygon
 		virtual	bool	Sample( CqHitTestCache& hitTestCache, SqSampleData const& sample, TqFloat& D, CqVector2D& uv, TqFloat time, bool UsingDof = false ) const;
 
 		virtual void CacheHitTestValues(CqHitTestCache& cache, bool usingDof) const;
+		virtual bool CacheHitTestValuesAtTime(CqHitTestCache& cache, TqFloat time,
+				CqBound& bound) const;
 
 		virtual void	MarkTrimmed()
 		{
@@ -959,6 +1159,16 @@ class CqMicroPolygonMotion : public CqMicroPolygon
 		}
 
 	protected:
+		/** \brief Find the motion segment containing a time.
+		 *
+		 * \param time - time to look up, clamped to the key times.
+		 * \param fraction - set to the position of time along the segment.
+		 * \return the index of the key at the start of the segment.
+		 */
+		TqInt	KeyAtTime( TqFloat time, TqFloat& fraction ) const;
+		/// Interpolate the vertices of the micropolygon along a motion segment.
+		void	PointsAtTime( TqInt key, TqFloat fraction, CqVector3D points[4] ) const;
+
 		CqBoundList	m_BoundList;			///< List of bounds to get a tighter fit.
 		bool	m_BoundReady;				///< Flag indicating the boundary has been initialised.
 		std::vector<TqFloat> m_Times;
@@ -82,8 +82,6 @@ namespace Aqsis {
  */
 void CqMultiJitteredSampler::multiJitterIndices(TqInt* indices, TqInt numX, TqInt numY)
 {
-	static CqRandom random(42);
-
 	// Initialise the subcell coordinates to a regular and stratified but
 	// non-random initial pattern
 	for (TqInt iy = 0; iy < numY; iy++ )
@@ -106,7 +104,7 @@ void CqMultiJitteredSampler::multiJitterIndices(TqInt* indices, TqInt numX, TqIn
 		TqInt ix = numX;
 		while(ix > 1)
 		{
-			TqInt ix2 = random.RandomInt(ix);
+			TqInt ix2 = m_random.RandomInt(ix);
 			--ix;
 			std::swap(indices[2*(iy*numX + ix) + 1],
 					indices[2*(iy*numX + ix2) + 1]);
@@ -119,7 +117,7 @@ void CqMultiJitteredSampler::multiJitterIndices(TqInt* indices, TqInt numX, TqIn
 		TqInt iy = numY;
 		while(iy > 1)
 		{
-			TqInt iy2 = random.RandomInt(iy);
+			TqInt iy2 = m_random.RandomInt(iy);
 			--iy;
 			std::swap(indices[2*(iy*numX + ix)],
 					indices[2*(iy2*numX + ix)]);
@@ -130,14 +128,13 @@ void CqMultiJitteredSampler::multiJitterIndices(TqInt* indices, TqInt numX, TqIn
 void CqMultiJitteredSampler::setupJitterPattern(TqInt offset)
 {
 	TqInt nSamples = numSamples();
-	static CqRandom random(  53 );
 
 	// Initialize points to the "canonical" multi-jittered pattern.
 
 	if( m_pixelXSamples == 1 && m_pixelYSamples == 1)
 	{
-		m_2dSamples[offset] = CqVector2D(random.RandomFloat(), random.RandomFloat());
-		m_1dSamples[offset] = random.RandomFloat();
+		m_2dSamples[offset] = CqVector2D(m_random.RandomFloat(), m_random.RandomFloat());
+		m_1dSamples[offset] = m_random.RandomFloat();
 	}
 	else
 	{
@@ -164,8 +161,8 @@ void CqMultiJitteredSampler::setupJitterPattern(TqInt offset)
 				// which would result if we placed the sample positions at the
 				// centre of the subcell.
 				m_2dSamples[offset+which] = CqVector2D(
-					(xindex+random.RandomFloat())*subcellWidth + ix*subPixelWidth,
-					(yindex+random.RandomFloat())*subcellWidth + iy*subPixelHeight);
+					(xindex+m_random.RandomFloat())*subcellWidth + ix*subPixelWidth,
+					(yindex+m_random.RandomFloat())*subcellWidth + iy*subPixelHeight);
 				++which;
 			}
 		}
@@ -179,7 +176,7 @@ void CqMultiJitteredSampler::setupJitterPattern(TqInt offset)
 	//
 	// TODO: In fact, this can be improved using a randomized low discrepency
 	// sequence (suitably shuffled or randomized between pixels)
-	TqFloat random1d = random.RandomFloat( delta1d );
+	TqFloat random1d = m_random.RandomFloat( delta1d );
 
 	for (TqInt i = 0; i < nSamples; i++ )
 	{
@@ -195,7 +192,7 @@ void CqMultiJitteredSampler::setupJitterPattern(TqInt offset)
 	TqInt j = nSamples;
 	while(j > 1)
 	{
-		TqInt j2 = random.RandomInt(j);
+		TqInt j2 = m_random.RandomInt(j);
 		--j;
 		std::swap(m_shuffledIndices[offset+j], m_shuffledIndices[offset+j2]);
 	}
@@ -89,7 +89,8 @@ class CqMultiJitteredSampler : public IqSampler
 
 inline CqMultiJitteredSampler::CqMultiJitteredSampler(TqInt pixelXSamples, TqInt pixelYSamples) :
 	m_pixelXSamples(pixelXSamples),
-	m_pixelYSamples(pixelYSamples)
+	m_pixelYSamples(pixelYSamples),
+	m_random(53)
 {
 	m_1dSamples.resize(numSamples()*m_cacheSize);
 	m_2dSamples.resize(numSamples()*m_cacheSize);
@@ -114,6 +114,12 @@ void CqOcclusionTree::setSampleDepth(TqFloat depth, TqInt index)
 	m_needsUpdate = true;
 }
 
+void CqOcclusionTree::setSampleIgnored(TqInt index, bool ignored)
+{
+	m_depthTree[index] = ignored ? 0 : FLT_MAX;
+	m_needsUpdate = true;
+}
+
 void CqOcclusionTree::updateTree()
 {
 	// Only update the depths if the leaf nodes have changed since the last
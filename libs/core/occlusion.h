@@ -111,6 +111,17 @@ class CqOcclusionTree
 		 */
 		void setSampleDepth(TqFloat depth, TqInt index);
 
+		/** \brief Set whether the sample at a leaf node is ignored.
+		 *
+		 * Ignored samples, like leaf nodes without a sample, never stop an
+		 * object from being culled.  Otherwise the leaf depth is reset to
+		 * infinity, for a sample which hasn't been hit yet.
+		 *
+		 * \param index - index of the leaf node.
+		 * \param ignored - whether to ignore the sample.
+		 */
+		void setSampleIgnored(TqInt index, bool ignored);
+
 		/** \brief Update the occlusion tree if necessary.
 		 *
 		 * Depths are propagated from the leaf nodes down to the the root if
@@ -25,6 +25,10 @@
 
 #include "occlusion.h"
 
+#include <cfloat>
+
+#include "bound.h"
+
 #define BOOST_TEST_DYN_LINK
 #include <boost/test/auto_unit_test.hpp>
 
@@ -38,6 +42,16 @@ struct CqOcclusionTree::Test
 	{
 		return CqOcclusionTree::treeIndexForPoint(treeDepth, splitXFirst, x, y);
 	}
+	/// Set up a tree over [0,2]x[0,2], with a sample at every leaf.
+	static void setupTree(CqOcclusionTree& tree, TqInt numLevels)
+	{
+		tree.m_numLevels = numLevels;
+		tree.m_splitXFirst = true;
+		tree.m_firstLeafNode = (1 << (numLevels-1)) - 1;
+		tree.m_depthTree.assign(2*tree.m_firstLeafNode + 1, FLT_MAX);
+		tree.m_treeBoundMin = CqVector2D(0, 0);
+		tree.m_treeBoundMax = CqVector2D(2, 2);
+	}
 };
 }
 
@@ -128,4 +142,41 @@ BOOST_AUTO_TEST_CASE(treeIndexForPoint_test)
     BOOST_CHECK_EQUAL(Test::treeIndexForPoint(4, false, 1, 3), 14);
 }
 
+BOOST_AUTO_TEST_CASE(setSampleIgnored_test)
+{
+	typedef CqOcclusionTree::Test Test;
+	// Leaves 3 to 6 cover the quadrants of the tree, as in the diagrams above.
+	CqOcclusionTree tree;
+	Test::setupTree(tree, 3);
+	const CqBound wholeTree(0, 0, 1, 2, 2, 2);
+	const CqBound topRight(1.2, 1.2, 1, 1.8, 1.8, 2);
+	BOOST_CHECK(!tree.canCull(wholeTree));
+
+	// Every sample but one is hit in front of the bounds.
+	tree.setSampleDepth(0.5, 3);
+	tree.setSampleDepth(0.5, 5);
+	tree.setSampleDepth(0.5, 6);
+	tree.updateTree();
+	BOOST_CHECK(!tree.canCull(wholeTree));
+	BOOST_CHECK(tree.canCull(topRight));
+
+	// Ignoring the sample which wasn't hit lets the bound be culled.
+	tree.setSampleIgnored(4, true);
+	tree.updateTree();
+	BOOST_CHECK(tree.canCull(wholeTree));
+
+	// Using it again resets it to a sample which hasn't been hit yet.
+	tree.setSampleIgnored(4, false);
+	tree.updateTree();
+	BOOST_CHECK(!tree.canCull(wholeTree));
+	BOOST_CHECK(tree.canCull(topRight));
+
+	// Ignoring a sample which was hit doesn't stop culling either.
+	tree.setSampleDepth(0.5, 4);
+	tree.setSampleIgnored(6, true);
+	tree.updateTree();
+	BOOST_CHECK(tree.canCull(wholeTree));
+	BOOST_CHECK(tree.canCull(topRight));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
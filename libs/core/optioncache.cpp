@@ -40,9 +40,16 @@ SqOptionCache::SqOptionCache()
 	xBucketSize(16),
 	yBucketSize(16),
 	maxEyeSplits(1),
+	geometryMemory(0),
 	displayMode(DMode_None),
 	depthFilter(Filter_Min),
-	zThreshold()
+	zThreshold(),
+	shadowPrefetch(false),
+	xAdaptiveSamps(0),
+	yAdaptiveSamps(0),
+	adaptiveThreshold(0.02f),
+	adaptiveContrast(0.3f),
+	interleavedTime(false)
 { }
 
 void SqOptionCache::cacheOptions(const IqOptions& opts)
@@ -86,6 +93,10 @@ void SqOptionCache::cacheOptions(const IqOptions& opts)
 	maxEyeSplits = 10;
 	if(const TqInt* splits = opts.GetIntegerOption("limits", "eyesplits"))
 		maxEyeSplits = splits[0];
+	// Memory budget for deferred geometry
+	geometryMemory = 0;
+	if(const TqInt* geomMem = opts.GetIntegerOption("limits", "geometrymemory"))
+		geometryMemory = geomMem[0];
 
 	// Display mode.
 	const TqInt* dMode = opts.GetIntegerOption("System", "DisplayMode");
@@ -114,6 +125,30 @@ void SqOptionCache::cacheOptions(const IqOptions& opts)
 	zThreshold = CqColor(1.0f);
 	if(const CqColor* zTh = opts.GetColorOption("limits", "zthreshold"))
 		zThreshold = zTh[0];
+
+	// Shadow map prefetching
+	shadowPrefetch = false;
+	if(const TqInt* prefetch = opts.GetIntegerOption("shadow", "prefetch"))
+		shadowPrefetch = prefetch[0] != 0;
+
+	// Adaptive sampling, where PixelSamples is the most samples taken.
+	xAdaptiveSamps = 0;
+	yAdaptiveSamps = 0;
+	if(const TqInt* adaptiveSamps = opts.GetIntegerOption("Hider", "adaptivesamples"))
+	{
+		xAdaptiveSamps = adaptiveSamps[0];
+		yAdaptiveSamps = adaptiveSamps[1];
+	}
+	adaptiveThreshold = 0.02f;
+	if(const TqFloat* threshold = opts.GetFloatOption("Hider", "adaptivethreshold"))
+		adaptiveThreshold = threshold[0];
+	adaptiveContrast = 0.3f;
+	if(const TqFloat* contrast = opts.GetFloatOption("Hider", "adaptivecontrast"))
+		adaptiveContrast = contrast[0];
+
+	interleavedTime = false;
+	if(const TqInt* interleaved = opts.GetIntegerOption("Hider", "interleavedtime"))
+		interleavedTime = interleaved[0] != 0;
 }
 
 } // namespace Aqsis
@@ -62,12 +62,22 @@ struct SqOptionCache
 	TqInt xBucketSize;  ///< Bucket size in the x-direction
 	TqInt yBucketSize;  ///< Bucket size in the y-direction
 	TqInt maxEyeSplits; ///< Maximum allowed number of eye splits
+	TqInt geometryMemory; ///< Memory for deferred geometry in kB, 0 if unlimited
 
 	EqDisplayMode displayMode; ///< Type of the connected displays
 
 	EqDepthFilter depthFilter; ///< Type of depth filter to use
 	CqColor zThreshold; ///< Opacity threshold for inclusion in depth maps
 
+	bool shadowPrefetch; ///< Load shadow map tiles for buckets in advance
+
+	TqInt xAdaptiveSamps; ///< Base samples in x for adaptive sampling, 0 if off
+	TqInt yAdaptiveSamps; ///< Base samples in y for adaptive sampling, 0 if off
+	TqFloat adaptiveThreshold; ///< Sample standard deviation which adds samples
+	TqFloat adaptiveContrast; ///< Sample contrast which adds samples
+
+	bool interleavedTime; ///< Give the samples of a bucket the same times
+
 	/// Initialise all options to non-catastrophic defaults.
 	SqOptionCache();
 	/// Populate the cache with options extracted from opts.
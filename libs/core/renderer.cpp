@@ -33,10 +33,13 @@
 #include	"imagebuffer.h"
 #include	"lights.h"
 #include	"renderer.h"
+#include	"reshadestore.h"
 #include	"shaders.h"
 #include	"nurbs.h"
 #include	"points.h"
 #include	"lath.h"
+#include	"instance.h"
+#include	"splitrecord.h"
 #include	"transform.h"
 #include	"texturemap_old.h"
 #include	<aqsis/shadervm/ishader.h>
@@ -82,6 +85,7 @@ CqRenderer::CqRenderer()
 	m_Shaders(),
 	m_InstancedShaders(),
 	m_lights(),
+	m_reshadeStore(),
 	m_textureCache(),
 	m_fSaveGPrims(false),
 	m_pTransCamera(new CqTransform()),
@@ -101,6 +105,9 @@ CqRenderer::CqRenderer()
 	m_pRaytracer(CreateRaytracer()),
 	m_clippingVolume(),
 	m_aWorld(),
+	m_objectMasters(),
+	m_pCurrentObject(),
+	m_splitRecord(),
 	m_cropWindowXMin(0),
 	m_cropWindowXMax(0),
 	m_cropWindowYMin(0),
@@ -140,6 +147,7 @@ CqRenderer::CqRenderer()
 
 CqRenderer::~CqRenderer()
 {
+	clearReshadeStore();
 	if ( m_pImageBuffer )
 	{
 		m_pImageBuffer->Release();
@@ -410,6 +418,17 @@ void	CqRenderer::EndWorldModeBlock()
 		m_pconCurrent->EndWorldModeBlock();
 		m_pconCurrent = m_pconCurrent->pconParent();
 	}
+	// Object definitions made inside the world block don't outlive it, those
+	// made outside are kept for later frames.
+	m_pCurrentObject.reset();
+	TqObjectMap::iterator iMaster = m_objectMasters.begin();
+	while( iMaster != m_objectMasters.end() )
+	{
+		if( iMaster->second->fWorldScope() )
+			m_objectMasters.erase( iMaster++ );
+		else
+			++iMaster;
+	}
 }
 
 
@@ -686,6 +705,13 @@ void CqRenderer::RenderWorld(bool clone)
 	poptCurrent()->InitialiseCamera();
 	pImage()->SetImage();
 
+	// Keep the grids for reshading if the render is interactive.  Shadow
+	// passes are never reshaded.
+	clearReshadeStore();
+	const TqInt* pIpr = GetIntegerOption("render", "ipr");
+	if(!clone && pIpr && pIpr[0])
+		m_reshadeStore = boost::shared_ptr<CqReshadeStore>(new CqReshadeStore());
+
 	PrepareShaders();
 
 	if(clone)
@@ -697,11 +723,113 @@ void CqRenderer::RenderWorld(bool clone)
 	pImage() ->RenderImage();
 	m_pDDManager->CloseDisplays();
 
+	if(m_reshadeStore && !m_reshadeStore->isComplete())
+	{
+		Aqsis::log() << warning << "Some grids can't be reshaded, edits will need the frame to be rendered again" << std::endl;
+		clearReshadeStore();
+	}
+
 	if(NULL != pMultipass)
 		pMultipass[0] = multiPass;
 }
 
 
+//----------------------------------------------------------------------
+/** Release the grids kept for reshading.
+ */
+
+void CqRenderer::clearReshadeStore()
+{
+	if(m_reshadeStore)
+		m_reshadeStore->clear();
+	m_reshadeStore.reset();
+}
+
+
+//----------------------------------------------------------------------
+/** Change an argument of a light source shader.
+ *
+ * Edits only apply to the grids kept for reshading, so nothing is changed
+ * when there aren't any.
+ */
+
+void CqRenderer::editLightArgument( const char* lightName, const char* argName,
+		EqVariableType type, void* value )
+{
+	if(!m_reshadeStore)
+	{
+		Aqsis::log() << warning << "No grids kept for reshading, edit of light \""
+			<< lightName << "\" ignored" << std::endl;
+		return;
+	}
+	CqLightsourcePtr light = findLight(lightName);
+	boost::shared_ptr<IqShader> shader = light->pShader();
+	shader->SetArgument(argName, type, "", value);
+	shader->InitialiseParameters();
+	// Results cached for the old arguments are no longer valid.
+	light->SetCache(boost::shared_ptr<CqLightCache>());
+	m_reshadeStore->invalidateLight(light.get());
+}
+
+
+//----------------------------------------------------------------------
+/** Change an argument of the surface and atmosphere shaders with a name.
+ *
+ * The shaders are found through the grids kept for reshading, so nothing is
+ * changed when there aren't any.
+ */
+
+void CqRenderer::editShaderArgument( const char* shaderName, const char* argName,
+		EqVariableType type, void* value )
+{
+	if(!m_reshadeStore)
+	{
+		Aqsis::log() << warning << "No grids kept for reshading, edit of shader \""
+			<< shaderName << "\" ignored" << std::endl;
+		return;
+	}
+	std::vector<boost::shared_ptr<IqShader> > shaders;
+	m_reshadeStore->findShaders(shaderName, shaders);
+	if(shaders.empty())
+	{
+		Aqsis::log() << warning << "No kept grids use shader \"" << shaderName
+			<< "\", edit ignored" << std::endl;
+		return;
+	}
+	for(std::vector<boost::shared_ptr<IqShader> >::iterator i = shaders.begin();
+			i != shaders.end(); ++i)
+	{
+		(*i)->SetArgument(argName, type, "", value);
+		(*i)->InitialiseParameters();
+	}
+	m_reshadeStore->invalidateShader(shaderName);
+}
+
+
+//----------------------------------------------------------------------
+/** Render the last frame again from the grids kept for reshading.
+ */
+
+bool CqRenderer::reshade()
+{
+	if(!m_reshadeStore)
+	{
+		Aqsis::log() << warning << "No grids kept for reshading, set Option \"render\" \"ipr\" and render the frame" << std::endl;
+		return false;
+	}
+
+	initialiseCropWindow();
+	poptCurrent()->InitialiseCamera();
+	pImage()->SetImage();
+
+	m_pDDManager->OpenDisplays(m_cropWindowXMax - m_cropWindowXMin, m_cropWindowYMax - m_cropWindowYMin);
+	pImage()->ReshadeGrids(*m_reshadeStore);
+	pImage()->RenderImage();
+	m_pDDManager->CloseDisplays();
+	return true;
+}
+
+
 //----------------------------------------------------------------------
 /** Render any automatic shadow passes.
  */
@@ -1258,6 +1386,13 @@ boost::shared_ptr<IqShader> CqRenderer::CreateShader(
 
 void CqRenderer::StorePrimitive( const boost::shared_ptr<CqSurface>& pSurface )
 {
+	// Primitives inside an object definition only become part of the master.
+	if( m_pCurrentObject )
+	{
+		m_pCurrentObject->AddSurface( pSurface );
+		return;
+	}
+
 	// If we are not in a mode that allows 'extra' passes, then fasttrack the primitive directly into the pipeline.
 	const TqInt* pMultipass = GetIntegerOption("Render", "multipass");
 	if(pMultipass && pMultipass[0])
@@ -1274,6 +1409,49 @@ void CqRenderer::StorePrimitive( const boost::shared_ptr<CqSurface>& pSurface )
 	}
 }
 
+bool CqRenderer::BeginObject( const char* name )
+{
+	if( m_pCurrentObject )
+		return( false );
+
+	// Attribute and transform changes inside the object are local to it.
+	BeginAttributeModeBlock();
+
+	m_pCurrentObject = boost::shared_ptr<CqObjectMaster>( new CqObjectMaster(
+				ptransCurrent()->matObjectToWorld( Time() ), pattrCurrent(),
+				IsWorldBegin() ) );
+	m_objectMasters[ name ] = m_pCurrentObject;
+	STATS_INC( GEO_ins_masters );
+	return( true );
+}
+
+
+bool CqRenderer::EndObject()
+{
+	if( !m_pCurrentObject )
+		return( false );
+
+	EndAttributeModeBlock();
+	m_pCurrentObject.reset();
+	return( true );
+}
+
+
+bool CqRenderer::InstanceObject( const char* name )
+{
+	TqObjectMap::const_iterator iMaster = m_objectMasters.find( name );
+	if( iMaster == m_objectMasters.end() )
+		return( false );
+
+	std::vector<boost::shared_ptr<CqSurface> > aInstances;
+	iMaster->second->Instantiate( ptransCurrent(), pattrCurrent(), aInstances );
+	std::vector<boost::shared_ptr<CqSurface> >::const_iterator iInstance;
+	for( iInstance = aInstances.begin(); iInstance != aInstances.end(); ++iInstance )
+		StorePrimitive( *iInstance );
+	return( true );
+}
+
+
 void CqRenderer::PostWorld()
 {
 	while(!m_aWorld.empty())
@@ -1353,6 +1531,11 @@ void CqRenderer::PostSurface( const boost::shared_ptr<CqSurface>& pSurface )
 		pSurface->pAttributes()->GetFloatAttributeWrite( "System", "LevelOfDetailBounds" ) [ 1 ] = maxImportance;
 	}
 
+	// Note the primitives generated by a procedural, so that they can be
+	// evicted when the deferred geometry is over its memory limit.
+	if( m_splitRecord && !m_splitRecord->addSurface( pSurface ) )
+		return;
+
 	pImage()->PostSurface(pSurface);
 }
 
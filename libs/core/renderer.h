@@ -54,6 +54,9 @@ namespace Aqsis {
 
 class CqImageBuffer;
 class CqModeBlock;
+class CqReshadeStore;
+class CqObjectMaster;
+class CqSplitRecord;
 
 struct SqCoordSys
 {
@@ -278,10 +281,70 @@ class CqRenderer : public IqRenderer
 		/// Find the light associated with the given name
 		CqLightsourcePtr findLight(const char* name);
 
+		/** Get the grids kept for reshading the last frame rendered.
+		 * \return NULL unless Option "render" "ipr" was set for it.
+		 */
+		CqReshadeStore* reshadeStore()
+		{
+			return ( m_reshadeStore.get() );
+		}
+		/// Release the grids kept for reshading.
+		void clearReshadeStore();
+		/** Change an argument of a light source shader, marking the grids
+		 * it lights for reshading.
+		 */
+		void editLightArgument( const char* lightName, const char* argName,
+				EqVariableType type, void* value );
+		/** Change an argument of the surface and atmosphere shaders with the
+		 * given name, marking the grids using them for reshading.
+		 */
+		void editShaderArgument( const char* shaderName, const char* argName,
+				EqVariableType type, void* value );
+		/** Show the effect of the edits since the last render, only
+		 * reshading the grids affected by them.
+		 * \return false if no grids were kept, so the frame must be rendered again.
+		 */
+		bool reshade();
+
 		void	PostSurface( const boost::shared_ptr<CqSurface>& pSurface );
 		void	StorePrimitive( const boost::shared_ptr<CqSurface>& pSurface );
+
+		/** Start recording primitives into a new object master.
+		 * \return false if an object is already being defined.
+		 */
+		bool	BeginObject( const char* name );
+		/** Finish the current object master.
+		 * \return false if no object is being defined.
+		 */
+		bool	EndObject();
+		/** Store instances of the named object master with the current
+		 * transformation and attributes.
+		 * \return false if there is no object with the given name.
+		 */
+		bool	InstanceObject( const char* name );
+		/// Whether primitives are currently being stored into an object master.
+		bool	fObjectBlock() const
+		{
+			return ( m_pCurrentObject.get() != 0 );
+		}
 		void	PostWorld();
 		void	PostCloneOfWorld();
+		/** Get the record noting the primitives generated by the procedural
+		 * being expanded, NULL if they aren't noted.
+		 */
+		const boost::shared_ptr<CqSplitRecord>&	splitRecord() const
+		{
+			return ( m_splitRecord );
+		}
+		/** Set the record which notes the primitives stored from now on.
+		 * \return The previous record.
+		 */
+		boost::shared_ptr<CqSplitRecord>	setSplitRecord( const boost::shared_ptr<CqSplitRecord>& record )
+		{
+			boost::shared_ptr<CqSplitRecord> prev = m_splitRecord;
+			m_splitRecord = record;
+			return ( prev );
+		}
 
 		/** Set the world to screen matrix.
 		 * \param mat The new matrix to use as the world to screen transformation.
@@ -541,6 +604,8 @@ class CqRenderer : public IqRenderer
 
 		typedef std::map<std::string, CqLightsourcePtr> TqLightMap;
 		TqLightMap m_lights;
+		/// Grids kept for reshading, see Option "render" "ipr".
+		boost::shared_ptr<CqReshadeStore> m_reshadeStore;
 
 		boost::shared_ptr<IqTextureCache> m_textureCache; ///< Cache for aqsistex texture access.
 		 
@@ -581,6 +646,11 @@ class CqRenderer : public IqRenderer
 
 		std::deque<boost::shared_ptr<CqSurface> >	m_aWorld;
 
+		typedef std::map<std::string, boost::shared_ptr<CqObjectMaster> > TqObjectMap;
+		TqObjectMap	m_objectMasters;		///< Defined object masters.
+		boost::shared_ptr<CqObjectMaster>	m_pCurrentObject;	///< Object master being defined.
+		boost::shared_ptr<CqSplitRecord>	m_splitRecord;	///< Record of the procedural being expanded.
+
 		// Cached calculated cropwindow coordinates in raster space.
 		TqInt				m_cropWindowXMin;
 		TqInt				m_cropWindowXMax;
@@ -0,0 +1,178 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/**
+        \file
+        \brief Implements the store of shaded grids kept for interactive reshading.
+*/
+
+#include "reshadestore.h"
+
+#include <algorithm>
+
+#include "micropolygon.h"
+#include "renderer.h"
+
+namespace Aqsis {
+
+namespace {
+
+/// Whether a grid is lit by the given light.
+bool isLitBy(const CqMicroPolyGrid* pGrid, const IqLightsource* light)
+{
+	IqConstAttributesPtr attrs = pGrid->pAttributes();
+	for(TqUint i = 0, n = attrs->cLights(); i < n; ++i)
+	{
+		if(attrs->pLight(i) == light)
+			return true;
+	}
+	return false;
+}
+
+/// Whether the surface or atmosphere shader of a grid has the given name.
+bool hasShader(const CqMicroPolyGrid* pGrid, const std::string& name)
+{
+	TqFloat time = QGetRenderContext()->Time();
+	boost::shared_ptr<IqShader> surface = pGrid->pAttributes()->pshadSurface(time);
+	boost::shared_ptr<IqShader> atmosphere = pGrid->pAttributes()->pshadAtmosphere(time);
+	return (surface && surface->strName() == name)
+		|| (atmosphere && atmosphere->strName() == name);
+}
+
+} // unnamed namespace
+
+
+//------------------------------------------------------------------------------
+CqReshadeStore::CqReshadeStore()
+	: m_mutex(),
+	m_grids(),
+	m_buckets(),
+	m_complete(true)
+{ }
+
+CqReshadeStore::~CqReshadeStore()
+{
+	clear();
+}
+
+void CqReshadeStore::addGrid(CqMicroPolyGrid* pGrid)
+{
+	SqGrid entry;
+	entry.grid = pGrid;
+	entry.dirty = false;
+	// P is in raster space once the grid has been split.
+	const CqVector3D* pP = 0;
+	pGrid->pVar(EnvVars_P)->GetPointPtr(pP);
+	for(TqInt i = 0, n = pGrid->pShaderExecEnv()->shadingPointCount(); i < n; ++i)
+		entry.bound.Encapsulate(pP[i]);
+
+	ADDREF(pGrid);
+	boost::mutex::scoped_lock lock(m_mutex);
+	m_grids.push_back(entry);
+}
+
+void CqReshadeStore::addUnsupported()
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	m_complete = false;
+}
+
+void CqReshadeStore::addBucket(TqInt col, TqInt row, const CqChannelBuffer& buffer)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	m_buckets[std::make_pair(col, row)] = buffer;
+}
+
+bool CqReshadeStore::isComplete() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_complete;
+}
+
+std::vector<CqReshadeStore::SqGrid>& CqReshadeStore::grids()
+{
+	return m_grids;
+}
+
+const CqChannelBuffer* CqReshadeStore::bucket(TqInt col, TqInt row) const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	TqBucketMap::const_iterator i = m_buckets.find(std::make_pair(col, row));
+	return i == m_buckets.end() ? 0 : &i->second;
+}
+
+TqInt CqReshadeStore::invalidateLight(const IqLightsource* light)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	TqInt count = 0;
+	for(std::vector<SqGrid>::iterator i = m_grids.begin(); i != m_grids.end(); ++i)
+	{
+		if(isLitBy(i->grid, light))
+		{
+			i->dirty = true;
+			++count;
+		}
+	}
+	return count;
+}
+
+void CqReshadeStore::findShaders(const std::string& name,
+		std::vector<boost::shared_ptr<IqShader> >& shaders) const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	TqFloat time = QGetRenderContext()->Time();
+	for(std::vector<SqGrid>::const_iterator i = m_grids.begin(); i != m_grids.end(); ++i)
+	{
+		boost::shared_ptr<IqShader> surface = i->grid->pAttributes()->pshadSurface(time);
+		boost::shared_ptr<IqShader> atmosphere = i->grid->pAttributes()->pshadAtmosphere(time);
+		if(surface && surface->strName() == name
+			&& std::find(shaders.begin(), shaders.end(), surface) == shaders.end())
+			shaders.push_back(surface);
+		if(atmosphere && atmosphere->strName() == name
+			&& std::find(shaders.begin(), shaders.end(), atmosphere) == shaders.end())
+			shaders.push_back(atmosphere);
+	}
+}
+
+TqInt CqReshadeStore::invalidateShader(const std::string& name)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	TqInt count = 0;
+	for(std::vector<SqGrid>::iterator i = m_grids.begin(); i != m_grids.end(); ++i)
+	{
+		if(hasShader(i->grid, name))
+		{
+			i->dirty = true;
+			++count;
+		}
+	}
+	return count;
+}
+
+void CqReshadeStore::clear()
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	for(std::vector<SqGrid>::iterator i = m_grids.begin(); i != m_grids.end(); ++i)
+		RELEASEREF(i->grid);
+	m_grids.clear();
+	m_buckets.clear();
+	m_complete = true;
+}
+
+} // namespace Aqsis
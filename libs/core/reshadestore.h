@@ -0,0 +1,125 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/**
+        \file
+        \brief Declares the store of shaded grids kept for interactive reshading.
+*/
+
+#ifndef RESHADESTORE_H_INCLUDED
+#define RESHADESTORE_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+
+#include <aqsis/core/ilightsource.h>
+#include <aqsis/math/region.h>
+#include <aqsis/shadervm/ishader.h>
+#include "bound.h"
+#include "channelbuffer.h"
+
+namespace Aqsis {
+
+class CqMicroPolyGrid;
+
+/** \brief Grids and filtered buckets of a render, kept so that edits to
+ * lights and shaders can be shown without dicing the scene again.
+ *
+ * With Option "render" "ipr" set, every grid which is rendered is kept along
+ * with its state before surface shading.  An edit marks the grids it affects
+ * as dirty; reshading then only runs the surface shaders of the dirty grids,
+ * and only resamples the buckets they touch.  The other buckets are sent to
+ * the displays from the stored filtered data.
+ *
+ * Grids which can't be reshaded, such as deforming ones, make the store
+ * incomplete, in which case reshading isn't possible.
+ */
+class CqReshadeStore : boost::noncopyable
+{
+	public:
+		/// A kept grid.
+		struct SqGrid
+		{
+			CqMicroPolyGrid*	grid;
+			/// Raster bound of the grid, with camera space depth.
+			CqBound	bound;
+			/// Whether the grid has to be shaded again.
+			bool	dirty;
+		};
+
+		CqReshadeStore();
+		~CqReshadeStore();
+
+		/** Keep a grid which has just been split into micropolygons.
+		 *
+		 * The grid must have been prepared with PrepareReshade() before it
+		 * was shaded.  A reference to it is held until the store is cleared.
+		 */
+		void	addGrid(CqMicroPolyGrid* pGrid);
+		/// Note that a grid which can't be reshaded was rendered.
+		void	addUnsupported();
+		/// Keep the filtered data of a finished bucket.
+		void	addBucket(TqInt col, TqInt row, const CqChannelBuffer& buffer);
+
+		/// Whether every grid rendered has been kept.
+		bool	isComplete() const;
+		/// Kept grids.
+		std::vector<SqGrid>&	grids();
+		/// Filtered data of a bucket, or NULL if it wasn't kept.
+		const CqChannelBuffer*	bucket(TqInt col, TqInt row) const;
+
+		/** Mark the grids lit by a light as dirty.
+		 * \return the number of grids marked.
+		 */
+		TqInt	invalidateLight(const IqLightsource* light);
+		/** Get the surface and atmosphere shaders of the kept grids with the
+		 * given name, each shader once.
+		 */
+		void	findShaders(const std::string& name,
+				std::vector<boost::shared_ptr<IqShader> >& shaders) const;
+		/** Mark the grids whose surface or atmosphere shader has the given
+		 * name as dirty.
+		 * \return the number of grids marked.
+		 */
+		TqInt	invalidateShader(const std::string& name);
+
+		/// Release all grids and buckets.
+		void	clear();
+
+	private:
+		typedef std::map<std::pair<TqInt, TqInt>, CqChannelBuffer> TqBucketMap;
+
+		/// Protects everything below.
+		mutable boost::mutex	m_mutex;
+		std::vector<SqGrid>	m_grids;
+		TqBucketMap	m_buckets;
+		bool	m_complete;
+};
+
+} // namespace Aqsis
+
+#endif // RESHADESTORE_H_INCLUDED
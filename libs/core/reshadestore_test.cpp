@@ -0,0 +1,95 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file Unit tests for the store of grids kept for reshading.
+ *
+ * Grids can only be made with a full renderer, so these tests cover the
+ * filtered buckets and the bookkeeping of the store.
+ */
+
+#include "reshadestore.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(reshadestore_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+void fillBuffer(CqChannelBuffer& buffer, TqFloat value)
+{
+	buffer.clearChannels();
+	buffer.addChannel("Ci", 3);
+	buffer.allocate(2, 2);
+	for(TqInt y = 0; y < 2; ++y)
+		for(TqInt x = 0; x < 2; ++x)
+			for(TqInt c = 0; c < 3; ++c)
+				buffer(x, y, 0)[c] = value;
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(reshadestore_bucket_test)
+{
+	CqReshadeStore store;
+	BOOST_CHECK(store.bucket(0, 0) == 0);
+
+	CqChannelBuffer buffer;
+	fillBuffer(buffer, 1);
+	store.addBucket(1, 2, buffer);
+	// The store keeps its own copy of the data.
+	fillBuffer(buffer, 2);
+	const CqChannelBuffer* kept = store.bucket(1, 2);
+	BOOST_REQUIRE(kept != 0);
+	BOOST_CHECK_EQUAL(kept->width(), 2);
+	BOOST_CHECK_EQUAL(kept->height(), 2);
+	BOOST_CHECK_EQUAL((*kept)(1, 1, 0)[2], 1.0f);
+	BOOST_CHECK(store.bucket(2, 1) == 0);
+
+	// Keeping a bucket again replaces it.
+	store.addBucket(1, 2, buffer);
+	BOOST_CHECK_EQUAL((*store.bucket(1, 2))(0, 0, 0)[0], 2.0f);
+}
+
+BOOST_AUTO_TEST_CASE(reshadestore_complete_test)
+{
+	CqReshadeStore store;
+	BOOST_CHECK(store.isComplete());
+	store.addUnsupported();
+	BOOST_CHECK(!store.isComplete());
+
+	CqChannelBuffer buffer;
+	fillBuffer(buffer, 1);
+	store.addBucket(0, 0, buffer);
+	store.clear();
+	BOOST_CHECK(store.isComplete());
+	BOOST_CHECK(store.bucket(0, 0) == 0);
+	BOOST_CHECK(store.grids().empty());
+}
+
+BOOST_AUTO_TEST_CASE(reshadestore_empty_invalidate_test)
+{
+	CqReshadeStore store;
+	BOOST_CHECK_EQUAL(store.invalidateLight(0), 0);
+	BOOST_CHECK_EQUAL(store.invalidateShader("plastic"), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -30,9 +30,12 @@
 
 #include "attributes.h"
 #include "imagebuffer.h"
+#include "lightcache.h"
 #include "renderer.h"
+#include "threadlocalpool.h"
 #include "transform.h"
 #include <aqsis/math/math.h>
+#include <aqsis/shadervm/ishader.h>
 
 namespace Aqsis {
 
@@ -156,7 +159,9 @@ void CqStats::PrintStats( TqInt level ) const
 		<< STATS_INT_GETI( GPR_allocated ) <<  " allocated\n\t"
 		<< STATS_INT_GETI( GPR_created_total ) <<  " used (" << _gpr_u_q << "%), " << STATS_INT_GETI( GPR_peak ) << " peak,\n\t"
 		<< STATS_INT_GETI( GPR_culled ) << " culled (" << _gpr_c_q << "%)\n\t"
-		<< STATS_INT_GETI( GPR_occlusion_culled ) << " occlusion culled (" << _gpr_oc_q << "%)\n" << std::endl;
+		<< STATS_INT_GETI( GPR_occlusion_culled ) << " occlusion culled (" << _gpr_oc_q << "%)\n\t"
+		<< STATS_INT_GETI( GPR_evicted ) << " evicted over the geometry memory limit, "
+		<< STATS_INT_GETI( GPR_regenerated ) << " regenerated\n" << std::endl;
 		/*
 			GPrim stats - End
 			-------------------------------------------------------------------
@@ -179,6 +184,11 @@ void CqStats::PrintStats( TqInt level ) const
 		TqFloat _geo_prc_s_q = 0.0f;
 		if (STATS_INT_GETI( GEO_prc_created ))
 			_geo_prc_s_q = 100.0f * STATS_INT_GETI( GEO_prc_split ) / STATS_INT_GETI( GEO_prc_created );
+		// Archives
+		TqFloat _arc_disk_q = 0.0f;
+		TqInt _arc_disk_reads = STATS_INT_GETI( ARC_disk_hits ) + STATS_INT_GETI( ARC_disk_misses );
+		if (_arc_disk_reads)
+			_arc_disk_q = 100.0f * STATS_INT_GETI( ARC_disk_hits ) / _arc_disk_reads;
 		MSG << "Geometry:\n\t"
 		// Curves
 		<< "Curves:\n"
@@ -186,12 +196,25 @@ void CqStats::PrintStats( TqInt level ) const
 		<<					"\t" << STATS_INT_GETI( GEO_crv_splits ) << " split (" << _geo_crv_s_q << "%)\n\t\t\t"
 		<<							STATS_INT_GETI( GEO_crv_crv ) << " (" << _geo_crv_s_c_q << "%) into " << STATS_INT_GETI( GEO_crv_crv_created ) << " subcurves\n\t\t\t"
 		<<							STATS_INT_GETI( GEO_crv_patch ) << " (" << _geo_crv_s_p_q << "%) into " << STATS_INT_GETI( GEO_crv_patch_created ) << " patches\n\t"
+		<<					"\t" << STATS_INT_GETI( GEO_crv_ribbon ) << " segments diced as ribbons\n\t"
 		<< "Procedurals:\n"
 		<<					"\t\t" << STATS_INT_GETI( GEO_prc_created ) << " created\n\t"
 		<<					"\t" << STATS_INT_GETI( GEO_prc_split ) << " split (" << _geo_prc_s_q << "%)\n\t\t"
 		<<							STATS_INT_GETI( GEO_prc_created_dl ) << " dynamic load,\n\t\t"
 		<<							STATS_INT_GETI( GEO_prc_created_dra ) << " dynamic read archive,\n\t\t"
-		<<							STATS_INT_GETI( GEO_prc_created_prp ) << " run program\n\t\t"
+		<<							STATS_INT_GETI( GEO_prc_created_prp ) << " run program\n\t"
+		<< "Instances:\n"
+		<<					"\t\t" << STATS_INT_GETI( GEO_ins_masters ) << " objects defined\n\t"
+		<<					"\t" << STATS_INT_GETI( GEO_ins_created ) << " instances created\n\t"
+		<<					"\t" << STATS_INT_GETI( GEO_ins_expanded ) << " instances expanded\n\t"
+		<< "Archives:\n"
+		<<					"\t\t" << STATS_INT_GETI( ARC_prefetched ) << " prefetched\n\t"
+		<<					"\t" << STATS_INT_GETI( ARC_hits ) << " replayed from cache ("
+		<<							STATS_INT_GETI( ARC_waits ) << " waited for parsing)\n\t"
+		<<					"\t" << STATS_INT_GETI( ARC_misses ) << " parsed serially\n\t"
+		<<					"\t" << STATS_INT_GETI( ARC_disk_hits ) << " read from disk cache (" << _arc_disk_q << "% hit rate, "
+		<<							STATS_INT_GETF( ARC_disk_saved ) << "MB of source skipped)\n\t"
+		<<					"\t" << STATS_INT_GETI( ARC_disk_misses ) << " added to disk cache\n"
 		<< std::endl;
 		/*
 			GPrim stats - End
@@ -250,7 +273,8 @@ void CqStats::PrintStats( TqInt level ) const
 		TqFloat	_grd_shd_g256	=	100.0f * STATS_INT_GETI( GRD_shd_size_g256 ) / _grd_shade;
 		MSG << "Grids:\n\t"
 		<< STATS_INT_GETI( GRD_created ) << " created, " << STATS_INT_GETI( GRD_peak ) << " peak,\n\t"
-		<< _grd_init << " initialized (" << _grd_init_quote << "%),\n\t" << _grd_shade << " shaded (" << _grd_shade_quote << "%), " << STATS_INT_GETI( GRD_culled ) << " culled (" << _grd_cull_quote << "%)\n\n"
+		<< _grd_init << " initialized (" << _grd_init_quote << "%),\n\t" << _grd_shade << " shaded (" << _grd_shade_quote << "%), " << STATS_INT_GETI( GRD_culled ) << " culled (" << _grd_cull_quote << "%),\n\t"
+		<< STATS_INT_GETI( GRD_coalesced ) << " surfaces coalesced into larger grids\n\n"
 		<< "\tGrid count/size (diced grids):\n"
 		<< "\t+------+------+------+------+------+------+------+------+\n"
 		<< "\t|<=  4 |<=  8 |<= 16 |<= 32 |<= 64 |<=128 |<=256 | >256 |\n"
@@ -346,6 +370,7 @@ void CqStats::PrintStats( TqInt level ) const
 			_mpg_max = STATS_INT_GETF( MPG_max_area );
 		MSG << "Micropolygons:\n\t"
 		<< STATS_INT_GETI( MPG_allocated ) << " created (" << STATS_INT_GETI( MPG_culled ) << " culled)\n"
+		<< "\t" << STATS_INT_GETI( MPG_grids ) << " static grids sampled directly\n"
 		<< "\t" <<STATS_INT_GETI( MPG_peak ) << " peak, " << STATS_INT_GETI( MPG_trimmed ) << " trimmed, ( " << STATS_INT_GETI( MPG_trimmedout ) << " completely ) " << STATS_INT_GETI( MPG_missed ) << " missed (" << _mpg_m_q << "%)\n\t"
 		<< "\n\tMPG Area:\t" << _mpg_average_ratio << " average \n\t\t\t"
 		<<  _mpg_min << " min\n\t\t\t"
@@ -376,6 +401,35 @@ void CqStats::PrintStats( TqInt level ) const
 			MPG stats - End
 			-------------------------------------------------------------------
 		*/
+		/*
+			-------------------------------------------------------------------
+			Memory pools
+		*/
+		MSG << "Memory pools:\n";
+		const std::vector<CqThreadLocalPoolBase*>& pools = CqThreadLocalPoolBase::pools();
+		std::vector<CqThreadLocalPoolBase::SqHeapStats> heapStats;
+		for ( std::vector<CqThreadLocalPoolBase*>::const_iterator pool = pools.begin(); pool != pools.end(); ++pool )
+		{
+			( *pool )->heapStats( heapStats );
+			if ( heapStats.empty() )
+				continue;
+			TqInt _pool_chunks = 0;
+			for ( TqUint i = 0; i < heapStats.size(); ++i )
+				_pool_chunks += heapStats[ i ].chunks;
+			MSG << "\t" << ( *pool )->name() << ": " << heapStats.size() << " thread heaps, "
+			<< _pool_chunks * ( *pool )->chunkSize() / 1024 << "KB\n";
+			for ( TqUint i = 0; i < heapStats.size(); ++i )
+			{
+				MSG << "\t\theap " << i << ": " << heapStats[ i ].allocated << " allocated, "
+				<< heapStats[ i ].freed << " freed locally, "
+				<< heapStats[ i ].returned << " returned from other threads\n";
+			}
+		}
+		MSG << std::endl;
+		/*
+			Memory pools - End
+			-------------------------------------------------------------------
+		*/
 		/*
 			-------------------------------------------------------------------
 			Sampling
@@ -398,6 +452,15 @@ void CqStats::PrintStats( TqInt level ) const
 		<< "bound hits: " << STATS_INT_GETI( SPL_bound_hits ) << " (" << _spl_b_h << "%),\n\tmisses: "
 		<< STATS_INT_GETI( SPL_count ) - STATS_INT_GETI( SPL_hits ) - STATS_INT_GETI( SPL_bound_hits ) << " (" << _spl_m << "%)\n"
 		<< std::endl;
+		if (STATS_INT_GETI( SPL_pixels ))
+		{
+			MSG << "Adaptive sampling:\n\t"
+			<< STATS_INT_GETI( SPL_refined_pixels ) << " of " << STATS_INT_GETI( SPL_pixels ) << " pixels refined ("
+			<< 100.0f * STATS_INT_GETI( SPL_refined_pixels ) / STATS_INT_GETI( SPL_pixels ) << "%)\n\t"
+			<< "Average samples per pixel: "
+			<< static_cast<TqFloat>( STATS_INT_GETI( SPL_pixel_samples ) ) / STATS_INT_GETI( SPL_pixels ) << "\n"
+			<< std::endl;
+		}
 		/*
 			Sampling - End
 			-------------------------------------------------------------------
@@ -411,6 +474,37 @@ void CqStats::PrintStats( TqInt level ) const
 		// MSG << "Transforms:\n\t";
 		// MSG << ( TqInt ) Transform_stack.size() << " created\n" << std::endl;
 		MSG << "Parameters:\n\t" << STATS_INT_GETI( PRM_created ) << " created, " << STATS_INT_GETI( PRM_peak ) << " peak\n" << std::endl;
+		SqShaderVMStats shaderStats = shaderVMStatistics();
+		MSG << "Shaders:\n\t" << shaderStats.programs << " programs loaded, "
+		<< shaderStats.programBytes / 1024 << "KB\n\t"
+		<< shaderStats.instances << " instances, "
+		<< shaderStats.sharedBytes / 1024 << "KB of programs shared between them\n\t"
+		<< shaderStats.contexts << " per thread execution contexts\n\t"
+		<< "uniform code run for " << shaderStats.uniformEvaluated << " grids ("
+		<< shaderStats.uniformTime << "secs), cached results used for "
+		<< shaderStats.uniformReused << " grids";
+		if ( shaderStats.uniformEvaluated > 0 )
+			MSG << " (~" << shaderStats.uniformTime * shaderStats.uniformReused / shaderStats.uniformEvaluated
+			<< "secs saved)";
+		MSG << "\n" << std::endl;
+		std::vector<boost::shared_ptr<CqLightCache> > lightCaches;
+		CqLightCache::caches( lightCaches );
+		if ( !lightCaches.empty() )
+		{
+			MSG << "Light caches:\n";
+			for ( TqUint i = 0; i < lightCaches.size(); ++i )
+			{
+				const CqLightCache& cache = *lightCaches[ i ];
+				TqInt _lc_hits = cache.hits();
+				TqInt _lc_count = _lc_hits + cache.misses();
+				MSG << "\t" << cache.name() << ": " << cache.size() << " results stored, "
+				<< _lc_hits << " of " << _lc_count << " points reused";
+				if ( _lc_count > 0 )
+					MSG << " (" << 100.0f * _lc_hits / _lc_count << "%)";
+				MSG << "\n";
+			}
+			MSG << std::endl;
+		}
 	}
 	if ( level == 3 )
 	{
@@ -273,6 +273,9 @@ class CqStats
 		       MPG_min_area,
 		       MPG_max_area,
 
+		       // Archive stats
+		       ARC_disk_saved,
+
 		       _Last_float } EqFloatIndex;
 
 		//! Enum to index the integer array
@@ -287,6 +290,8 @@ class CqStats
 		       GPR_peak,
 		       GPR_culled,
 		       GPR_occlusion_culled,
+		       GPR_evicted,
+		       GPR_regenerated,
 
 		       // GPrim types
 
@@ -308,6 +313,7 @@ class CqStats
 		       GEO_crv_patch,
 		       GEO_crv_crv_created,
 		       GEO_crv_patch_created,
+		       GEO_crv_ribbon,
 
 		       // Procedural
 
@@ -317,10 +323,26 @@ class CqStats
 		       GEO_prc_created_dra,
 		       GEO_prc_created_prp,
 
+		       // Object instancing
+
+		       GEO_ins_masters,
+		       GEO_ins_created,
+		       GEO_ins_expanded,
+
+		       // Archive caches
+
+		       ARC_prefetched,
+		       ARC_hits,
+		       ARC_misses,
+		       ARC_waits,
+		       ARC_disk_hits,
+		       ARC_disk_misses,
+
 		       // Grid stats
 
 		       GRD_created,
 		       GRD_culled,
+		       GRD_coalesced,
 		       GRD_current,
 		       GRD_peak,
 		       GRD_allocated,
@@ -357,6 +379,7 @@ class CqStats
 		       MPG_missed,
 		       MPG_trimmed,
 		       MPG_trimmedout,
+		       MPG_grids,
 
 		       // Sample hit quote
 		       MPG_sample_coverage0_125,
@@ -380,6 +403,9 @@ class CqStats
 		       SPL_count,
 		       SPL_bound_hits,
 		       SPL_hits,
+		       SPL_pixels,
+		       SPL_pixel_samples,
+		       SPL_refined_pixels,
 
 		       // Parameters
 		       PRM_created,
@@ -49,12 +49,6 @@ namespace Aqsis {
 #define	NumSamples	16
 #define	MinSamples	3
 
-// Local Variables
-
-static TqInt    m_rand_index = -1;
-static TqFloat  m_aRand_no[ 1024 ];
-static CqRandom random( 42 );
-
 //---------------------------------------------------------------------
 /** Constructor.
  */
@@ -62,15 +56,6 @@ static CqRandom random( 42 );
 CqShadowMapOld::CqShadowMapOld( const CqString& strName ) :
 		CqTextureMapOld( strName )
 {
-
-	// Initialise the random table the first time it is needed.
-	if( m_rand_index < 0 )
-	{
-		TqInt i;
-		for ( i = 0; i < 1024; i++ )
-			m_aRand_no[ i ] = random.RandomFloat(2.0);
-		m_rand_index = 0;
-	}
 	for (TqInt k=0; k < 256; k++)
 		m_apLast[k] = NULL;
 	m_LastPoint = CqVector2D(-1, -1);
@@ -585,6 +570,9 @@ void	CqShadowMapOld::SampleMap( CqVector3D& R1, CqVector3D& R2, CqVector3D& R3,
 		return;
 	}
 
+	// The jitter is seeded from the filter region, so that results don't
+	// depend on the order of the lookups.
+	CqRandom random( lu ^ ( hu << 16 ), lv ^ ( hv << 16 ) );
 	for ( i = 0; i < ns; i++, s += ds )
 	{
 		t = lv - tdelta;
@@ -593,10 +581,8 @@ void	CqShadowMapOld::SampleMap( CqVector3D& R1, CqVector3D& R2, CqVector3D& R3,
 		for ( j = 0; j < nt; j++, t += dt )
 		{
 			// Jitter s and t
-			m_rand_index = ( m_rand_index + 1 ) & 1023;
-			TqInt iu = static_cast<TqUint>( s + m_aRand_no[ m_rand_index ] * js );
-			m_rand_index = ( m_rand_index + 1 ) & 1023;
-			TqInt iv = static_cast<TqUint>( t + m_aRand_no[ m_rand_index ] * jt );
+			TqInt iu = static_cast<TqUint>( s + random.RandomFloat( 2.0f ) * js );
+			TqInt iv = static_cast<TqUint>( t + random.RandomFloat( 2.0f ) * jt );
 
 			if( iu < 0 || iu >= (TqInt) m_XRes || iv < 0 || iv >= (TqInt) m_YRes )
 			{
@@ -615,8 +601,7 @@ void	CqShadowMapOld::SampleMap( CqVector3D& R1, CqVector3D& R2, CqVector3D& R3,
 
 				TqFloat mapz = pTMBa->GetValue( iu, iv, 0 );
 
-				m_rand_index = ( m_rand_index + 1 ) & 1023;
-				TqFloat bias = m_biasRange*m_aRand_no[m_rand_index] + m_minBias;
+				TqFloat bias = m_biasRange*random.RandomFloat( 2.0f ) + m_minBias;
 
 				if ( z > mapz + bias)
 				{
@@ -54,7 +54,6 @@ namespace Aqsis {
 // Local Constants
 
 #define MEG1                8192*1024
-#define RDMAX 128
 
 #undef  ALLOCSEGMENTSTATUS
 
@@ -123,44 +122,31 @@ IqRenderer* QGetRenderContextI();
 //----------------------------------------------------------------------
 /** CalculateNoise() Return pseudorandom value for sampling texture.
 *
+* The first sample is always at the centre.  The generator is made by the
+* caller for each lookup, so that results don't depend on the order in which
+* lookups happen.
 */
 
-static void CalculateNoise(TqFloat &du, TqFloat &dv, TqInt which)
+static void CalculateNoise(TqFloat &du, TqFloat &dv, TqInt which, CqRandom& random)
 {
-	static TqInt   i_RdIx = -1;
-	static TqFloat RD[RDMAX][2];
-
-	// Crucial to have some speed here;
-	// I initialize 128 x,y random value which
-	// will be used by GetSampleWithoutBlur()
-	if (i_RdIx == -1)
-	{
-		TqInt i;
-		CqRandom rd;
-
-		for (i =0; i < RDMAX; i ++)
-		{
-			RD[i][0] = rd.RandomFloat();
-			RD[i][1] = rd.RandomFloat();
-			//Aqsis::log() << warning << RD[i][0] << " " << RD[i][1] << std::endl;
-		}
-
-		i_RdIx = 0;
-
-	}
-
 	if (which != 0)
 	{
-		du = RD[i_RdIx][0];
-		dv = RD[i_RdIx][1];
-		i_RdIx ++;
-		i_RdIx %= RDMAX;
+		du = random.RandomFloat();
+		dv = random.RandomFloat();
 	}
 	else
 	{
 		dv = du = 0.5;
 	}
 }
+
+/** NoiseSeed() Make a seed for CalculateNoise() from a pair of coordinates.
+*/
+static TqUint NoiseSeed(TqFloat a, TqFloat b)
+{
+	return static_cast<TqUint>(lfloor(a * 4096.0f))
+		^ (static_cast<TqUint>(lfloor(b * 4096.0f)) << 16);
+}
 //----------------------------------------------------------------------
 /** IsVerbose() Is it adequate to printout the level of mipmap ?
  * Option "statistics" "int renderinfo" 1 by default it returns false
@@ -813,12 +799,13 @@ void CqTextureMapOld::GetSampleWithoutBlur( TqFloat u1, TqFloat v1, TqFloat u2,
 
 
 	// Assuming this will also include the pixel at u,v multiple samplings interval
+	CqRandom random(NoiseSeed(u1, v1), NoiseSeed(u2, v2));
 	for (TqInt i = 0; i <= m_samples; i ++)
 	{
 		// return random values into du, dv between 0..1.0
 		// but when i == 0; du = dv = 0.5 so at the minimum
 		// a pixel will be read at (u,v)
-		CalculateNoise(du, dv, i);
+		CalculateNoise(du, dv, i, random);
 
 		mul = (*m_FilterFunc)(du-0.5,dv-0.5 , 1.0, 1.0);
 
@@ -1931,9 +1918,11 @@ void CqEnvironmentMapOld::SampleMap( CqVector3D& R1,
 
 		TqFloat dfovu = fabs(1.0f - m_fov)/(TqFloat) (m_XRes);
 		TqFloat dfovv = fabs(1.0f - m_fov)/(TqFloat) (m_YRes);
+		CqRandom random(NoiseSeed(R1.x(), R1.y()) ^ NoiseSeed(R1.z(), 0),
+				NoiseSeed(R4.x(), R4.y()) ^ NoiseSeed(R4.z(), 0));
 		for (i=0; i < m_samples; i++)
 		{
-			CalculateNoise(x, y, i);
+			CalculateNoise(x, y, i, random);
 
 			D = lerp(y, lerp(x, R1, R2), lerp(x, R3, R4));
 
@@ -0,0 +1,252 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/**
+        \file
+        \brief Implements an object pool with a separate heap for each thread.
+*/
+
+#include "threadlocalpool.h"
+
+#include <algorithm>
+
+#ifdef AQSIS_SYSTEM_WIN32
+#include <windows.h>
+#endif
+
+namespace Aqsis {
+
+namespace {
+
+/// Link used to chain free elements, held in the element storage itself.
+struct SqLink
+{
+	SqLink* next;
+};
+
+/** Atomically set *dest to newVal if it currently holds oldVal.
+ * \return The value held by *dest before the operation.
+ */
+inline SqLink* compareAndSwap(SqLink* volatile* dest, SqLink* oldVal, SqLink* newVal)
+{
+#if AQSIS_COMPILER_GCC
+	return __sync_val_compare_and_swap(dest, oldVal, newVal);
+#elif defined(AQSIS_SYSTEM_WIN32)
+	return static_cast<SqLink*>(InterlockedCompareExchangePointer(
+			reinterpret_cast<PVOID volatile*>(dest), newVal, oldVal));
+#else
+#	error "No atomic compare and swap available for CqThreadLocalPoolBase"
+#endif
+}
+
+} // unnamed namespace
+
+
+/// Header stored in front of each element.
+union CqThreadLocalPoolBase::SqHeader
+{
+	SqHeap* owner;	///< Heap the element was carved from.
+	double align;	///< Keep the element storage aligned.
+};
+
+
+/// Per thread heap.
+struct CqThreadLocalPoolBase::SqHeap
+{
+	CqThreadLocalPoolBase* pool;
+	/// Free elements, only touched by the owning thread.
+	SqLink* freeList;
+	/// Elements freed by other threads, pushed without locking.
+	SqLink* volatile returned;
+	std::vector<char*> chunks;
+	SqHeapStats stats;
+
+	SqHeap(CqThreadLocalPoolBase* pool)
+		: pool(pool),
+		freeList(0),
+		returned(0),
+		chunks()
+	{
+		stats.allocated = 0;
+		stats.freed = 0;
+		stats.returned = 0;
+		stats.chunks = 0;
+	}
+	~SqHeap()
+	{
+		for(std::vector<char*>::iterator i = chunks.begin(); i != chunks.end(); ++i)
+			delete[] *i;
+	}
+};
+
+
+//------------------------------------------------------------------------------
+CqThreadLocalPoolBase::CqThreadLocalPoolBase(const char* name, TqInt elementSize,
+		TqInt chunkSize)
+	: m_name(name),
+	m_elementSize(0),
+	m_chunkSize(chunkSize),
+	m_heapMutex(),
+	m_heaps(),
+	m_spareHeaps(),
+	m_currentHeap(&CqThreadLocalPoolBase::releaseHeap)
+{
+	// Room for the free list link, rounded up so the next header is aligned.
+	TqInt storage = std::max<TqInt>(elementSize, sizeof(SqLink));
+	storage = (storage + sizeof(SqHeader) - 1) / sizeof(SqHeader) * sizeof(SqHeader);
+	m_elementSize = sizeof(SqHeader) + storage;
+	m_chunkSize = std::max(m_chunkSize, m_elementSize);
+	poolRegistry().push_back(this);
+}
+
+CqThreadLocalPoolBase::~CqThreadLocalPoolBase()
+{
+	// Any other threads using the pool have exited by now.
+	m_currentHeap.reset();
+	for(std::vector<SqHeap*>::iterator i = m_heaps.begin(); i != m_heaps.end(); ++i)
+		delete *i;
+	std::vector<CqThreadLocalPoolBase*>& registry = poolRegistry();
+	registry.erase(std::remove(registry.begin(), registry.end(), this), registry.end());
+}
+
+void* CqThreadLocalPoolBase::alloc()
+{
+	SqHeap* heap = currentHeap();
+	if(!heap->freeList)
+	{
+		// Take everything freed by other threads in one go.  Since elements
+		// are only ever pushed by other threads and the whole list is
+		// removed at once here, this doesn't suffer from the ABA problem.
+		SqLink* returned = heap->returned;
+		while(returned)
+		{
+			SqLink* prev = compareAndSwap(&heap->returned, returned, 0);
+			if(prev == returned)
+				break;
+			returned = prev;
+		}
+		if(returned)
+		{
+			heap->freeList = returned;
+			for(SqLink* link = returned; link; link = link->next)
+				++heap->stats.returned;
+		}
+		else
+			grow(heap);
+	}
+	SqLink* p = heap->freeList;
+	heap->freeList = p->next;
+	++heap->stats.allocated;
+	return p;
+}
+
+void CqThreadLocalPoolBase::free(void* p)
+{
+	if(!p)
+		return;
+	SqLink* link = static_cast<SqLink*>(p);
+	SqHeap* owner = (reinterpret_cast<SqHeader*>(p) - 1)->owner;
+	if(owner == m_currentHeap.get())
+	{
+		link->next = owner->freeList;
+		owner->freeList = link;
+		++owner->stats.freed;
+	}
+	else
+	{
+		SqLink* head = owner->returned;
+		while(true)
+		{
+			link->next = head;
+			SqLink* prev = compareAndSwap(&owner->returned, head, link);
+			if(prev == head)
+				break;
+			head = prev;
+		}
+	}
+}
+
+void CqThreadLocalPoolBase::heapStats(std::vector<SqHeapStats>& stats) const
+{
+	boost::mutex::scoped_lock lock(m_heapMutex);
+	stats.clear();
+	for(std::vector<SqHeap*>::const_iterator i = m_heaps.begin(); i != m_heaps.end(); ++i)
+		stats.push_back((*i)->stats);
+}
+
+const std::vector<CqThreadLocalPoolBase*>& CqThreadLocalPoolBase::pools()
+{
+	return poolRegistry();
+}
+
+CqThreadLocalPoolBase::SqHeap* CqThreadLocalPoolBase::currentHeap()
+{
+	SqHeap* heap = m_currentHeap.get();
+	if(!heap)
+	{
+		boost::mutex::scoped_lock lock(m_heapMutex);
+		if(!m_spareHeaps.empty())
+		{
+			heap = m_spareHeaps.back();
+			m_spareHeaps.pop_back();
+		}
+		else
+		{
+			heap = new SqHeap(this);
+			m_heaps.push_back(heap);
+		}
+		m_currentHeap.reset(heap);
+	}
+	return heap;
+}
+
+void CqThreadLocalPoolBase::grow(SqHeap* heap)
+{
+	char* chunk = new char[m_chunkSize];
+	heap->chunks.push_back(chunk);
+	++heap->stats.chunks;
+	// Chain the elements up, each remembering which heap it belongs to.
+	SqLink* head = 0;
+	for(TqInt i = m_chunkSize / m_elementSize - 1; i >= 0; --i)
+	{
+		char* element = chunk + i*m_elementSize;
+		reinterpret_cast<SqHeader*>(element)->owner = heap;
+		SqLink* link = reinterpret_cast<SqLink*>(element + sizeof(SqHeader));
+		link->next = head;
+		head = link;
+	}
+	heap->freeList = head;
+}
+
+void CqThreadLocalPoolBase::releaseHeap(SqHeap* heap)
+{
+	if(!heap)
+		return;
+	CqThreadLocalPoolBase* pool = heap->pool;
+	boost::mutex::scoped_lock lock(pool->m_heapMutex);
+	pool->m_spareHeaps.push_back(heap);
+}
+
+std::vector<CqThreadLocalPoolBase*>& CqThreadLocalPoolBase::poolRegistry()
+{
+	static std::vector<CqThreadLocalPoolBase*> registry;
+	return registry;
+}
+
+} // namespace Aqsis
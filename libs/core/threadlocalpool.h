@@ -0,0 +1,128 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/**
+        \file
+        \brief Declares an object pool with a separate heap for each thread.
+*/
+
+#ifndef THREADLOCALPOOL_H_INCLUDED
+#define THREADLOCALPOOL_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/utility.hpp>
+
+namespace Aqsis {
+
+/** \brief Fixed size object pool with one heap per thread.
+ *
+ * Like CqObjectPool, memory is handed out in fixed size elements carved from
+ * large chunks.  Each thread allocates from its own heap, so no locking is
+ * needed in the common case.  Every element remembers the heap it came from;
+ * an element freed by a different thread is pushed onto a lock free return
+ * queue of the owning heap, which the owner reclaims the next time it runs
+ * out of free elements.
+ *
+ * Heaps outlive their threads.  When a thread exits its heap is handed to the
+ * next thread which needs one, since the renderer starts a new thread for each
+ * bucket.  All memory is released when the pool is destroyed.
+ */
+class CqThreadLocalPoolBase : boost::noncopyable
+{
+	public:
+		/// Allocation statistics for one heap of a pool.
+		struct SqHeapStats
+		{
+			TqInt	allocated;	///< Elements handed out.
+			TqInt	freed;		///< Elements freed by the owning thread.
+			TqInt	returned;	///< Elements reclaimed after being freed by other threads.
+			TqInt	chunks;		///< Chunks allocated.
+		};
+
+		/** Create a pool.
+		 * \param name - name of the pool, used in the statistics output.
+		 * \param elementSize - size of the objects to be allocated.
+		 * \param chunkSize - size in bytes of each block of elements.
+		 */
+		CqThreadLocalPoolBase(const char* name, TqInt elementSize, TqInt chunkSize);
+		~CqThreadLocalPoolBase();
+
+		/// Allocate an element from the heap of the calling thread.
+		void*	alloc();
+		/// Free an element allocated by alloc() on any thread.
+		void	free(void* p);
+
+		/// Name of the pool.
+		const char*	name() const
+		{
+			return m_name;
+		}
+		/// Size in bytes of each chunk.
+		TqInt	chunkSize() const
+		{
+			return m_chunkSize;
+		}
+		/// Get the statistics for each heap in the pool.
+		void	heapStats(std::vector<SqHeapStats>& stats) const;
+
+		/// All pools in existence, for statistics reporting.
+		static const std::vector<CqThreadLocalPoolBase*>& pools();
+
+	private:
+		struct SqHeap;
+		union SqHeader;
+
+		SqHeap*	currentHeap();
+		void	grow(SqHeap* heap);
+		static void releaseHeap(SqHeap* heap);
+		static std::vector<CqThreadLocalPoolBase*>& poolRegistry();
+
+		const char*	m_name;
+		TqInt	m_elementSize;	///< Element size including the header.
+		TqInt	m_chunkSize;
+		/// Protects m_heaps and m_spareHeaps.
+		mutable boost::mutex	m_heapMutex;
+		std::vector<SqHeap*>	m_heaps;
+		std::vector<SqHeap*>	m_spareHeaps;
+		/// The heap used by the calling thread.
+		boost::thread_specific_ptr<SqHeap>	m_currentHeap;
+};
+
+/** \brief Typed interface to CqThreadLocalPoolBase.
+ *
+ * Use this as a static member to implement class operators new and delete,
+ * in the same way as CqObjectPool.
+ */
+template <class T, TqInt CS=8>
+class CqThreadLocalPool : public CqThreadLocalPoolBase
+{
+	public:
+		explicit CqThreadLocalPool(const char* name)
+			: CqThreadLocalPoolBase(name, sizeof(T), CS*1024-16)
+		{}
+};
+
+} // namespace Aqsis
+
+#endif // THREADLOCALPOOL_H_INCLUDED
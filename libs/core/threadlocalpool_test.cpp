@@ -0,0 +1,119 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file Unit tests for the thread local object pool.
+ */
+
+#include "threadlocalpool.h"
+
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(threadlocalpool_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+struct SqElement
+{
+	double d;
+	TqInt i[5];
+};
+
+typedef CqThreadLocalPool<SqElement, 1> TqTestPool;
+
+void allocMany(TqTestPool& pool, std::vector<void*>& elements, TqInt count)
+{
+	for(TqInt i = 0; i < count; ++i)
+		elements.push_back(pool.alloc());
+}
+
+void freeAll(TqTestPool& pool, const std::vector<void*>& elements)
+{
+	for(TqInt i = 0, end = elements.size(); i < end; ++i)
+		pool.free(elements[i]);
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(threadlocalpool_local_reuse_test)
+{
+	TqTestPool pool("test");
+	void* a = pool.alloc();
+	void* b = pool.alloc();
+	BOOST_CHECK(a != b);
+	pool.free(a);
+	// Freed elements are handed out again straight away.
+	BOOST_CHECK_EQUAL(pool.alloc(), a);
+	pool.free(a);
+	pool.free(b);
+
+	std::vector<CqThreadLocalPoolBase::SqHeapStats> stats;
+	pool.heapStats(stats);
+	BOOST_REQUIRE_EQUAL(stats.size(), 1U);
+	BOOST_CHECK_EQUAL(stats[0].allocated, 3);
+	BOOST_CHECK_EQUAL(stats[0].freed, 3);
+	BOOST_CHECK_EQUAL(stats[0].returned, 0);
+	BOOST_CHECK_EQUAL(stats[0].chunks, 1);
+}
+
+BOOST_AUTO_TEST_CASE(threadlocalpool_cross_thread_free_test)
+{
+	TqTestPool pool("test");
+	// Allocate enough to span several chunks in another thread, then free
+	// them all from this one.
+	std::vector<void*> elements;
+	boost::thread allocThread(boost::bind(&allocMany, boost::ref(pool),
+				boost::ref(elements), 1000));
+	allocThread.join();
+	freeAll(pool, elements);
+
+	// The next thread to start up takes over the heap of the exited thread,
+	// and gets the freed elements back rather than allocating new chunks.
+	std::vector<void*> elements2;
+	boost::thread allocThread2(boost::bind(&allocMany, boost::ref(pool),
+				boost::ref(elements2), 1000));
+	allocThread2.join();
+
+	std::vector<CqThreadLocalPoolBase::SqHeapStats> stats;
+	pool.heapStats(stats);
+	BOOST_REQUIRE_EQUAL(stats.size(), 1U);
+	BOOST_CHECK_EQUAL(stats[0].allocated, 2000);
+	BOOST_CHECK_EQUAL(stats[0].freed, 0);
+	BOOST_CHECK_EQUAL(stats[0].returned, 1000);
+	TqInt chunks = stats[0].chunks;
+	BOOST_CHECK(chunks > 1);
+
+	// Likewise for this thread.
+	freeAll(pool, elements2);
+	std::vector<void*> elements3;
+	allocMany(pool, elements3, 1000);
+	pool.heapStats(stats);
+	BOOST_REQUIRE_EQUAL(stats.size(), 1U);
+	BOOST_CHECK_EQUAL(stats[0].chunks, chunks);
+	freeAll(pool, elements3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -196,6 +196,14 @@ void CqTransform::SetCurrentTransform( TqFloat time, const CqMatrix& matTrans )
 
 
 
+void CqTransform::SetKeyTransform( TqFloat time, const SqTransformation& trans )
+{
+	AddTimeSlot( time, trans );
+	m_IsMoving = true;
+}
+
+
+
 void CqTransform::SetTransform( TqFloat time, const CqMatrix& matTrans )
 {
 	TqFloat det = matTrans.Determinant();
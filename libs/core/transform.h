@@ -93,6 +93,12 @@ class CqTransform : public CqMotionSpec<SqTransformation>, public IqTransform, p
 		// virtual	CqTransform& operator=( const CqTransform& From );
 
 		void	SetCurrentTransform( TqFloat time, const CqMatrix& matTrans );
+		/** Set the transformation at a key time.
+		 *
+		 * Unlike SetCurrentTransform(), this always adds a key, so may be
+		 * used to build a moving transformation outside a motion block.
+		 */
+		void	SetKeyTransform( TqFloat time, const SqTransformation& trans );
 		void	ResetTransform(const CqMatrix& mat, bool hand, bool makeStatic=true);
 
 		virtual	const CqMatrix&	matObjectToWorld( TqFloat time ) const;
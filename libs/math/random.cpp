@@ -19,165 +19,70 @@
 
 
 /** \file
-		\brief Declares the CqRandom class responsible for producing random numbers.
+		\brief Implements the CqRandom class responsible for producing random numbers.
 		\author Andrew Bromage (ajb@spamcop.net)
 */
 
-// This implementation is based on the MT19937 (Mersenne Twister)
-// generator by Takuji Nishimura and Makoto Matsumoto.  The original
-// copyright notice follows.
-
-//? Is random.h included already?
-
 #include	<aqsis/aqsis.h>
 
-#include	<stdlib.h>
-#include	<stdio.h>
-
 #include	<aqsis/math/random.h>
 #include	<aqsis/math/math.h>
 
 namespace Aqsis {
 
-// This implementation is based on the MT19937 (Mersenne Twister)
-// generator by Takuji Nishimura and Makoto Matsumoto.  The original
-// copyright notice follows.
-
-/*
-   A C-program for MT19937, with initialization improved 2002/2/10.
-   Coded by Takuji Nishimura and Makoto Matsumoto.
-   This is a faster version by taking Shawn Cokus's optimization,
-   Matthe Bellew's simplification, Isaku Wada's real version.
- 
-   [...]
- 
-   Copyright (C) 1997 - 2002, Makoto Matsumoto and Takuji Nishimura,
-   All rights reserved.                          
- 
-   Redistribution and use in source and binary forms, with or without
-   modification, are permitted provided that the following conditions
-   are met:
- 
-     1. Redistributions of source code must retain the above copyright
-        notice, this list of conditions and the following disclaimer.
- 
-     2. Redistributions in binary form must reproduce the above copyright
-        notice, this list of conditions and the following disclaimer in the
-        documentation and/or other materials provided with the distribution.
- 
-     3. The names of its contributors may not be used to endorse or promote 
-        products derived from this software without specific prior written 
-        permission.
- 
-   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
-   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
-   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
-   A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
-   CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
-   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
-   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
-   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
-   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
-   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
-   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- 
- 
-   Any feedback is very welcome.
-   http://www.math.keio.ac.jp/matumoto/emt.html
-   email: matumoto@math.keio.ac.jp
-*/
-
-/* Period parameters */
-#define N 624
-#define M 397
-#define MATRIX_A 0x9908b0dfUL   /* constant vector a */
-#define UPPER_MASK 0x80000000UL /* most significant w-r bits */
-#define LOWER_MASK 0x7fffffffUL /* least significant r bits */
+namespace {
 
-/// \todo <b>Code Review</b> Random number state shouldn't be stored in static storage - "independent" random number classes are not really independent in this case!  This will cause problems with reproducible sample patterns and big problems with future multithreading.
-static TqUlong mt[N];   /* the array for the state vector  */
-static TqInt   mti=N+1; /* mti==N+1 means mt[N] is not initialized */
+/// Multiplier of the underlying 64 bit linear congruential generator.
+const boost::uint64_t pcgMultiplier = 6364136223846793005ULL;
+/// Seed used by the default constructor.
+const TqUint defaultSeed = 5489;
 
-/* initializes mt[N] with a seed */
-static void init_genrand(TqUlong s)
+/// Advance the state and return the output for the old state (XSH RR).
+inline TqUint pcgNext( boost::uint64_t& state, boost::uint64_t increment )
 {
-	mt[0]= s & 0xffffffffUL;
-	for (mti=1; mti<N; mti++)
-	{
-		mt[mti] =
-		    (1812433253UL * (mt[mti-1] ^ (mt[mti-1] >> 30)) + mti);
-		/* See Knuth TAOCP Vol2. 3rd Ed. P.106 for multiplier. */
-		/* In the previous versions, MSBs of the seed affect   */
-		/* only MSBs of the array mt[].                        */
-		/* 2002/01/09 modified by Makoto Matsumoto             */
-		mt[mti] &= 0xffffffffUL;
-		/* for >32 bit machines */
-	}
+	boost::uint64_t old = state;
+	state = old * pcgMultiplier + increment;
+	boost::uint32_t xorShifted = static_cast<boost::uint32_t>( ( ( old >> 18 ) ^ old ) >> 27 );
+	boost::uint32_t rot = static_cast<boost::uint32_t>( old >> 59 );
+	return ( xorShifted >> rot ) | ( xorShifted << ( ( 32 - rot ) & 31 ) );
 }
 
-/* generates a random number on [0,0xffffffff]-interval */
-static TqUlong genrand_int32(void)
+/// Convert a random integer to a float in [0,1).
+inline TqFloat toUnitFloat( TqUint i )
 {
-	TqUlong  y;
-	static TqUlong  mag01[2]={0x0UL, MATRIX_A};
-	/* mag01[x] = x * MATRIX_A  for x=0,1 */
-
-	if (mti >= N)
-	{ /* generate N words at one time */
-		TqInt kk;
-
-		if (mti == N+1)   /* if init_genrand() has not been called, */
-			init_genrand(5489UL); /* a default initial seed is used */
-
-		for (kk=0;kk<N-M;kk++)
-		{
-			y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
-			mt[kk] = mt[kk+M] ^ (y >> 1) ^ mag01[y & 0x1UL];
-		}
-		for (;kk<N-1;kk++)
-		{
-			y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
-			mt[kk] = mt[kk+(M-N)] ^ (y >> 1) ^ mag01[y & 0x1UL];
-		}
-		y = (mt[N-1]&UPPER_MASK)|(mt[0]&LOWER_MASK);
-		mt[N-1] = mt[M-1] ^ (y >> 1) ^ mag01[y & 0x1UL];
-
-		mti = 0;
-	}
-
-	y = mt[mti++];
-
-	/* Tempering */
-	y ^= (y >> 11);
-	y ^= (y << 7) & 0x9d2c5680UL;
-	y ^= (y << 15) & 0xefc60000UL;
-	y ^= (y >> 18);
-
-	return y;
+	// Divide by 2^32 + 128.  We've got to be quite careful here, because a
+	// float doesn't encompass the entire precision of the uint32 used as the
+	// source of the randomness.  This means that if we just divide by 2^32
+	// in double precision and truncate to a float then sometimes the float
+	// will get rounded up to 1.
+	//
+	// Instead we've got to add the extra 128 to the denominator to ensure that
+	// it always gets correctly rounded down when using the default IEEE
+	// rounding mode.
+	return i*(1.0/4294967424.0);
 }
 
-/* generates a random number on [0,1)-real-interval */
-//static TqDouble genrand_real2(void)
-//{
-//	return genrand_int32()*(1.0/4294967296.0);
-//	/* divided by 2^32 */
-//}
+} // unnamed namespace
 
-//----------------------------------------------------------------------
 /** \class CqRandom
  * A random number generator class.
  */
 
 CqRandom::CqRandom()
-{}
-CqRandom::CqRandom( TqUint Seed )
-{}
+{
+	Reseed( defaultSeed );
+}
+
+CqRandom::CqRandom( TqUint seed, TqUint stream )
+{
+	Reseed( seed, stream );
+}
 
 /** Get a random integer in the range (0 <= value < 2^32).
  */
 TqUint CqRandom::RandomInt()
 {
-	return genrand_int32();
+	return pcgNext( m_state, m_increment );
 }
 
 /** Get a random integer in the specified range (0 <= value < Range).
@@ -193,16 +98,7 @@ TqUint CqRandom::RandomInt( TqUint Range )
  */
 TqFloat	CqRandom::RandomFloat()
 {
-	// Divide by 2^32 + 128.  We've got to be quite careful here, because a
-	// float doesn't encompass the entire precision of the uint32 used as the
-	// source of the randomness.  This means that if we just divide by 2^32
-	// in double precision and truncate to a float then sometimes the float
-	// will get rounded up to 1.
-	//
-	// Instead we've got to add the extra 128 to the denominator to ensure that
-	// it always gets correctly rounded down when using the default IEEE
-	// rounding mode.
-	return genrand_int32()*(1.0/4294967424.0);
+	return toUnitFloat( pcgNext( m_state, m_increment ) );
 }
 
 /** Get a random float in the specified range (0 <= value < Range).
@@ -213,23 +109,33 @@ TqFloat	CqRandom::RandomFloat( TqFloat Range )
 	return Range*RandomFloat();
 }
 
-/** Set the random internal to known value; eg. at each framebegin we might
- * want to set up the internal of random to a know value so regardless the 
- * which frame the user renders it will be able to recreate it; 
- * \param Seek The known seed number 
+/** Fill an array with random floats, keeping the state in registers for the
+ * whole loop.
  */
-void    CqRandom::Reseed(TqUint Seek)
+void	CqRandom::RandomFloats( TqFloat* values, TqInt count )
 {
-	init_genrand((TqUlong) Seek);
+	boost::uint64_t state = m_state;
+	for ( TqInt i = 0; i < count; ++i )
+		values[i] = toUnitFloat( pcgNext( state, m_increment ) );
+	m_state = state;
 }
 
-/** Obsolete method
+/** Set the generator to a known state; eg. at each framebegin we might want
+ * to set up the generator to a known value so regardless which frame the
+ * user renders it will be able to recreate it.
+ * \param seed The known seed number
+ * \param stream The stream to use
  */
-void    CqRandom::NextState()
-{}
+void	CqRandom::Reseed( TqUint seed, TqUint stream )
+{
+	m_state = 0;
+	m_increment = ( static_cast<boost::uint64_t>( stream ) << 1 ) | 1;
+	pcgNext( m_state, m_increment );
+	m_state += seed;
+	pcgNext( m_state, m_increment );
+}
 
 
 //-----------------------------------------------------------------------
 
 } // namespace Aqsis
-
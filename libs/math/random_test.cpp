@@ -0,0 +1,97 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for CqRandom
+ */
+
+#include <aqsis/math/random.h>
+
+#include <vector>
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/auto_unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(random_tests)
+
+BOOST_AUTO_TEST_CASE(CqRandom_sequence_test)
+{
+	// Generators with the same seed and stream give the same sequence,
+	// independently of any other generator.
+	Aqsis::CqRandom a(42, 3);
+	Aqsis::CqRandom other(42, 3);
+	other.RandomInt();
+	Aqsis::CqRandom b(42, 3);
+	for(TqInt i = 0; i < 100; ++i)
+		BOOST_CHECK_EQUAL(a.RandomInt(), b.RandomInt());
+
+	// Reseeding restarts the sequence.
+	TqUint first = Aqsis::CqRandom(42, 3).RandomInt();
+	a.Reseed(42, 3);
+	BOOST_CHECK_EQUAL(a.RandomInt(), first);
+}
+
+BOOST_AUTO_TEST_CASE(CqRandom_stream_test)
+{
+	// Different streams or seeds give different sequences.
+	Aqsis::CqRandom a(42, 0);
+	Aqsis::CqRandom b(42, 1);
+	Aqsis::CqRandom c(43, 0);
+	TqInt sameB = 0;
+	TqInt sameC = 0;
+	for(TqInt i = 0; i < 100; ++i)
+	{
+		TqUint r = a.RandomInt();
+		sameB += r == b.RandomInt();
+		sameC += r == c.RandomInt();
+	}
+	BOOST_CHECK(sameB < 2);
+	BOOST_CHECK(sameC < 2);
+}
+
+BOOST_AUTO_TEST_CASE(CqRandom_range_test)
+{
+	Aqsis::CqRandom r;
+	TqFloat sum = 0;
+	const TqInt n = 10000;
+	for(TqInt i = 0; i < n; ++i)
+	{
+		TqFloat f = r.RandomFloat();
+		BOOST_REQUIRE(f >= 0 && f < 1);
+		sum += f;
+		BOOST_REQUIRE(r.RandomInt(7) < 7);
+	}
+	BOOST_CHECK(sum/n > 0.48f && sum/n < 0.52f);
+}
+
+BOOST_AUTO_TEST_CASE(CqRandom_batch_test)
+{
+	// RandomFloats() gives the same values as repeated RandomFloat().
+	Aqsis::CqRandom a(7, 11);
+	Aqsis::CqRandom b(7, 11);
+	std::vector<TqFloat> values(37);
+	a.RandomFloats(&values[0], values.size());
+	for(TqInt i = 0, n = values.size(); i < n; ++i)
+		BOOST_CHECK_EQUAL(values[i], b.RandomFloat());
+	BOOST_CHECK_EQUAL(a.RandomInt(), b.RandomInt());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,81 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Renderer services fixtures shared by the archive cache unit tests.
+ */
+
+#ifndef ARCHIVECACHE_TEST_H_INCLUDED
+#define ARCHIVECACHE_TEST_H_INCLUDED
+
+#include <istream>
+#include <string>
+
+#include <boost/scoped_ptr.hpp>
+
+#include <aqsis/riutil/ribparser.h>
+#include <aqsis/riutil/ricxx.h>
+#include <aqsis/riutil/ricxxutil.h>
+#include <aqsis/riutil/tokendictionary.h>
+
+#include "archiveparseservices.h"
+
+// Renderer services with a plain token dictionary and no filter chain.
+class TestServices : public Aqsis::StubRendererServices
+{
+    public:
+        Aqsis::TokenDict tokenDict;
+
+        int errorCount() const { return m_errorHandler.errorCount(); }
+
+        virtual Aqsis::Ri::ErrorHandler& errorHandler() { return m_errorHandler; }
+        virtual Aqsis::Ri::TypeSpec getDeclaration(RtConstToken token,
+                                const char** nameBegin = 0,
+                                const char** nameEnd = 0) const
+        {
+            return tokenDict.lookup(token, nameBegin, nameEnd);
+        }
+        virtual Aqsis::Ri::Renderer& firstFilter() { return m_firstFilter; }
+        virtual void parseRib(std::istream& ribStream, const char* name,
+                              Aqsis::Ri::Renderer& context)
+        {
+            boost::scoped_ptr<Aqsis::RibParser> parser(
+                    Aqsis::RibParser::create(*this));
+            parser->parseStream(ribStream, name, context);
+        }
+        using Aqsis::StubRendererServices::parseRib;
+    private:
+        Aqsis::CountingErrorHandler m_errorHandler;
+        Aqsis::StubRenderer m_firstFilter;
+};
+
+#endif // ARCHIVECACHE_TEST_H_INCLUDED
+// vi: set et:
@@ -0,0 +1,183 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/// \file
+/// \brief Renderer services for parsing RIB archives out of request order.
+
+#ifndef AQSIS_ARCHIVEPARSESERVICES_H_INCLUDED
+#define AQSIS_ARCHIVEPARSESERVICES_H_INCLUDED
+
+#include <aqsis/config.h>
+
+#include <boost/scoped_ptr.hpp>
+
+#include <aqsis/riutil/errorhandler.h>
+#include <aqsis/riutil/ribparser.h>
+#include <aqsis/riutil/ricxx_filter.h>
+#include <aqsis/riutil/tokendictionary.h>
+#include <aqsis/util/exception.h>
+
+namespace Aqsis {
+
+//------------------------------------------------------------------------------
+/// Error handler for parses which happen out of the usual request order.
+///
+/// Archives parsed ahead of time or on worker threads can't report errors
+/// through the main error handler without scrambling the order of messages,
+/// so we just remember that something went wrong.  The archive is then parsed
+/// again in the usual way to report the errors.
+class CountingErrorHandler : public Ri::ErrorHandler
+{
+    public:
+        CountingErrorHandler()
+            : ErrorHandler(Warning),
+            m_errorCount(0)
+        { }
+
+        int errorCount() const { return m_errorCount; }
+
+    protected:
+        virtual void dispatch(int code, const std::string& message)
+        {
+            if(errorCategory(code) >= Error)
+                ++m_errorCount;
+        }
+
+    private:
+        int m_errorCount;
+};
+
+
+//------------------------------------------------------------------------------
+/// Renderer services for a single out-of-order archive parse.
+///
+/// Standard function lookups are forwarded to the main services object, while
+/// token declarations are looked up in a private dictionary so that inline
+/// Declare requests in the archive are honoured without touching the main
+/// dictionary.
+class ArchiveParseServices : public Ri::RendererServices
+{
+    public:
+        ArchiveParseServices(Ri::RendererServices& services,
+                         const TokenDict& declarations)
+            : m_services(services),
+            m_tokenDict(declarations),
+            m_errorHandler()
+        { }
+
+        TokenDict& tokenDict() { return m_tokenDict; }
+        int errorCount() const { return m_errorHandler.errorCount(); }
+
+        virtual Ri::ErrorHandler& errorHandler()
+        {
+            return m_errorHandler;
+        }
+        virtual RtFilterFunc getFilterFunc(RtConstToken name) const
+        {
+            return m_services.getFilterFunc(name);
+        }
+        virtual RtConstBasis* getBasis(RtConstToken name) const
+        {
+            return m_services.getBasis(name);
+        }
+        virtual RtErrorFunc getErrorFunc(RtConstToken name) const
+        {
+            return m_services.getErrorFunc(name);
+        }
+        virtual RtProcSubdivFunc getProcSubdivFunc(RtConstToken name) const
+        {
+            return m_services.getProcSubdivFunc(name);
+        }
+        virtual Ri::TypeSpec getDeclaration(RtConstToken token,
+                                            const char** nameBegin = 0,
+                                            const char** nameEnd = 0) const
+        {
+            return m_tokenDict.lookup(token, nameBegin, nameEnd);
+        }
+
+        // Archive parses only ever send requests to a recorder, so the filter
+        // chain isn't available.
+        virtual Ri::Renderer& firstFilter()
+        {
+            AQSIS_THROW_XQERROR(XqInternal, EqE_Bug,
+                "filter chain not available during archive parsing");
+        }
+        virtual void addFilter(const char* name,
+                               const Ri::ParamList& filterParams = Ri::ParamList())
+        {
+            AQSIS_THROW_XQERROR(XqInternal, EqE_Bug,
+                "filter chain not available during archive parsing");
+        }
+        virtual void addFilter(Ri::Filter& filter)
+        {
+            AQSIS_THROW_XQERROR(XqInternal, EqE_Bug,
+                "filter chain not available during archive parsing");
+        }
+        virtual void parseRib(std::istream& ribStream, const char* name,
+                              Ri::Renderer& context)
+        {
+            boost::scoped_ptr<RibParser> parser(RibParser::create(*this));
+            parser->parseStream(ribStream, name, context);
+        }
+
+    private:
+        Ri::RendererServices& m_services;
+        TokenDict m_tokenDict;
+        CountingErrorHandler m_errorHandler;
+};
+
+
+//------------------------------------------------------------------------------
+/// Filter which adds Declare()'d tokens to a dictionary.
+///
+/// Parsers look up parameter types in the dictionary of their renderer
+/// services, so inline Declare requests need to be recorded there when the
+/// requests aren't going to the main renderer.
+class DeclaringFilter : public PassthroughFilter
+{
+    public:
+        DeclaringFilter(TokenDict& tokenDict)
+            : m_tokenDict(tokenDict)
+        { }
+
+        virtual RtVoid Declare(RtConstString name, RtConstString declaration)
+        {
+            m_tokenDict.declare(name, declaration);
+            nextFilter().Declare(name, declaration);
+        }
+
+    private:
+        TokenDict& m_tokenDict;
+};
+
+} // namespace Aqsis
+
+#endif // AQSIS_ARCHIVEPARSESERVICES_H_INCLUDED
+// vi: set et:
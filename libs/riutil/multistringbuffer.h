@@ -84,6 +84,14 @@ class MultiStringBuffer
             m_offsets.clear();
         }
 
+        /// Number of bytes of heap memory used by the buffer
+        size_t heapSize() const
+        {
+            return m_storage.capacity()
+                + m_offsets.capacity()*sizeof(size_t)
+                + m_cStrings.capacity()*sizeof(const char*);
+        }
+
         /// Convert to an vector of C-strings
         const std::vector<const char*>& toCstringVec() const
         {
@@ -35,7 +35,6 @@
 #include <aqsis/riutil/ricxx_filter.h>
 #include <aqsis/riutil/ricxxutil.h>
 
-#include <vector>
 #include <stack>
 
 #include <aqsis/util/exception.h>
@@ -53,11 +52,12 @@ class RenderUtilFilter : public Ri::Filter
 {
     private:
         // Caching stuff
-        std::vector<CachedRiStream*> m_archives;
-        std::vector<CachedRiStream*> m_objectInstances;
+        CachedStreamTable m_archives;
+        CachedStreamTable m_objectInstances;
         CachedRiStream* m_currCache;
         int m_nested;
         bool m_inObject;
+        bool m_cacheObjects;
         // Conditional testing stuff
         IfElseTestCallback m_ifElseTest;
         std::stack<bool> m_ifInactiveStack;
@@ -65,60 +65,32 @@ class RenderUtilFilter : public Ri::Filter
         bool m_ifInactive;
 #       define IF_ELSE_TEST if(m_ifInactive) return;
 
-        // Find a cached stream in a given cache.
-        //
-        // Return -1 if not found.
-        static int findCachedStream(std::vector<CachedRiStream*>& cache, const char* name)
+        // Report streams which use a lot of memory once they're complete.
+        void reportMemoryUsage(const char* type, const CachedRiStream& stream)
         {
-            for(int i = 0, iend = cache.size(); i < iend; ++i)
-                if(cache[i]->name() == name)
-                    return i;
-            return -1;
-        }
-
-        // Create a new cache stream, insert into given cache and return it.
-        //
-        // If a stream with the same name already exists, the new stream
-        // replaces the old one.
-        static CachedRiStream* newCachedStream(std::vector<CachedRiStream*>& cache,
-                                   const char* name)
-        {
-            // First search to make sure we haven't already defined a stream
-            // with the same name.  If so, the new stream replaces the old one.
-            int index = findCachedStream(cache, name);
-            if(index >= 0)
-            {
-                delete cache[index];
-                cache[index] = new CachedRiStream(name);
-                return cache[index];
-            }
-            else
-            {
-                cache.push_back(new CachedRiStream(name));
-                return cache.back();
-            }
+            const size_t reportThreshold = 64*1024*1024;
+            size_t size = stream.memoryUsage();
+            if(size >= reportThreshold)
+                services().errorHandler().info(EqE_NoError,
+                    "%s \"%s\" uses %d MB of memory", type, stream.name(),
+                    static_cast<int>(size/(1024*1024)));
         }
 
     public:
-        RenderUtilFilter(const IfElseTestCallback& conditionTest)
+        RenderUtilFilter(const IfElseTestCallback& conditionTest,
+                         bool cacheObjects)
             : m_archives(),
             m_objectInstances(),
             m_currCache(0),
             m_nested(0),
             m_inObject(false),
+            m_cacheObjects(cacheObjects),
             m_ifElseTest(conditionTest),
             m_ifInactiveStack(),
             m_trueClauseFound(false),
             m_ifInactive(false)
         { }
 
-        ~RenderUtilFilter()
-        {
-            for(size_t i = 0; i < m_archives.size(); ++i)
-                delete m_archives[i];
-            for(size_t i = 0; i < m_objectInstances.size(); ++i)
-                delete m_objectInstances[i];
-        }
 
         //--------------------------------------------------
         // Inline archive handling
@@ -131,7 +103,7 @@ class RenderUtilFilter : public Ri::Filter
                 m_currCache->push_back(new RiCache::ArchiveBegin(name, pList));
             }
             else
-                m_currCache = newCachedStream(m_archives, name);
+                m_currCache = &m_archives.define(name);
         }
 
         virtual RtVoid ArchiveEnd()
@@ -142,8 +114,11 @@ class RenderUtilFilter : public Ri::Filter
                 m_currCache->push_back(new RiCache::ArchiveEnd());
                 --m_nested;
             }
-            else
+            else if(m_currCache)
+            {
+                reportMemoryUsage("Archive", *m_currCache);
                 m_currCache = 0;
+            }
         }
 
         virtual RtVoid ReadArchive(RtConstToken name, RtArchiveCallback callback,
@@ -156,9 +131,8 @@ class RenderUtilFilter : public Ri::Filter
                 return;
             }
             // Search for the archive name in the cached archives.
-            int index = findCachedStream(m_archives, name);
-            if(index >= 0)
-                m_archives[index]->replay(services().firstFilter());
+            if(const CachedRiStream* archive = m_archives.find(name))
+                archive->replay(services().firstFilter());
             else
             {
                 // If not found in our archive list it's probably on-disk, so
@@ -178,10 +152,15 @@ class RenderUtilFilter : public Ri::Filter
                 // call, don't instantiate it.
                 m_currCache->push_back(new RiCache::ObjectBegin(name));
             }
+            else if(!m_cacheObjects)
+            {
+                // The renderer does its own instancing.
+                nextFilter().ObjectBegin(name);
+            }
             else
             {
                 // If not currently in an archive, instantiate the object.
-                m_currCache = newCachedStream(m_objectInstances, name);
+                m_currCache = &m_objectInstances.define(name);
                 m_inObject = true;
             }
         }
@@ -199,9 +178,12 @@ class RenderUtilFilter : public Ri::Filter
             {
                 // Else if we're currently making an object instance, terminate
                 // it.
+                reportMemoryUsage("Object", *m_currCache);
                 m_inObject = false;
                 m_currCache = 0;
             }
+            else if(!m_cacheObjects)
+                nextFilter().ObjectEnd();
             // Else it's a scoping error; just ignore the ObjectEnd.
         }
 
@@ -213,10 +195,14 @@ class RenderUtilFilter : public Ri::Filter
                 m_currCache->push_back(new RiCache::ObjectInstance(name));
                 return;
             }
+            if(!m_cacheObjects)
+            {
+                nextFilter().ObjectInstance(name);
+                return;
+            }
             // Search for the object instance name
-            int index = findCachedStream(m_objectInstances, name);
-            if(index >= 0)
-                m_objectInstances[index]->replay(services().firstFilter());
+            if(const CachedRiStream* object = m_objectInstances.find(name))
+                object->replay(services().firstFilter());
             else
             {
                 // If we didn't find it, error
@@ -1302,9 +1288,10 @@ class RenderUtilFilter : public Ri::Filter
 };
 
 
-Ri::Filter* createRenderUtilFilter(const IfElseTestCallback& callback)
+Ri::Filter* createRenderUtilFilter(const IfElseTestCallback& callback,
+                                   bool cacheObjects)
 {
-    return new RenderUtilFilter(callback);
+    return new RenderUtilFilter(callback, cacheObjects);
 }
 
 } // namespace Aqsis
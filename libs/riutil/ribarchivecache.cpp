@@ -0,0 +1,276 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/// \file Parsing of RIB archives ahead of time on worker threads.
+
+#include <aqsis/riutil/ribarchivecache.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <aqsis/riutil/ribdiskcache.h>
+#include <aqsis/riutil/tokendictionary.h>
+#include "archiveparseservices.h"
+#include "ricxx_cache.h"
+
+namespace Aqsis {
+
+namespace {
+
+//------------------------------------------------------------------------------
+/// Recorder which also declares tokens, since later requests in the archive
+/// need to see the declarations while they are being parsed.
+class StreamRecorder : public CachedRiStreamRecorder
+{
+    public:
+        StreamRecorder(CachedRiStream& stream, TokenDict& tokenDict)
+            : CachedRiStreamRecorder(stream),
+            m_tokenDict(tokenDict)
+        { }
+
+        virtual RtVoid Declare(RtConstString name, RtConstString declaration)
+        {
+            m_tokenDict.declare(name, declaration);
+            CachedRiStreamRecorder::Declare(name, declaration);
+        }
+
+    private:
+        TokenDict& m_tokenDict;
+};
+
+
+//------------------------------------------------------------------------------
+/// Implementation of the archive cache with a simple pool of worker threads.
+class RibArchiveCacheImpl : public RibArchiveCache
+{
+    public:
+        RibArchiveCacheImpl(Ri::RendererServices& services, int numThreads,
+                            RibDiskCache* diskCache)
+            : m_services(services),
+            m_diskCache(diskCache),
+            m_entries(),
+            m_queue(),
+            m_stats(),
+            m_quit(false)
+        {
+            for(int i = 0; i < numThreads; ++i)
+                m_workers.create_thread(boost::bind(&RibArchiveCacheImpl::work, this));
+        }
+
+        ~RibArchiveCacheImpl()
+        {
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                m_quit = true;
+                m_queue.clear();
+            }
+            m_workAvailable.notify_all();
+            m_workers.join_all();
+        }
+
+        virtual void prefetch(const std::string& path,
+                              const TokenDict& declarations)
+        {
+            if(m_workers.size() == 0)
+                return;
+            boost::mutex::scoped_lock lock(m_mutex);
+            if(m_entries.find(path) != m_entries.end())
+                return;
+            EntryPtr entry(new Entry(path, declarations));
+            m_entries[path] = entry;
+            m_queue.push_back(entry);
+            ++m_stats.prefetched;
+            m_workAvailable.notify_one();
+        }
+
+        virtual bool replay(const std::string& path, Ri::Renderer& context)
+        {
+            EntryPtr entry;
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                EntryMap::iterator i = m_entries.find(path);
+                if(i == m_entries.end())
+                {
+                    ++m_stats.misses;
+                    return false;
+                }
+                entry = i->second;
+                if(entry->state == Entry::Queued)
+                {
+                    // Nobody has started on the archive yet; it's cheaper for
+                    // the caller to parse it directly than to wait.
+                    m_queue.erase(std::find(m_queue.begin(), m_queue.end(), entry));
+                    m_entries.erase(i);
+                    ++m_stats.misses;
+                    return false;
+                }
+                if(entry->state == Entry::Parsing)
+                {
+                    ++m_stats.waits;
+                    while(entry->state == Entry::Parsing)
+                        m_parseFinished.wait(lock);
+                }
+                if(entry->state == Entry::Failed)
+                {
+                    ++m_stats.misses;
+                    return false;
+                }
+                ++m_stats.hits;
+            }
+            // Completed entries are never modified, so replay without the lock.
+            entry->stream->replay(context);
+            return true;
+        }
+
+        virtual void flush()
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            // Entries which are currently being parsed are kept alive by the
+            // worker holding a reference; we just forget about them here.
+            m_queue.clear();
+            m_entries.clear();
+        }
+
+        virtual Stats stats() const
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            return m_stats;
+        }
+
+    private:
+        struct Entry
+        {
+            enum State { Queued, Parsing, Done, Failed };
+
+            std::string path;
+            boost::scoped_ptr<TokenDict> declarations;
+            boost::scoped_ptr<CachedRiStream> stream;
+            State state;
+
+            Entry(const std::string& path, const TokenDict& declarations)
+                : path(path),
+                declarations(new TokenDict(declarations)),
+                stream(new CachedRiStream(path.c_str())),
+                state(Queued)
+            { }
+        };
+        typedef boost::shared_ptr<Entry> EntryPtr;
+        typedef std::map<std::string, EntryPtr> EntryMap;
+
+        /// Worker thread main loop.
+        void work()
+        {
+            while(true)
+            {
+                EntryPtr entry;
+                {
+                    boost::mutex::scoped_lock lock(m_mutex);
+                    while(m_queue.empty() && !m_quit)
+                        m_workAvailable.wait(lock);
+                    if(m_quit)
+                        return;
+                    entry = m_queue.front();
+                    m_queue.pop_front();
+                    entry->state = Entry::Parsing;
+                }
+                bool success = parse(*entry);
+                {
+                    boost::mutex::scoped_lock lock(m_mutex);
+                    entry->state = success ? Entry::Done : Entry::Failed;
+                    // The declarations were only needed during parsing.
+                    entry->declarations.reset();
+                    if(!success)
+                        entry->stream.reset();
+                }
+                m_parseFinished.notify_all();
+            }
+        }
+
+        /// Parse the archive for the given entry into its request stream.
+        bool parse(Entry& entry)
+        {
+            try
+            {
+                ArchiveParseServices services(m_services, *entry.declarations);
+                StreamRecorder recorder(*entry.stream, services.tokenDict());
+                if(m_diskCache && m_diskCache->parse(entry.path, services,
+                                                     recorder))
+                    return services.errorCount() == 0;
+                boost::filesystem::ifstream archiveFile(entry.path,
+                                                        std::ios::binary);
+                if(!archiveFile)
+                    return false;
+                services.parseRib(archiveFile, entry.path.c_str(), recorder);
+                return services.errorCount() == 0;
+            }
+            catch(std::exception& /*e*/)
+            {
+                return false;
+            }
+        }
+
+        Ri::RendererServices& m_services;
+        /// Persistent cache used when parsing archives.  May be NULL.
+        RibDiskCache* m_diskCache;
+        /// Archives which have been prefetched, keyed by path.
+        EntryMap m_entries;
+        /// Entries waiting for a worker thread.
+        std::deque<EntryPtr> m_queue;
+        Stats m_stats;
+        bool m_quit;
+
+        mutable boost::mutex m_mutex;
+        boost::condition m_workAvailable;
+        boost::condition m_parseFinished;
+        boost::thread_group m_workers;
+};
+
+} // anon. namespace
+
+
+//------------------------------------------------------------------------------
+RibArchiveCache* RibArchiveCache::create(Ri::RendererServices& services,
+                                         int numThreads,
+                                         RibDiskCache* diskCache)
+{
+    return new RibArchiveCacheImpl(services, numThreads, diskCache);
+}
+
+} // namespace Aqsis
+// vi: set et:
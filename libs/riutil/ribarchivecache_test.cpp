@@ -0,0 +1,156 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ * \brief Unit tests for the RIB archive cache.
+ */
+
+#include <aqsis/riutil/ribarchivecache.h>
+
+#define BOOST_TEST_DYN_LINK
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/test/auto_unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <aqsis/riutil/ricxxutil.h>
+
+#include "archivecache_test.h"
+
+using namespace Aqsis;
+
+namespace {
+
+// Renderer recording the spheres it sees, along with a float parameter.
+class SphereRecorder : public StubRenderer
+{
+    public:
+        std::vector<float> radii;
+        std::vector<float> params;
+
+        virtual RtVoid Sphere(RtFloat radius, RtFloat zmin, RtFloat zmax,
+                              RtFloat thetamax, const ParamList& pList)
+        {
+            radii.push_back(radius);
+            if(pList.size() > 0 && pList[0].spec().storageType() == Ri::TypeSpec::Float)
+                params.push_back(pList[0].floatData()[0]);
+        }
+};
+
+// Temporary archive file, removed on destruction.
+struct TempArchive
+{
+    std::string path;
+    TempArchive(const std::string& name, const std::string& contents)
+        : path(name)
+    {
+        std::ofstream out(path.c_str());
+        out << contents;
+    }
+    ~TempArchive()
+    {
+        boost::filesystem::remove(path);
+    }
+};
+
+// Replay an archive, re-queueing it until a worker gets to it first.
+//
+// Queued archives are handed back to the caller on replay, so a single
+// prefetch + replay isn't guaranteed to hit the cache.
+void replayWhenParsed(RibArchiveCache& cache, const std::string& path,
+                      const TokenDict& dict, Ri::Renderer& renderer)
+{
+    cache.prefetch(path, dict);
+    while(!cache.replay(path, renderer))
+    {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+        cache.prefetch(path, dict);
+    }
+}
+
+} // anon. namespace
+
+
+BOOST_AUTO_TEST_SUITE(ribarchivecache_tests)
+
+BOOST_AUTO_TEST_CASE(RibArchiveCache_replay_test)
+{
+    TempArchive archive("aqsis_archivecache_test1.rib",
+        "Declare \"myparam\" \"uniform float\"\n"
+        "Sphere 1 -1 1 360 \"myparam\" [42]\n"
+        "Sphere 2 -2 2 360\n");
+    TestServices services;
+    boost::scoped_ptr<RibArchiveCache> cache(RibArchiveCache::create(services, 2));
+
+    // Replaying twice should produce the same requests both times.
+    for(int i = 0; i < 2; ++i)
+    {
+        SphereRecorder renderer;
+        if(i == 0)
+            replayWhenParsed(*cache, archive.path, services.tokenDict, renderer);
+        else
+            BOOST_CHECK(cache->replay(archive.path, renderer));
+        BOOST_REQUIRE_EQUAL(renderer.radii.size(), 2U);
+        BOOST_CHECK_EQUAL(renderer.radii[0], 1.0f);
+        BOOST_CHECK_EQUAL(renderer.radii[1], 2.0f);
+        BOOST_REQUIRE_EQUAL(renderer.params.size(), 1U);
+        BOOST_CHECK_EQUAL(renderer.params[0], 42.0f);
+    }
+    BOOST_CHECK_GE(cache->stats().hits, 2);
+}
+
+BOOST_AUTO_TEST_CASE(RibArchiveCache_miss_test)
+{
+    TempArchive archive("aqsis_archivecache_test2.rib",
+        "Sphere 1 -1 1 360 \"undeclared_param\" [1]\n");
+    TestServices services;
+    boost::scoped_ptr<RibArchiveCache> cache(RibArchiveCache::create(services, 1));
+    SphereRecorder renderer;
+    // Archives which weren't prefetched aren't replayed.
+    BOOST_CHECK(!cache->replay(archive.path, renderer));
+    // Archives with parse errors must be parsed by the caller for error
+    // reporting.  With a single worker, the broken archive is finished once
+    // a second archive queued behind it has been replayed.
+    TempArchive goodArchive("aqsis_archivecache_test3.rib", "Sphere 1 -1 1 360\n");
+    cache->prefetch(archive.path, services.tokenDict);
+    replayWhenParsed(*cache, goodArchive.path, services.tokenDict, renderer);
+    BOOST_CHECK(!cache->replay(archive.path, renderer));
+    BOOST_CHECK_EQUAL(renderer.radii.size(), 1U);
+    // Cache contents are gone after a flush.
+    cache->flush();
+    BOOST_CHECK(!cache->replay(goodArchive.path, renderer));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,408 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/// \file Persistent on-disk cache of decoded RIB archives.
+
+#include <aqsis/riutil/ribdiskcache.h>
+
+#include <ctime>
+#include <sstream>
+
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <aqsis/riutil/errorhandler.h>
+#include <aqsis/riutil/ribparser.h>
+#include <aqsis/riutil/ribwriter.h>
+#include <aqsis/riutil/ricxx_filter.h>
+#include <aqsis/util/exception.h>
+#include <aqsis/util/file.h>
+
+namespace Aqsis {
+
+namespace {
+
+/// Version of the cache entry format.  Bump this whenever the format changes.
+const int cacheFormatVersion = 1;
+
+const char* filterFuncNames[] = {
+    "box", "gaussian", "triangle", "mitchell", "catmull-rom",
+    "sinc", "bessel", "disk",
+};
+const char* errorFuncNames[] = { "ignore", "print", "abort" };
+const char* subdivFuncNames[] = {
+    "DelayedReadArchive", "RunProgram", "DynamicLoad"
+};
+
+/// Stable 64-bit FNV-1a hash of a string.
+///
+/// We need the same hash from one run to the next, so boost::hash is out.
+boost::uint64_t hashString(const std::string& str)
+{
+    boost::uint64_t hash = 14695981039346656037ULL;
+    for(std::string::size_type i = 0; i < str.size(); ++i)
+    {
+        hash ^= static_cast<unsigned char>(str[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+//------------------------------------------------------------------------------
+/// Error handler which passes messages on, counting the errors.
+class ForwardingErrorHandler : public Ri::ErrorHandler
+{
+    public:
+        ForwardingErrorHandler(Ri::ErrorHandler& target)
+            : ErrorHandler(Debug),
+            m_target(target),
+            m_errorCount(0)
+        { }
+
+        int errorCount() const { return m_errorCount; }
+
+    protected:
+        virtual void dispatch(int code, const std::string& message)
+        {
+            if(errorCategory(code) >= Error)
+                ++m_errorCount;
+            m_target.log(code, "%s", message);
+        }
+
+    private:
+        Ri::ErrorHandler& m_target;
+        int m_errorCount;
+};
+
+
+/// Renderer services used while recording a new cache entry.
+///
+/// Everything is forwarded to the services of the caller, except that errors
+/// are counted on the way through so that we know whether to keep the entry.
+class EntryBuildServices : public Ri::RendererServices
+{
+    public:
+        EntryBuildServices(Ri::RendererServices& services)
+            : m_services(services),
+            m_errorHandler(services.errorHandler())
+        { }
+
+        int errorCount() const { return m_errorHandler.errorCount(); }
+
+        virtual Ri::ErrorHandler& errorHandler()
+        {
+            return m_errorHandler;
+        }
+        virtual RtFilterFunc getFilterFunc(RtConstToken name) const
+        {
+            return m_services.getFilterFunc(name);
+        }
+        virtual RtConstBasis* getBasis(RtConstToken name) const
+        {
+            return m_services.getBasis(name);
+        }
+        virtual RtErrorFunc getErrorFunc(RtConstToken name) const
+        {
+            return m_services.getErrorFunc(name);
+        }
+        virtual RtProcSubdivFunc getProcSubdivFunc(RtConstToken name) const
+        {
+            return m_services.getProcSubdivFunc(name);
+        }
+        virtual Ri::TypeSpec getDeclaration(RtConstToken token,
+                                            const char** nameBegin = 0,
+                                            const char** nameEnd = 0) const
+        {
+            return m_services.getDeclaration(token, nameBegin, nameEnd);
+        }
+        virtual Ri::Renderer& firstFilter()
+        {
+            return m_services.firstFilter();
+        }
+        virtual void addFilter(const char* name,
+                               const Ri::ParamList& filterParams = Ri::ParamList())
+        {
+            m_services.addFilter(name, filterParams);
+        }
+        virtual void addFilter(Ri::Filter& filter)
+        {
+            m_services.addFilter(filter);
+        }
+        virtual void parseRib(std::istream& ribStream, const char* name,
+                              Ri::Renderer& context)
+        {
+            boost::scoped_ptr<RibParser> parser(RibParser::create(*this));
+            parser->parseStream(ribStream, name, context);
+        }
+
+    private:
+        Ri::RendererServices& m_services;
+        ForwardingErrorHandler m_errorHandler;
+};
+
+
+//------------------------------------------------------------------------------
+class RibDiskCacheImpl : public RibDiskCache
+{
+    public:
+        RibDiskCacheImpl(const std::string& cacheDir,
+                         Ri::RendererServices& services)
+            : m_cacheDir(cacheDir),
+            m_services(services),
+            m_stats(),
+            m_tempCount(0)
+        {
+            try
+            {
+                boostfs::create_directories(m_cacheDir);
+            }
+            catch(boostfs::filesystem_error& e)
+            {
+                m_services.errorHandler().warning(EqE_System,
+                    "could not create archive cache directory \"%s\": %s",
+                    cacheDir, e.what());
+            }
+        }
+
+        virtual bool parse(const std::string& path,
+                           Ri::RendererServices& parseServices,
+                           Ri::Renderer& context)
+        {
+            boost::uintmax_t size = 0;
+            std::time_t mtime = 0;
+            try
+            {
+                size = boostfs::file_size(path);
+                mtime = boostfs::last_write_time(path);
+            }
+            catch(boostfs::filesystem_error& /*e*/)
+            {
+                return false;
+            }
+            std::string header = entryHeader(path, mtime, size);
+            boostfs::path entryPath = m_cacheDir / entryName(path);
+            boostfs::ifstream entryFile(entryPath, std::ios::binary);
+            if(!readHeader(entryFile, header))
+            {
+                entryFile.close();
+                if(!build(path, header, entryPath, parseServices, context))
+                    return false;
+                boost::mutex::scoped_lock lock(m_mutex);
+                ++m_stats.misses;
+                return true;
+            }
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                ++m_stats.hits;
+                m_stats.bytesSaved += size;
+            }
+            parseServices.parseRib(entryFile, path.c_str(), context);
+            return true;
+        }
+
+        virtual Stats stats() const
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            return m_stats;
+        }
+
+    private:
+        /// Get the cache entry file name for the archive at the given path.
+        static std::string entryName(const std::string& path)
+        {
+            std::ostringstream name;
+            name << std::hex;
+            name.width(16);
+            name.fill('0');
+            name << hashString(path) << ".rib";
+            return name.str();
+        }
+
+        /// Get the header line identifying the cache entry for an archive.
+        ///
+        /// The header is a RIB comment, so that cache entries are valid RIB
+        /// files in their own right.
+        static std::string entryHeader(const std::string& path,
+                                       std::time_t mtime,
+                                       boost::uintmax_t size)
+        {
+            std::ostringstream header;
+            header << "##AqsisArchiveCache " << cacheFormatVersion << " "
+                << mtime << " " << size << " " << path;
+            return header.str();
+        }
+
+        /// Check that a cache entry is valid for the expected header.
+        ///
+        /// On success, the stream is left positioned at the start of the
+        /// cached requests.
+        static bool readHeader(std::istream& entryFile,
+                               const std::string& expectedHeader)
+        {
+            if(!entryFile)
+                return false;
+            std::string header;
+            std::getline(entryFile, header);
+            return entryFile && header == expectedHeader;
+        }
+
+        /// Register the standard functions with a RIB writer.
+        ///
+        /// The writer needs to map function pointers back to names, and the
+        /// pointers it sees are those supplied by our renderer services.
+        void registerFuncs(RibWriterServices& writer)
+        {
+            for(size_t i = 0; i < sizeof(filterFuncNames)/sizeof(char*); ++i)
+            {
+                if(RtFilterFunc f = m_services.getFilterFunc(filterFuncNames[i]))
+                    writer.registerFilterFunc(filterFuncNames[i], f);
+            }
+            for(size_t i = 0; i < sizeof(errorFuncNames)/sizeof(char*); ++i)
+            {
+                if(RtErrorFunc f = m_services.getErrorFunc(errorFuncNames[i]))
+                    writer.registerErrorFunc(errorFuncNames[i], f);
+            }
+            for(size_t i = 0; i < sizeof(subdivFuncNames)/sizeof(char*); ++i)
+            {
+                if(RtProcSubdivFunc f =
+                        m_services.getProcSubdivFunc(subdivFuncNames[i]))
+                    writer.registerProcSubdivFunc(subdivFuncNames[i], f);
+            }
+        }
+
+        /// Parse an archive into the context, recording a new cache entry.
+        ///
+        /// The requests are written to the entry as they are sent on to the
+        /// context, so the archive is only parsed once.  The entry is only
+        /// kept if there were no parse errors.
+        ///
+        /// \return false if the archive couldn't be parsed, in which case
+        /// nothing was sent to the context.
+        bool build(const std::string& path, const std::string& header,
+                   const boostfs::path& entryPath,
+                   Ri::RendererServices& parseServices,
+                   Ri::Renderer& context)
+        {
+            // Write to a temporary file first so that readers never see a
+            // partially written entry.
+            std::ostringstream tempName;
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                tempName << native(entryPath) << "." << std::time(0) << "-"
+                    << this << "-" << ++m_tempCount << ".tmp";
+            }
+            boostfs::path tempPath = tempName.str();
+            boostfs::ifstream archiveFile(path, std::ios::binary);
+            if(!archiveFile)
+                return false;
+            boostfs::ofstream entryFile(tempPath, std::ios::binary);
+            if(!entryFile)
+            {
+                // Can't cache the archive, but we can still parse it.
+                parseServices.parseRib(archiveFile, path.c_str(), context);
+                return true;
+            }
+            bool success = false;
+            try
+            {
+                entryFile << header << "\n";
+                RibWriterOptions opts;
+                opts.useBinary = true;
+                boost::scoped_ptr<RibWriterServices> writer(
+                        createRibWriter(entryFile, opts));
+                registerFuncs(*writer);
+                EntryBuildServices services(parseServices);
+                boost::scoped_ptr<Ri::Filter> tee(
+                        createTeeFilter(writer->firstFilter()));
+                tee->setNextFilter(context);
+                tee->setRendererServices(services);
+                services.parseRib(archiveFile, path.c_str(), *tee);
+                entryFile.flush();
+                success = services.errorCount() == 0 && entryFile;
+            }
+            catch(...)
+            {
+                entryFile.close();
+                removeEntry(tempPath);
+                throw;
+            }
+            entryFile.close();
+            if(success)
+            {
+                try
+                {
+                    if(boostfs::exists(entryPath))
+                        boostfs::remove(entryPath);
+                    boostfs::rename(tempPath, entryPath);
+                }
+                catch(boostfs::filesystem_error& /*e*/)
+                {
+                    removeEntry(tempPath);
+                }
+            }
+            else
+                removeEntry(tempPath);
+            return true;
+        }
+
+        /// Remove a partially written cache entry, ignoring failures.
+        static void removeEntry(const boostfs::path& entryPath)
+        {
+            try
+            {
+                boostfs::remove(entryPath);
+            }
+            catch(boostfs::filesystem_error& /*e*/)
+            { }
+        }
+
+        boostfs::path m_cacheDir;
+        Ri::RendererServices& m_services;
+        Stats m_stats;
+        int m_tempCount;
+        mutable boost::mutex m_mutex;
+};
+
+} // anon. namespace
+
+
+//------------------------------------------------------------------------------
+RibDiskCache* RibDiskCache::create(const std::string& cacheDir,
+                                   Ri::RendererServices& services)
+{
+    return new RibDiskCacheImpl(cacheDir, services);
+}
+
+} // namespace Aqsis
+// vi: set et:
@@ -0,0 +1,184 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ * \brief Unit tests for the persistent RIB archive cache.
+ */
+
+#include <aqsis/riutil/ribdiskcache.h>
+
+#define BOOST_TEST_DYN_LINK
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+#include <aqsis/riutil/ricxxutil.h>
+#include <aqsis/util/file.h>
+
+#include "archivecache_test.h"
+
+using namespace Aqsis;
+
+namespace {
+
+// Renderer recording the spheres it sees, along with any float parameters.
+class SphereRecorder : public StubRenderer
+{
+    public:
+        std::vector<float> radii;
+        std::vector<float> params;
+
+        SphereRecorder(TestServices& services) : m_services(services) {}
+
+        virtual RtVoid Declare(RtConstString name, RtConstString declaration)
+        {
+            m_services.tokenDict.declare(name, declaration);
+        }
+        virtual RtVoid Sphere(RtFloat radius, RtFloat zmin, RtFloat zmax,
+                              RtFloat thetamax, const ParamList& pList)
+        {
+            radii.push_back(radius);
+            for(size_t i = 0; i < pList.size(); ++i)
+                if(pList[i].spec().storageType() == Ri::TypeSpec::Float)
+                    params.push_back(pList[i].floatData()[0]);
+        }
+
+    private:
+        TestServices& m_services;
+};
+
+void writeFile(const std::string& path, const std::string& contents)
+{
+    std::ofstream out(path.c_str());
+    out << contents;
+}
+
+// Temporary directory holding an archive and a cache; removed on destruction.
+struct CacheFixture
+{
+    boost::filesystem::path dir;
+    std::string archivePath;
+    TestServices services;
+    boost::scoped_ptr<RibDiskCache> cache;
+
+    CacheFixture()
+        : dir("aqsis_diskcache_test"),
+        archivePath(native(dir / "archive.rib"))
+    {
+        boost::filesystem::remove_all(dir);
+        boost::filesystem::create_directories(dir);
+        cache.reset(RibDiskCache::create(native(dir / "cache"), services));
+    }
+    ~CacheFixture()
+    {
+        cache.reset();
+        boost::filesystem::remove_all(dir);
+    }
+
+    bool parse(SphereRecorder& renderer)
+    {
+        return cache->parse(archivePath, services, renderer);
+    }
+};
+
+} // anon. namespace
+
+
+BOOST_AUTO_TEST_SUITE(ribdiskcache_tests)
+
+BOOST_AUTO_TEST_CASE(RibDiskCache_hit_test)
+{
+    CacheFixture f;
+    f.services.tokenDict.declare("globalparam", "uniform float");
+    writeFile(f.archivePath,
+        "Declare \"localparam\" \"uniform float\"\n"
+        "Sphere 1 -1 1 360 \"localparam\" [42]\n"
+        "Sphere 2 -2 2 360 \"globalparam\" [3]\n");
+    // The first read creates the cache entry, the second reads it back.
+    for(int i = 0; i < 2; ++i)
+    {
+        SphereRecorder renderer(f.services);
+        BOOST_CHECK(f.parse(renderer));
+        BOOST_REQUIRE_EQUAL(renderer.radii.size(), 2U);
+        BOOST_CHECK_EQUAL(renderer.radii[0], 1.0f);
+        BOOST_CHECK_EQUAL(renderer.radii[1], 2.0f);
+        BOOST_REQUIRE_EQUAL(renderer.params.size(), 2U);
+        BOOST_CHECK_EQUAL(renderer.params[0], 42.0f);
+        BOOST_CHECK_EQUAL(renderer.params[1], 3.0f);
+    }
+    RibDiskCache::Stats stats = f.cache->stats();
+    BOOST_CHECK_EQUAL(stats.misses, 1);
+    BOOST_CHECK_EQUAL(stats.hits, 1);
+    BOOST_CHECK_EQUAL(stats.bytesSaved,
+                      boost::filesystem::file_size(f.archivePath));
+}
+
+BOOST_AUTO_TEST_CASE(RibDiskCache_outofdate_test)
+{
+    CacheFixture f;
+    writeFile(f.archivePath, "Sphere 1 -1 1 360\n");
+    SphereRecorder renderer1(f.services);
+    BOOST_CHECK(f.parse(renderer1));
+    // Changing the size of the archive invalidates the cache entry.
+    writeFile(f.archivePath, "Sphere 1 -1 1 360\nSphere 2 -2 2 360\n");
+    SphereRecorder renderer2(f.services);
+    BOOST_CHECK(f.parse(renderer2));
+    BOOST_CHECK_EQUAL(renderer2.radii.size(), 2U);
+    BOOST_CHECK_EQUAL(f.cache->stats().misses, 2);
+}
+
+BOOST_AUTO_TEST_CASE(RibDiskCache_error_test)
+{
+    CacheFixture f;
+    writeFile(f.archivePath, "Sphere 1 -1 1 360 \"undeclared_param\" [1]\n"
+                             "Sphere 2 -2 2 360\n");
+    // Archives with errors are parsed as usual, but aren't cached.
+    for(int i = 0; i < 2; ++i)
+    {
+        SphereRecorder renderer(f.services);
+        BOOST_CHECK(f.parse(renderer));
+        BOOST_CHECK_EQUAL(renderer.radii.size(), 1U);
+        BOOST_CHECK_EQUAL(f.services.errorCount(), i + 1);
+    }
+    BOOST_CHECK_EQUAL(f.cache->stats().misses, 2);
+    BOOST_CHECK_EQUAL(f.cache->stats().hits, 0);
+    // Missing archives are left for the caller.
+    SphereRecorder renderer(f.services);
+    f.archivePath = native(f.dir / "nonexistent.rib");
+    BOOST_CHECK(!f.parse(renderer));
+    BOOST_CHECK(renderer.radii.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
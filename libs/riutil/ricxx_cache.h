@@ -37,8 +37,17 @@
 
 #include <aqsis/riutil/ricxx.h>
 
+#include <cassert>
 #include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
 #include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/version.hpp>
+#if BOOST_VERSION >= 103600
+#   include <boost/unordered_map.hpp>
+#endif
 
 #include "multistringbuffer.h"
 
@@ -57,6 +66,9 @@ class CachedRequest
         /// Re-call the interface function on the given context.
         virtual void reCall(Ri::Renderer& context) const = 0;
 
+        /// Approximate number of bytes of memory used by the request.
+        virtual size_t memoryUsage() const = 0;
+
         virtual ~CachedRequest() {}
 
     protected:
@@ -79,14 +91,17 @@ class CachedRiStream
     private:
         boost::ptr_vector<CachedRequest> m_requests;
         std::string m_name;
+        size_t m_memoryUsage;
 
     public:
         CachedRiStream(RtConstToken name)
-            : m_name(name)
+            : m_name(name),
+            m_memoryUsage(0)
         { }
         void push_back(CachedRequest* req)
         {
             m_requests.push_back(req);
+            m_memoryUsage += req->memoryUsage();
         }
         void replay(Ri::Renderer& context) const
         {
@@ -94,6 +109,75 @@ class CachedRiStream
                 m_requests[i].reCall(context);
         }
         const std::string& name() const { return m_name; }
+        /// Approximate number of bytes of memory used by the cached requests.
+        size_t memoryUsage() const
+        {
+            return sizeof(*this) + m_name.capacity()
+                + m_requests.capacity()*sizeof(void*) + m_memoryUsage;
+        }
+};
+
+
+//------------------------------------------------------------------------------
+/// A set of named cached streams with constant time lookup by name.
+class CachedStreamTable
+{
+    private:
+#       if BOOST_VERSION >= 103600
+        typedef boost::unordered_map<std::string, CachedRiStream*> StreamMap;
+#       else
+        typedef std::map<std::string, CachedRiStream*> StreamMap;
+#       endif
+        StreamMap m_streams;
+
+    public:
+        CachedStreamTable()
+            : m_streams()
+        { }
+
+        ~CachedStreamTable()
+        {
+            for(StreamMap::iterator i = m_streams.begin();
+                    i != m_streams.end(); ++i)
+                delete i->second;
+        }
+
+        /// Find the stream with the given name.
+        ///
+        /// Return null if no stream has been defined with the name.  This may
+        /// be called concurrently, as long as nothing is being defined.
+        CachedRiStream* find(const char* name) const
+        {
+            StreamMap::const_iterator i = m_streams.find(std::string(name));
+            if(i == m_streams.end())
+                return 0;
+            return i->second;
+        }
+
+        /// Create a new empty stream with the given name.
+        ///
+        /// If a stream with the same name already exists, it is replaced by
+        /// the new stream.
+        CachedRiStream& define(const char* name)
+        {
+            CachedRiStream*& stream = m_streams[std::string(name)];
+            delete stream;
+            stream = new CachedRiStream(name);
+            return *stream;
+        }
+
+        /// Number of distinct stream names in the table.
+        int size() const { return m_streams.size(); }
+
+        /// Approximate number of bytes of memory used by all the streams.
+        size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            for(StreamMap::const_iterator i = m_streams.begin();
+                    i != m_streams.end(); ++i)
+                size += i->second->memoryUsage();
+            return size;
+        }
 };
 
 
@@ -120,6 +204,8 @@ class CachedString
         CachedString(RtConstString str) : m_str(str) {}
 
         operator RtConstString() const { return m_str.c_str(); }
+
+        size_t heapSize() const { return m_str.capacity(); }
 };
 
 template<typename T>
@@ -136,6 +222,8 @@ class CachedArray
                 return Ri::Array<T>();
             return Ri::Array<T>(&m_vec[0], m_vec.size());
         }
+
+        size_t heapSize() const { return m_vec.capacity()*sizeof(T); }
 };
 
 typedef CachedArray<RtInt> CachedIntArray;
@@ -158,6 +246,8 @@ class CachedStringArray
                 return Ri::StringArray();
             return Ri::StringArray(&strings[0], strings.size());
         }
+
+        size_t heapSize() const { return m_buf.heapSize(); }
 };
 
 template<int N>
@@ -202,9 +292,11 @@ class CachedParamList
         boost::scoped_array<char> m_chars;
         boost::scoped_array<RtConstString> m_strings;
         std::vector<Ri::Param> m_pList;
+        size_t m_heapSize;
 
     public:
         CachedParamList(const Ri::ParamList& pList)
+            : m_heapSize(0)
         {
             if(pList.size() == 0)
                 return;
@@ -246,6 +338,9 @@ class CachedParamList
             if(ptrCount)  m_pointers.reset(new RtPointer[ptrCount]);
             if(stringCount) m_strings.reset(new RtConstString[stringCount]);
             if(charCount)   m_chars.reset(new char[charCount]);
+            m_heapSize = intCount*sizeof(RtInt) + floatCount*sizeof(RtFloat)
+                + ptrCount*sizeof(RtPointer) + stringCount*sizeof(RtConstString)
+                + charCount + pList.size()*sizeof(Ri::Param);
             // Finally, copy over the data
             intCount = 0;
             floatCount = 0;
@@ -309,8 +404,17 @@ class CachedParamList
                 return Ri::ParamList();
             return Ri::ParamList(&m_pList[0], m_pList.size());
         }
+
+        size_t heapSize() const { return m_heapSize; }
 };
 
+// Heap memory owned by the cached argument types, for memory accounting.
+inline size_t heapSize(const CachedString& s) { return s.heapSize(); }
+template<typename T>
+inline size_t heapSize(const CachedArray<T>& a) { return a.heapSize(); }
+inline size_t heapSize(const CachedStringArray& a) { return a.heapSize(); }
+inline size_t heapSize(const CachedParamList& pList) { return pList.heapSize(); }
+
 
 /*
 --------------------------------------------------------------------------------
@@ -341,6 +445,17 @@ class ${procName} : public CachedRequest
         {
             context.${procName}($callArgs);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+#for $type,$name in $memberData
+#if $type in $heapTypes
+            size += heapSize(m_$name);
+#end if
+#end for
+            return size;
+        }
 };'''
 
 customImplementations = set(['Procedural'])
@@ -358,6 +473,10 @@ memberTypeMap = {
     'RtBasis': 'CachedMatrix',
     'RtMatrix': 'CachedMatrix',
 }
+# Member types which own heap memory.
+heapTypes = set(['CachedString', 'CachedIntArray', 'CachedFloatArray',
+                 'CachedStringArray', 'CachedParamList'])
+
 def getMemberType(arg):
     type = arg.findtext('Type')
     return memberTypeMap.get(type, type)
@@ -396,6 +515,14 @@ class Declare : public CachedRequest
         {
             context.Declare(m_name, m_declaration);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_name);
+            size += heapSize(m_declaration);
+            return size;
+        }
 };
 
 class FrameBegin : public CachedRequest
@@ -411,6 +538,12 @@ class FrameBegin : public CachedRequest
         {
             context.FrameBegin(m_number);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class FrameEnd : public CachedRequest
@@ -424,6 +557,12 @@ class FrameEnd : public CachedRequest
         {
             context.FrameEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class WorldBegin : public CachedRequest
@@ -437,6 +576,12 @@ class WorldBegin : public CachedRequest
         {
             context.WorldBegin();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class WorldEnd : public CachedRequest
@@ -450,6 +595,12 @@ class WorldEnd : public CachedRequest
         {
             context.WorldEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class IfBegin : public CachedRequest
@@ -465,6 +616,13 @@ class IfBegin : public CachedRequest
         {
             context.IfBegin(m_condition);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_condition);
+            return size;
+        }
 };
 
 class ElseIf : public CachedRequest
@@ -480,6 +638,13 @@ class ElseIf : public CachedRequest
         {
             context.ElseIf(m_condition);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_condition);
+            return size;
+        }
 };
 
 class Else : public CachedRequest
@@ -493,6 +658,12 @@ class Else : public CachedRequest
         {
             context.Else();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class IfEnd : public CachedRequest
@@ -506,6 +677,12 @@ class IfEnd : public CachedRequest
         {
             context.IfEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Format : public CachedRequest
@@ -525,6 +702,12 @@ class Format : public CachedRequest
         {
             context.Format(m_xresolution, m_yresolution, m_pixelaspectratio);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class FrameAspectRatio : public CachedRequest
@@ -540,6 +723,12 @@ class FrameAspectRatio : public CachedRequest
         {
             context.FrameAspectRatio(m_frameratio);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class ScreenWindow : public CachedRequest
@@ -561,6 +750,12 @@ class ScreenWindow : public CachedRequest
         {
             context.ScreenWindow(m_left, m_right, m_bottom, m_top);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class CropWindow : public CachedRequest
@@ -582,6 +777,12 @@ class CropWindow : public CachedRequest
         {
             context.CropWindow(m_xmin, m_xmax, m_ymin, m_ymax);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Projection : public CachedRequest
@@ -599,6 +800,14 @@ class Projection : public CachedRequest
         {
             context.Projection(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_name);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Clipping : public CachedRequest
@@ -616,6 +825,12 @@ class Clipping : public CachedRequest
         {
             context.Clipping(m_cnear, m_cfar);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class ClippingPlane : public CachedRequest
@@ -641,6 +856,12 @@ class ClippingPlane : public CachedRequest
         {
             context.ClippingPlane(m_x, m_y, m_z, m_nx, m_ny, m_nz);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class DepthOfField : public CachedRequest
@@ -660,6 +881,12 @@ class DepthOfField : public CachedRequest
         {
             context.DepthOfField(m_fstop, m_focallength, m_focaldistance);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Shutter : public CachedRequest
@@ -677,6 +904,12 @@ class Shutter : public CachedRequest
         {
             context.Shutter(m_opentime, m_closetime);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class PixelVariance : public CachedRequest
@@ -692,6 +925,12 @@ class PixelVariance : public CachedRequest
         {
             context.PixelVariance(m_variance);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class PixelSamples : public CachedRequest
@@ -709,6 +948,12 @@ class PixelSamples : public CachedRequest
         {
             context.PixelSamples(m_xsamples, m_ysamples);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class PixelFilter : public CachedRequest
@@ -728,6 +973,12 @@ class PixelFilter : public CachedRequest
         {
             context.PixelFilter(m_function, m_xwidth, m_ywidth);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Exposure : public CachedRequest
@@ -745,6 +996,12 @@ class Exposure : public CachedRequest
         {
             context.Exposure(m_gain, m_gamma);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Imager : public CachedRequest
@@ -762,6 +1019,14 @@ class Imager : public CachedRequest
         {
             context.Imager(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_name);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Quantize : public CachedRequest
@@ -785,6 +1050,13 @@ class Quantize : public CachedRequest
         {
             context.Quantize(m_type, m_one, m_min, m_max, m_ditheramplitude);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_type);
+            return size;
+        }
 };
 
 class Display : public CachedRequest
@@ -806,6 +1078,16 @@ class Display : public CachedRequest
         {
             context.Display(m_name, m_type, m_mode, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_name);
+            size += heapSize(m_type);
+            size += heapSize(m_mode);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Hider : public CachedRequest
@@ -823,6 +1105,14 @@ class Hider : public CachedRequest
         {
             context.Hider(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_name);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class ColorSamples : public CachedRequest
@@ -840,6 +1130,14 @@ class ColorSamples : public CachedRequest
         {
             context.ColorSamples(m_nRGB, m_RGBn);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_nRGB);
+            size += heapSize(m_RGBn);
+            return size;
+        }
 };
 
 class RelativeDetail : public CachedRequest
@@ -855,6 +1153,12 @@ class RelativeDetail : public CachedRequest
         {
             context.RelativeDetail(m_relativedetail);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Option : public CachedRequest
@@ -872,6 +1176,14 @@ class Option : public CachedRequest
         {
             context.Option(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_name);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class AttributeBegin : public CachedRequest
@@ -885,6 +1197,12 @@ class AttributeBegin : public CachedRequest
         {
             context.AttributeBegin();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class AttributeEnd : public CachedRequest
@@ -898,6 +1216,12 @@ class AttributeEnd : public CachedRequest
         {
             context.AttributeEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Color : public CachedRequest
@@ -913,6 +1237,12 @@ class Color : public CachedRequest
         {
             context.Color(m_Cq);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Opacity : public CachedRequest
@@ -928,6 +1258,12 @@ class Opacity : public CachedRequest
         {
             context.Opacity(m_Os);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class TextureCoordinates : public CachedRequest
@@ -957,6 +1293,12 @@ class TextureCoordinates : public CachedRequest
         {
             context.TextureCoordinates(m_s1, m_t1, m_s2, m_t2, m_s3, m_t3, m_s4, m_t4);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class LightSource : public CachedRequest
@@ -976,6 +1318,15 @@ class LightSource : public CachedRequest
         {
             context.LightSource(m_shadername, m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_shadername);
+            size += heapSize(m_name);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class AreaLightSource : public CachedRequest
@@ -995,6 +1346,15 @@ class AreaLightSource : public CachedRequest
         {
             context.AreaLightSource(m_shadername, m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_shadername);
+            size += heapSize(m_name);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Illuminate : public CachedRequest
@@ -1012,6 +1372,13 @@ class Illuminate : public CachedRequest
         {
             context.Illuminate(m_name, m_onoff);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_name);
+            return size;
+        }
 };
 
 class Surface : public CachedRequest
@@ -1029,6 +1396,14 @@ class Surface : public CachedRequest
         {
             context.Surface(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_name);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Displacement : public CachedRequest
@@ -1046,6 +1421,14 @@ class Displacement : public CachedRequest
         {
             context.Displacement(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_name);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Atmosphere : public CachedRequest
@@ -1063,6 +1446,14 @@ class Atmosphere : public CachedRequest
         {
             context.Atmosphere(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_name);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Interior : public CachedRequest
@@ -1080,6 +1471,14 @@ class Interior : public CachedRequest
         {
             context.Interior(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_name);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Exterior : public CachedRequest
@@ -1097,6 +1496,14 @@ class Exterior : public CachedRequest
         {
             context.Exterior(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_name);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class ShaderLayer : public CachedRequest
@@ -1118,6 +1525,16 @@ class ShaderLayer : public CachedRequest
         {
             context.ShaderLayer(m_type, m_name, m_layername, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_type);
+            size += heapSize(m_name);
+            size += heapSize(m_layername);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class ConnectShaderLayers : public CachedRequest
@@ -1141,6 +1558,17 @@ class ConnectShaderLayers : public CachedRequest
         {
             context.ConnectShaderLayers(m_type, m_layer1, m_variable1, m_layer2, m_variable2);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_type);
+            size += heapSize(m_layer1);
+            size += heapSize(m_variable1);
+            size += heapSize(m_layer2);
+            size += heapSize(m_variable2);
+            return size;
+        }
 };
 
 class ShadingRate : public CachedRequest
@@ -1156,6 +1584,12 @@ class ShadingRate : public CachedRequest
         {
             context.ShadingRate(m_size);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class ShadingInterpolation : public CachedRequest
@@ -1171,6 +1605,13 @@ class ShadingInterpolation : public CachedRequest
         {
             context.ShadingInterpolation(m_type);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_type);
+            return size;
+        }
 };
 
 class Matte : public CachedRequest
@@ -1186,6 +1627,12 @@ class Matte : public CachedRequest
         {
             context.Matte(m_onoff);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Bound : public CachedRequest
@@ -1201,6 +1648,12 @@ class Bound : public CachedRequest
         {
             context.Bound(m_bound);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Detail : public CachedRequest
@@ -1216,6 +1669,12 @@ class Detail : public CachedRequest
         {
             context.Detail(m_bound);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class DetailRange : public CachedRequest
@@ -1237,6 +1696,12 @@ class DetailRange : public CachedRequest
         {
             context.DetailRange(m_offlow, m_onlow, m_onhigh, m_offhigh);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class GeometricApproximation : public CachedRequest
@@ -1254,6 +1719,13 @@ class GeometricApproximation : public CachedRequest
         {
             context.GeometricApproximation(m_type, m_value);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_type);
+            return size;
+        }
 };
 
 class Orientation : public CachedRequest
@@ -1269,6 +1741,13 @@ class Orientation : public CachedRequest
         {
             context.Orientation(m_orientation);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_orientation);
+            return size;
+        }
 };
 
 class ReverseOrientation : public CachedRequest
@@ -1282,6 +1761,12 @@ class ReverseOrientation : public CachedRequest
         {
             context.ReverseOrientation();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Sides : public CachedRequest
@@ -1297,6 +1782,12 @@ class Sides : public CachedRequest
         {
             context.Sides(m_nsides);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Identity : public CachedRequest
@@ -1310,6 +1801,12 @@ class Identity : public CachedRequest
         {
             context.Identity();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Transform : public CachedRequest
@@ -1325,6 +1822,12 @@ class Transform : public CachedRequest
         {
             context.Transform(m_transform);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class ConcatTransform : public CachedRequest
@@ -1340,6 +1843,12 @@ class ConcatTransform : public CachedRequest
         {
             context.ConcatTransform(m_transform);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Perspective : public CachedRequest
@@ -1355,6 +1864,12 @@ class Perspective : public CachedRequest
         {
             context.Perspective(m_fov);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Translate : public CachedRequest
@@ -1374,6 +1889,12 @@ class Translate : public CachedRequest
         {
             context.Translate(m_dx, m_dy, m_dz);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Rotate : public CachedRequest
@@ -1395,6 +1916,12 @@ class Rotate : public CachedRequest
         {
             context.Rotate(m_angle, m_dx, m_dy, m_dz);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Scale : public CachedRequest
@@ -1414,6 +1941,12 @@ class Scale : public CachedRequest
         {
             context.Scale(m_sx, m_sy, m_sz);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Skew : public CachedRequest
@@ -1441,6 +1974,12 @@ class Skew : public CachedRequest
         {
             context.Skew(m_angle, m_dx1, m_dy1, m_dz1, m_dx2, m_dy2, m_dz2);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class CoordinateSystem : public CachedRequest
@@ -1456,6 +1995,13 @@ class CoordinateSystem : public CachedRequest
         {
             context.CoordinateSystem(m_space);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_space);
+            return size;
+        }
 };
 
 class CoordSysTransform : public CachedRequest
@@ -1471,6 +2017,13 @@ class CoordSysTransform : public CachedRequest
         {
             context.CoordSysTransform(m_space);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_space);
+            return size;
+        }
 };
 
 class TransformBegin : public CachedRequest
@@ -1484,6 +2037,12 @@ class TransformBegin : public CachedRequest
         {
             context.TransformBegin();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class TransformEnd : public CachedRequest
@@ -1497,6 +2056,12 @@ class TransformEnd : public CachedRequest
         {
             context.TransformEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Resource : public CachedRequest
@@ -1516,6 +2081,15 @@ class Resource : public CachedRequest
         {
             context.Resource(m_handle, m_type, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_handle);
+            size += heapSize(m_type);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class ResourceBegin : public CachedRequest
@@ -1529,6 +2103,12 @@ class ResourceBegin : public CachedRequest
         {
             context.ResourceBegin();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class ResourceEnd : public CachedRequest
@@ -1542,6 +2122,12 @@ class ResourceEnd : public CachedRequest
         {
             context.ResourceEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Attribute : public CachedRequest
@@ -1559,6 +2145,14 @@ class Attribute : public CachedRequest
         {
             context.Attribute(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_name);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Polygon : public CachedRequest
@@ -1574,6 +2168,13 @@ class Polygon : public CachedRequest
         {
             context.Polygon(m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class GeneralPolygon : public CachedRequest
@@ -1591,6 +2192,14 @@ class GeneralPolygon : public CachedRequest
         {
             context.GeneralPolygon(m_nverts, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_nverts);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class PointsPolygons : public CachedRequest
@@ -1610,7 +2219,16 @@ class PointsPolygons : public CachedRequest
         {
             context.PointsPolygons(m_nverts, m_verts, m_pList);
         }
-};
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_nverts);
+            size += heapSize(m_verts);
+            size += heapSize(m_pList);
+            return size;
+        }
+};
 
 class PointsGeneralPolygons : public CachedRequest
 {
@@ -1631,6 +2249,16 @@ class PointsGeneralPolygons : public CachedRequest
         {
             context.PointsGeneralPolygons(m_nloops, m_nverts, m_verts, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_nloops);
+            size += heapSize(m_nverts);
+            size += heapSize(m_verts);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Basis : public CachedRequest
@@ -1652,6 +2280,12 @@ class Basis : public CachedRequest
         {
             context.Basis(m_ubasis, m_ustep, m_vbasis, m_vstep);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class Patch : public CachedRequest
@@ -1669,6 +2303,14 @@ class Patch : public CachedRequest
         {
             context.Patch(m_type, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_type);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class PatchMesh : public CachedRequest
@@ -1694,6 +2336,16 @@ class PatchMesh : public CachedRequest
         {
             context.PatchMesh(m_type, m_nu, m_uwrap, m_nv, m_vwrap, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_type);
+            size += heapSize(m_uwrap);
+            size += heapSize(m_vwrap);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class NuPatch : public CachedRequest
@@ -1729,6 +2381,15 @@ class NuPatch : public CachedRequest
         {
             context.NuPatch(m_nu, m_uorder, m_uknot, m_umin, m_umax, m_nv, m_vorder, m_vknot, m_vmin, m_vmax, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_uknot);
+            size += heapSize(m_vknot);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class TrimCurve : public CachedRequest
@@ -1760,6 +2421,21 @@ class TrimCurve : public CachedRequest
         {
             context.TrimCurve(m_ncurves, m_order, m_knot, m_min, m_max, m_n, m_u, m_v, m_w);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_ncurves);
+            size += heapSize(m_order);
+            size += heapSize(m_knot);
+            size += heapSize(m_min);
+            size += heapSize(m_max);
+            size += heapSize(m_n);
+            size += heapSize(m_u);
+            size += heapSize(m_v);
+            size += heapSize(m_w);
+            return size;
+        }
 };
 
 class SubdivisionMesh : public CachedRequest
@@ -1789,6 +2465,20 @@ class SubdivisionMesh : public CachedRequest
         {
             context.SubdivisionMesh(m_scheme, m_nvertices, m_vertices, m_tags, m_nargs, m_intargs, m_floatargs, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_scheme);
+            size += heapSize(m_nvertices);
+            size += heapSize(m_vertices);
+            size += heapSize(m_tags);
+            size += heapSize(m_nargs);
+            size += heapSize(m_intargs);
+            size += heapSize(m_floatargs);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Sphere : public CachedRequest
@@ -1812,6 +2502,13 @@ class Sphere : public CachedRequest
         {
             context.Sphere(m_radius, m_zmin, m_zmax, m_thetamax, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Cone : public CachedRequest
@@ -1833,6 +2530,13 @@ class Cone : public CachedRequest
         {
             context.Cone(m_height, m_radius, m_thetamax, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Cylinder : public CachedRequest
@@ -1856,6 +2560,13 @@ class Cylinder : public CachedRequest
         {
             context.Cylinder(m_radius, m_zmin, m_zmax, m_thetamax, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Hyperboloid : public CachedRequest
@@ -1877,6 +2588,13 @@ class Hyperboloid : public CachedRequest
         {
             context.Hyperboloid(m_point1, m_point2, m_thetamax, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Paraboloid : public CachedRequest
@@ -1900,6 +2618,13 @@ class Paraboloid : public CachedRequest
         {
             context.Paraboloid(m_rmax, m_zmin, m_zmax, m_thetamax, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Disk : public CachedRequest
@@ -1921,6 +2646,13 @@ class Disk : public CachedRequest
         {
             context.Disk(m_height, m_radius, m_thetamax, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Torus : public CachedRequest
@@ -1946,6 +2678,13 @@ class Torus : public CachedRequest
         {
             context.Torus(m_majorrad, m_minorrad, m_phimin, m_phimax, m_thetamax, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Points : public CachedRequest
@@ -1961,6 +2700,13 @@ class Points : public CachedRequest
         {
             context.Points(m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Curves : public CachedRequest
@@ -1982,6 +2728,16 @@ class Curves : public CachedRequest
         {
             context.Curves(m_type, m_nvertices, m_wrap, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_type);
+            size += heapSize(m_nvertices);
+            size += heapSize(m_wrap);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Blobby : public CachedRequest
@@ -2005,6 +2761,16 @@ class Blobby : public CachedRequest
         {
             context.Blobby(m_nleaf, m_code, m_floats, m_strings, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_code);
+            size += heapSize(m_floats);
+            size += heapSize(m_strings);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class Geometry : public CachedRequest
@@ -2022,6 +2788,14 @@ class Geometry : public CachedRequest
         {
             context.Geometry(m_type, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_type);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class SolidBegin : public CachedRequest
@@ -2037,6 +2811,13 @@ class SolidBegin : public CachedRequest
         {
             context.SolidBegin(m_type);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_type);
+            return size;
+        }
 };
 
 class SolidEnd : public CachedRequest
@@ -2050,6 +2831,12 @@ class SolidEnd : public CachedRequest
         {
             context.SolidEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class ObjectBegin : public CachedRequest
@@ -2065,6 +2852,13 @@ class ObjectBegin : public CachedRequest
         {
             context.ObjectBegin(m_name);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_name);
+            return size;
+        }
 };
 
 class ObjectEnd : public CachedRequest
@@ -2078,6 +2872,12 @@ class ObjectEnd : public CachedRequest
         {
             context.ObjectEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class ObjectInstance : public CachedRequest
@@ -2093,6 +2893,13 @@ class ObjectInstance : public CachedRequest
         {
             context.ObjectInstance(m_name);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_name);
+            return size;
+        }
 };
 
 class MotionBegin : public CachedRequest
@@ -2108,6 +2915,13 @@ class MotionBegin : public CachedRequest
         {
             context.MotionBegin(m_times);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_times);
+            return size;
+        }
 };
 
 class MotionEnd : public CachedRequest
@@ -2121,6 +2935,12 @@ class MotionEnd : public CachedRequest
         {
             context.MotionEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class MakeTexture : public CachedRequest
@@ -2150,6 +2970,17 @@ class MakeTexture : public CachedRequest
         {
             context.MakeTexture(m_imagefile, m_texturefile, m_swrap, m_twrap, m_filterfunc, m_swidth, m_twidth, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_imagefile);
+            size += heapSize(m_texturefile);
+            size += heapSize(m_swrap);
+            size += heapSize(m_twrap);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class MakeLatLongEnvironment : public CachedRequest
@@ -2175,6 +3006,15 @@ class MakeLatLongEnvironment : public CachedRequest
         {
             context.MakeLatLongEnvironment(m_imagefile, m_reflfile, m_filterfunc, m_swidth, m_twidth, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_imagefile);
+            size += heapSize(m_reflfile);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class MakeCubeFaceEnvironment : public CachedRequest
@@ -2212,6 +3052,20 @@ class MakeCubeFaceEnvironment : public CachedRequest
         {
             context.MakeCubeFaceEnvironment(m_px, m_nx, m_py, m_ny, m_pz, m_nz, m_reflfile, m_fov, m_filterfunc, m_swidth, m_twidth, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_px);
+            size += heapSize(m_nx);
+            size += heapSize(m_py);
+            size += heapSize(m_ny);
+            size += heapSize(m_pz);
+            size += heapSize(m_nz);
+            size += heapSize(m_reflfile);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class MakeShadow : public CachedRequest
@@ -2231,6 +3085,15 @@ class MakeShadow : public CachedRequest
         {
             context.MakeShadow(m_picfile, m_shadowfile, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_picfile);
+            size += heapSize(m_shadowfile);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class MakeOcclusion : public CachedRequest
@@ -2250,6 +3113,15 @@ class MakeOcclusion : public CachedRequest
         {
             context.MakeOcclusion(m_picfiles, m_shadowfile, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_picfiles);
+            size += heapSize(m_shadowfile);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class ErrorHandler : public CachedRequest
@@ -2265,6 +3137,12 @@ class ErrorHandler : public CachedRequest
         {
             context.ErrorHandler(m_handler);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 
 class ReadArchive : public CachedRequest
@@ -2284,6 +3162,14 @@ class ReadArchive : public CachedRequest
         {
             context.ReadArchive(m_name, m_callback, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_name);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class ArchiveBegin : public CachedRequest
@@ -2301,6 +3187,14 @@ class ArchiveBegin : public CachedRequest
         {
             context.ArchiveBegin(m_name, m_pList);
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            size += heapSize(m_name);
+            size += heapSize(m_pList);
+            return size;
+        }
 };
 
 class ArchiveEnd : public CachedRequest
@@ -2314,6 +3208,12 @@ class ArchiveEnd : public CachedRequest
         {
             context.ArchiveEnd();
         }
+
+        virtual size_t memoryUsage() const
+        {
+            size_t size = sizeof(*this);
+            return size;
+        }
 };
 //[[[end]]]
 
@@ -2350,11 +3250,659 @@ class Procedural : public CachedRequest
         {
             context.Procedural(m_data, m_bound, m_refineproc, &doNothingFreeProc);
         }
+
+        // The procedural data is opaque, so we can't account for it.
+        virtual size_t memoryUsage() const
+        {
+            return sizeof(*this);
+        }
 };
 
 
 } // namespace RiCache
 
+//------------------------------------------------------------------------------
+/// Renderer which records all requests into a CachedRiStream.
+///
+/// ArchiveRecord has no cached form, so it is dropped.
+class CachedRiStreamRecorder : public Ri::Renderer
+{
+    public:
+        CachedRiStreamRecorder(CachedRiStream& stream)
+            : m_stream(stream)
+        { }
+
+        virtual RtVoid ArchiveRecord(RtConstToken type, const char* string)
+        { }
+
+        // Code generator for autogenerated method declarations
+        /*[[[cog
+        from codegenutils import *
+        riXml = parseXml(riXmlPath)
+        from Cheetah.Template import Template
+
+        methodTemplate = r'''
+        virtual $wrapDecl($riCxxMethodDecl($proc), 72, wrapIndent=20)
+        {
+            m_stream.push_back(new RiCache::${procName}($callArgs));
+        }
+        '''
+
+        for proc in riXml.findall('Procedures/Procedure'):
+            procName = proc.findtext('Name')
+            if proc.findall('Rib'):
+                callArgs = ', '.join(wrapperCallArgList(proc))
+                cog.out(str(Template(methodTemplate, searchList=locals())));
+
+        ]]]*/
+
+        virtual RtVoid Declare(RtConstString name, RtConstString declaration)
+        {
+            m_stream.push_back(new RiCache::Declare(name, declaration));
+        }
+
+        virtual RtVoid FrameBegin(RtInt number)
+        {
+            m_stream.push_back(new RiCache::FrameBegin(number));
+        }
+
+        virtual RtVoid FrameEnd()
+        {
+            m_stream.push_back(new RiCache::FrameEnd());
+        }
+
+        virtual RtVoid WorldBegin()
+        {
+            m_stream.push_back(new RiCache::WorldBegin());
+        }
+
+        virtual RtVoid WorldEnd()
+        {
+            m_stream.push_back(new RiCache::WorldEnd());
+        }
+
+        virtual RtVoid IfBegin(RtConstString condition)
+        {
+            m_stream.push_back(new RiCache::IfBegin(condition));
+        }
+
+        virtual RtVoid ElseIf(RtConstString condition)
+        {
+            m_stream.push_back(new RiCache::ElseIf(condition));
+        }
+
+        virtual RtVoid Else()
+        {
+            m_stream.push_back(new RiCache::Else());
+        }
+
+        virtual RtVoid IfEnd()
+        {
+            m_stream.push_back(new RiCache::IfEnd());
+        }
+
+        virtual RtVoid Format(RtInt xresolution, RtInt yresolution,
+                    RtFloat pixelaspectratio)
+        {
+            m_stream.push_back(new RiCache::Format(xresolution, yresolution, pixelaspectratio));
+        }
+
+        virtual RtVoid FrameAspectRatio(RtFloat frameratio)
+        {
+            m_stream.push_back(new RiCache::FrameAspectRatio(frameratio));
+        }
+
+        virtual RtVoid ScreenWindow(RtFloat left, RtFloat right, RtFloat bottom,
+                    RtFloat top)
+        {
+            m_stream.push_back(new RiCache::ScreenWindow(left, right, bottom, top));
+        }
+
+        virtual RtVoid CropWindow(RtFloat xmin, RtFloat xmax, RtFloat ymin,
+                    RtFloat ymax)
+        {
+            m_stream.push_back(new RiCache::CropWindow(xmin, xmax, ymin, ymax));
+        }
+
+        virtual RtVoid Projection(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Projection(name, pList));
+        }
+
+        virtual RtVoid Clipping(RtFloat cnear, RtFloat cfar)
+        {
+            m_stream.push_back(new RiCache::Clipping(cnear, cfar));
+        }
+
+        virtual RtVoid ClippingPlane(RtFloat x, RtFloat y, RtFloat z, RtFloat nx,
+                    RtFloat ny, RtFloat nz)
+        {
+            m_stream.push_back(new RiCache::ClippingPlane(x, y, z, nx, ny, nz));
+        }
+
+        virtual RtVoid DepthOfField(RtFloat fstop, RtFloat focallength,
+                    RtFloat focaldistance)
+        {
+            m_stream.push_back(new RiCache::DepthOfField(fstop, focallength, focaldistance));
+        }
+
+        virtual RtVoid Shutter(RtFloat opentime, RtFloat closetime)
+        {
+            m_stream.push_back(new RiCache::Shutter(opentime, closetime));
+        }
+
+        virtual RtVoid PixelVariance(RtFloat variance)
+        {
+            m_stream.push_back(new RiCache::PixelVariance(variance));
+        }
+
+        virtual RtVoid PixelSamples(RtFloat xsamples, RtFloat ysamples)
+        {
+            m_stream.push_back(new RiCache::PixelSamples(xsamples, ysamples));
+        }
+
+        virtual RtVoid PixelFilter(RtFilterFunc function, RtFloat xwidth,
+                    RtFloat ywidth)
+        {
+            m_stream.push_back(new RiCache::PixelFilter(function, xwidth, ywidth));
+        }
+
+        virtual RtVoid Exposure(RtFloat gain, RtFloat gamma)
+        {
+            m_stream.push_back(new RiCache::Exposure(gain, gamma));
+        }
+
+        virtual RtVoid Imager(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Imager(name, pList));
+        }
+
+        virtual RtVoid Quantize(RtConstToken type, RtInt one, RtInt min, RtInt max,
+                    RtFloat ditheramplitude)
+        {
+            m_stream.push_back(new RiCache::Quantize(type, one, min, max, ditheramplitude));
+        }
+
+        virtual RtVoid Display(RtConstToken name, RtConstToken type, RtConstToken mode,
+                    const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Display(name, type, mode, pList));
+        }
+
+        virtual RtVoid Hider(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Hider(name, pList));
+        }
+
+        virtual RtVoid ColorSamples(const FloatArray& nRGB, const FloatArray& RGBn)
+        {
+            m_stream.push_back(new RiCache::ColorSamples(nRGB, RGBn));
+        }
+
+        virtual RtVoid RelativeDetail(RtFloat relativedetail)
+        {
+            m_stream.push_back(new RiCache::RelativeDetail(relativedetail));
+        }
+
+        virtual RtVoid Option(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Option(name, pList));
+        }
+
+        virtual RtVoid AttributeBegin()
+        {
+            m_stream.push_back(new RiCache::AttributeBegin());
+        }
+
+        virtual RtVoid AttributeEnd()
+        {
+            m_stream.push_back(new RiCache::AttributeEnd());
+        }
+
+        virtual RtVoid Color(RtConstColor Cq)
+        {
+            m_stream.push_back(new RiCache::Color(Cq));
+        }
+
+        virtual RtVoid Opacity(RtConstColor Os)
+        {
+            m_stream.push_back(new RiCache::Opacity(Os));
+        }
+
+        virtual RtVoid TextureCoordinates(RtFloat s1, RtFloat t1, RtFloat s2,
+                    RtFloat t2, RtFloat s3, RtFloat t3, RtFloat s4,
+                    RtFloat t4)
+        {
+            m_stream.push_back(new RiCache::TextureCoordinates(s1, t1, s2, t2, s3, t3, s4, t4));
+        }
+
+        virtual RtVoid LightSource(RtConstToken shadername, RtConstToken name,
+                    const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::LightSource(shadername, name, pList));
+        }
+
+        virtual RtVoid AreaLightSource(RtConstToken shadername, RtConstToken name,
+                    const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::AreaLightSource(shadername, name, pList));
+        }
+
+        virtual RtVoid Illuminate(RtConstToken name, RtBoolean onoff)
+        {
+            m_stream.push_back(new RiCache::Illuminate(name, onoff));
+        }
+
+        virtual RtVoid Surface(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Surface(name, pList));
+        }
+
+        virtual RtVoid Displacement(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Displacement(name, pList));
+        }
+
+        virtual RtVoid Atmosphere(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Atmosphere(name, pList));
+        }
+
+        virtual RtVoid Interior(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Interior(name, pList));
+        }
+
+        virtual RtVoid Exterior(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Exterior(name, pList));
+        }
+
+        virtual RtVoid ShaderLayer(RtConstToken type, RtConstToken name,
+                    RtConstToken layername, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::ShaderLayer(type, name, layername, pList));
+        }
+
+        virtual RtVoid ConnectShaderLayers(RtConstToken type, RtConstToken layer1,
+                    RtConstToken variable1, RtConstToken layer2,
+                    RtConstToken variable2)
+        {
+            m_stream.push_back(new RiCache::ConnectShaderLayers(type, layer1, variable1, layer2, variable2));
+        }
+
+        virtual RtVoid ShadingRate(RtFloat size)
+        {
+            m_stream.push_back(new RiCache::ShadingRate(size));
+        }
+
+        virtual RtVoid ShadingInterpolation(RtConstToken type)
+        {
+            m_stream.push_back(new RiCache::ShadingInterpolation(type));
+        }
+
+        virtual RtVoid Matte(RtBoolean onoff)
+        {
+            m_stream.push_back(new RiCache::Matte(onoff));
+        }
+
+        virtual RtVoid Bound(RtConstBound bound)
+        {
+            m_stream.push_back(new RiCache::Bound(bound));
+        }
+
+        virtual RtVoid Detail(RtConstBound bound)
+        {
+            m_stream.push_back(new RiCache::Detail(bound));
+        }
+
+        virtual RtVoid DetailRange(RtFloat offlow, RtFloat onlow, RtFloat onhigh,
+                    RtFloat offhigh)
+        {
+            m_stream.push_back(new RiCache::DetailRange(offlow, onlow, onhigh, offhigh));
+        }
+
+        virtual RtVoid GeometricApproximation(RtConstToken type, RtFloat value)
+        {
+            m_stream.push_back(new RiCache::GeometricApproximation(type, value));
+        }
+
+        virtual RtVoid Orientation(RtConstToken orientation)
+        {
+            m_stream.push_back(new RiCache::Orientation(orientation));
+        }
+
+        virtual RtVoid ReverseOrientation()
+        {
+            m_stream.push_back(new RiCache::ReverseOrientation());
+        }
+
+        virtual RtVoid Sides(RtInt nsides)
+        {
+            m_stream.push_back(new RiCache::Sides(nsides));
+        }
+
+        virtual RtVoid Identity()
+        {
+            m_stream.push_back(new RiCache::Identity());
+        }
+
+        virtual RtVoid Transform(RtConstMatrix transform)
+        {
+            m_stream.push_back(new RiCache::Transform(transform));
+        }
+
+        virtual RtVoid ConcatTransform(RtConstMatrix transform)
+        {
+            m_stream.push_back(new RiCache::ConcatTransform(transform));
+        }
+
+        virtual RtVoid Perspective(RtFloat fov)
+        {
+            m_stream.push_back(new RiCache::Perspective(fov));
+        }
+
+        virtual RtVoid Translate(RtFloat dx, RtFloat dy, RtFloat dz)
+        {
+            m_stream.push_back(new RiCache::Translate(dx, dy, dz));
+        }
+
+        virtual RtVoid Rotate(RtFloat angle, RtFloat dx, RtFloat dy, RtFloat dz)
+        {
+            m_stream.push_back(new RiCache::Rotate(angle, dx, dy, dz));
+        }
+
+        virtual RtVoid Scale(RtFloat sx, RtFloat sy, RtFloat sz)
+        {
+            m_stream.push_back(new RiCache::Scale(sx, sy, sz));
+        }
+
+        virtual RtVoid Skew(RtFloat angle, RtFloat dx1, RtFloat dy1, RtFloat dz1,
+                    RtFloat dx2, RtFloat dy2, RtFloat dz2)
+        {
+            m_stream.push_back(new RiCache::Skew(angle, dx1, dy1, dz1, dx2, dy2, dz2));
+        }
+
+        virtual RtVoid CoordinateSystem(RtConstToken space)
+        {
+            m_stream.push_back(new RiCache::CoordinateSystem(space));
+        }
+
+        virtual RtVoid CoordSysTransform(RtConstToken space)
+        {
+            m_stream.push_back(new RiCache::CoordSysTransform(space));
+        }
+
+        virtual RtVoid TransformBegin()
+        {
+            m_stream.push_back(new RiCache::TransformBegin());
+        }
+
+        virtual RtVoid TransformEnd()
+        {
+            m_stream.push_back(new RiCache::TransformEnd());
+        }
+
+        virtual RtVoid Resource(RtConstToken handle, RtConstToken type,
+                    const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Resource(handle, type, pList));
+        }
+
+        virtual RtVoid ResourceBegin()
+        {
+            m_stream.push_back(new RiCache::ResourceBegin());
+        }
+
+        virtual RtVoid ResourceEnd()
+        {
+            m_stream.push_back(new RiCache::ResourceEnd());
+        }
+
+        virtual RtVoid Attribute(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Attribute(name, pList));
+        }
+
+        virtual RtVoid Polygon(const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Polygon(pList));
+        }
+
+        virtual RtVoid GeneralPolygon(const IntArray& nverts, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::GeneralPolygon(nverts, pList));
+        }
+
+        virtual RtVoid PointsPolygons(const IntArray& nverts, const IntArray& verts,
+                    const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::PointsPolygons(nverts, verts, pList));
+        }
+
+        virtual RtVoid PointsGeneralPolygons(const IntArray& nloops,
+                    const IntArray& nverts, const IntArray& verts,
+                    const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::PointsGeneralPolygons(nloops, nverts, verts, pList));
+        }
+
+        virtual RtVoid Basis(RtConstBasis ubasis, RtInt ustep, RtConstBasis vbasis,
+                    RtInt vstep)
+        {
+            m_stream.push_back(new RiCache::Basis(ubasis, ustep, vbasis, vstep));
+        }
+
+        virtual RtVoid Patch(RtConstToken type, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Patch(type, pList));
+        }
+
+        virtual RtVoid PatchMesh(RtConstToken type, RtInt nu, RtConstToken uwrap,
+                    RtInt nv, RtConstToken vwrap,
+                    const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::PatchMesh(type, nu, uwrap, nv, vwrap, pList));
+        }
+
+        virtual RtVoid NuPatch(RtInt nu, RtInt uorder, const FloatArray& uknot,
+                    RtFloat umin, RtFloat umax, RtInt nv, RtInt vorder,
+                    const FloatArray& vknot, RtFloat vmin, RtFloat vmax,
+                    const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::NuPatch(nu, uorder, uknot, umin, umax, nv, vorder, vknot, vmin, vmax, pList));
+        }
+
+        virtual RtVoid TrimCurve(const IntArray& ncurves, const IntArray& order,
+                    const FloatArray& knot, const FloatArray& min,
+                    const FloatArray& max, const IntArray& n,
+                    const FloatArray& u, const FloatArray& v,
+                    const FloatArray& w)
+        {
+            m_stream.push_back(new RiCache::TrimCurve(ncurves, order, knot, min, max, n, u, v, w));
+        }
+
+        virtual RtVoid SubdivisionMesh(RtConstToken scheme, const IntArray& nvertices,
+                    const IntArray& vertices, const TokenArray& tags,
+                    const IntArray& nargs, const IntArray& intargs,
+                    const FloatArray& floatargs,
+                    const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::SubdivisionMesh(scheme, nvertices, vertices, tags, nargs, intargs, floatargs, pList));
+        }
+
+        virtual RtVoid Sphere(RtFloat radius, RtFloat zmin, RtFloat zmax,
+                    RtFloat thetamax, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Sphere(radius, zmin, zmax, thetamax, pList));
+        }
+
+        virtual RtVoid Cone(RtFloat height, RtFloat radius, RtFloat thetamax,
+                    const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Cone(height, radius, thetamax, pList));
+        }
+
+        virtual RtVoid Cylinder(RtFloat radius, RtFloat zmin, RtFloat zmax,
+                    RtFloat thetamax, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Cylinder(radius, zmin, zmax, thetamax, pList));
+        }
+
+        virtual RtVoid Hyperboloid(RtConstPoint point1, RtConstPoint point2,
+                    RtFloat thetamax, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Hyperboloid(point1, point2, thetamax, pList));
+        }
+
+        virtual RtVoid Paraboloid(RtFloat rmax, RtFloat zmin, RtFloat zmax,
+                    RtFloat thetamax, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Paraboloid(rmax, zmin, zmax, thetamax, pList));
+        }
+
+        virtual RtVoid Disk(RtFloat height, RtFloat radius, RtFloat thetamax,
+                    const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Disk(height, radius, thetamax, pList));
+        }
+
+        virtual RtVoid Torus(RtFloat majorrad, RtFloat minorrad, RtFloat phimin,
+                    RtFloat phimax, RtFloat thetamax,
+                    const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Torus(majorrad, minorrad, phimin, phimax, thetamax, pList));
+        }
+
+        virtual RtVoid Points(const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Points(pList));
+        }
+
+        virtual RtVoid Curves(RtConstToken type, const IntArray& nvertices,
+                    RtConstToken wrap, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Curves(type, nvertices, wrap, pList));
+        }
+
+        virtual RtVoid Blobby(RtInt nleaf, const IntArray& code,
+                    const FloatArray& floats, const TokenArray& strings,
+                    const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Blobby(nleaf, code, floats, strings, pList));
+        }
+
+        virtual RtVoid Procedural(RtPointer data, RtConstBound bound,
+                    RtProcSubdivFunc refineproc,
+                    RtProcFreeFunc freeproc)
+        {
+            m_stream.push_back(new RiCache::Procedural(data, bound, refineproc, freeproc));
+        }
+
+        virtual RtVoid Geometry(RtConstToken type, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::Geometry(type, pList));
+        }
+
+        virtual RtVoid SolidBegin(RtConstToken type)
+        {
+            m_stream.push_back(new RiCache::SolidBegin(type));
+        }
+
+        virtual RtVoid SolidEnd()
+        {
+            m_stream.push_back(new RiCache::SolidEnd());
+        }
+
+        virtual RtVoid ObjectBegin(RtConstToken name)
+        {
+            m_stream.push_back(new RiCache::ObjectBegin(name));
+        }
+
+        virtual RtVoid ObjectEnd()
+        {
+            m_stream.push_back(new RiCache::ObjectEnd());
+        }
+
+        virtual RtVoid ObjectInstance(RtConstToken name)
+        {
+            m_stream.push_back(new RiCache::ObjectInstance(name));
+        }
+
+        virtual RtVoid MotionBegin(const FloatArray& times)
+        {
+            m_stream.push_back(new RiCache::MotionBegin(times));
+        }
+
+        virtual RtVoid MotionEnd()
+        {
+            m_stream.push_back(new RiCache::MotionEnd());
+        }
+
+        virtual RtVoid MakeTexture(RtConstString imagefile, RtConstString texturefile,
+                    RtConstToken swrap, RtConstToken twrap,
+                    RtFilterFunc filterfunc, RtFloat swidth,
+                    RtFloat twidth, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::MakeTexture(imagefile, texturefile, swrap, twrap, filterfunc, swidth, twidth, pList));
+        }
+
+        virtual RtVoid MakeLatLongEnvironment(RtConstString imagefile,
+                    RtConstString reflfile, RtFilterFunc filterfunc,
+                    RtFloat swidth, RtFloat twidth,
+                    const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::MakeLatLongEnvironment(imagefile, reflfile, filterfunc, swidth, twidth, pList));
+        }
+
+        virtual RtVoid MakeCubeFaceEnvironment(RtConstString px, RtConstString nx,
+                    RtConstString py, RtConstString ny,
+                    RtConstString pz, RtConstString nz,
+                    RtConstString reflfile, RtFloat fov,
+                    RtFilterFunc filterfunc, RtFloat swidth,
+                    RtFloat twidth, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::MakeCubeFaceEnvironment(px, nx, py, ny, pz, nz, reflfile, fov, filterfunc, swidth, twidth, pList));
+        }
+
+        virtual RtVoid MakeShadow(RtConstString picfile, RtConstString shadowfile,
+                    const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::MakeShadow(picfile, shadowfile, pList));
+        }
+
+        virtual RtVoid MakeOcclusion(const StringArray& picfiles,
+                    RtConstString shadowfile, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::MakeOcclusion(picfiles, shadowfile, pList));
+        }
+
+        virtual RtVoid ErrorHandler(RtErrorFunc handler)
+        {
+            m_stream.push_back(new RiCache::ErrorHandler(handler));
+        }
+
+        virtual RtVoid ReadArchive(RtConstToken name, RtArchiveCallback callback,
+                    const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::ReadArchive(name, callback, pList));
+        }
+
+        virtual RtVoid ArchiveBegin(RtConstToken name, const ParamList& pList)
+        {
+            m_stream.push_back(new RiCache::ArchiveBegin(name, pList));
+        }
+
+        virtual RtVoid ArchiveEnd()
+        {
+            m_stream.push_back(new RiCache::ArchiveEnd());
+        }
+        //[[[end]]]
+
+    protected:
+        CachedRiStream& m_stream;
+};
+
 } // namespace Aqsis
 
 #endif // AQSIS_API_CACHE_H_INCLUDED
@@ -0,0 +1,120 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ * \brief Unit tests for in-memory caching of interface calls.
+ */
+
+#include "ricxx_cache.h"
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include <aqsis/riutil/ricxxutil.h>
+
+using namespace Aqsis;
+
+namespace {
+
+// Renderer counting the spheres it sees.
+class SphereCounter : public StubRenderer
+{
+    public:
+        int count;
+        SphereCounter() : count(0) {}
+        virtual RtVoid Sphere(RtFloat radius, RtFloat zmin, RtFloat zmax,
+                              RtFloat thetamax, const ParamList& pList)
+        {
+            ++count;
+        }
+};
+
+void addSpheres(CachedRiStream& stream, int count)
+{
+    for(int i = 0; i < count; ++i)
+        stream.push_back(new RiCache::Sphere(1, -1, 1, 360, Ri::ParamList()));
+}
+
+} // anon. namespace
+
+
+BOOST_AUTO_TEST_SUITE(ricxx_cache_tests)
+
+BOOST_AUTO_TEST_CASE(CachedStreamTable_lookup_test)
+{
+    CachedStreamTable table;
+    BOOST_CHECK(!table.find("a"));
+    CachedRiStream& a = table.define("a");
+    CachedRiStream& b = table.define("b");
+    BOOST_CHECK_EQUAL(table.find("a"), &a);
+    BOOST_CHECK_EQUAL(table.find("b"), &b);
+    BOOST_CHECK_EQUAL(table.find("b")->name(), "b");
+    BOOST_CHECK_EQUAL(table.size(), 2);
+
+    // Redefining a stream replaces the old one.
+    addSpheres(a, 2);
+    addSpheres(table.define("a"), 1);
+    SphereCounter counter;
+    table.find("a")->replay(counter);
+    BOOST_CHECK_EQUAL(counter.count, 1);
+    BOOST_CHECK_EQUAL(table.size(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(CachedStreamTable_memory_test)
+{
+    CachedStreamTable table;
+    CachedRiStream& stream = table.define("a");
+    size_t emptySize = table.memoryUsage();
+    addSpheres(stream, 10);
+    size_t smallSize = table.memoryUsage();
+    BOOST_CHECK_GT(smallSize, emptySize);
+
+    // Parameter data should be accounted for.
+    std::vector<RtFloat> P(3000, 0.0f);
+    Ri::Param param(Ri::TypeSpec(Ri::TypeSpec::Vertex, Ri::TypeSpec::Point),
+                    "P", &P[0], P.size());
+    stream.push_back(new RiCache::Points(Ri::ParamList(&param, 1)));
+    BOOST_CHECK_GE(table.memoryUsage(), smallSize + P.size()*sizeof(RtFloat));
+}
+
+BOOST_AUTO_TEST_CASE(CachedRiStreamRecorder_test)
+{
+    CachedRiStream stream("a");
+    CachedRiStreamRecorder recorder(stream);
+    recorder.Sphere(1, -1, 1, 360, Ri::ParamList());
+    recorder.ArchiveRecord("comment", "not recorded");
+    recorder.Sphere(1, -1, 1, 360, Ri::ParamList());
+    SphereCounter counter;
+    stream.replay(counter);
+    BOOST_CHECK_EQUAL(counter.count, 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -148,7 +148,9 @@ const CqPrimvarToken standardVarsInit[] = {
 	CqPrimvarToken(class_uniform,  type_integer, 1, "texturememory"),
 	CqPrimvarToken(class_uniform,  type_integer, 2, "bucketsize"),
 	CqPrimvarToken(class_uniform,  type_integer, 1, "eyesplits"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "geometrymemory"),
 	CqPrimvarToken(class_uniform,  type_color,   1, "zthreshold"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "archivethreads"),
 	// Option "searchpath"
 	CqPrimvarToken(class_uniform,  type_string,  1, "shader"),
 	CqPrimvarToken(class_uniform,  type_string,  1, "archive"),
@@ -186,6 +188,10 @@ const CqPrimvarToken standardVarsInit[] = {
 	// Hider
 	CqPrimvarToken(class_uniform,  type_integer, 1, "jitter"),
 	CqPrimvarToken(class_uniform,  type_string,  1, "depthfilter"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "interleavedtime"),
+	CqPrimvarToken(class_uniform,  type_integer, 2, "adaptivesamples"),
+	CqPrimvarToken(class_uniform,  type_float,   1, "adaptivethreshold"),
+	CqPrimvarToken(class_uniform,  type_float,   1, "adaptivecontrast"),
 	// Attribute "dice"
 	CqPrimvarToken(class_uniform,  type_integer, 1, "binary"),
 	// Attribute "mpdump"
@@ -200,8 +206,17 @@ const CqPrimvarToken standardVarsInit[] = {
 	CqPrimvarToken(class_uniform,  type_integer, 1, "res"),
 	// Attribute "Render"
 	CqPrimvarToken(class_uniform,  type_integer, 1, "multipass"),
+	// Option "render"
+	CqPrimvarToken(class_uniform,  type_string,  1, "archivecache"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "ipr"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "progressive"),
 	// Attribute "aqsis"
 	CqPrimvarToken(class_uniform,  type_float,   1, "expandgrids"),
+	// Attribute "light"
+	CqPrimvarToken(class_uniform,  type_integer, 1, "cache"),
+	CqPrimvarToken(class_uniform,  type_float,   1, "cachetolerance"),
+	// Option "shadow"
+	CqPrimvarToken(class_uniform,  type_integer, 1, "prefetch"),
 
 	//--------------------------------------------------
 	// Extra options not used by aqsis, but apparently commonly exported in RIB files.
@@ -25,80 +25,73 @@
 
 
 #include	<stdio.h>
+#include	<cstring>
 
 #include	"shaderexecenv.h"
 #include	<aqsis/math/vectorcast.h>
+#include	<aqsis/util/autobuffer.h>
 
 namespace Aqsis {
 
 
-void	CqShaderExecEnv::SO_frandom( IqShaderData* Result, IqShader* pShader )
+CqRandom& CqShaderExecEnv::gridRandom()
 {
-	bool __fVarying;
-	TqUint __iGrid;
-
-	__fVarying=(Result)->Class()==class_varying;
-
-	__iGrid = 0;
-	const CqBitVector& RS = RunningState();
-	do
+	if(!m_randomSeeded)
 	{
-		if(!__fVarying || RS.Value( __iGrid ) )
+		// Hash the bits of the first shading point position together with
+		// the size of the grid.
+		TqUint seed = shadingPointCount();
+		TqUint stream = 0;
+		if(IqShaderData* pP = P())
 		{
-			(Result)->SetFloat(m_random.RandomFloat(),__iGrid);
+			CqVector3D P0;
+			pP->GetPoint(P0, 0);
+			TqFloat xyz[3] = {P0.x(), P0.y(), P0.z()};
+			TqUint bits[3];
+			std::memcpy(bits, xyz, sizeof(bits));
+			seed ^= bits[0] * 2654435761U;
+			stream = bits[1] ^ (bits[2] * 2246822519U);
 		}
+		m_random.Reseed(seed, stream);
+		m_randomSeeded = true;
 	}
-	while( ( ++__iGrid < shadingPointCount() ) && __fVarying);
+	return m_random;
 }
 
-void	CqShaderExecEnv::SO_crandom( IqShaderData* Result, IqShader* pShader )
-{
-	bool __fVarying;
-	TqUint __iGrid;
-
-	__fVarying=(Result)->Class()==class_varying;
+/** Generate random values for all running shading points, each getting
+ * NumComponents consecutive values from the grid's random stream.
+ */
+#define	GEN_RANDOM(NumComponents, SetValue)	\
+	bool __fVarying = (Result)->Class()==class_varying; \
+	TqInt __count = __fVarying ? shadingPointCount() : 1; \
+	CqAutoBuffer<TqFloat, 3*256> __values(NumComponents*__count); \
+	gridRandom().RandomFloats(__values.get(), NumComponents*__count); \
+	const CqBitVector& RS = RunningState(); \
+	for(TqInt __iGrid = 0; __iGrid < __count; ++__iGrid) \
+	{ \
+		if(!__fVarying || RS.Value( __iGrid ) ) \
+		{ \
+			const TqFloat* r = &__values[NumComponents*__iGrid]; \
+			SetValue; \
+		} \
+	}
 
-	__iGrid = 0;
-	const CqBitVector& RS = RunningState();
-	do
-	{
-		if(!__fVarying || RS.Value( __iGrid ) )
-		{
-			TqFloat a, b, c;
-			a = m_random.RandomFloat();
-			b = m_random.RandomFloat();
-			c = m_random.RandomFloat();
+void	CqShaderExecEnv::SO_frandom( IqShaderData* Result, IqShader* pShader )
+{
+	GEN_RANDOM(1, (Result)->SetFloat(r[0],__iGrid))
+}
 
-			(Result)->SetColor(CqColor(a,b,c),__iGrid);
-		}
-	}
-	while( ( ++__iGrid < shadingPointCount() ) && __fVarying);
+void	CqShaderExecEnv::SO_crandom( IqShaderData* Result, IqShader* pShader )
+{
+	GEN_RANDOM(3, (Result)->SetColor(CqColor(r[0],r[1],r[2]),__iGrid))
 }
 
 void	CqShaderExecEnv::SO_prandom( IqShaderData* Result, IqShader* pShader )
 {
-	bool __fVarying;
-	TqUint __iGrid;
-
-	__fVarying=(Result)->Class()==class_varying;
-
-	__iGrid = 0;
-	const CqBitVector& RS = RunningState();
-	do
-	{
-		if(!__fVarying || RS.Value( __iGrid ) )
-		{
-			TqFloat a, b, c;
-			a = m_random.RandomFloat();
-			b = m_random.RandomFloat();
-			c = m_random.RandomFloat();
-
-			(Result)->SetPoint(CqVector3D(a,b,c),__iGrid);
-		}
-	}
-	while( ( ++__iGrid < shadingPointCount() ) && __fVarying);
+	GEN_RANDOM(3, (Result)->SetPoint(CqVector3D(r[0],r[1],r[2]),__iGrid))
 }
 
+#undef GEN_RANDOM
 
 //----------------------------------------------------------------------
 // noise(v)
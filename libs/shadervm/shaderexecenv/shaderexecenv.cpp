@@ -39,7 +39,6 @@ boost::shared_ptr<IqShaderExecEnv> IqShaderExecEnv::create(IqRenderer* context)
 
 CqNoise	CqShaderExecEnv::m_noise;
 CqCellNoise	CqShaderExecEnv::m_cellnoise;
-CqRandom	CqShaderExecEnv::m_random;
 CqMatrix	CqShaderExecEnv::m_matIdentity;
 
 const char*	gVariableNames[ EnvVars_Last ] =
@@ -145,7 +144,9 @@ CqShaderExecEnv::CqShaderExecEnv(IqRenderer* pRenderContext)
 	m_stkState(),
 	m_pRenderContext(pRenderContext),
 	m_LocalIndex(0),
-	m_pCurrentSurface(0)
+	m_pCurrentSurface(0),
+	m_random(),
+	m_randomSeeded(false)
 { }
 
 
@@ -189,6 +190,7 @@ void CqShaderExecEnv::Initialise( const TqInt uGridRes, const TqInt vGridRes,
 	m_li = 0;
 	m_Illuminate = 0;
 	m_IlluminanceCacheValid = false;
+	m_randomSeeded = false;
 
 	// Initialise the state bitvectors
 	m_CurrentState.SetSize( m_shadingPointCount );
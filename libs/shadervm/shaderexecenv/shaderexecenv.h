@@ -383,6 +383,14 @@ class AQSIS_SHADERVM_SHARE CqShaderExecEnv : public IqShaderExecEnv, boost::nonc
 								 IqShaderData* result, int cParams,
 								 IqShaderData** apParams, IqShader* pShader);
 
+		/** \brief Get the random number stream for the current grid.
+		 *
+		 * The stream is seeded from the first shading point of the grid, so
+		 * the numbers used by random() don't depend on which thread shades
+		 * the grid or on what was shaded before it.
+		 */
+		CqRandom&	gridRandom();
+
 		/// Turn 1D iteration into 2D grid indices
 		///
 		/// u is the fast changing index; v is slow changing.
@@ -421,7 +429,6 @@ class AQSIS_SHADERVM_SHARE CqShaderExecEnv : public IqShaderExecEnv, boost::nonc
 		};
 		static	CqNoise	m_noise;		///< One off noise generator, used by all envs.
 		static	CqCellNoise	m_cellnoise;	///< One off cell noise generator, used by all envs.
-		static	CqRandom	m_random;		///< One off random number generator used by all envs.
 		static	CqMatrix	m_matIdentity;
 
 		TqInt	m_uGridRes;				///< The resolution of the grid in u.
@@ -447,6 +454,9 @@ class AQSIS_SHADERVM_SHARE CqShaderExecEnv : public IqShaderExecEnv, boost::nonc
 
 		CqGridDiff m_diff;
 
+		CqRandom	m_random;			///< Random number stream for the current grid.
+		bool	m_randomSeeded;			///< Has m_random been seeded for the current grid?
+
 	public:
 
 		virtual	bool	SO_init_illuminance();
@@ -323,6 +323,50 @@ class AQSIS_SHADERVM_SHARE CqShaderStack
 		 */
 		static void Statistics();
 
+		/** Delete the pools of temporary variables kept for every thread.
+		 */
+		static void DeleteTempPools();
+
+		/** \brief Pools of temporary variables for reuse by GetNextTemp().
+		 *
+		 * Each shading thread has its own set of pools so that shaders can be
+		 * executed concurrently.  The pools of a thread which has finished
+		 * are kept for the next thread to start up.
+		 */
+		struct SqTempPools
+		{
+			std::deque<CqShaderVariableUniformFloat*>				m_UFPool;
+			// Integer
+			std::deque<CqShaderVariableUniformPoint*>				m_UPPool;
+			std::deque<CqShaderVariableUniformString*>			m_USPool;
+			std::deque<CqShaderVariableUniformColor*>				m_UCPool;
+			// Triple
+			// hPoint
+			std::deque<CqShaderVariableUniformNormal*>			m_UNPool;
+			std::deque<CqShaderVariableUniformVector*>			m_UVPool;
+			// Void
+			std::deque<CqShaderVariableUniformMatrix*>			m_UMPool;
+			// SixteenTuple
+
+			std::deque<CqShaderVariableVaryingFloat*>				m_VFPool;
+			// Integer
+			std::deque<CqShaderVariableVaryingPoint*>				m_VPPool;
+			std::deque<CqShaderVariableVaryingString*>			m_VSPool;
+			std::deque<CqShaderVariableVaryingColor*>				m_VCPool;
+			// Triple
+			// hPoint
+			std::deque<CqShaderVariableVaryingNormal*>			m_VNPool;
+			std::deque<CqShaderVariableVaryingVector*>			m_VVPool;
+			// Void
+			std::deque<CqShaderVariableVaryingMatrix*>			m_VMPool;
+			// SixteenTuple
+
+			/// Delete all the pooled variables.
+			~SqTempPools();
+		};
+		/// Get the temporary variable pools for the calling thread.
+		static SqTempPools& tempPools();
+
 		/** set the more efficient number of samples per type of variable at run-time.
 		 */
 		static void	SetSamples(TqInt n)
@@ -334,32 +378,6 @@ class AQSIS_SHADERVM_SHARE CqShaderStack
 		std::vector<SqStackEntry>	m_Stack;
 		TqUint	m_iTop;										///< Index of the top entry.
 
-		static std::deque<CqShaderVariableUniformFloat*>				m_UFPool;
-		// Integer
-		static std::deque<CqShaderVariableUniformPoint*>				m_UPPool;
-		static std::deque<CqShaderVariableUniformString*>			m_USPool;
-		static std::deque<CqShaderVariableUniformColor*>				m_UCPool;
-		// Triple
-		// hPoint
-		static std::deque<CqShaderVariableUniformNormal*>			m_UNPool;
-		static std::deque<CqShaderVariableUniformVector*>			m_UVPool;
-		// Void
-		static std::deque<CqShaderVariableUniformMatrix*>			m_UMPool;
-		// SixteenTuple
-
-		static std::deque<CqShaderVariableVaryingFloat*>				m_VFPool;
-		// Integer
-		static std::deque<CqShaderVariableVaryingPoint*>				m_VPPool;
-		static std::deque<CqShaderVariableVaryingString*>			m_VSPool;
-		static std::deque<CqShaderVariableVaryingColor*>				m_VCPool;
-		// Triple
-		// hPoint
-		static std::deque<CqShaderVariableVaryingNormal*>			m_VNPool;
-		static std::deque<CqShaderVariableVaryingVector*>			m_VVPool;
-		// Void
-		static std::deque<CqShaderVariableVaryingMatrix*>			m_VMPool;
-		// SixteenTuple
-
 		static TqUint    m_samples; // by default == 18 see shaderstack.cpp
 		static TqUint    m_maxsamples;
 }
@@ -25,7 +25,9 @@
 
 #include "shadervm.h"
 
+#include <algorithm>
 #include <cstring>
+#include <ctime>
 #include <ctype.h>
 #include <iostream>
 #include <sstream>
@@ -64,6 +66,47 @@ void shutdownShaderVM()
 	CqShaderVM::ShutdownShaderEngine();
 }
 
+namespace {
+
+boost::mutex g_statsMutex;
+SqShaderVMStats g_stats = { 0, 0, 0, 0, 0, 0, 0, 0.0 };
+
+template<typename T>
+void updateStats(T SqShaderVMStats::* counter, T n)
+{
+	boost::mutex::scoped_lock lock(g_statsMutex);
+	g_stats.*counter += n;
+}
+
+} // unnamed namespace
+
+SqShaderVMStats shaderVMStatistics()
+{
+	boost::mutex::scoped_lock lock(g_statsMutex);
+	return g_stats;
+}
+
+//------------------------------------------------------------------------------
+SqShaderProgram::~SqShaderProgram()
+{
+	// Delete strings used by the program
+	for ( std::list<CqString*>::iterator i = m_ProgramStrings.begin();
+			i != m_ProgramStrings.end(); i++ )
+	{
+		delete *i;
+	}
+}
+
+TqInt SqShaderProgram::memoryUsage() const
+{
+	TqInt size = sizeof(SqShaderProgram)
+		+ (m_ProgramInit.capacity() + m_Program.capacity()) * sizeof(UsProgramElement);
+	for ( std::list<CqString*>::const_iterator i = m_ProgramStrings.begin();
+			i != m_ProgramStrings.end(); i++ )
+		size += sizeof(CqString) + (*i)->capacity();
+	return size;
+}
+
 //------------------------------------------------------------------------------
 
 /*
@@ -490,6 +533,7 @@ static const TqUlong uhash = CqString::hash("uniform");
 static const TqUlong ushash = CqString::hash("USES");
 static const TqUlong ehash = CqString::hash("external");
 static const TqUlong ohash = CqString::hash("output");
+static const TqUlong uehash = CqString::hash("uniform_end");
 
 
 CqShaderVM::CqShaderVM(IqRenderer* pRenderContext)
@@ -503,9 +547,12 @@ CqShaderVM::CqShaderVM(IqRenderer* pRenderContext)
 	m_LocalVars(),
 	m_InstancedParams(),
 	m_StoredArguments(),
-	m_ProgramInit(),
-	m_Program(),
-	m_ProgramStrings(),
+	m_pProgram(new SqShaderProgram()),
+	m_fArgumentsBound(false),
+	m_pUniformAttributes(),
+	m_pUniformTransform(),
+	m_UniformCache(),
+	m_parameterVersion(0),
 	m_uGridRes(0),
 	m_vGridRes(0),
 	m_shadingPointCount(0),
@@ -514,8 +561,13 @@ CqShaderVM::CqShaderVM(IqRenderer* pRenderContext)
 	m_PE(0),
 	m_fAmbient(true),
 	m_outsideWorld(false),
-	m_pRenderContext(pRenderContext)
+	m_pRenderContext(pRenderContext),
+	m_pInstance(0),
+	m_ownerThread(boost::this_thread::get_id()),
+	m_contextPool(new SqContextPool()),
+	m_threadContexts(&CqShaderVM::releaseContext)
 {
+	updateStats(&SqShaderVMStats::instances, 1);
 	// Find out if this shader is being declared outside the world construct. If so
 	// if is effectively being defined in 'camera' space, which will affect the
 	// transformation of parameters. Should only affect lightsource shaders as these
@@ -536,9 +588,12 @@ CqShaderVM::CqShaderVM(const CqShaderVM& From)
 	m_pTransform(),
 	m_LocalVars(),
 	m_StoredArguments(),
-	m_ProgramInit(),
-	m_Program(),
-	m_ProgramStrings(),
+	m_pProgram(),
+	m_fArgumentsBound(false),
+	m_pUniformAttributes(),
+	m_pUniformTransform(),
+	m_UniformCache(),
+	m_parameterVersion(0),
 	m_uGridRes(0),
 	m_vGridRes(0),
 	m_shadingPointCount(0),
@@ -547,9 +602,15 @@ CqShaderVM::CqShaderVM(const CqShaderVM& From)
 	m_PE(0),
 	m_fAmbient(true),
 	m_outsideWorld(false),
-	m_pRenderContext(0)
+	m_pRenderContext(0),
+	m_pInstance(0),
+	m_ownerThread(boost::this_thread::get_id()),
+	m_contextPool(new SqContextPool()),
+	m_threadContexts(&CqShaderVM::releaseContext)
 {
 	*this = From;
+	updateStats(&SqShaderVMStats::instances, 1);
+	updateStats(&SqShaderVMStats::sharedBytes, m_pProgram->memoryUsage());
 	// Find out if this shader is being declared outside the world construct. If so
 	// if is effectively being defined in 'camera' space, which will affect the
 	// transformation of parameters. Should only affect lightsource shaders as these
@@ -562,23 +623,36 @@ CqShaderVM::CqShaderVM(const CqShaderVM& From)
 
 CqShaderVM::~CqShaderVM()
 {
+	// Delete the free execution contexts.  Those still held by a thread are
+	// deleted by releaseContext() when the thread exits.
+	if(!m_pInstance)
+	{
+		std::vector<CqShaderVM*> freeContexts;
+		{
+			boost::mutex::scoped_lock lock(m_contextPool->m_contextMutex);
+			m_contextPool->m_fInstanceAlive = false;
+			freeContexts.swap(m_contextPool->m_freeContexts);
+		}
+		for(std::vector<CqShaderVM*>::iterator i = freeContexts.begin();
+				i != freeContexts.end(); ++i)
+			delete *i;
+	}
+	ClearUniformCache();
 	// Delete the local variables.
 	for ( std::vector<IqShaderData*>::iterator i = m_LocalVars.begin(); i != m_LocalVars.end(); i++ )
 	{
 		delete *i;
 	}
 	// Delete the cached instance params (note that every second one is the
-	// corresponding local var)
-	for( std::vector<IqShaderData*>::iterator i = m_InstancedParams.begin();
-		 i < m_InstancedParams.end(); i+=2 )
+	// corresponding local var).  Execution contexts share those of the
+	// instance.
+	if(!m_pInstance)
 	{
-		delete *i;
-	}
-	// Delete strings used by the program
-	for ( std::list<CqString*>::iterator i = m_ProgramStrings.begin();
-			i != m_ProgramStrings.end(); i++ )
-	{
-		delete *i;
+		for( std::vector<IqShaderData*>::iterator i = m_InstancedParams.begin();
+			 i < m_InstancedParams.end(); i+=2 )
+		{
+			delete *i;
+		}
 	}
 	// Delete stored shader arguments
 	for(std::vector<SqArgumentRecord>::iterator i = m_StoredArguments.begin();
@@ -1011,13 +1085,13 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 			else if ( ihash == htoken) // == "Init"
 			{
 				Segment = Seg_Init;
-				pProgramArea = &m_ProgramInit;
+				pProgramArea = &m_pProgram->m_ProgramInit;
 				aLabels.clear();
 			}
 			else if (chash == htoken ) // == "Code"
 			{
 				Segment = Seg_Code;
-				pProgramArea = &m_Program;
+				pProgramArea = &m_pProgram->m_Program;
 				aLabels.clear();
 			}
 		}
@@ -1081,6 +1155,12 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 
 				case Seg_Init:
 				case Seg_Code:
+					// Check if it is the end of the uniform code.
+					if ( Segment == Seg_Code && uehash == htoken )
+					{
+						m_pProgram->m_UniformEnd = pProgramArea->size();
+						break;
+					}
 					// Check if it is a label
 					if ( strcmp( token, ":" ) == 0 )
 					{
@@ -1316,10 +1396,11 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 		( *pFile ) >> std::ws;
 	}
 	// Now we need to complete any label jump statements.
+	std::vector<UsProgramElement>& program = m_pProgram->m_Program;
 	i = 0;
-	while ( i < m_Program.size() )
+	while ( i < program.size() )
 	{
-		UsProgramElement E = m_Program[ i++ ]
+		UsProgramElement E = program[ i++ ]
 		                     ;
 		if ( E.m_Command == &CqShaderVM::SO_jnz ||
 		        E.m_Command == &CqShaderVM::SO_jmp ||
@@ -1328,9 +1409,9 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 		        E.m_Command == &CqShaderVM::SO_S_JZ)
 		{
 			SqLabel lab;
-			lab.m_Offset = aLabels[ static_cast<unsigned int>( m_Program[ i ].m_FloatVal ) ];
-			lab.m_pAddress = &m_Program[ lab.m_Offset ];
-			m_Program[ i ].m_Label = lab;
+			lab.m_Offset = aLabels[ static_cast<unsigned int>( program[ i ].m_FloatVal ) ];
+			lab.m_pAddress = &program[ lab.m_Offset ];
+			program[ i ].m_Label = lab;
 			i++;
 		}
 		else
@@ -1347,6 +1428,41 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 			}
 		}
 	}
+
+	// Find the local variables used by the uniform code, so that their values
+	// can be cached.
+	i = 0;
+	while ( i < static_cast<TqUlong>( m_pProgram->m_UniformEnd ) )
+	{
+		UsProgramElement E = program[ i++ ];
+		TqInt j;
+		for ( j = 0; j < m_cTransSize; j++ )
+		{
+			if ( m_TransTable[ j ].m_pCommand == E.m_Command )
+				break;
+		}
+		if ( j == m_cTransSize )
+			continue;
+		for ( TqInt p = 0; p < m_TransTable[ j ].m_cParams; p++, i++ )
+		{
+			if ( m_TransTable[ j ].m_aParamTypes[ p ] != type_invalid )
+				continue;
+			TqInt iVar = program[ i ].m_iVariable;
+			if ( iVar & 0x8000 || m_LocalVars[ iVar ]->Class() != class_uniform )
+			{
+				// Only uniform locals can be cached, don't trust the mark.
+				m_pProgram->m_UniformEnd = 0;
+				m_pProgram->m_UniformVars.clear();
+				break;
+			}
+			if ( std::find( m_pProgram->m_UniformVars.begin(), m_pProgram->m_UniformVars.end(), iVar )
+			        == m_pProgram->m_UniformVars.end() )
+				m_pProgram->m_UniformVars.push_back( iVar );
+		}
+	}
+
+	updateStats(&SqShaderVMStats::programs, 1);
+	updateStats(&SqShaderVMStats::programBytes, m_pProgram->memoryUsage());
 }
 
 CqString CqShaderVM::GetString(std::istream* pFile)
@@ -1476,8 +1592,20 @@ void CqShaderVM::GetNumericEscapeChar(std::istream* pFile, CqString &s, char c)
 */
 
 void CqShaderVM::Initialise( const TqInt uGridRes, const TqInt vGridRes, TqInt shadingPointCount, IqShaderExecEnv* pEnv )
+{
+	ExecutionContext()->InitialiseState( uGridRes, vGridRes, shadingPointCount, pEnv );
+}
+
+void CqShaderVM::InitialiseState( const TqInt uGridRes, const TqInt vGridRes, TqInt shadingPointCount, IqShaderExecEnv* pEnv )
 {
 	m_pEnv = pEnv;
+	// The uniform results of an execution context are stale if the
+	// parameters of the instance were edited since they were computed.
+	if ( m_pInstance && m_parameterVersion != m_pInstance->m_parameterVersion )
+	{
+		ClearUniformCache();
+		m_parameterVersion = m_pInstance->m_parameterVersion;
+	}
 	// Initialise local variables.
 	TqInt i;
 	for ( i = m_LocalVars.size() - 1; i >= 0;
@@ -1495,6 +1623,7 @@ void CqShaderVM::Initialise( const TqInt uGridRes, const TqInt vGridRes, TqInt s
 	m_uGridRes = uGridRes;
 	m_vGridRes = vGridRes;
 	m_shadingPointCount = shadingPointCount;
+	m_fArgumentsBound = false;
 
 	// Reset the program counter.
 	m_PC = 0;
@@ -1519,34 +1648,129 @@ CqShaderVM&	CqShaderVM::operator=( const CqShaderVM& From )
 	for ( i = From.m_LocalVars.begin(); i != From.m_LocalVars.end(); i++ )
 		m_LocalVars.push_back( ( *i ) ->Clone() );
 
-	// Copy the intialisation program.
-	m_ProgramInit.assign(From.m_ProgramInit.begin(), From.m_ProgramInit.end());
-
-	// Copy the main program.
-	m_Program.assign(From.m_Program.begin(), From.m_Program.end());
+	// Share the program.
+	m_pProgram = From.m_pProgram;
 
 	return ( *this );
 }
 
 
+//---------------------------------------------------------------------
+/**	Create an execution context for the given shader instance.
+*/
+
+CqShaderVM::CqShaderVM(CqShaderVM* pInstance)
+	: CqShaderStack(),
+	m_Uses(0),
+	m_strName(),
+	m_Type(pInstance->m_Type),
+	m_LocalIndex(0),
+	m_pEnv(0),
+	m_pTransform(),
+	m_LocalVars(),
+	m_StoredArguments(),
+	m_pProgram(),
+	m_fArgumentsBound(false),
+	m_pUniformAttributes(),
+	m_pUniformTransform(),
+	m_UniformCache(),
+	m_parameterVersion(pInstance->m_parameterVersion),
+	m_uGridRes(0),
+	m_vGridRes(0),
+	m_shadingPointCount(0),
+	m_PC(0),
+	m_PO(0),
+	m_PE(0),
+	m_fAmbient(true),
+	m_outsideWorld(pInstance->m_outsideWorld),
+	m_pRenderContext(0),
+	m_pInstance(pInstance),
+	m_ownerThread(boost::this_thread::get_id()),
+	m_contextPool(pInstance->m_contextPool),
+	m_threadContexts(&CqShaderVM::releaseContext)
+{
+	*this = *pInstance;
+	// Pair the cached instance parameters of the instance with our own copies
+	// of the corresponding local variables.
+	for( std::vector<IqShaderData*>::const_iterator i = pInstance->m_InstancedParams.begin();
+		 i < pInstance->m_InstancedParams.end(); i+=2 )
+	{
+		std::vector<IqShaderData*>::const_iterator local = std::find(
+				pInstance->m_LocalVars.begin(), pInstance->m_LocalVars.end(), *(i+1) );
+		assert( local != pInstance->m_LocalVars.end() );
+		m_InstancedParams.push_back( *i );
+		m_InstancedParams.push_back( m_LocalVars[ local - pInstance->m_LocalVars.begin() ] );
+	}
+	updateStats(&SqShaderVMStats::contexts, 1);
+}
+
+
+CqShaderVM* CqShaderVM::ExecutionContext() const
+{
+	CqShaderVM* self = const_cast<CqShaderVM*>(this);
+	if( m_pInstance || boost::this_thread::get_id() == m_ownerThread )
+		return self;
+	CqShaderVM* pContext = m_threadContexts.get();
+	// A context from another pool was left behind by a deleted instance
+	// which lived at the same address; reset() below releases it.
+	if( pContext && pContext->m_contextPool == m_contextPool )
+		return pContext;
+	pContext = 0;
+	{
+		boost::mutex::scoped_lock lock(m_contextPool->m_contextMutex);
+		if( !m_contextPool->m_freeContexts.empty() )
+		{
+			pContext = m_contextPool->m_freeContexts.back();
+			m_contextPool->m_freeContexts.pop_back();
+		}
+	}
+	if( !pContext )
+		pContext = new CqShaderVM(self);
+	m_threadContexts.reset(pContext);
+	return pContext;
+}
+
+
+void CqShaderVM::releaseContext(CqShaderVM* pContext)
+{
+	if( !pContext )
+		return;
+	// Keep the pool alive while the context is deleted.
+	boost::shared_ptr<SqContextPool> pool = pContext->m_contextPool;
+	{
+		boost::mutex::scoped_lock lock(pool->m_contextMutex);
+		if( pool->m_fInstanceAlive )
+		{
+			pool->m_freeContexts.push_back(pContext);
+			return;
+		}
+	}
+	delete pContext;
+}
+
+
 //---------------------------------------------------------------------
 /**	Execute a series of shader language bytecodes.
 */
 
 void CqShaderVM::Execute(IqShaderExecEnv* pEnv)
 {
+	std::vector<UsProgramElement>& program = m_pProgram->m_Program;
 	// Check if there is anything to execute.
-	if ( m_Program.size() <= 0 )
+	if ( program.size() <= 0 )
 		return ;
 
 	m_pEnv = pEnv;
 
 	pEnv->InvalidateIlluminanceCache();
 
-	// Execute the main program.
-	m_PC = &m_Program[ 0 ];
+	// Execute the main program, starting from the cached results of the
+	// uniform code if possible.
+	m_PC = &program[ 0 ];
 	m_PO = 0;
-	m_PE = m_Program.size();
+	if ( m_pProgram->m_UniformEnd > 0 )
+		ExecuteUniform( pEnv );
+	m_PE = program.size();
 	UsProgramElement* pE;
 
 	while ( !fDone() )
@@ -1560,14 +1784,79 @@ void CqShaderVM::Execute(IqShaderExecEnv* pEnv)
 }
 
 
+//---------------------------------------------------------------------
+/**	Execute the uniform code at the start of the main program, or restore its
+ * results if they are cached for the current attributes and transform.
+ * Leaves the program counter at the end of the uniform code.
+ */
+
+void CqShaderVM::ExecuteUniform( IqShaderExecEnv* pEnv )
+{
+	const std::vector<TqInt>& vars = m_pProgram->m_UniformVars;
+	// Parameters set from primitive variables may differ from grid to grid.
+	bool fCache = !m_fArgumentsBound;
+	if ( fCache && !m_UniformCache.empty() &&
+	        m_pUniformAttributes == pEnv->pAttributes() &&
+	        m_pUniformTransform == pEnv->pTransform() )
+	{
+		for ( TqUint i = 0; i < vars.size(); ++i )
+			m_LocalVars[ vars[ i ] ]->SetValueFromVariable( m_UniformCache[ i ] );
+		m_PC += m_pProgram->m_UniformEnd;
+		m_PO = m_pProgram->m_UniformEnd;
+		updateStats(&SqShaderVMStats::uniformReused, 1);
+		return;
+	}
+
+	std::clock_t start = std::clock();
+	m_PE = m_pProgram->m_UniformEnd;
+	UsProgramElement* pE;
+	while ( !fDone() )
+	{
+		pE = &ReadNext();
+		( this->*pE->m_Command ) ();
+	}
+	assert( m_iTop == 0 );
+	updateStats(&SqShaderVMStats::uniformEvaluated, 1);
+	updateStats(&SqShaderVMStats::uniformTime,
+			static_cast<double>( std::clock() - start ) / CLOCKS_PER_SEC);
+	if ( !fCache )
+		return;
+
+	if ( m_UniformCache.empty() )
+	{
+		for ( TqUint i = 0; i < vars.size(); ++i )
+			m_UniformCache.push_back( m_LocalVars[ vars[ i ] ]->Clone() );
+	}
+	else
+	{
+		for ( TqUint i = 0; i < vars.size(); ++i )
+			m_UniformCache[ i ]->SetValueFromVariable( m_LocalVars[ vars[ i ] ] );
+	}
+	m_pUniformAttributes = pEnv->pAttributes();
+	m_pUniformTransform = pEnv->pTransform();
+}
+
+
+void CqShaderVM::ClearUniformCache()
+{
+	for ( std::vector<IqShaderData*>::iterator i = m_UniformCache.begin();
+	        i != m_UniformCache.end(); ++i )
+		delete *i;
+	m_UniformCache.clear();
+	m_pUniformAttributes.reset();
+	m_pUniformTransform.reset();
+}
+
+
 //---------------------------------------------------------------------
 /**	Execute the program segment which initialises the default values of instance variables.
 */
 
 void CqShaderVM::ExecuteInit()
 {
+	std::vector<UsProgramElement>& programInit = m_pProgram->m_ProgramInit;
 	// Check if there is anything to execute.
-	if ( m_ProgramInit.size() <= 0 )
+	if ( programInit.size() <= 0 )
 		return ;
 
 	// Fake an environment
@@ -1575,12 +1864,12 @@ void CqShaderVM::ExecuteInit()
 
 	CqShaderExecEnv Env(m_pRenderContext);
 	Env.Initialise( 1, 1, 1, 1, false, IqAttributesPtr(), IqTransformPtr(), this, m_Uses );
-	Initialise( 1, 1, 1, &Env );
+	InitialiseState( 1, 1, 1, &Env );
 
 	// Execute the init program.
-	m_PC = &m_ProgramInit[ 0 ];
+	m_PC = &programInit[ 0 ];
 	m_PO = 0;
-	m_PE = m_ProgramInit.size();
+	m_PE = programInit.size();
 	UsProgramElement* pE;
 
 	while ( !fDone() )
@@ -1691,6 +1980,17 @@ void CqShaderVM::SetArgument( const CqString& strName, EqVariableType type, cons
 
 				DeleteTemporaryStorage(pVMVal);
 			}
+			// An argument given again replaces the earlier value.
+			for(std::vector<SqArgumentRecord>::iterator i = m_StoredArguments.begin();
+					i != m_StoredArguments.end(); ++i)
+			{
+				if(i->m_strName == strName)
+				{
+					delete i->m_Value;
+					m_StoredArguments.erase(i);
+					break;
+				}
+			}
 			SqArgumentRecord rec;
 			rec.m_Value = pStoredArg;
 			rec.m_strSpace = strSpace;
@@ -1753,6 +2053,8 @@ void CqShaderVM::InitialiseParameters( )
 	Aqsis::log() << debug << "Preparing shader @" << this << " : " << strName().c_str() << " [" << m_StoredArguments.size() << " args]"  << std::endl;
 
 	// Reinitialise the local variables to their defaults.
+	ClearUniformCache();
+	++m_parameterVersion;
 	PrepareDefArgs();
 
 	// Transfer the arguments from the store onto the shader proper, ready for use.
@@ -1840,14 +2142,15 @@ void CqShaderVM::InitialiseParameters( )
 	// necessary.
 	if(!m_InstancedParams.empty())
 	{
-		// TODO: Does it make sense that InitialiseParameters() is called more
-		// than once per shader by the aqsis core?
+		// The parameters were edited after the shader was first prepared.
+		// Update the values in place, since execution contexts share the
+		// storage.
 		for( std::vector<IqShaderData*>::iterator i = m_InstancedParams.begin();
 			i < m_InstancedParams.end(); i+=2 )
 		{
-			delete *i;
+			(*i)->SetValueFromVariable(*(i+1));
 		}
-		m_InstancedParams.clear();
+		return;
 	}
 	for( std::vector<IqShaderData*>::iterator i = m_LocalVars.begin();
 		 i != m_LocalVars.end(); ++i )
@@ -1870,13 +2173,17 @@ void CqShaderVM::InitialiseParameters( )
 
 void CqShaderVM::SetArgument( IqParameter* pParam, IqSurface* pSurface )
 {
+	CqShaderVM* pContext = ExecutionContext();
 	// Find the relevant variable.
-	TqInt i = FindLocalVarIndex( pParam->strName().c_str() );
+	TqInt i = pContext->FindLocalVarIndex( pParam->strName().c_str() );
 	if ( i >= 0 )
 	{
-		IqShaderData* pVar = m_LocalVars[ i ];
+		IqShaderData* pVar = pContext->m_LocalVars[ i ];
 		if(pVar->Type() == pParam->Type())
-			pParam->Dice(m_uGridRes,m_vGridRes,pVar,pSurface);
+		{
+			pParam->Dice(pContext->m_uGridRes,pContext->m_vGridRes,pVar,pSurface);
+			pContext->m_fArgumentsBound = true;
+		}
 	}
 }
 
@@ -1887,10 +2194,11 @@ void CqShaderVM::SetArgument( IqParameter* pParam, IqSurface* pSurface )
 
 IqShaderData* CqShaderVM::FindArgument( const CqString& name )
 {
+	CqShaderVM* pContext = ExecutionContext();
 	// Find the relevant variable.
-	TqInt i = FindLocalVarIndex( name.c_str() );
+	TqInt i = pContext->FindLocalVarIndex( name.c_str() );
 	if ( i >= 0 )
-		return( m_LocalVars[ i ] );
+		return( pContext->m_LocalVars[ i ] );
 	else
 		return( NULL );
 }
@@ -1902,11 +2210,12 @@ IqShaderData* CqShaderVM::FindArgument( const CqString& name )
 
 bool CqShaderVM::GetVariableValue( const char* name, IqShaderData* res ) const
 {
+	const CqShaderVM* pContext = ExecutionContext();
 	// Find the relevant variable.
-	TqInt i = FindLocalVarIndex( name );
+	TqInt i = pContext->FindLocalVarIndex( name );
 	if ( i >= 0 )
 	{
-		IqShaderData* src = m_LocalVars[i];
+		IqShaderData* src = pContext->m_LocalVars[i];
 		// Check that the result and source variables are compatible: they
 		// - have the same type
 		// - array length, and
@@ -1936,82 +2245,7 @@ const std::vector<IqShaderData*>& CqShaderVM::GetArguments() const
 void CqShaderVM::ShutdownShaderEngine()
 {
 	// Free any temporary variables in the buckets.
-	while( !m_UFPool.empty() )
-	{
-		delete(m_UFPool.front());
-		m_UFPool.pop_front();
-	}
-	while( !m_VFPool.empty() )
-	{
-		delete(m_VFPool.front());
-		m_VFPool.pop_front();
-	}
-
-	while( !m_UPPool.empty() )
-	{
-		delete(m_UPPool.front());
-		m_UPPool.pop_front();
-	}
-	while( !m_VPPool.empty() )
-	{
-		delete(m_VPPool.front());
-		m_VPPool.pop_front();
-	}
-
-	while( !m_USPool.empty() )
-	{
-		delete(m_USPool.front());
-		m_USPool.pop_front();
-	}
-	while( !m_VSPool.empty() )
-	{
-		delete(m_VSPool.front());
-		m_VSPool.pop_front();
-	}
-
-	while( !m_UCPool.empty() )
-	{
-		delete(m_UCPool.front());
-		m_UCPool.pop_front();
-	}
-	while( !m_VCPool.empty() )
-	{
-		delete(m_VCPool.front());
-		m_VCPool.pop_front();
-	}
-
-	while( !m_UNPool.empty() )
-	{
-		delete(m_UNPool.front());
-		m_UNPool.pop_front();
-	}
-	while( !m_VNPool.empty() )
-	{
-		delete(m_VNPool.front());
-		m_VNPool.pop_front();
-	}
-
-	while( !m_UVPool.empty() )
-	{
-		delete(m_UVPool.front());
-		m_UVPool.pop_front();
-	}
-	while( !m_VVPool.empty() )
-	{
-		delete(m_VVPool.front());
-		m_VVPool.pop_front();
-	}
-
-	while( !m_UMPool.empty() )
-	{
-		delete(m_UMPool.front());
-		m_UMPool.pop_front();
-	}
-	while( !m_VMPool.empty() )
-	{
-		delete(m_VMPool.front());
-		m_VMPool.pop_front();
-	}
+	DeleteTempPools();
 }
 
 
@@ -30,6 +30,10 @@
 #include	<vector>
 #include	<list>
 #include	<boost/shared_ptr.hpp>
+#include	<boost/thread/mutex.hpp>
+#include	<boost/thread/thread.hpp>
+#include	<boost/thread/tss.hpp>
+#include	<boost/utility.hpp>
 
 #include	<aqsis/aqsis.h>
 
@@ -105,6 +109,32 @@ union UsProgramElement
 	SqDSOExternalCall *m_pExtCall	;		///< Call a DSO function
 };
 
+//----------------------------------------------------------------------
+/** \struct SqShaderProgram
+ * The bytecodes of a loaded shader.  Once loaded a program is never modified,
+ * so it is shared by all the instances of a shader and their execution
+ * contexts.
+ */
+
+struct SqShaderProgram : boost::noncopyable
+{
+	std::vector<UsProgramElement>	m_ProgramInit;		///< Bytecodes of the intialisation program.
+	std::vector<UsProgramElement>	m_Program;			///< Bytecodes of the main program.
+	std::list<CqString*>			m_ProgramStrings;	///< Strings used by the program, which are stored additionally as UsProgramElements.
+	/// Offset of the end of the uniform code at the start of the main
+	/// program, marked by the compiler, or 0 if there is none.
+	TqInt	m_UniformEnd;
+	/// Local variables referenced by the uniform code.
+	std::vector<TqInt>	m_UniformVars;
+
+	SqShaderProgram()
+		: m_UniformEnd(0)
+	{}
+	~SqShaderProgram();
+	/// Approximate memory used by the program, in bytes.
+	TqInt	memoryUsage() const;
+};
+
 //----------------------------------------------------------------------
 /** \class CqShaderVM
  * Main class handling the execution of a program in shader language bytecodes.
@@ -150,7 +180,7 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 		virtual	bool	GetVariableValue( const char* name, IqShaderData* res ) const;
 		virtual	void	Evaluate( IqShaderExecEnv* pEnv )
 		{
-			Execute( pEnv );
+			ExecutionContext()->Execute( pEnv );
 		}
 		virtual	void	PrepareDefArgs()
 		{
@@ -214,6 +244,44 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 		void	LoadProgram( std::istream* pFile );
 		void	Execute( IqShaderExecEnv* pEnv );
 		void	ExecuteInit();
+		void	InitialiseState( const TqInt uGridRes, const TqInt vGridRes, const TqInt shadingPointCount, IqShaderExecEnv* pEnv );
+		void	ExecuteUniform( IqShaderExecEnv* pEnv );
+		void	ClearUniformCache();
+
+		/** \brief Create an execution context for a shader instance.
+		 *
+		 * The context shares the program and the cached instance parameters
+		 * of the instance, but has its own local variables and stack.
+		 */
+		explicit CqShaderVM(CqShaderVM* pInstance);
+		/** \brief Get the shader holding the execution state for the calling
+		 * thread.
+		 *
+		 * The thread which created the shader instance uses the instance
+		 * itself.  Any other thread gets its own execution context, taken
+		 * from the free contexts of the instance or created on first use.
+		 */
+		CqShaderVM*	ExecutionContext() const;
+		/** \brief Thread exit cleanup for execution contexts.
+		 *
+		 * Hands the context back to the free list of its instance for reuse
+		 * by later threads, or deletes it if the instance is already gone.
+		 */
+		static void	releaseContext(CqShaderVM* pContext);
+
+		/** \brief Execution contexts of an instance which no thread is using.
+		 *
+		 * Shared between the instance and its contexts, so that threads
+		 * exiting after the instance has been deleted can still find out
+		 * what to do with their context.
+		 */
+		struct SqContextPool
+		{
+			SqContextPool() : m_contextMutex(), m_freeContexts(), m_fInstanceAlive(true) {}
+			boost::mutex	m_contextMutex;	///< Protects the other members.
+			std::vector<CqShaderVM*>	m_freeContexts;	///< Contexts ready for reuse.
+			bool	m_fInstanceAlive;	///< False once the instance has been deleted.
+		};
 
 		// Allow createShaderVM to call LoadProgram:
 		friend boost::shared_ptr<IqShader> createShaderVM(
@@ -238,9 +306,12 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 		std::vector<IqShaderData*>	m_LocalVars;		///< Array of local variables.
 		std::vector<IqShaderData*>	m_InstancedParams;	///< Array of (instance parameter,local var) pairs.  Includes default params.
 		std::vector<SqArgumentRecord>	m_StoredArguments;		///< Array of arguments specified during construction.
-		std::vector<UsProgramElement>	m_ProgramInit;		///< Bytecodes of the intialisation program.
-		std::vector<UsProgramElement>	m_Program;			///< Bytecodes of the main program.
-		std::list<CqString*>			m_ProgramStrings;	///< Strings used by the program, which are stored additionally as UsProgramElements.
+		boost::shared_ptr<SqShaderProgram>	m_pProgram;	///< The shared program.
+		bool	m_fArgumentsBound;	///< Parameters have been set from primitive variables for this grid.
+		IqConstAttributesPtr	m_pUniformAttributes;	///< Attributes the uniform code results were computed for.
+		IqConstTransformPtr	m_pUniformTransform;	///< Transform the uniform code results were computed for.
+		std::vector<IqShaderData*>	m_UniformCache;	///< Values of m_pProgram->m_UniformVars after the uniform code.
+		TqUint	m_parameterVersion;	///< Number of times the parameters have been initialised, for execution contexts to notice edits.
 		TqInt	m_uGridRes;
 		TqInt	m_vGridRes;
 		TqInt	m_shadingPointCount;
@@ -251,6 +322,11 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 		bool	m_outsideWorld;						///< Flag indicating this shader was declared outside the world.
 		IqRenderer*	m_pRenderContext;
 
+		CqShaderVM*	m_pInstance;		///< Instance this is an execution context of, or 0.
+		boost::thread::id	m_ownerThread;	///< Thread which created this instance.
+		boost::shared_ptr<SqContextPool>	m_contextPool;	///< Free execution contexts of the instance.
+		mutable boost::thread_specific_ptr<CqShaderVM>	m_threadContexts;	///< Context for each thread.
+
 
 		/** \brief Get a string from a program file and interpret escaped chars
 		 *
@@ -373,7 +449,7 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 			UsProgramElement E;
 			E.m_pString = ps;
 			pProgramArea->push_back( E );
-			m_ProgramStrings.push_back( ps ); // Store here as well to avoid mem leak.
+			m_pProgram->m_ProgramStrings.push_back( ps ); // Store here as well to avoid mem leak.
 		}
 		/** Add an variable index value to the program area.
 		 * \param iVar Integer variable index to add, top bit indicates system variable.
@@ -136,7 +136,28 @@ void CqCodeGenOutput::Visit( IqParseNodeShader& S )
 	m_slxFile << std::endl << std::endl << "segment Code" << std::endl;
 	IqParseNode* pCode = pNode->pChild();
 	// Output the code tree.
-	if ( pCode )
+	if ( pCode && pCode->NodeType() == ParseNode_Base )
+	{
+		// Mark the end of the statements at the start of the code which
+		// only compute uniform values from the shader parameters and
+		// attributes.  The VM reuses their results between grids.
+		IqParseNode* pStatement = pCode->pChild();
+		bool fUniformPrefix = false;
+		while ( pStatement && IsUniformStatement( pStatement ) )
+		{
+			pStatement->Accept( *this );
+			fUniformPrefix = true;
+			pStatement = pStatement->pNextSibling();
+		}
+		if ( fUniformPrefix )
+			m_slxFile << "\tuniform_end" << std::endl;
+		while ( pStatement )
+		{
+			pStatement->Accept( *this );
+			pStatement = pStatement->pNextSibling();
+		}
+	}
+	else if ( pCode )
 		pCode->Accept( *this );
 	/// \note There is another child here, it is the list of arguments, but they don't need to be
 	/// output as part of the code segment.
@@ -144,6 +165,113 @@ void CqCodeGenOutput::Visit( IqParseNodeShader& S )
 	m_slxFile.close();
 }
 
+/// Shadeops whose result depends only on their arguments and the attributes.
+static const char* gUniformFuncs[] =
+    {
+        "radians", "degrees", "sin", "asin", "cos", "acos", "tan", "atan",
+        "pow", "exp", "sqrt", "inversesqrt", "log", "mod", "abs", "sign",
+        "min", "max", "clamp", "floor", "ceil", "round", "step", "smoothstep",
+        "mix", "spline", "noise", "pnoise", "cellnoise",
+        "xcomp", "ycomp", "zcomp", "setxcomp", "setycomp", "setzcomp",
+        "comp", "setcomp", "length", "distance", "normalize", "ptlined",
+        "determinant", "translate", "rotate", "scale",
+        "transform", "vtransform", "ntransform", "ctransform", "mtransform",
+        "concat", "format", "match", "shadername"
+    };
+static const TqInt gcUniformFuncs = sizeof( gUniformFuncs ) / sizeof( gUniformFuncs[ 0 ] );
+
+/** Determine whether a uniform local variable is referenced.
+ */
+static bool IsUniformLocal( const SqVarRef& Ref )
+{
+	if ( Ref.m_Type != VarTypeLocal )
+		return ( false );
+	IqVarDef* pVD = IqVarDef::GetVariablePtr( Ref );
+	return ( pVD != 0 && ( pVD->Type() & Type_Varying ) == 0 );
+}
+
+/** Determine whether a statement can be evaluated once and its results
+ * reused for every grid shaded by the same shader instance with the same
+ * attributes.  It may only read and write uniform local variables, and only
+ * call shadeops with no side effects whose result depends on nothing but
+ * their arguments, the transformations and the attributes.
+ */
+bool CqCodeGenOutput::IsUniformStatement( const IqParseNode* pNode )
+{
+	// Declarations without an initialiser produce no code.
+	if ( pNode->NodeType() == ParseNode_Base && pNode->pChild() == 0 )
+		return ( true );
+	if ( pNode->fVarying() )
+		return ( false );
+
+	switch ( pNode->NodeType() )
+	{
+			case ParseNode_Base:
+			case ParseNode_MathOp:
+			case ParseNode_RelationalOp:
+			case ParseNode_UnaryOp:
+			case ParseNode_LogicalOp:
+			case ParseNode_DiscardResult:
+			case ParseNode_ConstantFloat:
+			case ParseNode_ConstantString:
+			case ParseNode_TypeCast:
+			case ParseNode_Triple:
+			case ParseNode_SixteenTuple:
+			break;
+
+			case ParseNode_Variable:
+			case ParseNode_ArrayVariable:
+			case ParseNode_VariableAssign:
+			case ParseNode_ArrayVariableAssign:
+			{
+				IqParseNodeVariable* pVN = static_cast<IqParseNodeVariable*>( pNode->GetInterface( ParseNode_Variable ) );
+				if ( !IsUniformLocal( pVN->VarRef() ) )
+					return ( false );
+			}
+			break;
+
+			case ParseNode_FunctionCall:
+			{
+				IqParseNodeFunctionCall* pFC = static_cast<IqParseNodeFunctionCall*>( pNode->GetInterface( ParseNode_FunctionCall ) );
+				const IqFuncDef* pFunc = pFC->pFuncDef();
+				if ( pFunc->fLocal() )
+					return ( false );
+				std::string strName( pFunc->strName() );
+				if ( strName.compare( 0, 8, "operator" ) != 0 )
+				{
+					TqInt i = 0;
+					while ( i < gcUniformFuncs && strName != gUniformFuncs[ i ] )
+						i++;
+					if ( i == gcUniformFuncs )
+						return ( false );
+				}
+			}
+			break;
+
+			case ParseNode_MessagePassingFunction:
+			{
+				IqParseNodeMessagePassingFunction* pMPF = static_cast<IqParseNodeMessagePassingFunction*>( pNode->GetInterface( ParseNode_MessagePassingFunction ) );
+				if ( pMPF->CommType() != CommTypeAttribute &&
+				        pMPF->CommType() != CommTypeOption &&
+				        pMPF->CommType() != CommTypeRendererInfo )
+					return ( false );
+				if ( !IsUniformLocal( pMPF->VarRef() ) )
+					return ( false );
+			}
+			break;
+
+			default:
+			return ( false );
+	}
+
+	for ( const IqParseNode* pChild = pNode->pChild(); pChild; pChild = pChild->pNextSibling() )
+	{
+		if ( !IsUniformStatement( pChild ) )
+			return ( false );
+	}
+	return ( true );
+}
+
 void CqCodeGenOutput::Visit( IqParseNodeFunctionCall& FC )
 {
 	// Output the function name.
@@ -106,6 +106,7 @@ class CqCodeGenOutput : public IqParseNodeVisitor
 	private:
 		void rsPush();
 		void rsPop();
+		static bool IsUniformStatement( const IqParseNode* pNode );
 
 		CqString	m_strOutName;
 		TqInt	m_gcLabels;
@@ -81,4 +81,10 @@ const CqShadowSampleOptions& IqShadowSampler::defaultSampleOptions() const
 	return defaultOptions;
 }
 
+void IqShadowSampler::setCurrToWorld(const CqMatrix& /*currToWorld*/)
+{ }
+
+void IqShadowSampler::prefetch(const CqVector3D* /*points*/, TqInt /*numPoints*/) const
+{ }
+
 } // namespace Aqsis
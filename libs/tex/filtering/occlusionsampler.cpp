@@ -37,7 +37,10 @@
 
 #include "occlusionsampler.h"
 
+#include <cstring>
+
 #include <aqsis/math/math.h>
+#include <aqsis/math/random.h>
 #include <aqsis/tex/filtering/filtertexture.h>
 #include <aqsis/tex/filtering/sampleaccum.h>
 #include <aqsis/tex/texexception.h>
@@ -68,6 +71,15 @@ class CqConstFilter
 		}
 };
 
+/// Seed for the random numbers used when sampling at the given position.
+TqUint positionSeed(const CqVector3D& p)
+{
+	TqFloat xyz[3] = {p.x(), p.y(), p.z()};
+	TqUint bits[3];
+	std::memcpy(bits, xyz, sizeof(bits));
+	return bits[0] ^ (bits[1] * 2654435761U) ^ (bits[2] * 2246822519U);
+}
+
 } // unnamed namespace
 
 
@@ -257,8 +269,7 @@ CqOcclusionSampler::CqOcclusionSampler(
 		const boost::shared_ptr<IqTiledTexInputFile>& file,
 		const CqMatrix& currToWorld)
 	: m_maps(),
-	m_defaultSampleOptions(),
-	m_random()
+	m_defaultSampleOptions()
 {
 	// Connect the multiple shadow maps to the input file.
 	TqInt numMaps = file->numSubImages();
@@ -283,6 +294,9 @@ void CqOcclusionSampler::sample(const Sq3DSamplePllgram& samplePllgram,
 	N.Unit();
 
 	const TqFloat sampNumMult = 4.0 * sampleOpts.numSamples() / m_maps.size();
+	// Seed from the position rather than keeping a stream in the sampler, as
+	// the sampler is shared by all threads.
+	CqRandom random(positionSeed(samplePllgram.c));
 
 	// Accumulate the total occlusion over all directions.  Here we use an
 	// importance sampling approach: we decide how many samples each map should
@@ -312,7 +326,7 @@ void CqOcclusionSampler::sample(const Sq3DSamplePllgram& samplePllgram,
 			// This isn't an integer though, so we take the floor,
 			TqInt numSamples = lfloor(numSampFlt);
 			// TODO: Investigate performance impact of using RandomFloat() here.
-			if(m_random.RandomFloat() < numSampFlt - numSamples)
+			if(random.RandomFloat() < numSampFlt - numSamples)
 			{
 				// And increment with a probability equal to the extra fraction
 				// of samples that the current map should have.
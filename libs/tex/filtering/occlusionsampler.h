@@ -46,7 +46,6 @@
 
 #include <aqsis/tex/filtering/iocclusionsampler.h>
 #include <aqsis/math/matrix.h>
-#include <aqsis/math/random.h>
 #include <aqsis/tex/filtering/texturesampleoptions.h>
 
 namespace Aqsis
@@ -92,8 +91,6 @@ class AQSIS_TEX_SHARE CqOcclusionSampler : public IqOcclusionSampler
 		TqViewVec m_maps;
 		/// Default occlusion sampling options.
 		CqShadowSampleOptions m_defaultSampleOptions;
-		/// Random number stream for importance sampling.
-		mutable CqRandom m_random;
 };
 
 
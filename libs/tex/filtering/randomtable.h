@@ -66,13 +66,14 @@ class AQSIS_TEX_SHARE Cq2dQuasiRandomTable
 		/// Initialize the table with quasi random numbers.
 		Cq2dQuasiRandomTable();
 
-		/// "randomize" the low-discrepency sequence by resetting the offset.
-		void randomize();
-
-		/// Get the x sample point at the given index.
-		TqFloat x(TqUint index) const;
-		/// Get the y sample point at the given index.
-		TqFloat y(TqUint index) const;
+		/** Get the x sample point at the given index.
+		 * \param offset - random offset in [0,1) for the current sequence.
+		 */
+		TqFloat x(TqUint index, TqFloat offset) const;
+		/** Get the y sample point at the given index.
+		 * \param offset - random offset in [0,1) for the current sequence.
+		 */
+		TqFloat y(TqUint index, TqFloat offset) const;
 	private:
 		/// Note that this table size
 		static const TqUint m_tableSize = (1 << 10);
@@ -80,12 +81,6 @@ class AQSIS_TEX_SHARE Cq2dQuasiRandomTable
 		TqFloat m_x[m_tableSize];
 		/// Table of y-positions
 		TqFloat m_y[m_tableSize];
-		/// Random numbers for randomizing the offsets
-		CqRandom m_rand;
-		/// Psudo-random x-offset
-		TqFloat m_offsetX;
-		/// Psudo-random y-offset
-		TqFloat m_offsetY;
 };
 
 
@@ -94,31 +89,22 @@ class AQSIS_TEX_SHARE Cq2dQuasiRandomTable
 //==============================================================================
 namespace detail {
 
-/// \todo Multithreading - This cannot be a singleton.
-//
-// It would be possible to make the table itself a singleton, and have another
-// object holding the randomized QMC offsets.
+/// The table is read only, so may be shared; the offsets are held by the users.
 extern Cq2dQuasiRandomTable g_randTab;
 
 }
 
 // Cq2dQuasiRandomTable
 
-inline void Cq2dQuasiRandomTable::randomize()
-{
-	m_offsetX = m_rand.RandomFloat();
-	m_offsetY = m_rand.RandomFloat();
-}
-
-inline TqFloat Cq2dQuasiRandomTable::x(TqUint index) const
+inline TqFloat Cq2dQuasiRandomTable::x(TqUint index, TqFloat offset) const
 {
-	TqFloat res = m_x[index & (m_tableSize-1)] + m_offsetX;
+	TqFloat res = m_x[index & (m_tableSize-1)] + offset;
 	return res - (res >= 1);
 }
 
-inline TqFloat Cq2dQuasiRandomTable::y(TqUint index) const
+inline TqFloat Cq2dQuasiRandomTable::y(TqUint index, TqFloat offset) const
 {
-	TqFloat res = m_y[index & (m_tableSize-1)] + m_offsetY;
+	TqFloat res = m_y[index & (m_tableSize-1)] + offset;
 	return res - (res >= 1);
 }
 
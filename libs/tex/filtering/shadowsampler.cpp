@@ -37,6 +37,10 @@
 
 #include "shadowsampler.h"
 
+#include <cfloat>
+
+#include <aqsis/math/math.h>
+
 #include <aqsis/tex/io/itexinputfile.h>
 #include <aqsis/tex/filtering/sampleaccum.h>
 #include <aqsis/tex/filtering/filtertexture.h>
@@ -95,6 +99,10 @@ inline void applyPCF(const CqTileArray<TqFloat>& pixelBuf,
 class CqShadowSampler::CqShadowView
 {
 	private:
+		/// transformation: world -> light coordinates, from the file.
+		CqMatrix m_worldToLight;
+		/// transformation: world -> light raster coordinates, from the file.
+		CqMatrix m_worldToLightRaster;
 		/// transformation: current -> light coordinates
 		CqMatrix m_currToLight;
 		/// transformation: current -> raster coordinates ( [0,width]x[0,height] )
@@ -128,7 +136,9 @@ class CqShadowSampler::CqShadowView
 		 */
 		CqShadowView(const boost::shared_ptr<IqTiledTexInputFile>& file, TqInt imageNum,
 				const CqMatrix& currToWorld)
-			: m_currToLight(),
+			: m_worldToLight(),
+			m_worldToLightRaster(),
+			m_currToLight(),
 			m_currToRaster(),
 			m_currToRasterVec(),
 			m_viewDirec(),
@@ -155,7 +165,7 @@ class CqShadowSampler::CqShadowView
 						"No world -> camera matrix found in file \""
 						<< file->fileName() << "\"");
 			}
-			m_currToLight = (*worldToLight) * currToWorld;
+			m_worldToLight = *worldToLight;
 
 			// Get matrix which transforms the sample points to texture coordinates.
 			const CqMatrix* worldToLightScreen
@@ -166,15 +176,27 @@ class CqShadowSampler::CqShadowView
 						"No world -> screen matrix found in file \""
 						<< file->fileName() << "\"");
 			}
-			m_currToRaster = (*worldToLightScreen) * currToWorld;
+			m_worldToLightRaster = *worldToLightScreen;
 			// worldToLightScreen transforms world coordinates to "screen" coordinates,
 			// ie, onto the 2D box [-1,1]x[-1,1].  We instead want texture coordinates,
 			// which correspond to the box [0,width]x[0,height].  In
 			// addition, the direction of increase of the y-axis should be
 			// swapped, since texture coordinates define the origin to be in
 			// the top left of the texture rather than the bottom right.
-			m_currToRaster.Translate(CqVector3D(1,-1,0));
-			m_currToRaster.Scale(0.5f, -0.5f, 1);
+			m_worldToLightRaster.Translate(CqVector3D(1,-1,0));
+			m_worldToLightRaster.Scale(0.5f, -0.5f, 1);
+
+			setCurrToWorld(currToWorld);
+		}
+
+		/** \brief Recompute the transformations from "current" space.
+		 *
+		 * \param currToWorld - current -> world transformation matrix.
+		 */
+		void setCurrToWorld(const CqMatrix& currToWorld)
+		{
+			m_currToLight = m_worldToLight * currToWorld;
+			m_currToRaster = m_worldToLightRaster * currToWorld;
 
 			// Transform the light origin to "current" space to use
 			// when checking the visibility of a point.
@@ -191,6 +213,39 @@ class CqShadowSampler::CqShadowView
 			m_viewDirec.Unit();
 		}
 
+		/** \brief Load the tiles which shadow the convex hull of some points.
+		 *
+		 * Nothing is loaded if any of the points lie behind the light, since
+		 * the region can't be bounded in the map then.
+		 *
+		 * \param points - points in "current" coordinates.
+		 * \param numPoints - number of points.
+		 */
+		void prefetch(const CqVector3D* points, TqInt numPoints) const
+		{
+			if(numPoints <= 0)
+				return;
+			TqFloat xMin = FLT_MAX, xMax = -FLT_MAX;
+			TqFloat yMin = FLT_MAX, yMax = -FLT_MAX;
+			for(TqInt i = 0; i < numPoints; ++i)
+			{
+				if((m_currToLight*points[i]).z() <= 0)
+					return;
+				CqVector3D p = m_currToRaster*points[i];
+				xMin = min(xMin, p.x());
+				xMax = max(xMax, p.x());
+				yMin = min(yMin, p.y());
+				yMax = max(yMax, p.y());
+			}
+			// Pad by a pixel for the filter support, and clamp before
+			// converting so that huge regions can't overflow.
+			TqFloat w = m_pixels.width();
+			TqFloat h = m_pixels.height();
+			m_pixels.prefetch(SqFilterSupport(
+					lfloor(clamp(xMin - 1, 0.0f, w)), lceil(clamp(xMax + 1, 0.0f, w)),
+					lfloor(clamp(yMin - 1, 0.0f, h)), lceil(clamp(yMax + 1, 0.0f, h)) ));
+		}
+
 		/** \brief Visibility of the specified point to the lightsource.
 		 *
 		 * If multiple maps are specified, this is used as a factor to 
@@ -295,6 +350,18 @@ CqShadowSampler::CqShadowSampler(const boost::shared_ptr<IqTiledTexInputFile>& f
 	m_defaultSampleOptions.fillFromFileHeader(file->header());
 }
 
+void CqShadowSampler::setCurrToWorld(const CqMatrix& currToWorld)
+{
+	for(TqViewVec::const_iterator i = m_maps.begin(), end = m_maps.end(); i != end; ++i)
+		(*i)->setCurrToWorld(currToWorld);
+}
+
+void CqShadowSampler::prefetch(const CqVector3D* points, TqInt numPoints) const
+{
+	for(TqViewVec::const_iterator i = m_maps.begin(), end = m_maps.end(); i != end; ++i)
+		(*i)->prefetch(points, numPoints);
+}
+
 void CqShadowSampler::sample(const Sq3DSampleQuad& sampleQuad,
 		const CqShadowSampleOptions& sampleOpts, TqFloat* outSamps) const
 {
@@ -72,6 +72,8 @@ class AQSIS_TEX_SHARE CqShadowSampler : public IqShadowSampler
 		virtual void sample(const Sq3DSampleQuad& sampleQuad,
 				const CqShadowSampleOptions& sampleOpts, TqFloat* outSamps) const;
 		virtual const CqShadowSampleOptions& defaultSampleOptions() const;
+		virtual void setCurrToWorld(const CqMatrix& currToWorld);
+		virtual void prefetch(const CqVector3D* points, TqInt numPoints) const;
 	private:
 		class CqShadowView;
 		typedef std::vector<boost::shared_ptr<CqShadowView> > TqViewVec;
@@ -37,6 +37,15 @@
 
 #include "texturecache.h"
 
+#include <deque>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
 #include <aqsis/util/exception.h>
 #include <aqsis/util/file.h>
 #include <aqsis/tex/filtering/ienvironmentsampler.h>
@@ -47,9 +56,118 @@
 #include <aqsis/util/logging.h>
 #include <aqsis/util/sstring.h>
 #include <aqsis/tex/texexception.h>
+#include <aqsis/math/vector3d.h>
 
 namespace Aqsis {
 
+//------------------------------------------------------------------------------
+/** \brief Thread which loads shadow map tiles ahead of their use.
+ *
+ * Regions are only useful if they're loaded before shading reaches them, so
+ * only the most recent couple of requests are queued and older ones which
+ * haven't been started are dropped.
+ */
+class CqTextureCache::CqShadowPrefetcher : boost::noncopyable
+{
+	public:
+		typedef std::vector<boost::shared_ptr<IqShadowSampler> > TqSamplerVec;
+
+		CqShadowPrefetcher()
+			: m_mutex(),
+			m_jobCond(),
+			m_idleCond(),
+			m_jobs(),
+			m_busy(false),
+			m_stop(false),
+			m_thread()
+		{ }
+
+		~CqShadowPrefetcher()
+		{
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+				m_stop = true;
+				m_jobs.clear();
+			}
+			m_jobCond.notify_all();
+			if(m_thread)
+				m_thread->join();
+		}
+
+		/// Queue loading of the region bounded by points for each sampler.
+		void add(const TqSamplerVec& samplers, const CqVector3D* points, TqInt numPoints)
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			if(!m_thread)
+				m_thread.reset(new boost::thread(boost::bind(&CqShadowPrefetcher::run, this)));
+			while(m_jobs.size() >= 2)
+				m_jobs.pop_front();
+			m_jobs.push_back(SqJob());
+			m_jobs.back().samplers = samplers;
+			m_jobs.back().points.assign(points, points + numPoints);
+			m_jobCond.notify_one();
+		}
+
+		/// Drop queued requests and wait for the one in progress to finish.
+		void cancel()
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			m_jobs.clear();
+			while(m_busy)
+				m_idleCond.wait(lock);
+		}
+
+	private:
+		struct SqJob
+		{
+			TqSamplerVec samplers;
+			std::vector<CqVector3D> points;
+		};
+
+		void run()
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			while(true)
+			{
+				while(!m_stop && m_jobs.empty())
+					m_jobCond.wait(lock);
+				if(m_stop)
+					return;
+				{
+					SqJob job = m_jobs.front();
+					m_jobs.pop_front();
+					m_busy = true;
+					lock.unlock();
+					for(TqSamplerVec::const_iterator i = job.samplers.begin();
+							i != job.samplers.end(); ++i)
+					{
+						try
+						{
+							(*i)->prefetch(&job.points[0], job.points.size());
+						}
+						catch(XqException& /*e*/)
+						{
+							// Any problem with the file will be reported
+							// when the tile is sampled.
+						}
+					}
+				}
+				lock.lock();
+				m_busy = false;
+				m_idleCond.notify_all();
+			}
+		}
+
+		boost::mutex m_mutex;
+		boost::condition m_jobCond;
+		boost::condition m_idleCond;
+		std::deque<SqJob> m_jobs;
+		bool m_busy;
+		bool m_stop;
+		boost::scoped_ptr<boost::thread> m_thread;
+};
+
+
 //------------------------------------------------------------------------------
 // IqTextureCache creation function.
 
@@ -63,47 +181,131 @@ boost::shared_ptr<IqTextureCache> IqTextureCache::create(
 //------------------------------------------------------------------------------
 // CqTextureCache
 
+CqTextureCache::SqFileStamp::SqFileStamp(const boostfs::path& path)
+	: path(path),
+	modified(0),
+	size(0)
+{
+	try
+	{
+		modified = boostfs::last_write_time(path);
+		size = boostfs::file_size(path);
+	}
+	catch(boostfs::filesystem_error& /*e*/)
+	{
+		// Leave the stamp empty; opening the file will report the problem.
+	}
+}
+
+bool CqTextureCache::SqFileStamp::operator==(const SqFileStamp& rhs) const
+{
+	return path == rhs.path && modified == rhs.modified && size == rhs.size;
+}
+
 CqTextureCache::CqTextureCache(TqSearchPathCallback searchPathCallback)
 	: m_textureCache(),
 	m_environmentCache(),
 	m_shadowCache(),
 	m_occlusionCache(),
 	m_texFileCache(),
+	m_retainedTextures(),
+	m_retainedEnvironments(),
+	m_retainedShadows(),
+	m_retainedFiles(),
+	m_writtenFiles(),
+	m_mutex(),
+	m_prefetcher(),
 	m_currToWorld(),
 	m_searchPathCallback(searchPathCallback)
 { }
 
+CqTextureCache::~CqTextureCache()
+{
+	// Stop the prefetch thread before the samplers it uses go away.
+	m_prefetcher.reset();
+}
+
 IqTextureSampler& CqTextureCache::findTextureSampler(const char* name)
 {
-	return findSampler(m_textureCache, name);
+	return findSampler(m_textureCache, &m_retainedTextures, name);
 }
 
 IqEnvironmentSampler& CqTextureCache::findEnvironmentSampler(const char* name)
 {
-	return findSampler(m_environmentCache, name);
+	return findSampler(m_environmentCache, &m_retainedEnvironments, name);
 }
 
 IqShadowSampler& CqTextureCache::findShadowSampler(const char* name)
 {
-	return findSampler(m_shadowCache, name);
+	return findSampler(m_shadowCache, &m_retainedShadows, name);
 }
 
 IqOcclusionSampler& CqTextureCache::findOcclusionSampler(const char* name)
 {
-	return findSampler(m_occlusionCache, name);
+	return findSampler<IqOcclusionSampler>(m_occlusionCache, 0, name);
 }
 
 void CqTextureCache::flush()
 {
+	boost::mutex::scoped_lock lock(m_mutex);
+	if(m_prefetcher)
+		m_prefetcher->cancel();
 	m_textureCache.clear();
 	m_environmentCache.clear();
 	m_shadowCache.clear();
 	m_occlusionCache.clear();
 	m_texFileCache.clear();
+	m_retainedTextures.clear();
+	m_retainedEnvironments.clear();
+	m_retainedShadows.clear();
+	m_retainedFiles.clear();
+	m_writtenFiles.clear();
+}
+
+void CqTextureCache::endFrame()
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	if(m_prefetcher)
+		m_prefetcher->cancel();
+	retainSamplers(m_textureCache, m_retainedTextures);
+	retainSamplers(m_environmentCache, m_retainedEnvironments);
+	retainSamplers(m_shadowCache, m_retainedShadows);
+	// Occlusion samplers aren't kept, since they can't be moved to a new
+	// camera.
+	m_occlusionCache.clear();
+	m_retainedFiles.clear();
+	m_retainedFiles.swap(m_texFileCache);
+	// Files written during the frame may have been read before they were
+	// replaced.
+	dropWrittenFiles();
+	m_writtenFiles.clear();
+}
+
+void CqTextureCache::prefetchShadows(const CqVector3D* points, TqInt numPoints)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	if(m_shadowCache.empty())
+		return;
+	CqShadowPrefetcher::TqSamplerVec samplers;
+	samplers.reserve(m_shadowCache.size());
+	for(std::map<TqUlong, boost::shared_ptr<IqShadowSampler> >::const_iterator
+			i = m_shadowCache.begin(); i != m_shadowCache.end(); ++i)
+		samplers.push_back(i->second);
+	if(!m_prefetcher)
+		m_prefetcher.reset(new CqShadowPrefetcher());
+	m_prefetcher->add(samplers, points, numPoints);
+}
+
+void CqTextureCache::fileWritten(const char* fileName)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	m_writtenFiles.insert(filename(fileName));
+	dropWrittenFiles();
 }
 
 const CqTexFileHeader* CqTextureCache::textureInfo(const char* name)
 {
+	boost::mutex::scoped_lock lock(m_mutex);
 	boost::shared_ptr<IqTiledTexInputFile> file;
 	try
 	{
@@ -118,6 +320,7 @@ const CqTexFileHeader* CqTextureCache::textureInfo(const char* name)
 
 void CqTextureCache::setCurrToWorldMatrix(const CqMatrix& currToWorld)
 {
+	boost::mutex::scoped_lock lock(m_mutex);
 	m_currToWorld = currToWorld;
 }
 
@@ -126,8 +329,10 @@ void CqTextureCache::setCurrToWorldMatrix(const CqMatrix& currToWorld)
 template<typename SamplerT>
 SamplerT& CqTextureCache::findSampler(
 		std::map<TqUlong, boost::shared_ptr<SamplerT> >& samplerMap,
+		std::map<TqUlong, boost::shared_ptr<SamplerT> >* retainedMap,
 		const char* name)
 {
+	boost::mutex::scoped_lock lock(m_mutex);
 	TqUlong hash = CqString::hash(name);
 	typename std::map<TqUlong, boost::shared_ptr<SamplerT> >::const_iterator
 		texIter = samplerMap.find(hash);
@@ -144,7 +349,19 @@ SamplerT& CqTextureCache::findSampler(
 		try
 		{
 			// Find the file in the current file cache.
-			newTex = newSamplerFromFile<SamplerT>(getTextureFile(name));
+			boost::shared_ptr<IqTiledTexInputFile> file = getTextureFile(name);
+			// Reuse the sampler from the previous frame if there is one.
+			// getTextureFile() has already discarded it if the file changed.
+			typename std::map<TqUlong, boost::shared_ptr<SamplerT> >::iterator
+				retained;
+			if(retainedMap && (retained = retainedMap->find(hash)) != retainedMap->end())
+			{
+				newTex = retained->second;
+				retainedMap->erase(retained);
+				reuseSampler(*newTex);
+			}
+			else
+				newTex = newSamplerFromFile<SamplerT>(file);
 		}
 		catch(XqInvalidFile& e)
 		{
@@ -167,13 +384,30 @@ boost::shared_ptr<IqTiledTexInputFile> CqTextureCache::getTextureFile(
 		const char* name)
 {
 	TqUlong hash = CqString::hash(name);
-	std::map<TqUlong, boost::shared_ptr<IqTiledTexInputFile> >::const_iterator
-		fileIter = m_texFileCache.find(hash);
+	TqFileMap::const_iterator fileIter = m_texFileCache.find(hash);
 	if(fileIter != m_texFileCache.end())
 		// File exists in the cache; return it.
-		return fileIter->second;
-	// Else try to open the file and store it in the cache before returning it.
+		return fileIter->second.file;
 	boostfs::path fullName = findFile(name, m_searchPathCallback());
+	SqFileStamp stamp(fullName);
+	// Reuse the file from the previous frame if it hasn't changed.
+	TqFileMap::iterator retained = m_retainedFiles.find(hash);
+	if(retained != m_retainedFiles.end())
+	{
+		if(retained->second.stamp == stamp)
+		{
+			boost::shared_ptr<IqTiledTexInputFile> file = retained->second.file;
+			m_texFileCache.insert(*retained);
+			m_retainedFiles.erase(retained);
+			return file;
+		}
+		// The file has been replaced, so the samplers reading it are stale.
+		m_retainedFiles.erase(retained);
+		m_retainedTextures.erase(hash);
+		m_retainedEnvironments.erase(hash);
+		m_retainedShadows.erase(hash);
+	}
+	// Else try to open the file and store it in the cache before returning it.
 	boost::shared_ptr<IqTiledTexInputFile> file;
 	try
 	{
@@ -187,10 +421,60 @@ boost::shared_ptr<IqTiledTexInputFile> CqTextureCache::getTextureFile(
 		Aqsis::log() << warning << "Could not open file as a tiled texture: "
 			<< e.what() << ".  Rendering will continue, but may be slower.\n";
 	}
-	m_texFileCache[hash] = file;
+	m_texFileCache.insert(TqFileMap::value_type(hash, SqCachedFile(file, stamp)));
 	return file;
 }
 
+void CqTextureCache::dropWrittenFiles()
+{
+	if(m_writtenFiles.empty())
+		return;
+	// Files are matched by name alone, since the path they were written to
+	// needn't be the one they're found at.  Dropping a map by mistake only
+	// costs reading it again.
+	for(TqFileMap::iterator i = m_retainedFiles.begin();
+			i != m_retainedFiles.end();)
+	{
+		if(m_writtenFiles.count(filename(i->second.stamp.path)))
+		{
+			m_retainedTextures.erase(i->first);
+			m_retainedEnvironments.erase(i->first);
+			m_retainedShadows.erase(i->first);
+			m_retainedFiles.erase(i++);
+		}
+		else
+			++i;
+	}
+}
+
+template<typename SamplerT>
+void CqTextureCache::retainSamplers(
+		std::map<TqUlong, boost::shared_ptr<SamplerT> >& samplerMap,
+		std::map<TqUlong, boost::shared_ptr<SamplerT> >& retainedMap)
+{
+	retainedMap.clear();
+	for(typename std::map<TqUlong, boost::shared_ptr<SamplerT> >::const_iterator
+			i = samplerMap.begin(); i != samplerMap.end(); ++i)
+	{
+		// Dummy samplers for missing files aren't worth keeping, the file
+		// might turn up.
+		if(m_texFileCache.find(i->first) != m_texFileCache.end())
+			retainedMap.insert(*i);
+	}
+	samplerMap.clear();
+}
+
+template<typename SamplerT>
+void CqTextureCache::reuseSampler(SamplerT& /*sampler*/)
+{ }
+
+// Shadow samplers need to be moved to the new camera.
+template<>
+void CqTextureCache::reuseSampler(IqShadowSampler& sampler)
+{
+	sampler.setCurrToWorld(m_currToWorld);
+}
+
 template<typename SamplerT>
 boost::shared_ptr<SamplerT> CqTextureCache::newSamplerFromFile(
 		const boost::shared_ptr<IqTiledTexInputFile>& file)
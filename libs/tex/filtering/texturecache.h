@@ -40,10 +40,18 @@
 
 #include <aqsis/aqsis.h>
 
+#include <ctime>
 #include <map>
+#include <set>
+#include <string>
 
+#include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/utility.hpp>
 
+#include <aqsis/util/file.h>
+
 #include <aqsis/tex/filtering/itexturecache.h>
 #include <aqsis/math/matrix.h>
 
@@ -70,6 +78,7 @@ class AQSIS_TEX_SHARE CqTextureCache : public IqTextureCache, private boost::non
 		 * search path when searching for textures.
 		 */
 		CqTextureCache(TqSearchPathCallback searchPathCallback);
+		~CqTextureCache();
 
 		// Inherited from IqTextureCache
 		virtual IqTextureSampler& findTextureSampler(const char* name);
@@ -77,21 +86,67 @@ class AQSIS_TEX_SHARE CqTextureCache : public IqTextureCache, private boost::non
 		virtual IqShadowSampler& findShadowSampler(const char* name);
 		virtual IqOcclusionSampler& findOcclusionSampler(const char* name);
 		virtual void flush();
+		virtual void endFrame();
+		virtual void prefetchShadows(const CqVector3D* points, TqInt numPoints);
+		virtual void fileWritten(const char* fileName);
 		virtual const CqTexFileHeader* textureInfo(const char* name);
 		virtual void setCurrToWorldMatrix(const CqMatrix& currToWorld);
 
 	private:
+		class CqShadowPrefetcher;
+
+		/** \brief Identity of a texture file on disk.
+		 *
+		 * Used to decide whether a map kept from a previous frame is still
+		 * up to date.
+		 */
+		struct SqFileStamp
+		{
+			boostfs::path path;
+			std::time_t modified;
+			boost::uintmax_t size;
+
+			SqFileStamp(const boostfs::path& path);
+			bool operator==(const SqFileStamp& rhs) const;
+		};
+		/// A texture file together with its identity when it was opened.
+		struct SqCachedFile
+		{
+			boost::shared_ptr<IqTiledTexInputFile> file;
+			SqFileStamp stamp;
+
+			SqCachedFile(const boost::shared_ptr<IqTiledTexInputFile>& file,
+					const SqFileStamp& stamp)
+				: file(file), stamp(stamp)
+			{ }
+		};
+		typedef std::map<TqUlong, SqCachedFile> TqFileMap;
+
 		/** \brief Find a sampler in the given map, or create one from file if needed.
 		 *
 		 * If the file isn't found, we issue a warning, and a dummy sampler
 		 * should be created instead so that the render can continue.
 		 *
 		 * \param samplerMap - std::map to find the sampler in.
+		 * \param retainedMap - samplers of the same type kept from the
+		 *                      previous frame, or 0 if they aren't kept.
 		 * \param name - name of the texture.
 		 */
 		template<typename SamplerT>
 		SamplerT& findSampler(std::map<TqUlong, boost::shared_ptr<SamplerT> >&
-				samplerMap, const char* name);
+				samplerMap, std::map<TqUlong, boost::shared_ptr<SamplerT> >*
+				retainedMap, const char* name);
+		/** \brief Keep the samplers in samplerMap which came from a file.
+		 *
+		 * The samplers are moved into retainedMap, replacing its contents.
+		 */
+		template<typename SamplerT>
+		void retainSamplers(std::map<TqUlong, boost::shared_ptr<SamplerT> >&
+				samplerMap, std::map<TqUlong, boost::shared_ptr<SamplerT> >&
+				retainedMap);
+		/// Prepare a sampler kept from the previous frame for reuse.
+		template<typename SamplerT>
+		void reuseSampler(SamplerT& sampler);
 		/** \brief Retrive a texture file from the cache, or open it from file.
 		 *
 		 * First search for the given file name in the cache.  If it's not
@@ -110,6 +165,8 @@ class AQSIS_TEX_SHARE CqTextureCache : public IqTextureCache, private boost::non
 		template<typename SamplerT>
 		boost::shared_ptr<SamplerT> newSamplerFromFile(
 				const boost::shared_ptr<IqTiledTexInputFile>& file);
+		/// Drop the kept files and samplers with a name in m_writtenFiles.
+		void dropWrittenFiles();
 
 		/// Cached textures live in here
 		std::map<TqUlong, boost::shared_ptr<IqTextureSampler> > m_textureCache;
@@ -117,7 +174,19 @@ class AQSIS_TEX_SHARE CqTextureCache : public IqTextureCache, private boost::non
 		std::map<TqUlong, boost::shared_ptr<IqShadowSampler> > m_shadowCache;
 		std::map<TqUlong, boost::shared_ptr<IqOcclusionSampler> > m_occlusionCache;
 		/// Cached texture files live in here:
-		std::map<TqUlong, boost::shared_ptr<IqTiledTexInputFile> > m_texFileCache;
+		TqFileMap m_texFileCache;
+		/// Samplers and files used in the previous frame, which may be reused.
+		std::map<TqUlong, boost::shared_ptr<IqTextureSampler> > m_retainedTextures;
+		std::map<TqUlong, boost::shared_ptr<IqEnvironmentSampler> > m_retainedEnvironments;
+		std::map<TqUlong, boost::shared_ptr<IqShadowSampler> > m_retainedShadows;
+		TqFileMap m_retainedFiles;
+		/// Names of the files written by the renderer during this frame.
+		std::set<std::string> m_writtenFiles;
+		/// Protects everything above, since shading threads look up samplers
+		/// concurrently.
+		boost::mutex m_mutex;
+		/// Background loader for shadow map tiles, created on first use.
+		boost::scoped_ptr<CqShadowPrefetcher> m_prefetcher;
 		/// Camera -> world transformation - used for creating shadow maps.
 		CqMatrix m_currToWorld;
 		/// Callback function to obtain the current texture search path.
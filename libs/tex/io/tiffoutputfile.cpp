@@ -186,7 +186,7 @@ void CqTiffOutputFile::writeTiledPixels(const CqMixedImageBuffer& buffer)
 		{
 			const TqInt tileDataLen = min(tileRowStride,
 					rowStride - tileCol*tileRowStride);
-			const TqInt tileDataHeight = min(tileInfo.height, buffer.height() - line);
+			const TqInt tileDataHeight = min(tileInfo.height, endLine - line);
 			// Copy parts of the scanlines into the tile buffer.
 			stridedCopy(tileBuf.get(), tileRowStride, srcBuf, rowStride,
 					tileDataHeight, tileDataLen);
@@ -35,12 +35,20 @@
  * \author Chris Foster  [chris42f _at_ gmail.com]
  */
 
+
 #ifndef DOWNSAMPLE_H_INCLUDED
 #define DOWNSAMPLE_H_INCLUDED
 
 #include <aqsis/aqsis.h>
 
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <aqsis/math/math.h>
 #include "cachedfilter.h"
@@ -76,9 +84,11 @@ class CqDownsampleIterator
 		 * \param buf - source buffer to downsample
 		 * \param filterInfo - information about which filter type and size to use
 		 * \param wrapModes - specifies how the texture will be wrapped at the edges.
+		 * \param numThreads - number of threads to filter each level with.
 		 */
 		CqDownsampleIterator(boost::shared_ptr<ArrayT> buf,
-				const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes);
+				const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes,
+				TqInt numThreads = 1);
 		/** \brief Advance to the next image in the sequence
 		 *
 		 * The current image is downsampled to obtain the next one.
@@ -96,6 +106,7 @@ class CqDownsampleIterator
 		boost::shared_ptr<ArrayT> m_buf;
 		SqFilterInfo m_filterInfo;
 		SqWrapModes m_wrapModes;
+		TqInt m_numThreads;
 };
 
 /** \brief Downsample an image to the next smaller mipmap size.
@@ -110,10 +121,108 @@ class CqDownsampleIterator
  * \param srcBuf - input texture buffer.
  * \param filterInfo - information about which filter type and size to use
  * \param wrapModes - specifies how the texture will be wrapped at the edges.
+ * \param numThreads - number of threads to split the filtering between.
  */
 template<typename ArrayT>
 boost::shared_ptr<ArrayT> downsample(const ArrayT& srcBuf,
-		const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes);
+		const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes,
+		TqInt numThreads = 1);
+
+//------------------------------------------------------------------------------
+/** \brief Downsampler for separable filters, taking the source in bands of
+ * scanlines.
+ *
+ * When the filter kernel is a product of functions of x and y, downsampling
+ * can be done as two one dimensional passes: each source scanline is first
+ * filtered down to the new width, then the new scanlines are formed by
+ * filtering down the columns of these.  For each output pixel the source
+ * pixels and weights which contribute to it are fixed, so they're computed
+ * once up front as lists of "taps" with the wrap modes already applied.
+ *
+ * The source doesn't have to be in memory all at once; it's passed to
+ * addBand() a few scanlines at a time from top to bottom.  Horizontally
+ * filtered scanlines are only kept until the last output scanline which
+ * needs them has been computed, so the memory used is a small number of
+ * scanlines in addition to the result (plus the few scanlines at the
+ * opposite edge needed for periodic wrapping).  The rows in each band are
+ * split between numThreads threads.
+ */
+template<typename ArrayT>
+class CqSeparableDownsampler
+{
+	public:
+		/** \brief Set up the downsampler for a source image.
+		 *
+		 * \param srcWidth
+		 * \param srcHeight - size of the source image
+		 * \param numChannels - number of channels in the source image
+		 * \param filterInfo - downsampling filter; must be separable for the
+		 *                     given image size, see isSeparable().
+		 * \param wrapModes - specifies how the texture will be wrapped at the edges.
+		 * \param numThreads - number of threads to split the filtering between.
+		 */
+		CqSeparableDownsampler(TqInt srcWidth, TqInt srcHeight, TqInt numChannels,
+				const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes,
+				TqInt numThreads = 1);
+
+		/** \brief Determine whether a filter can be used with this class.
+		 *
+		 * Rather than relying on the filter type, this checks whether the
+		 * discrete kernel which will be used to downsample an image of the
+		 * given size is the product of a row and a column of weights.
+		 */
+		static bool isSeparable(const SqFilterInfo& filterInfo, TqInt srcWidth,
+				TqInt srcHeight);
+
+		/** \brief Filter the next band of source scanlines.
+		 *
+		 * \param band - buffer holding the scanlines following those passed
+		 *               in the previous call; must have the full source width.
+		 */
+		void addBand(const ArrayT& band);
+
+		/** \brief Get the downsampled image.
+		 *
+		 * Only valid once all the source scanlines have been passed to
+		 * addBand().
+		 */
+		const boost::shared_ptr<ArrayT>& result() const;
+
+	private:
+		/// A source pixel index and weight contributing to an output pixel.
+		struct SqTap
+		{
+			TqInt src;
+			TqFloat weight;
+			SqTap(TqInt src, TqFloat weight) : src(src), weight(weight) {}
+		};
+		typedef std::vector<SqTap> TqTapList;
+
+		static void computeTaps(const std::vector<TqFloat>& weights,
+				TqInt srcSize, EqWrapMode wrapMode, std::vector<TqTapList>& taps);
+		void filterRows(const ArrayT& band, TqInt begin, TqInt end);
+		void filterColumns(TqInt begin, TqInt end);
+
+		TqInt m_numChannels;
+		TqInt m_numThreads;
+		/// Source columns contributing to each output column.
+		std::vector<TqTapList> m_xTaps;
+		/// Source rows contributing to each output row.
+		std::vector<TqTapList> m_yTaps;
+		/// Horizontally filtered source rows; empty once no longer needed.
+		std::vector<std::vector<TqFloat> > m_rows;
+		/// Number of output rows still to be computed from each source row.
+		std::vector<TqInt> m_rowUses;
+		/** Output rows, paired with the last source row they need and sorted
+		 * into the order in which they can be computed.
+		 */
+		std::vector<std::pair<TqInt, TqInt> > m_outOrder;
+		/// Number of source rows filtered so far.
+		TqInt m_rowsAdded;
+		/// Number of entries of m_outOrder which have been computed.
+		TqInt m_outDone;
+		boost::shared_ptr<ArrayT> m_result;
+};
 
 
 
@@ -125,15 +234,18 @@ template<typename ArrayT>
 CqDownsampleIterator<ArrayT>::CqDownsampleIterator()
 	: m_buf(),
 	m_filterInfo(),
-	m_wrapModes()
+	m_wrapModes(),
+	m_numThreads(1)
 { }
 
 template<typename ArrayT>
 CqDownsampleIterator<ArrayT>::CqDownsampleIterator(boost::shared_ptr<ArrayT> buf,
-		const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes)
+		const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes,
+		TqInt numThreads)
 	: m_buf(buf),
 	m_filterInfo(filterInfo),
-	m_wrapModes(wrapModes)
+	m_wrapModes(wrapModes),
+	m_numThreads(numThreads)
 { }
 
 template<typename ArrayT>
@@ -142,7 +254,7 @@ CqDownsampleIterator<ArrayT>& CqDownsampleIterator<ArrayT>::operator++()
 	if(!m_buf)
 		return *this;
 	if(m_buf->width() > 1 || m_buf->height() > 1)
-		m_buf = downsample(*m_buf, m_filterInfo, m_wrapModes);
+		m_buf = downsample(*m_buf, m_filterInfo, m_wrapModes, m_numThreads);
 	else
 		m_buf.reset();
 	return *this;
@@ -166,31 +278,91 @@ bool CqDownsampleIterator<ArrayT>::operator!=(const CqDownsampleIterator<ArrayT>
 
 namespace detail {
 
-/** \brief Downsample a buffer for mipmapping via a nonseperable convolution.
+/** \brief Call func(rangeBegin, rangeEnd) on numThreads threads, splitting
+ * [begin, end) into contiguous ranges.
+ */
+template<typename FuncT>
+void parallelFor(TqInt begin, TqInt end, TqInt numThreads, const FuncT& func)
+{
+	TqInt count = end - begin;
+	numThreads = min(numThreads, count);
+	if(numThreads <= 1)
+	{
+		if(count > 0)
+			func(begin, end);
+		return;
+	}
+	boost::thread_group threads;
+	for(TqInt i = 0; i < numThreads; ++i)
+	{
+		threads.create_thread(boost::bind<void>(func, begin + count*i/numThreads,
+					begin + count*(i+1)/numThreads));
+	}
+	threads.join_all();
+}
+
+/** \brief Split a cached filter kernel into row and column weights.
  *
- * Nonseperable convolution is the most general way of forming a weighted
- * average during filtering.  A seperable convolution should be faster, but is
- * more complicated to implement.
+ * \param filterWeights - kernel to split
+ * \param xWeights - weights along x; w(x,y) == xWeights[x]*yWeights[y]
+ * \param yWeights - weights along y
+ * \return false if the kernel isn't separable.
+ */
+inline bool separateFilter(const CqCachedFilter& filterWeights,
+		std::vector<TqFloat>& xWeights, std::vector<TqFloat>& yWeights)
+{
+	const TqInt width = filterWeights.width();
+	const TqInt height = filterWeights.height();
+	const SqFilterSupport support = filterWeights.support();
+	xWeights.assign(width, 0);
+	yWeights.assign(height, 0);
+	TqFloat totWeight = 0;
+	for(TqInt j = 0; j < height; ++j)
+	{
+		for(TqInt i = 0; i < width; ++i)
+		{
+			TqFloat w = filterWeights(support.sx.start + i, support.sy.start + j);
+			xWeights[i] += w;
+			yWeights[j] += w;
+			totWeight += w;
+		}
+	}
+	if(totWeight <= 0)
+		return false;
+	// If the kernel is separable, it's the outer product of its row and
+	// column sums divided by the total weight.  Small weights are zeroed by
+	// CqCachedFilter, so only ask for agreement to within that tolerance.
+	for(TqInt j = 0; j < height; ++j)
+	{
+		for(TqInt i = 0; i < width; ++i)
+		{
+			TqFloat w = filterWeights(support.sx.start + i, support.sy.start + j);
+			if(std::fabs(w - xWeights[i]*yWeights[j]/totWeight) > 1e-4f)
+				return false;
+		}
+	}
+	for(TqInt i = 0; i < width; ++i)
+		xWeights[i] /= totWeight;
+	for(TqInt j = 0; j < height; ++j)
+		yWeights[j] /= totWeight;
+	return true;
+}
+
+/** \brief Compute a range of rows of a nonseperably downsampled image.
  *
- * \param srcBuf - input texture buffer.
- * \param mipmapRatio - scale factor for the new file (0.5 for normal mipmapping)
- * \param filterWeights - precomputed kernel of filter weights
- * \param wrapModes - specify how the texture will be wrapped at the edges.
+ * \see downsampleNonseperable
  */
 template<typename ArrayT>
-boost::shared_ptr<ArrayT> downsampleNonseperable(
-		const ArrayT& srcBuf, TqInt mipmapRatio,
-		CqCachedFilter& filterWeights, const SqWrapModes& wrapModes)
+void downsampleNonseperableRows(const ArrayT& srcBuf, CqCachedFilter filterWeights,
+		const SqWrapModes wrapModes, ArrayT& destBuf, TqInt begin, TqInt end)
 {
-	TqInt newWidth = lceil(TqFloat(srcBuf.width())/mipmapRatio);
-	TqInt newHeight = lceil(TqFloat(srcBuf.height())/mipmapRatio);
+	TqInt newWidth = destBuf.width();
 	TqInt numChannels = srcBuf.numChannels();
-	boost::shared_ptr<ArrayT> destBuf(new ArrayT(newWidth, newHeight, numChannels));
 	TqInt filterOffsetX = (filterWeights.width()-1) / 2;
 	TqInt filterOffsetY = (filterWeights.height()-1) / 2;
 	std::vector<TqFloat> accumBuf(numChannels);
 	// Loop over pixels in the output image.
-	for(TqInt y = 0; y < newHeight; ++y)
+	for(TqInt y = begin; y < end; ++y)
 	{
 		for(TqInt x = 0; x < newWidth; ++x)
 		{
@@ -200,9 +372,36 @@ boost::shared_ptr<ArrayT> downsampleNonseperable(
 			CqSampleAccum<CqCachedFilter> accumulator(filterWeights, 0, numChannels, &accumBuf[0]);
 			filterTexture(accumulator, srcBuf, filterWeights.support(),
 					SqWrapModes(wrapModes.sWrap, wrapModes.tWrap));
-			destBuf->setPixel(x, y, &accumBuf[0]);
+			destBuf.setPixel(x, y, &accumBuf[0]);
 		}
 	}
+}
+
+/** \brief Downsample a buffer for mipmapping via a nonseperable convolution.
+ *
+ * Nonseperable convolution is the most general way of forming a weighted
+ * average during filtering.  CqSeparableDownsampler is used instead where
+ * possible since it's a lot faster for wide filters.
+ *
+ * \param srcBuf - input texture buffer.
+ * \param mipmapRatio - scale factor for the new file (0.5 for normal mipmapping)
+ * \param filterWeights - precomputed kernel of filter weights
+ * \param wrapModes - specify how the texture will be wrapped at the edges.
+ * \param numThreads - number of threads to split the output rows between.
+ */
+template<typename ArrayT>
+boost::shared_ptr<ArrayT> downsampleNonseperable(
+		const ArrayT& srcBuf, TqInt mipmapRatio,
+		const CqCachedFilter& filterWeights, const SqWrapModes& wrapModes,
+		TqInt numThreads)
+{
+	TqInt newWidth = lceil(TqFloat(srcBuf.width())/mipmapRatio);
+	TqInt newHeight = lceil(TqFloat(srcBuf.height())/mipmapRatio);
+	TqInt numChannels = srcBuf.numChannels();
+	boost::shared_ptr<ArrayT> destBuf(new ArrayT(newWidth, newHeight, numChannels));
+	parallelFor(0, newHeight, numThreads,
+			boost::bind(&downsampleNonseperableRows<ArrayT>, boost::cref(srcBuf),
+				filterWeights, wrapModes, boost::ref(*destBuf), _1, _2));
 	return destBuf;
 }
 
@@ -211,22 +410,201 @@ boost::shared_ptr<ArrayT> downsampleNonseperable(
 
 template<typename ArrayT>
 boost::shared_ptr<ArrayT> downsample(const ArrayT& srcBuf,
-		const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes)
+		const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes,
+		TqInt numThreads)
 {
 	// Amount to scale the image by.  Fixed at a factor of 2 for now.
 	TqInt mipmapRatio = 2;
 	TqFloat scale = 1.0f/mipmapRatio;
 
-	/// \todo Optimize for seperable filters.  This should also give some idea
-	/// about how to optimize the analogous filtering operations in the core renderer.
-	//
-	// if(FilterFunctorT::isSeperable()) ...
+	CqCachedFilter weights(filterInfo, srcBuf.width() % 2 != 0,
+			srcBuf.height() % 2 != 0, scale);
+	std::vector<TqFloat> xWeights;
+	std::vector<TqFloat> yWeights;
+	if(detail::separateFilter(weights, xWeights, yWeights))
+	{
+		CqSeparableDownsampler<ArrayT> downsampler(srcBuf.width(),
+				srcBuf.height(), srcBuf.numChannels(), filterInfo, wrapModes,
+				numThreads);
+		downsampler.addBand(srcBuf);
+		return downsampler.result();
+	}
 
 	// General case: Non-seperable filter.
+	return detail::downsampleNonseperable(srcBuf, mipmapRatio, weights,
+			wrapModes, numThreads);
+}
 
-	CqCachedFilter weights(filterInfo, srcBuf.width() % 2 != 0,
-			srcBuf.height() % 2 != 0, scale);
-	return detail::downsampleNonseperable(srcBuf, mipmapRatio, weights, wrapModes);
+
+//------------------------------------------------------------------------------
+// CqSeparableDownsampler implementation
+template<typename ArrayT>
+CqSeparableDownsampler<ArrayT>::CqSeparableDownsampler(TqInt srcWidth,
+		TqInt srcHeight, TqInt numChannels, const SqFilterInfo& filterInfo,
+		const SqWrapModes& wrapModes, TqInt numThreads)
+	: m_numChannels(numChannels),
+	m_numThreads(max(numThreads, 1)),
+	m_xTaps(),
+	m_yTaps(),
+	m_rows(srcHeight),
+	m_rowUses(srcHeight, 0),
+	m_outOrder(),
+	m_rowsAdded(0),
+	m_outDone(0),
+	m_result(new ArrayT(lceil(srcWidth/2.0f), lceil(srcHeight/2.0f), numChannels))
+{
+	CqCachedFilter weights(filterInfo, srcWidth % 2 != 0,
+			srcHeight % 2 != 0, 0.5f);
+	std::vector<TqFloat> xWeights;
+	std::vector<TqFloat> yWeights;
+	bool separable = detail::separateFilter(weights, xWeights, yWeights);
+	assert(separable);
+	computeTaps(xWeights, srcWidth, wrapModes.sWrap, m_xTaps);
+	computeTaps(yWeights, srcHeight, wrapModes.tWrap, m_yTaps);
+	// An output row may be computed as soon as the last source row it needs
+	// has been filtered.  With periodic wrapping that's the bottom row for
+	// the first few output rows, which are then left until the end.
+	TqInt newHeight = m_yTaps.size();
+	m_outOrder.resize(newHeight);
+	for(TqInt y = 0; y < newHeight; ++y)
+	{
+		TqInt lastRow = -1;
+		const TqTapList& taps = m_yTaps[y];
+		for(typename TqTapList::const_iterator t = taps.begin(); t != taps.end(); ++t)
+		{
+			++m_rowUses[t->src];
+			lastRow = max(lastRow, t->src);
+		}
+		m_outOrder[y] = std::make_pair(lastRow, y);
+	}
+	std::sort(m_outOrder.begin(), m_outOrder.end());
+}
+
+template<typename ArrayT>
+bool CqSeparableDownsampler<ArrayT>::isSeparable(const SqFilterInfo& filterInfo,
+		TqInt srcWidth, TqInt srcHeight)
+{
+	CqCachedFilter weights(filterInfo, srcWidth % 2 != 0,
+			srcHeight % 2 != 0, 0.5f);
+	std::vector<TqFloat> xWeights;
+	std::vector<TqFloat> yWeights;
+	return detail::separateFilter(weights, xWeights, yWeights);
+}
+
+template<typename ArrayT>
+void CqSeparableDownsampler<ArrayT>::addBand(const ArrayT& band)
+{
+	assert(m_rowsAdded + band.height() <= static_cast<TqInt>(m_rows.size()));
+	detail::parallelFor(0, band.height(), m_numThreads,
+			boost::bind(&CqSeparableDownsampler<ArrayT>::filterRows, this,
+				boost::cref(band), _1, _2));
+	m_rowsAdded += band.height();
+	// Compute all the output rows which are now ready.
+	TqInt outEnd = m_outDone;
+	while(outEnd < static_cast<TqInt>(m_outOrder.size())
+			&& m_outOrder[outEnd].first < m_rowsAdded)
+		++outEnd;
+	detail::parallelFor(m_outDone, outEnd, m_numThreads,
+			boost::bind(&CqSeparableDownsampler<ArrayT>::filterColumns, this,
+				_1, _2));
+	// Release the filtered source rows which won't be used again.
+	for(; m_outDone < outEnd; ++m_outDone)
+	{
+		const TqTapList& taps = m_yTaps[m_outOrder[m_outDone].second];
+		for(typename TqTapList::const_iterator t = taps.begin(); t != taps.end(); ++t)
+		{
+			if(--m_rowUses[t->src] == 0)
+				std::vector<TqFloat>().swap(m_rows[t->src]);
+		}
+	}
+}
+
+template<typename ArrayT>
+inline const boost::shared_ptr<ArrayT>& CqSeparableDownsampler<ArrayT>::result() const
+{
+	assert(m_outDone == static_cast<TqInt>(m_outOrder.size()));
+	return m_result;
+}
+
+template<typename ArrayT>
+void CqSeparableDownsampler<ArrayT>::computeTaps(const std::vector<TqFloat>& weights,
+		TqInt srcSize, EqWrapMode wrapMode, std::vector<TqTapList>& taps)
+{
+	TqInt newSize = lceil(srcSize/2.0f);
+	TqInt offset = (static_cast<TqInt>(weights.size())-1) / 2;
+	taps.assign(newSize, TqTapList());
+	for(TqInt i = 0; i < newSize; ++i)
+	{
+		for(TqInt k = 0, numWeights = weights.size(); k < numWeights; ++k)
+		{
+			if(weights[k] == 0)
+				continue;
+			TqInt src = 2*i - offset + k;
+			if(src < 0 || src >= srcSize)
+			{
+				// Apply the wrap mode in the same way as filterTexture(),
+				// which treats all modes other than black and clamp as
+				// periodic.
+				if(wrapMode == WrapMode_Black)
+					continue;
+				else if(wrapMode == WrapMode_Clamp)
+					src = clamp(src, 0, srcSize-1);
+				else
+					src = (src % srcSize + srcSize) % srcSize;
+			}
+			taps[i].push_back(SqTap(src, weights[k]));
+		}
+	}
+}
+
+template<typename ArrayT>
+void CqSeparableDownsampler<ArrayT>::filterRows(const ArrayT& band,
+		TqInt begin, TqInt end)
+{
+	const TqInt numChannels = m_numChannels;
+	const TqInt newWidth = m_xTaps.size();
+	for(TqInt y = begin; y < end; ++y)
+	{
+		TqInt srcRow = m_rowsAdded + y;
+		if(m_rowUses[srcRow] == 0)
+			continue;
+		std::vector<TqFloat>& row = m_rows[srcRow];
+		row.assign(newWidth*numChannels, 0);
+		for(TqInt x = 0; x < newWidth; ++x)
+		{
+			TqFloat* outPix = &row[x*numChannels];
+			const TqTapList& taps = m_xTaps[x];
+			for(typename TqTapList::const_iterator t = taps.begin(); t != taps.end(); ++t)
+			{
+				const typename ArrayT::TqSampleVector srcPix = band(t->src, y);
+				for(TqInt c = 0; c < numChannels; ++c)
+					outPix[c] += t->weight*srcPix[c];
+			}
+		}
+	}
+}
+
+template<typename ArrayT>
+void CqSeparableDownsampler<ArrayT>::filterColumns(TqInt begin, TqInt end)
+{
+	const TqInt numChannels = m_numChannels;
+	const TqInt newWidth = m_xTaps.size();
+	const TqInt rowLen = newWidth*numChannels;
+	std::vector<TqFloat> accum(rowLen);
+	for(TqInt i = begin; i < end; ++i)
+	{
+		TqInt y = m_outOrder[i].second;
+		std::fill(accum.begin(), accum.end(), 0.0f);
+		const TqTapList& taps = m_yTaps[y];
+		for(typename TqTapList::const_iterator t = taps.begin(); t != taps.end(); ++t)
+		{
+			const TqFloat* srcRow = &m_rows[t->src][0];
+			for(TqInt j = 0; j < rowLen; ++j)
+				accum[j] += t->weight*srcRow[j];
+		}
+		for(TqInt x = 0; x < newWidth; ++x)
+			m_result->setPixel(x, y, &accum[x*numChannels]);
+	}
 }
 
 } // namespace Aqsis
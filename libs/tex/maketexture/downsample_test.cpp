@@ -0,0 +1,169 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for mipmap downsampling.
+ */
+
+#include "downsample.h"
+
+#include <cmath>
+
+#include <aqsis/tex/buffers/texturebuffer.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(downsample_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+typedef CqTextureBuffer<TqFloat> TqBuffer;
+
+// Separable gaussian filter.
+TqFloat gaussianFilter(TqFloat x, TqFloat y, TqFloat xwidth, TqFloat ywidth)
+{
+	x /= xwidth;
+	y /= ywidth;
+	return std::exp(-8*(x*x + y*y));
+}
+
+// Nonseparable filter with diamond shaped support.
+TqFloat diamondFilter(TqFloat x, TqFloat y, TqFloat xwidth, TqFloat ywidth)
+{
+	return std::max(0.0f, 1 - 2*(std::fabs(x/xwidth) + std::fabs(y/ywidth)));
+}
+
+boost::shared_ptr<TqBuffer> testImage(TqInt width, TqInt height, TqInt numChannels)
+{
+	boost::shared_ptr<TqBuffer> buf(new TqBuffer(width, height, numChannels));
+	for(TqInt y = 0; y < height; ++y)
+	{
+		for(TqInt x = 0; x < width; ++x)
+		{
+			TqFloat* pix = buf->value(x, y);
+			for(TqInt c = 0; c < numChannels; ++c)
+				pix[c] = 0.5f + 0.5f*std::sin(0.7f*x + 1.3f*y + 2.1f*c);
+		}
+	}
+	return buf;
+}
+
+// Copy the scanlines [startLine, startLine+numScanlines) of src into band.
+void copyBand(const TqBuffer& src, TqInt startLine, TqInt numScanlines, TqBuffer& band)
+{
+	band.resize(src.width(), numScanlines, src.numChannels());
+	for(TqInt y = 0; y < numScanlines; ++y)
+		for(TqInt x = 0; x < src.width(); ++x)
+			band.setPixel(x, y, src(x, startLine + y));
+}
+
+void checkBuffersClose(const TqBuffer& a, const TqBuffer& b)
+{
+	BOOST_REQUIRE_EQUAL(a.width(), b.width());
+	BOOST_REQUIRE_EQUAL(a.height(), b.height());
+	BOOST_REQUIRE_EQUAL(a.numChannels(), b.numChannels());
+	TqFloat maxDiff = 0;
+	for(TqInt y = 0; y < a.height(); ++y)
+		for(TqInt x = 0; x < a.width(); ++x)
+			for(TqInt c = 0; c < a.numChannels(); ++c)
+				maxDiff = std::max(maxDiff, std::fabs(a(x,y)[c] - b(x,y)[c]));
+	BOOST_CHECK_SMALL(maxDiff, 1e-4f);
+}
+
+} // unnamed namespace
+
+
+BOOST_AUTO_TEST_CASE(downsample_separable_detection_test)
+{
+	BOOST_CHECK(CqSeparableDownsampler<TqBuffer>::isSeparable(
+				SqFilterInfo(gaussianFilter, 4, 4), 20, 13));
+	BOOST_CHECK(!CqSeparableDownsampler<TqBuffer>::isSeparable(
+				SqFilterInfo(diamondFilter, 4, 4), 20, 13));
+}
+
+BOOST_AUTO_TEST_CASE(downsample_separable_matches_nonseparable_test)
+{
+	// The separable downsampler should give the same result as direct 2D
+	// filtering, for each pair of wrap modes and for odd and even image sizes.
+	const EqWrapMode modes[] = {WrapMode_Black, WrapMode_Periodic, WrapMode_Clamp};
+	const TqInt sizes[][2] = { {16, 16}, {17, 10}, {5, 23}, {2, 1} };
+	for(TqInt m = 0; m < 9; ++m)
+	{
+		for(TqInt s = 0; s < 4; ++s)
+		{
+			SqWrapModes wrapModes(modes[m%3], modes[m/3]);
+			SqFilterInfo filterInfo(gaussianFilter, 3, 5);
+			boost::shared_ptr<TqBuffer> src = testImage(sizes[s][0], sizes[s][1], 3);
+			CqCachedFilter weights(filterInfo, src->width() % 2 != 0,
+					src->height() % 2 != 0, 0.5f);
+			boost::shared_ptr<TqBuffer> direct = detail::downsampleNonseperable(
+					*src, 2, weights, wrapModes, 1);
+			checkBuffersClose(*downsample(*src, filterInfo, wrapModes), *direct);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(downsample_banded_test)
+{
+	// Feeding the source in bands with several threads should give the same
+	// result as downsampling it all at once.
+	SqWrapModes wrapModes(WrapMode_Periodic, WrapMode_Periodic);
+	SqFilterInfo filterInfo(gaussianFilter, 4, 4);
+	boost::shared_ptr<TqBuffer> src = testImage(37, 41, 2);
+	boost::shared_ptr<TqBuffer> whole = downsample(*src, filterInfo, wrapModes);
+	const TqInt bandHeights[] = {1, 3, 8, 41};
+	for(TqInt i = 0; i < 4; ++i)
+	{
+		CqSeparableDownsampler<TqBuffer> downsampler(src->width(), src->height(),
+				src->numChannels(), filterInfo, wrapModes, 3);
+		TqBuffer band;
+		for(TqInt y = 0; y < src->height(); y += bandHeights[i])
+		{
+			copyBand(*src, y, std::min(bandHeights[i], src->height() - y), band);
+			downsampler.addBand(band);
+		}
+		checkBuffersClose(*downsampler.result(), *whole);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(downsample_threaded_nonseparable_test)
+{
+	SqWrapModes wrapModes(WrapMode_Clamp, WrapMode_Black);
+	SqFilterInfo filterInfo(diamondFilter, 4, 4);
+	boost::shared_ptr<TqBuffer> src = testImage(31, 18, 1);
+	checkBuffersClose(*downsample(*src, filterInfo, wrapModes, 4),
+			*downsample(*src, filterInfo, wrapModes, 1));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
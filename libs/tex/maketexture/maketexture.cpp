@@ -40,6 +40,7 @@
 #include <algorithm>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <aqsis/math/math.h>
 #include "bake.h"
@@ -61,6 +62,59 @@ namespace {
 // Helper functions and classes
 //------------------------------------------------------------------------------
 
+/** \brief Limits on the resources used for mipmap generation.
+ *
+ * These come from the optional "threads" and "memorylimit" parameters of the
+ * texture making calls.
+ */
+struct SqMipmapLimits
+{
+	/// Number of threads to use for filtering.
+	TqInt numThreads;
+	/// Approximate memory limit in bytes, or zero for no limit.
+	TqDouble memoryLimit;
+
+	/// Extract the limits from the optional parameters.
+	SqMipmapLimits(const CqRiParamList& paramList)
+		: numThreads(paramList.find<TqInt>("threads", 1)),
+		memoryLimit(max(paramList.find<TqInt>("memorylimit", 0), 0)*1024.0*1024.0)
+	{
+		// Zero or fewer threads means one per processor.
+		if(numThreads <= 0)
+			numThreads = max<TqInt>(boost::thread::hardware_concurrency(), 1);
+	}
+};
+
+/** \brief Read scanlines from a texture source, converting the channel type
+ * if necessary.
+ *
+ * SrcChannelT is the channel type stored in the source, ChannelT the channel
+ * type of the buffer.
+ */
+template<typename SrcChannelT, typename ChannelT>
+struct SqPixelReader
+{
+	template<typename TexSrcT>
+	static void read(const TexSrcT& texSrc, TqInt startLine, TqInt numScanlines,
+			CqTextureBuffer<ChannelT>& buf)
+	{
+		CqTextureBuffer<SrcChannelT> srcBuf;
+		texSrc.readPixels(srcBuf, startLine, numScanlines);
+		buf = srcBuf;
+	}
+};
+
+template<typename ChannelT>
+struct SqPixelReader<ChannelT, ChannelT>
+{
+	template<typename TexSrcT>
+	static void read(const TexSrcT& texSrc, TqInt startLine, TqInt numScanlines,
+			CqTextureBuffer<ChannelT>& buf)
+	{
+		texSrc.readPixels(buf, startLine, numScanlines);
+	}
+};
+
 /** \brief Downsample the provided buffer into the given output file.
  *
  * \param buf - Pointer to source data.  This smart pointer is reset to save
@@ -69,15 +123,16 @@ namespace {
  * \param outFile - output file for the mipmapped data
  * \param filterInfo - information about which filter type and size to use
  * \param wrapModes - specifies how the texture will be wrapped at the edges.
+ * \param numThreads - number of threads to filter with.
  */
 template<typename ChannelT>
 void downsampleToFile(boost::shared_ptr<CqTextureBuffer<ChannelT> >& buf,
 		IqMultiTexOutputFile& outFile, const SqFilterInfo& filterInfo,
-		const SqWrapModes wrapModes)
+		const SqWrapModes wrapModes, TqInt numThreads)
 {
 	outFile.writePixels(*buf);
 	typedef CqDownsampleIterator<CqTextureBuffer<ChannelT> > TqDownsampleIter;
-	for(TqDownsampleIter i = ++TqDownsampleIter(buf, filterInfo, wrapModes),
+	for(TqDownsampleIter i = ++TqDownsampleIter(buf, filterInfo, wrapModes, numThreads),
 			end = TqDownsampleIter(); i != end; ++i)
 	{
 		buf = *i;
@@ -88,83 +143,128 @@ void downsampleToFile(boost::shared_ptr<CqTextureBuffer<ChannelT> >& buf,
 
 /** \brief Create a mipmap from pixel data in the given input file.
  *
- * ChannelT is the pixel component type.
+ * SrcChannelT is the pixel component type of the source and ChannelT the
+ * type used for the mipmap.
+ *
+ * When the filter is separable the top level is never held in memory all at
+ * once.  It's read in bands of scanlines which are written straight to the
+ * output and filtered down to the next level as they arrive.  The band height
+ * is chosen to keep the memory used for the band and the next level within
+ * the memory limit, if there is one.  The remaining levels are a third of the
+ * size of the top level, so are made in memory.
  *
- * \param inFile - input file from which the data should be read
+ * \param texSrc - texture source from which the data should be read
  * \param outFile - name of output file for the mipmapped data
  * \param filterInfo - information about which filter type and size to use
  * \param wrapModes - specifies how the texture will be wrapped at the edges.
+ * \param limits - limits on threads and memory to use.
  */
-template<typename TexSrcT, typename ChannelT>
+template<typename SrcChannelT, typename ChannelT, typename TexSrcT>
 void createMipmapTyped(const TexSrcT& texSrc, IqMultiTexOutputFile& outFile,
-		const SqFilterInfo& filterInfo, const SqWrapModes wrapModes)
+		const SqFilterInfo& filterInfo, const SqWrapModes wrapModes,
+		const SqMipmapLimits& limits)
 {
-	// Read pixels into the input buffer.
-	boost::shared_ptr<CqTextureBuffer<ChannelT> > buf(new CqTextureBuffer<ChannelT>());
-	texSrc.readPixels(*buf);
-	downsampleToFile(buf, outFile, filterInfo, wrapModes);
-}
+	const CqTexFileHeader& header = outFile.header();
+	const TqInt width = header.width();
+	const TqInt height = header.height();
+	const TqInt numChannels = header.channelList().numChannels();
+	boost::shared_ptr<CqTextureBuffer<ChannelT> > buf;
+	if((width == 1 && height == 1) || !CqSeparableDownsampler<
+			CqTextureBuffer<ChannelT> >::isSeparable(filterInfo, width, height))
+	{
+		// Read pixels into the input buffer.
+		buf.reset(new CqTextureBuffer<ChannelT>());
+		SqPixelReader<SrcChannelT, ChannelT>::read(texSrc, 0, height, *buf);
+		downsampleToFile(buf, outFile, filterInfo, wrapModes, limits.numThreads);
+		return;
+	}
 
-/// Specialization for OpenEXR half data format (TIFF can't handle half data)
-template<typename TexSrcT>
-void createMipmapTypedHalf(const TexSrcT& texSrc, IqMultiTexOutputFile& outFile,
-		const SqFilterInfo& filterInfo, const SqWrapModes wrapModes)
-{
-#	ifdef USE_OPENEXR
-	// Read pixels into the input buffer and convert to 32-bit floating point
-	// since TIFF can't the half data type.
-	CqTextureBuffer<half> halfBuf;
-	texSrc.readPixels(halfBuf);
-	boost::shared_ptr<CqTextureBuffer<TqFloat> > buf(
-			new CqTextureBuffer<TqFloat>(halfBuf));
-	downsampleToFile(buf, outFile, filterInfo, wrapModes);
-#	else
-	assert(0 && "Compiled without OpenEXR support");
-#	endif
+	const TqDouble rowBytes = TqDouble(width)*numChannels*sizeof(ChannelT);
+	TqInt bandHeight = height;
+	if(limits.memoryLimit > 0)
+	{
+		// Leave room for the next level, which is a quarter the size.
+		TqDouble bandBytes = limits.memoryLimit - rowBytes*height/4;
+		bandHeight = static_cast<TqInt>(clamp(bandBytes/rowBytes, 1.0, TqDouble(height)));
+		// Tiled output must be written in whole rows of tiles.
+		if(const SqTileInfo* tileInfo = header.findPtr<Attr::TileInfo>())
+			bandHeight = max(tileInfo->height, bandHeight/tileInfo->height*tileInfo->height);
+		if(bandBytes < rowBytes*bandHeight)
+		{
+			Aqsis::log() << warning << "Memory limit of "
+				<< lround(limits.memoryLimit/(1024*1024)) << "MB is too small to mipmap "
+				<< width << "x" << height << " texture; using "
+				<< lceil(rowBytes*(bandHeight + height/4)/(1024*1024)) << "MB\n";
+		}
+	}
+
+	CqSeparableDownsampler<CqTextureBuffer<ChannelT> > downsampler(width,
+			height, numChannels, filterInfo, wrapModes, limits.numThreads);
+	{
+		CqTextureBuffer<ChannelT> band;
+		for(TqInt startLine = 0; startLine < height; startLine += bandHeight)
+		{
+			SqPixelReader<SrcChannelT, ChannelT>::read(texSrc, startLine,
+					min(bandHeight, height - startLine), band);
+			outFile.writePixels(band);
+			downsampler.addBand(band);
+		}
+	}
+	buf = downsampler.result();
+	outFile.newSubImage(buf->width(), buf->height());
+	downsampleToFile(buf, outFile, filterInfo, wrapModes, limits.numThreads);
 }
 
 /** \brief Create a mipmap given a texture source and save it to a file.
  *
- * \param texSrc - a "texture source" class.  Needs one method, readPixels().
- *                 IqTexInputFile is a model of this type.
+ * \param texSrc - a "texture source" class.  Needs one method,
+ *                 readPixels(buf, startLine, numScanlines).  IqTexInputFile
+ *                 is a model of this type.
  * \param chanType - texture channel type of input.
  * \param outFile - output file into which texture data will be placed.
  * \param filterInfo - information about mipmap downsampling filter type and size
  * \param wrapModes - specify how texture will be wrapped at edges during
  *            downsampling.
+ * \param limits - limits on threads and memory to use.
  */
 template<typename TexSrcT>
 void createMipmap(const TexSrcT& texSrc, const EqChannelType chanType,
 		IqMultiTexOutputFile& outFile, const SqFilterInfo& filterInfo,
-		const SqWrapModes& wrapModes)
+		const SqWrapModes& wrapModes, const SqMipmapLimits& limits)
 {
 	// Dispatche to mipmapping function based on the type of the input
 	// texture data.
 	switch(chanType)
 	{
 		case Channel_Float32:
-			createMipmapTyped<TexSrcT,TqFloat>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqFloat,TqFloat>(texSrc, outFile, filterInfo, wrapModes, limits);
 			break;
 		case Channel_Unsigned32:
-			createMipmapTyped<TexSrcT,TqUint32>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqUint32,TqUint32>(texSrc, outFile, filterInfo, wrapModes, limits);
 			break;
 		case Channel_Signed32:
-			createMipmapTyped<TexSrcT,TqInt32>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqInt32,TqInt32>(texSrc, outFile, filterInfo, wrapModes, limits);
 			break;
 		case Channel_Unsigned16:
-			createMipmapTyped<TexSrcT,TqUint16>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqUint16,TqUint16>(texSrc, outFile, filterInfo, wrapModes, limits);
 			break;
 		case Channel_Signed16:
-			createMipmapTyped<TexSrcT,TqInt16>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqInt16,TqInt16>(texSrc, outFile, filterInfo, wrapModes, limits);
 			break;
 		case Channel_Unsigned8:
-			createMipmapTyped<TexSrcT,TqUint8>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqUint8,TqUint8>(texSrc, outFile, filterInfo, wrapModes, limits);
 			break;
 		case Channel_Signed8:
-			createMipmapTyped<TexSrcT,TqInt8>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqInt8,TqInt8>(texSrc, outFile, filterInfo, wrapModes, limits);
 			break;
 		case Channel_Float16:
-			createMipmapTypedHalf(texSrc, outFile, filterInfo, wrapModes);
+#			ifdef USE_OPENEXR
+			// Convert to 32-bit floating point since TIFF can't handle the
+			// half data type.
+			createMipmapTyped<half,TqFloat>(texSrc, outFile, filterInfo, wrapModes, limits);
+#			else
+			assert(0 && "Compiled without OpenEXR support");
+#			endif
 			break;
 		default:
 			AQSIS_THROW_XQERROR(XqBadTexture, EqE_Limit,
@@ -204,10 +304,10 @@ void copyPixels(const CqTextureBuffer<ChannelT>& src, TqInt topLeftX, TqInt topL
  *
  * This class is a proxy for a texture input file.  We need it because it's
  * convenient to assume (for the other functions) that the input texture for
- * mipmapping will come from a single call to readPixels().  The readPixels()
- * in this class therefore stands in for IqTexInputFile::readPixels(),
- * performing texture concatenation in the correct order for cube face
- * environment texture generation.
+ * mipmapping comes from a single image.  The readPixels() in this class
+ * therefore stands in for IqTexInputFile::readPixels(), performing texture
+ * concatenation in the correct order for cube face environment texture
+ * generation.
  */
 class CqCubeFaceTextureSource
 {
@@ -229,11 +329,19 @@ class CqCubeFaceTextureSource
 			m_pz(pz), m_nz(nz)
 		{ }
 		/** \brief Read pixels from the six faces and concatenate into buf.
+		 *
+		 * The faces are laid out with +x, +y and +z along the top and -x, -y
+		 * and -z along the bottom.
 		 *
 		 * \param buf - output buffer for pixel data.
+		 * \param startLine - scanline of the concatenated image to start
+		 *                    reading from (top == 0)
+		 * \param numScanlines - number of scanlines to read.  If this is
+		 *                       negative, read until the end of the image.
 		 */
 		template<typename ChannelT>
-		void readPixels(CqTextureBuffer<ChannelT>& buf) const
+		void readPixels(CqTextureBuffer<ChannelT>& buf, TqInt startLine = 0,
+				TqInt numScanlines = -1) const
 		{
 			assert(m_px.header().channelList().sharedChannelType()
 					== getChannelTypeEnum<ChannelT>());
@@ -242,16 +350,30 @@ class CqCubeFaceTextureSource
 			TqInt faceWidth = m_px.header().width();
 			TqInt faceHeight = m_px.header().height();
 			TqInt numChans = m_px.header().channelList().numChannels();
-			buf.resize(faceWidth*3, faceHeight*2, numChans);
+			if(numScanlines <= 0)
+				numScanlines = 2*faceHeight - startLine;
+			buf.resize(faceWidth*3, numScanlines, numChans);
 
 			// Extract pixels from the input files and copy into buf.
+			const IqTexInputFile* faces[2][3] = {
+				{&m_px, &m_py, &m_pz},
+				{&m_nx, &m_ny, &m_nz}
+			};
 			CqTextureBuffer<ChannelT> tmpBuf;
-			m_px.readPixels(tmpBuf); copyPixels(tmpBuf, 0, 0, buf);
-			m_nx.readPixels(tmpBuf); copyPixels(tmpBuf, 0, faceHeight, buf);
-			m_py.readPixels(tmpBuf); copyPixels(tmpBuf, faceWidth, 0, buf);
-			m_ny.readPixels(tmpBuf); copyPixels(tmpBuf, faceWidth, faceHeight, buf);
-			m_pz.readPixels(tmpBuf); copyPixels(tmpBuf, 2*faceWidth, 0, buf);
-			m_nz.readPixels(tmpBuf); copyPixels(tmpBuf, 2*faceWidth, faceHeight, buf);
+			for(TqInt row = 0; row < 2; ++row)
+			{
+				// Scanlines of the faces in this row which lie in the band.
+				TqInt begin = max(startLine - row*faceHeight, 0);
+				TqInt end = min(startLine + numScanlines - row*faceHeight, faceHeight);
+				if(begin >= end)
+					continue;
+				for(TqInt i = 0; i < 3; ++i)
+				{
+					faces[row][i]->readPixels(tmpBuf, begin, end - begin);
+					copyPixels(tmpBuf, i*faceWidth,
+							row*faceHeight + begin - startLine, buf);
+				}
+			}
 		}
 };
 
@@ -364,7 +486,7 @@ void makeTexture(const boostfs::path& inFileName, const boostfs::path& outFileNa
 
 	// Create mipmap, saving to the output file.
 	createMipmap(*inFile, inFile->header().channelList().sharedChannelType(),
-			*outFile, filterInfo, wrapModes);
+			*outFile, filterInfo, wrapModes, SqMipmapLimits(paramList));
 }
 
 
@@ -406,7 +528,7 @@ void makeCubeFaceEnvironment(
 	// Create mipmap, saving to the output file.
 	createMipmap(CqCubeFaceTextureSource(*inPx, *inNx, *inPy, *inNy, *inPz, *inNz),
 			inPx->header().channelList().sharedChannelType(),
-			*outFile, filterInfo, wrapModes);
+			*outFile, filterInfo, wrapModes, SqMipmapLimits(paramList));
 }
 
 
@@ -430,7 +552,7 @@ void makeLatLongEnvironment(const boostfs::path& inFileName,
 
 	// Create mipmap, saving to the output file.
 	createMipmap(*inFile, inFile->header().channelList().sharedChannelType(),
-			*outFile, filterInfo, wrapModes);
+			*outFile, filterInfo, wrapModes, SqMipmapLimits(paramList));
 }
 
 
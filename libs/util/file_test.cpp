@@ -80,6 +80,11 @@ BOOST_AUTO_TEST_CASE(findFile_test)
 	// Check that directories aren't considered.
 	BOOST_CHECK_THROW(findFile("./foo", "."),
 			XqInvalidFile);
+
+	// Clean up, so the file isn't left in the tree.
+	boostfs::remove_all("./foo/bar");
+	if(boostfs::is_empty("./foo"))
+		boostfs::remove("./foo");
 }
 
 
@@ -62,7 +62,21 @@ int EmitterMesh::numFaces() const
 	return m_faces.size();
 }
 
-boost::shared_ptr<PrimVars> EmitterMesh::particlesOnFace(int faceIdx)
+float EmitterMesh::numParticles(int faceIdx) const
+{
+	return m_faces[faceIdx].weight*m_totParticles;
+}
+
+void EmitterMesh::faceVertices(int faceIdx, std::vector<Vec3>& P) const
+{
+	const MeshFace& face = m_faces[faceIdx];
+	P.resize(face.numVerts);
+	for(int i = 0; i < face.numVerts; ++i)
+		P[i] = m_P[face.v[i]];
+}
+
+boost::shared_ptr<PrimVars> EmitterMesh::particlesOnFace(int faceIdx,
+		SeededRand& rand)
 {
 	const MeshFace& face = m_faces[faceIdx];
 
@@ -70,7 +84,7 @@ boost::shared_ptr<PrimVars> EmitterMesh::particlesOnFace(int faceIdx)
 
 	float numParticlesCts = face.weight*m_totParticles;
 	int numParticles = Aqsis::lfloor(face.weight*m_totParticles);
-	if(numParticlesCts - numParticles > uRand())
+	if(numParticlesCts - numParticles > rand())
 		++numParticles;
 	if(numParticles == 0)
 		return boost::shared_ptr<PrimVars>();
@@ -111,8 +125,8 @@ boost::shared_ptr<PrimVars> EmitterMesh::particlesOnFace(int faceIdx)
 	}
 
 	// Float offsets for randomized quasi Monte-Carlo distribution
-	float uOffset = float(std::rand())/RAND_MAX;
-	float vOffset = float(std::rand())/RAND_MAX;
+	float uOffset = rand();
+	float vOffset = rand();
 	// loop over child particles
 	for(int particleNum = 0; particleNum < numParticles; ++particleNum)
 	{
@@ -69,6 +69,16 @@ class EmitterMesh
 		/// Get the number of faces in the mesh
 		int numFaces() const;
 
+		/// Get the expected number of particles generated on a face.
+		float numParticles(int faceIdx) const;
+
+		/** Get the positions of the vertices of a face.
+		 *
+		 * \param faceIdx - index of the face in the mesh
+		 * \param P - vertex positions (output)
+		 */
+		void faceVertices(int faceIdx, std::vector<Vec3>& P) const;
+
 		/** Randomly generate particle positions on a face, and interpolate
 		 * primvars from the mesh.
 		 *
@@ -77,9 +87,10 @@ class EmitterMesh
 		 * even over the whole mesh.
 		 *
 		 * \param faceIdx - index of the face in the mesh
+		 * \param rand - random number generator for the face.
 		 * \return A set of interpolated primvars for random positions on the face.
 		 */
-		boost::shared_ptr<PrimVars> particlesOnFace(int faceIdx);
+		boost::shared_ptr<PrimVars> particlesOnFace(int faceIdx, SeededRand& rand);
 
 	private:
 		struct MeshFace;
@@ -28,6 +28,7 @@
 //
 // (This is the New BSD license)
 
+#include <cfloat>
 #include <vector>
 #include <iostream>
 #include <sstream>
@@ -37,6 +38,8 @@
 #include <aqsis/math/math.h>
 #include <aqsis/math/matrix.h>
 
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/thread.hpp>
 #include <boost/tokenizer.hpp>
 #include <boost/algorithm/string/trim.hpp>
 
@@ -98,6 +101,8 @@ struct HairParams
 	std::string hairFileName;
 	Aqsis::CqMatrix emitterToHairMatrix;
 	HairModifiers hairModifiers;
+	int hairsPerProcedural;
+	int numThreads;
 	bool verbose;
 
 	/** Parse hair parameters from the given input string.
@@ -118,6 +123,8 @@ struct HairParams
 		hairFileName(),
 		emitterToHairMatrix(),
 		hairModifiers(),
+		hairsPerProcedural(5000),
+		numThreads(0),
 		verbose(false)
 	{
 		typedef boost::tokenizer<boost::char_separator<char> > Tokenizer;
@@ -163,6 +170,14 @@ struct HairParams
 				if(i == 16)
 					emitterToHairMatrix = Aqsis::CqMatrix(mInit);
 			}
+			else if(name == "hairs_per_procedural")
+			{
+				valueStream >> hairsPerProcedural;
+			}
+			else if(name == "threads")
+			{
+				valueStream >> numThreads;
+			}
 			else if(name == "verbose")
 			{
 				valueStream >> std::boolalpha >> verbose;
@@ -186,10 +201,30 @@ struct HairParams
 	}
 };
 
+class HairProcedural;
+
+/// Blind data for a procedural generating the hairs on a range of faces.
+struct HairFaceGroup
+{
+	boost::shared_ptr<const HairProcedural> hairs;
+	int beginFace;
+	int endFace;
+
+	HairFaceGroup(const boost::shared_ptr<const HairProcedural>& hairs,
+			int beginFace, int endFace)
+		: hairs(hairs),
+		beginFace(beginFace),
+		endFace(endFace)
+	{ }
+};
+
+static RtVoid subdivideFaceGroup(RtPointer blinddata, RtFloat detailsize);
+static RtVoid freeFaceGroup(RtPointer blinddata);
+
 //------------------------------------------------------------------------------
 /** Holder for procedural data related to hair generation.
  */
-class HairProcedural
+class HairProcedural : public boost::enable_shared_from_this<HairProcedural>
 {
 	private:
 		boost::shared_ptr<EmitterMesh> m_emitter;
@@ -279,6 +314,10 @@ class HairProcedural
 			if(!m_parentHairs)
 				throw std::runtime_error("Could not find parent Curves in file");
 
+			if(m_params.numThreads <= 0)
+				m_params.numThreads = boost::thread::hardware_concurrency();
+			m_params.numThreads = std::max(m_params.numThreads, 1);
+
 			if(m_params.verbose)
 			{
 				std::cout << "hairgen: Created hair procedural with "
@@ -286,28 +325,64 @@ class HairProcedural
 			}
 		}
 
-		/** Subdivide the hair procedural into a set of RiCurves
+		/** Subdivide the hair procedural into one procedural per group of
+		 * faces of the emitting mesh.
 		 *
-		 * subdivide() generates one set of RiCurves per face of the emitting mesh.
-		 * In principle it should generate a new procedural for each face so
-		 * that hairs can be culled, but presently it just generates all hairs
-		 * upfront.
+		 * Faces are grouped in mesh order until each group is expected to
+		 * hold about hairs_per_procedural hairs.  The bound of each group
+		 * comes from the faces and the extent of the parent hairs, so the
+		 * hairs of a group are only generated once the renderer reaches a
+		 * bucket they touch.
 		 */
 		void subdivide() const
 		{
+			int numFaces = m_emitter->numFaces();
+			int beginFace = 0;
+			int numGroups = 0;
+			float groupHairs = 0;
+			for(int faceNum = 0; faceNum < numFaces; ++faceNum)
+			{
+				groupHairs += m_emitter->numParticles(faceNum);
+				if(groupHairs >= m_params.hairsPerProcedural
+						|| faceNum == numFaces-1)
+				{
+					emitFaceGroup(beginFace, faceNum+1);
+					beginFace = faceNum+1;
+					groupHairs = 0;
+					++numGroups;
+				}
+			}
 			if(m_params.verbose)
-				std::cout << "hairgen: Starting hair generation\n";
-			for(int faceNum = 0, numFaces = m_emitter->numFaces();
-					faceNum < numFaces; ++faceNum)
 			{
+				std::cout << "hairgen: Split hair into " << numGroups
+					<< " procedurals\n";
+			}
+		}
+
+		/** Generate the RiCurves for a range of faces of the emitting mesh.
+		 *
+		 * One set of RiCurves is generated per face.  The hairs on a face
+		 * depend only on the face number, not on the order in which faces
+		 * are generated.
+		 */
+		void generate(int beginFace, int endFace) const
+		{
+			if(m_params.verbose)
+			{
+				std::cout << "hairgen: Generating hair for faces "
+					<< beginFace << " to " << endFace-1 << "\n";
+			}
+			for(int faceNum = beginFace; faceNum < endFace; ++faceNum)
+			{
+				SeededRand rand(faceNum);
 				boost::shared_ptr<PrimVars> faceVars =
-					m_emitter->particlesOnFace(faceNum);
+					m_emitter->particlesOnFace(faceNum, rand);
 				if(!faceVars)
 					continue;
 
 				transformPrimVars(*faceVars, m_params.emitterToHairMatrix);
 
-				m_parentHairs->childInterp(*faceVars);
+				m_parentHairs->childInterp(*faceVars, rand, m_params.numThreads);
 
 				// Alternative - generate hairs directly without parent hairs.
 //				linearHairsFromPoints(*faceVars);
@@ -330,21 +405,55 @@ class HairProcedural
 						  (char*)"nonperiodic",
 						  pList.count(), pList.tokens(), pList.values());
 			}
-			if(m_params.verbose)
-				std::cout << "hairgen: Hair generation done.\n";
+		}
+
+	private:
+		/// Emit a procedural for the hairs on a range of faces.
+		void emitFaceGroup(int beginFace, int endFace) const
+		{
+			Vec3 min(FLT_MAX, FLT_MAX, FLT_MAX);
+			Vec3 max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			std::vector<Vec3> P;
+			for(int faceNum = beginFace; faceNum < endFace; ++faceNum)
+			{
+				m_emitter->faceVertices(faceNum, P);
+				for(int i = 0, numVerts = P.size(); i < numVerts; ++i)
+				{
+					Vec3 p = m_params.emitterToHairMatrix*P[i];
+					min = Aqsis::min(min, p);
+					max = Aqsis::max(max, p);
+				}
+			}
+			m_parentHairs->childBound(min, max);
+			RtBound bound = {min.x(), max.x(), min.y(), max.y(),
+				min.z(), max.z()};
+			RiProcedural(new HairFaceGroup(shared_from_this(), beginFace,
+						endFace), bound, subdivideFaceGroup, freeFaceGroup);
 		}
 };
 
+static RtVoid subdivideFaceGroup(RtPointer blinddata, RtFloat detailsize)
+{
+	const HairFaceGroup* group = reinterpret_cast<HairFaceGroup*>(blinddata);
+	group->hairs->generate(group->beginFace, group->endFace);
+}
+
+static RtVoid freeFaceGroup(RtPointer blinddata)
+{
+	delete reinterpret_cast<HairFaceGroup*>(blinddata);
+}
+
 
 //------------------------------------------------------------------------------
 // RiProcDynamicLoad plugin interface functions.
 
 extern "C" AQSIS_EXPORT RtPointer ConvertParameters(char* initialdata)
 {
-	HairProcedural* params = 0;
+	boost::shared_ptr<HairProcedural>* params = 0;
 	try
 	{
-		params = new HairProcedural(initialdata);
+		params = new boost::shared_ptr<HairProcedural>(
+				new HairProcedural(initialdata));
 	}
 	catch(std::runtime_error& e)
 	{
@@ -356,14 +465,15 @@ extern "C" AQSIS_EXPORT RtPointer ConvertParameters(char* initialdata)
 
 extern "C" AQSIS_EXPORT void Subdivide(RtPointer blinddata, RtFloat detailsize)
 {
-	const HairProcedural* p = reinterpret_cast<HairProcedural*>(blinddata);
+	const boost::shared_ptr<HairProcedural>* p =
+		reinterpret_cast<boost::shared_ptr<HairProcedural>*>(blinddata);
 
 	if(p)
-		p->subdivide();
+		(*p)->subdivide();
 }
 
 extern "C" AQSIS_EXPORT void Free(RtPointer blinddata)
 {
-	delete reinterpret_cast<HairProcedural*>(blinddata);
+	delete reinterpret_cast<boost::shared_ptr<HairProcedural>*>(blinddata);
 }
 
@@ -30,10 +30,14 @@
 
 #include "parenthairs.h"
 
+#include <cfloat>
 #include <cmath>
 #include <iostream>
 #include <algorithm>
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
 //------------------------------------------------------------------------------
 // HairModifiers implementation
 bool HairModifiers::parseParam(const std::string& name, std::istream& in)
@@ -74,7 +78,12 @@ ParentHairs::ParentHairs(bool linear,
 	m_primVars(primVars),
 	m_storageCounts(),
 	m_baseP(),
-	m_lookupTree()
+	m_lookupTree(),
+	m_offsetMin(),
+	m_offsetMax(),
+	m_parentMin(),
+	m_parentMax(),
+	m_boundPadding(0)
 {
 	if(m_modifiers.rootIndex < 0)
 	{
@@ -105,6 +114,7 @@ ParentHairs::ParentHairs(bool linear,
 	const FloatArray& P = m_primVars->find(Aqsis::CqPrimvarToken(
 				Aqsis::class_vertex, Aqsis::type_point, 1, "P"));
 	initLookup(P, numVerts.size());
+	initBound(P, numVerts.size());
 }
 
 bool ParentHairs::linear() const
@@ -117,7 +127,8 @@ int ParentHairs::vertsPerCurve() const
 	return m_vertsPerCurve;
 }
 
-void ParentHairs::childInterp(PrimVars& childVars) const
+void ParentHairs::childInterp(PrimVars& childVars, SeededRand& rand,
+		int numThreads) const
 {
 	const FloatArray& P_emit = childVars.find("P_emit");
 
@@ -147,26 +158,99 @@ void ParentHairs::childInterp(PrimVars& childVars) const
 		newPrimvars.push_back(&childValues);
 	}
 
-	std::vector<int> closestParent;
+	FloatArray& P_child = childVars.find("P");
+	std::vector<float> clumpWeights;
 	if(m_modifiers.clump != 0)
-		closestParent.resize(numChildren);
+		computeClumpWeights(clumpWeights);
+
+	// Children only write to their own part of the child primvars, so blocks
+	// of children can be interpolated in parallel.  Blocks are kept large
+	// enough to be worth the cost of starting a thread.
+	const int minChildrenPerThread = 256;
+	int numBlocks = std::min(numThreads, numChildren/minChildrenPerThread);
+	if(numBlocks > 1)
+	{
+		boost::thread_group threads;
+		for(int block = 0; block < numBlocks; ++block)
+		{
+			threads.create_thread(boost::bind(&ParentHairs::interpChildren,
+					this, block*numChildren/numBlocks,
+					(block+1)*numChildren/numBlocks, &P_emit, &P_child,
+					&newPrimvars, &clumpWeights));
+		}
+		threads.join_all();
+	}
+	else
+	{
+		interpChildren(0, numChildren, &P_emit, &P_child, &newPrimvars,
+				&clumpWeights);
+	}
+
+	if(m_modifiers.endRough)
+	{
+		// Add random vectors to help with end rough.
+		childVars.append(Aqsis::CqPrimvarToken(Aqsis::class_uniform,
+					Aqsis::type_vector, 1, "endRoughRand"));
+		FloatArray& rand1 = *childVars.back().value;
+		rand1.reserve(3*numChildren);
+		for(int curveNum = 0; curveNum < numChildren; ++curveNum)
+		{
+			rand1.push_back(2*rand()-1);
+			rand1.push_back(2*rand()-1);
+			rand1.push_back(2*rand()-1);
+		}
+	}
+}
+
+void ParentHairs::childBound(Vec3& min, Vec3& max) const
+{
+	// Child vertices are offset from the child root by a convex combination
+	// of the parent offsets, and then clumping blends them toward a parent.
+	min += m_offsetMin;
+	max += m_offsetMax;
+	if(m_modifiers.clump != 0)
+	{
+		min = Aqsis::min(min, m_parentMin);
+		max = Aqsis::max(max, m_parentMax);
+	}
+	Vec3 padding(m_boundPadding, m_boundPadding, m_boundPadding);
+	min -= padding;
+	max += padding;
+}
+
+/** Interpolate a contiguous block of child hairs.
+ *
+ * This does the interpolation proper, the correction which puts the child
+ * roots at their positions on the emitter, and clumping.
+ *
+ * \param begin, end - range of children to interpolate.
+ * \param P_emit - child root positions.
+ * \param P_child - interpolated child positions.
+ * \param childValues - storage for the interpolated child primvars, in the
+ *                      same order as the parent primvars.
+ * \param clumpWeights - weights computed by computeClumpWeights().
+ */
+void ParentHairs::interpChildren(int begin, int end, const FloatArray* P_emit,
+		FloatArray* P_child, const std::vector<FloatArray*>* childValues,
+		const std::vector<float>* clumpWeights) const
+{
+	const FloatArray& P_parent = m_primVars->find("P");
 	// loop over all child curves
-	for(int curveNum = 0; curveNum < numChildren; ++curveNum)
+	for(int curveNum = begin; curveNum < end; ++curveNum)
 	{
 		// Get weights and indices of parent hairs for current child.
 		int parentIdx[m_parentsPerChild];
 		float weights[m_parentsPerChild];
-		Vec3 currP(&P_emit[3*curveNum]);
+		Vec3 currP(&(*P_emit)[3*curveNum]);
 		getParents(currP, parentIdx, weights);
-		if(m_modifiers.clump != 0)
-			closestParent[curveNum] = parentIdx[0];
 
-		// loop over all primvars of parent curves
+		// loop over all primvars of parent curves.  The weighted sum is
+		// accumulated one parent at a time so that the inner loops run along
+		// contiguous memory.
 		int storageIndex = 0;
-		PrimVarValueVec::iterator destVar = newPrimvars.begin();
 		for(PrimVars::const_iterator srcVar = m_primVars->begin(),
-				end = m_primVars->end(); srcVar != end;
-				++srcVar, ++storageIndex, ++destVar)
+				varEnd = m_primVars->end(); srcVar != varEnd;
+				++srcVar, ++storageIndex)
 		{
 			switch(srcVar->token.Class())
 			{
@@ -179,99 +263,67 @@ void ParentHairs::childInterp(PrimVars& childVars) const
 			}
 
 			int storageStride = m_storageCounts[storageIndex];
-
-			// interpolate vertex class values
-			const float* src[m_parentsPerChild];
-			for(int i = 0; i < m_parentsPerChild; ++i)
-				src[i] = &(*srcVar->value)[storageStride*parentIdx[i]];
-
-			float* dest = &(**destVar)[storageStride*curveNum];
-			for(int k = 0; k < storageStride; ++k, ++dest)
+			float* dest = &(*(*childValues)[storageIndex])[storageStride*curveNum];
+			const float* src = &(*srcVar->value)[storageStride*parentIdx[0]];
+			float w = weights[0];
+			for(int k = 0; k < storageStride; ++k)
+				dest[k] = w*src[k];
+			for(int i = 1; i < m_parentsPerChild; ++i)
 			{
-				*dest = 0;
-				for(int i = 0; i < m_parentsPerChild; ++i)
-				{
-					*dest += *src[i] * weights[i];
-					++src[i];
-				}
+				src = &(*srcVar->value)[storageStride*parentIdx[i]];
+				w = weights[i];
+				for(int k = 0; k < storageStride; ++k)
+					dest[k] += w*src[k];
 			}
 		}
-	}
 
-	FloatArray& P_child = childVars.find("P");
-	// Apply corrections to interpolation scheme for variables of class
-	// "point".  This is necessary since the desired base point of the hair
-	// (stored in P_emit) isn't stationary under the interpolation scheme.
-	int storageIndex = 0;
-	PrimVarValueVec::iterator destVar = newPrimvars.begin();
-	for(PrimVars::const_iterator srcVar = m_primVars->begin(),
-			end = m_primVars->end(); srcVar != end;
-			++srcVar, ++storageIndex, ++destVar)
-	{
-		switch(srcVar->token.Class())
+		// Apply corrections to interpolation scheme for variables of class
+		// "point".  This is necessary since the desired base point of the
+		// hair (stored in P_emit) isn't stationary under the interpolation
+		// scheme.
+		storageIndex = 0;
+		for(PrimVars::const_iterator srcVar = m_primVars->begin(),
+				varEnd = m_primVars->end(); srcVar != varEnd;
+				++srcVar, ++storageIndex)
 		{
-			default:
+			switch(srcVar->token.Class())
+			{
+				default:
+					continue;
+				case Aqsis::class_uniform:
+				case Aqsis::class_varying:
+				case Aqsis::class_vertex:
+					break;
+			}
+			if(srcVar->token.type() != Aqsis::type_point)
 				continue;
-			case Aqsis::class_uniform:
-			case Aqsis::class_varying:
-			case Aqsis::class_vertex:
-				break;
-		}
-		if(srcVar->token.type() != Aqsis::type_point)
-			continue;
-		// If we get here, we have a point class primvar which has been
-		// interpolated from parent hairs, and we need to apply the correction
-		// term to it.
-		int storageStride = m_storageCounts[storageIndex];
-		FloatArray& value = **destVar;
-		for(int curveNum = 0; curveNum < numChildren; ++curveNum)
-		{
-			Vec3 deltaP = Vec3(&P_emit[3*curveNum])
-				- Vec3(&P_child[storageStride*curveNum+3*m_modifiers.rootIndex]);
-			for(int k = curveNum*storageStride, kEnd = (curveNum+1)*storageStride;
-					k < kEnd; k += 3)
+			int storageStride = m_storageCounts[storageIndex];
+			Vec3 deltaP = currP - Vec3(&(*P_child)[
+					3*(m_vertsPerCurve*curveNum + m_modifiers.rootIndex)]);
+			float* value = &(*(*childValues)[storageIndex])[storageStride*curveNum];
+			for(int k = 0; k < storageStride; k += 3)
 			{
 				value[k] += deltaP.x();
 				value[k+1] += deltaP.y();
 				value[k+2] += deltaP.z();
 			}
 		}
-	}
 
-	if(m_modifiers.clump != 0)
-	{
-		// Apply clumping to P after correction factor.
-		const FloatArray& P_parent = m_primVars->find("P");
-		std::vector<float> weights;
-		computeClumpWeights(weights);
-		for(int curveNum = 0; curveNum < numChildren; ++curveNum)
+		if(m_modifiers.clump != 0)
 		{
-			const float* parentP = &P_parent[3*m_vertsPerCurve*closestParent[curveNum]];
-			float* childP = &P_child[3*m_vertsPerCurve*curveNum];
+			// Apply clumping to P after correction factor.
+			const std::vector<float>& cw = *clumpWeights;
+			const float* parentP = &P_parent[3*m_vertsPerCurve*parentIdx[0]];
+			float* childP = &(*P_child)[3*m_vertsPerCurve*curveNum];
 			for(int k = 0; k < m_vertsPerCurve; ++k)
 			{
 				int i = 3*k;
-				childP[i] = (1-weights[k])*childP[i] + weights[k]*parentP[i];
-				childP[i+1] = (1-weights[k])*childP[i+1] + weights[k]*parentP[i+1];
-				childP[i+2] = (1-weights[k])*childP[i+2] + weights[k]*parentP[i+2];
+				childP[i] = (1-cw[k])*childP[i] + cw[k]*parentP[i];
+				childP[i+1] = (1-cw[k])*childP[i+1] + cw[k]*parentP[i+1];
+				childP[i+2] = (1-cw[k])*childP[i+2] + cw[k]*parentP[i+2];
 			}
 		}
 	}
-
-	if(m_modifiers.endRough)
-	{
-		// Add random vectors to help with end rough.
-		childVars.append(Aqsis::CqPrimvarToken(Aqsis::class_uniform,
-					Aqsis::type_vector, 1, "endRoughRand"));
-		FloatArray& rand1 = *childVars.back().value;
-		rand1.reserve(3*numChildren);
-		for(int curveNum = 0; curveNum < numChildren; ++curveNum)
-		{
-			rand1.push_back(2*uRand()-1);
-			rand1.push_back(2*uRand()-1);
-			rand1.push_back(2*uRand()-1);
-		}
-	}
 }
 
 /** Compute weights to use in hair clumping
@@ -409,3 +461,44 @@ void ParentHairs::initLookup(const FloatArray& P, int numParents)
 	}
 	m_lookupTree.reset(new kdtree::kdtree2(m_baseP, false));
 }
+
+/** Initialize the bounds used by childBound().
+ *
+ * \param P - Positions array for parent curves.
+ * \param numParents - total number of parent particles.
+ */
+void ParentHairs::initBound(const FloatArray& P, int numParents)
+{
+	m_offsetMin = m_parentMin = Vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	m_offsetMax = m_parentMax = Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	float maxSegment = 0;
+	for(int i = 0; i < numParents; ++i)
+	{
+		const float* curveP = &P[3*m_vertsPerCurve*i];
+		Vec3 root(curveP + 3*m_modifiers.rootIndex);
+		for(int k = 0; k < m_vertsPerCurve; ++k)
+		{
+			Vec3 p(curveP + 3*k);
+			m_offsetMin = Aqsis::min(m_offsetMin, p - root);
+			m_offsetMax = Aqsis::max(m_offsetMax, p - root);
+			m_parentMin = Aqsis::min(m_parentMin, p);
+			m_parentMax = Aqsis::max(m_parentMax, p);
+			if(k > 0)
+				maxSegment = std::max(maxSegment, (p - Vec3(curveP + 3*(k-1))).Magnitude());
+		}
+	}
+	// Children get a convex combination of the parent widths; curves without
+	// any width have the RenderMan default width of 1.
+	float maxWidth = 1;
+	const FloatArray* width = m_primVars->findPtr("width");
+	if(!width)
+		width = m_primVars->findPtr("constantwidth");
+	if(width && !width->empty())
+		maxWidth = *std::max_element(width->begin(), width->end());
+	m_boundPadding = maxWidth/2;
+	// Cubic curves don't necessarily stay inside the hull of their control
+	// points.  For the usual bases (bezier, b-spline, catmull-rom) they don't
+	// stray further than the length of a segment.
+	if(!m_linear)
+		m_boundPadding += maxSegment;
+}
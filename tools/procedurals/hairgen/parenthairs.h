@@ -125,10 +125,23 @@ class ParentHairs
 		/** Create a set of interpolated child primvars based on the parent
 		 * hair primvars.
 		 *
+		 * Each child is interpolated independently, so the children are
+		 * split into contiguous blocks which are interpolated in parallel.
+		 *
 		 * \param childVars - A set of primvars containing at least the child
 		 *                    particle positions from the emitting mesh, P_emit.
+		 * \param rand - random number generator for the emitter face.
+		 * \param numThreads - maximum number of threads to interpolate with.
+		 */
+		void childInterp(PrimVars& childVars, SeededRand& rand,
+				int numThreads = 1) const;
+
+		/** Expand a box containing the roots of a set of child hairs so that
+		 * it bounds the whole of the child hairs, including their width.
+		 *
+		 * \param min, max - corners of the box (input and output).
 		 */
-		void childInterp(PrimVars& childVars) const;
+		void childBound(Vec3& min, Vec3& max) const;
 
 		/// Return the curve type flag (true==linear, false==cubic)
 		bool linear() const;
@@ -140,6 +153,10 @@ class ParentHairs
 		//--------------------------------------------------
 		void computeClumpWeights(std::vector<float>& clumpWeights) const;
 
+		void interpChildren(int begin, int end, const FloatArray* P_emit,
+				FloatArray* P_child, const std::vector<FloatArray*>* childValues,
+				const std::vector<float>* clumpWeights) const;
+
 		void getParents(const Vec3& pos, int ind[m_parentsPerChild],
 				float weights[m_parentsPerChild]) const;
 
@@ -148,6 +165,8 @@ class ParentHairs
 
 		void initLookup(const FloatArray& P, int numParents);
 
+		void initBound(const FloatArray& P, int numParents);
+
 		//--------------------------------------------------
 		/// flag for linear/cubic hairs
 		bool m_linear;
@@ -163,6 +182,14 @@ class ParentHairs
 		kdtree::kdtree2_array m_baseP;
 		/// search tree
 		boost::scoped_ptr<kdtree::kdtree2> m_lookupTree;
+		/// bound on the offsets of parent hair vertices from their roots.
+		Vec3 m_offsetMin;
+		Vec3 m_offsetMax;
+		/// bound on the parent hairs, which children may be clumped toward.
+		Vec3 m_parentMin;
+		Vec3 m_parentMax;
+		/// padding for the hair width and for curves leaving their hull.
+		float m_boundPadding;
 };
 
 #endif // PARENTHAIRS_H_INCLUDED
@@ -156,6 +156,8 @@ class ParamList
 			m_tokens(),
 			m_values()
 		{
+			// Reserve up front, since m_tokens points into m_tokenStorage.
+			m_tokenStorage.reserve(primVars.size());
 			for(PrimVars::const_iterator i = primVars.begin(); i != primVars.end(); ++i)
 			{
 				std::ostringstream out;
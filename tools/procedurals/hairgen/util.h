@@ -34,6 +34,8 @@
 #include <cstdlib>
 #include <iosfwd>
 
+#include <boost/cstdint.hpp>
+
 #include <aqsis/math/vector3d.h>
 #include <aqsis/riutil/ricxx.h>
 
@@ -48,6 +50,39 @@ inline float uRand()
 	return float(std::rand())/RAND_MAX;
 }
 
+/** Small random number generator with explicit state.
+ *
+ * Hairs are generated lazily, face by face, in whatever order the renderer
+ * needs them.  Random numbers which determine the hairs on a face come from
+ * one of these seeded with the face number rather than from uRand(), so that
+ * the hairs don't depend on the order of generation.
+ */
+class SeededRand
+{
+	public:
+		SeededRand(boost::uint32_t seed)
+			: m_state(seed*2654435761U + 1)
+		{
+			next();
+			next();
+		}
+
+		/// Uniform random numbers on [0,1).
+		float operator()()
+		{
+			return (next() >> 8) * (1.0f/16777216);
+		}
+
+	private:
+		boost::uint32_t next()
+		{
+			m_state = 1664525U*m_state + 1013904223U;
+			return m_state;
+		}
+
+		boost::uint32_t m_state;
+};
+
 /// Error stream.
 extern std::ostream& g_errStream;
 
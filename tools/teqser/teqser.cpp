@@ -60,6 +60,8 @@ ArgParse::apfloat g_width = -1.0;
 ArgParse::apstring g_compress = "none";
 ArgParse::apfloat g_quality = 70.0;
 ArgParse::apfloat g_bake = 128.0;
+ArgParse::apint g_threads = 0;
+ArgParse::apint g_memorylimit = 0;
 
 
 void version( std::ostream& Stream )
@@ -104,6 +106,8 @@ int main( int argc, const char** argv )
 	ap.alias( "width", "filterwidth" );
 	ap.argFloat( "quality", "=float\a[>=1.0f && <= 100.0f] (default: %default)", &g_quality );
 	ap.argFloat( "bake", "=float\a[>=2.0f && <= 2048.0f] (default: %default)", &g_bake );
+	ap.argInt( "threads", "=integer\anumber of threads used for filtering, 0 for one per processor (default: %default)", &g_threads );
+	ap.argInt( "memorylimit", "=integer\aapproximate memory limit in megabytes while filtering, 0 for no limit (default: %default)", &g_memorylimit );
 	ap.argString( "resize", "=string\a[up|down|round|up-|down-|round-] (default: %default)\n\aNot used, for BMRT compatibility only!", &g_resize );
 
 
@@ -221,6 +225,8 @@ int main( int argc, const char** argv )
 
 	char *compression = ( char * ) g_compress.c_str();
 	float quality = ( float ) g_quality;
+	int threads = g_threads;
+	int memorylimit = g_memorylimit;
 
 
 	std::auto_ptr<std::streambuf> show_level( new Aqsis::show_level_buf(Aqsis::log()) );
@@ -274,6 +280,10 @@ int main( int argc, const char** argv )
 		    &compression,
 		    "quality",
 		    &quality,
+		    "int threads",
+		    &threads,
+		    "int memorylimit",
+		    &memorylimit,
 		    RI_NULL );
 	}
 	else if ( g_shadow )
@@ -295,7 +305,8 @@ int main( int argc, const char** argv )
 		        ( char* ) g_compress.c_str() );
 
 		RiMakeLatLongEnvironment( ( char* ) ap.leftovers() [ 0 ].c_str(), ( char* ) ap.leftovers() [ 1 ].c_str(), filterfunc,
-		                          ( float ) g_swidth, ( float ) g_twidth, "compression", &compression, "quality", &quality, RI_NULL );
+		                          ( float ) g_swidth, ( float ) g_twidth, "compression", &compression, "quality", &quality,
+		                          "int threads", &threads, "int memorylimit", &memorylimit, RI_NULL );
 	}
 	else
 	{
@@ -314,7 +325,8 @@ int main( int argc, const char** argv )
 
 		RiMakeTexture( ( char* ) ap.leftovers() [ 0 ].c_str(), ( char* ) ap.leftovers() [ 1 ].c_str(),
 		               ( char* ) g_swrap.c_str(), ( char* ) g_twrap.c_str(), filterfunc,
-		               ( float ) g_swidth, ( float ) g_twidth, "compression", &compression, "quality", &quality, "float bake", &bake, RI_NULL );
+		               ( float ) g_swidth, ( float ) g_twidth, "compression", &compression, "quality", &quality, "float bake", &bake,
+		               "int threads", &threads, "int memorylimit", &memorylimit, RI_NULL );
 	}
 
 	RiEnd();